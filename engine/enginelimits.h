@@ -38,7 +38,11 @@ enum {
 	EL_NIGHT_RED_U8			= 131,
 	EL_NIGHT_GREEN_U8		= 125,
 	EL_NIGHT_BLUE_U8		= 255,
-	EL_MAP_SIZE				= 64,		// maximum size.
+	// The maps are sized at compile time: every per-tile array, BitArray and map texture
+	// is SIZE*SIZE, whatever the size of the map in use, so this is 6 and stays 6. (The
+	// map is also drawn with U16 indices into one vertex grid.)
+	EL_MAP_LOG2_SIZE		= 6,
+	EL_MAP_SIZE				= 1<<EL_MAP_LOG2_SIZE,	// maximum size.
 	EL_MAP_MAX_PATH			= 12,		// longest path anything can travel in one turn. Used to limit display memory.
 	EL_MAP_TEXTURE_SIZE		= 512
 };
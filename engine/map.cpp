@@ -75,10 +75,10 @@ const ModelResource* MapItemDef::GetDestroyedResource() const
 Map::Map( SpaceTree* tree )
 	: itemPool( "mapItemPool", sizeof( MapItem ), sizeof( MapItem ) * 200, false )
 {
-	memset( pyro, 0, SIZE*SIZE*sizeof(U8) );
-	memset( obscured, 0, SIZE*SIZE*sizeof(U8) );
-	memset( visMap, 0, SIZE*SIZE );
-	memset( pathMap, 0, SIZE*SIZE );
+	changeDepth = 0;
+	bulkDepth = 0;
+	memset( openers, 0, SIZE*SIZE );
+	pathInvalidated = 0;
 	dayTime = true;
 	pathBlocker = 0;
 	nImageData = 0;
@@ -102,6 +102,7 @@ Map::Map( SpaceTree* tree )
 		walkingMap[1].Init( &overlay[LAYER_OVER] );
 	}
 	lightMapValid = false;
+	lightFogMapValid = false;
 
 	TextureManager* texman = TextureManager::Instance();
 	backgroundTexture = texman->CreateTexture( "MapBackground", EL_MAP_TEXTURE_SIZE, EL_MAP_TEXTURE_SIZE, Surface::RGB16, Texture::PARAM_NONE, this );
@@ -109,17 +110,13 @@ Map::Map( SpaceTree* tree )
 
 	backgroundSurface.Set( Surface::RGB16, EL_MAP_TEXTURE_SIZE, EL_MAP_TEXTURE_SIZE );
 	backgroundSurface.Clear( 0 );
-	greySurface.Set( Surface::RGB16, EL_MAP_TEXTURE_SIZE/2, EL_MAP_TEXTURE_SIZE/2 );
-	greySurface.Clear( 0 );
+	backgroundValid = false;
 
 	nSeenIndex = nUnseenIndex = nPastSeenIndex = 0;
-	static const float INV64 = 1.0f / 64.0f;
-
-	for( int j=0; j<SIZE+1; ++j ) {
-		for( int i=0; i<SIZE+1; ++i ) {
-			mapVertex[j*(SIZE+1)+i].Set( (float)i*INV64, (float)(SIZE-j)*INV64 );
-		}
-	}
+	mapVertex = 0;
+	mapIndex = 0;
+	renderArena = 0;
+	renderArenaSize = 0;
 
 	pathQueryID = 1;
 	visibilityQueryID = 1;
@@ -135,7 +132,7 @@ Map::Map( SpaceTree* tree )
 	lightMapTex = texman->CreateTexture( "MapLightMap", SIZE, SIZE, Surface::RGB16, Texture::PARAM_NONE, this );
 	lightFogMapTex = texman->CreateTexture( "MapLightFogMap", SIZE, SIZE, Surface::RGB16, Texture::PARAM_NONE, this );
 
-	GLOUTPUT(( "Map created. %dK\n", sizeof( *this )/1024 ));
+	GLOUTPUT(( "Map created. %dK\n", (int)sizeof( *this )/1024 ));
 }
 
 
@@ -147,6 +144,8 @@ Map::~Map()
 	texman->DeleteTexture( lightMapTex );
 	texman->DeleteTexture( lightFogMapTex );
 
+	delete [] renderArena;
+
 	Rectangle2I b( 0, 0, SIZE-1, SIZE-1 );
 	MapItem* pItem = quadTree.FindItems( b, 0, 0 );
 
@@ -165,21 +164,82 @@ Map::~Map()
 
 void Map::SetSize( int w, int h )					
 {
-	width = w; 
-	height = h; 
+	GLRELASSERT( w > 0 && w <= SIZE && h > 0 && h <= SIZE );
+	if ( w != width || h != height ) {
+		width = w; 
+		height = h; 
+		// The render memory is sized to the new map by GenerateSeenUnseen().
+		mapVertex = 0;
+		mapIndex = 0;
+		nSeenIndex = nUnseenIndex = nPastSeenIndex = 0;
+		lightFogMapValid = false;
+	}
+}
+
+
+int Map::RenderArenaSize() const
+{
+	return (width+1)*(height+1)*sizeof(Vector2F) + width*height*6*sizeof(U16);
+}
+
+
+void Map::AllocRenderArena()
+{
+	int size = RenderArenaSize();
+	if ( size != renderArenaSize ) {
+		delete [] renderArena;
+		renderArena = new U8[size];
+		renderArenaSize = size;
+	}
+
+	// The vertices, then the indices, so everything is aligned.
+	mapVertex = (Vector2F*) renderArena;
+	mapIndex = (U16*)( mapVertex + (width+1)*(height+1) );
+	GLASSERT( (U8*)( mapIndex + width*height*6 ) == renderArena + renderArenaSize );
+
+	const float INV_SIZE = 1.0f / (float)SIZE;
+	for( int j=0; j<=height; ++j ) {
+		for( int i=0; i<=width; ++i ) {
+			mapVertex[j*(width+1)+i].Set( (float)i*INV_SIZE, (float)(SIZE-j)*INV_SIZE );
+		}
+	}
+}
+
+
+void Map::MemoryReport() const
+{
+	int tileMem = sizeof( tiles );
+	int fog = sizeof( fogOfWar ) + sizeof( cachedFogOfWar ) + sizeof( pastSeenFOW ) + sizeof( pathBlock ) + sizeof( pyroListed );
+	int surfaces = 0;
+	const Surface* s[] = { &backgroundSurface, &dayMap, &nightMap, &lightFogMap };
+	for( int i=0; i<4; ++i ) {
+		surfaces += s[i]->Width() * s[i]->Height() * s[i]->BytesPerPixel();
+	}
+	int lists =   quadTree.MemoryUsed()
+				+ pyroActive.Capacity()*sizeof(int) + pyroWork.Capacity()*sizeof(int)
+				+ doorArr.Capacity()*sizeof(MapItem*);
+
+	GLOUTPUT(( "Map memory %dx%d: object=%dK (tiles=%dK fog=%dK) surfaces=%dK render=%dK items=%dK lists=%dK\n",
+			   width, height,
+			   (int)sizeof( *this )/1024, tileMem/1024, fog/1024,
+			   surfaces/1024,
+			   RenderArenaSize()/1024,
+			   (int)itemPool.MemoryAllocated()/1024,
+			   lists/1024 ));
 }
 
 
 void Map::DrawSeen()
 {
 	GenerateLightMap();
+	UploadBackground();
 	if ( nSeenIndex == 0 )
 		return;
 
 	CompositingShader shader;
 
 	GPUStream stream;
-	stream.stride = sizeof( mapVertex[0] );
+	stream.stride = sizeof( Vector2F );
 	stream.nPos = 2;
 	stream.posOffset = 0;
 	stream.nTexture0 = 2;
@@ -187,19 +247,19 @@ void Map::DrawSeen()
 	stream.nTexture1 = 2;
 	stream.texture1Offset = 0;
 
-	shader.SetStream( stream, mapVertex, nSeenIndex, seenIndex );
 	shader.SetTexture0( backgroundTexture );
 	shader.SetTexture1( lightMapTex );
 
 	// the vertices are storred in texture coordinates, to use less space.
 
 	Matrix4 swizzle;
-	swizzle.m11 = 64.0f;
+	swizzle.m11 = (float)SIZE;
 	swizzle.m22 = 0.0f;
-	swizzle.m32 = -64.0f;	swizzle.m33 = 0.0f;		swizzle.m34 = 64.0f;
+	swizzle.m32 = -(float)SIZE;	swizzle.m33 = 0.0f;		swizzle.m34 = (float)SIZE;
 
 	shader.PushMatrix( GPUShader::MODELVIEW_MATRIX );
 	shader.MultMatrix( GPUShader::MODELVIEW_MATRIX, swizzle );
+	shader.SetStream( stream, mapVertex, nSeenIndex, SeenIndex() );
 	shader.Draw();
 	shader.PopMatrix( GPUShader::MODELVIEW_MATRIX );
 }
@@ -213,20 +273,20 @@ void Map::DrawUnseen()
 
 	CompositingShader shader;
 	GPUStream stream;
-	stream.stride = sizeof(mapVertex[0]);
+	stream.stride = sizeof( Vector2F );
 	stream.nPos = 2;
 	stream.posOffset = 0;
-	shader.SetStream( stream, mapVertex, nUnseenIndex, unseenIndex );
 
 	shader.SetColor( 0, 0, 0 );
 
 	Matrix4 swizzle;
-	swizzle.m11 = 64.0f;
+	swizzle.m11 = (float)SIZE;
 	swizzle.m22 = 0.0f;
-	swizzle.m32 = -64.0f;	swizzle.m33 = 0.0f;		swizzle.m34 = 64.0f;
+	swizzle.m32 = -(float)SIZE;	swizzle.m33 = 0.0f;		swizzle.m34 = (float)SIZE;
 
 	shader.PushMatrix( GPUShader::MODELVIEW_MATRIX );
 	shader.MultMatrix( GPUShader::MODELVIEW_MATRIX, swizzle );
+	shader.SetStream( stream, mapVertex, nUnseenIndex, UnseenIndex() );
 	shader.Draw();
 	shader.PopMatrix( GPUShader::MODELVIEW_MATRIX );
 }
@@ -235,29 +295,30 @@ void Map::DrawUnseen()
 void Map::DrawPastSeen( const Color4F& color )
 {
 	GenerateLightMap();
+	UploadBackground();
 	if ( nPastSeenIndex == 0 )
 		return;
 
 	CompositingShader shader;
 	GPUStream stream;
-	stream.stride = sizeof(mapVertex[0]);
+	stream.stride = sizeof( Vector2F );
 	stream.nPos = 2;
 	stream.posOffset = 0;
 	stream.nTexture0 = 2;
 	stream.texture0Offset = 0;
-	shader.SetStream( stream, mapVertex, nPastSeenIndex, pastSeenIndex );
 	shader.SetTexture0( greyTexture );
 
 	shader.SetColor( color );
 
 	// the vertices are stored in texture coordinates, to use less space.
 	Matrix4 swizzle;
-	swizzle.m11 = 64.0f;
+	swizzle.m11 = (float)SIZE;
 	swizzle.m22 = 0.0f;
-	swizzle.m32 = -64.0f;	swizzle.m33 = 0.0f;		swizzle.m34 = 64.0f;
+	swizzle.m32 = -(float)SIZE;	swizzle.m33 = 0.0f;		swizzle.m34 = (float)SIZE;
 
 	shader.PushMatrix( GPUShader::MODELVIEW_MATRIX );
 	shader.MultMatrix( GPUShader::MODELVIEW_MATRIX, swizzle );
+	shader.SetStream( stream, mapVertex, nPastSeenIndex, PastSeenIndex() );
 	shader.Draw();
 	shader.PopMatrix( GPUShader::MODELVIEW_MATRIX );
 }
@@ -321,11 +382,17 @@ void Map::SetTexture( const Surface* s, int x, int y, int tileRotation )
 		
 		backgroundSurface.BlitImg( target, s, inv );
 	}
+	// Uploaded when drawn, so a map loaded from many images uploads once.
+	backgroundValid = false;
+}
 
-	Rectangle2I greyTarget;
-	greyTarget.Set( target.min.x/2, target.min.y/2, target.max.x/2, target.max.y/2 );
-	for( int j=greyTarget.min.y; j<=greyTarget.max.y; ++j ) {
-		for( int i=greyTarget.min.x; i<=greyTarget.max.x; ++i ) {
+
+void Map::CalcGreySurface( Surface* greySurface )
+{
+	greySurface->Set( Surface::RGB16, backgroundSurface.Width()/2, backgroundSurface.Height()/2 );
+
+	for( int j=0; j<greySurface->Height(); ++j ) {
+		for( int i=0; i<greySurface->Width(); ++i ) {
 			Color4U8 rgba0 = Surface::CalcRGB16( backgroundSurface.GetImg16( i*2+0, j*2+0 ) );
 			Color4U8 rgba1 = Surface::CalcRGB16( backgroundSurface.GetImg16( i*2+1, j*2+0 ) );
 			Color4U8 rgba2 = Surface::CalcRGB16( backgroundSurface.GetImg16( i*2+0, j*2+1 ) );
@@ -339,13 +406,23 @@ void Map::SetTexture( const Surface* s, int x, int y, int tileRotation )
 			GLRELASSERT( c >= 0 && c <= 255 );
 			Color4U8 grey = { (U8)c, (U8)c, (U8)c, 255 };
 
-			greySurface.SetImg16( i, j, Surface::CalcRGB16( grey ) );
+			greySurface->SetImg16( i, j, Surface::CalcRGB16( grey ) );
 		}
 	}
+}
 
 
-	backgroundTexture->Upload( backgroundSurface );
-	greyTexture->Upload( greySurface );
+void Map::UploadBackground()
+{
+	if ( !backgroundValid ) {
+		// The grey version is only needed for the upload.
+		Surface greySurface;
+		CalcGreySurface( &greySurface );
+
+		backgroundTexture->Upload( backgroundSurface );
+		greyTexture->Upload( greySurface );
+		backgroundValid = true;
+	}
 }
 
 
@@ -360,6 +437,7 @@ void Map::SetLightMap0( int x, int y, float r, float g, float b )
 		nightMap.SetImg16( x, y, Surface::CalcRGB16( rgba ) );
 
 	lightMapValid = false;
+	lightFogMapValid = false;
 }
 
 
@@ -395,6 +473,7 @@ void Map::SetLightMaps( const Surface* day, const Surface* night, int x, int y,
 		nightMap.BlitImg( target, night, inv );
 	}
 	lightMapValid = false;
+	lightFogMapValid = false;
 }
 
 
@@ -404,6 +483,7 @@ void Map::SetDayTime( bool day )
 		dayTime = day;
 		lightMap = dayTime ? &dayMap : &nightMap;
 		lightMapValid = false;
+		lightFogMapValid = false;
 	}
 }
 
@@ -439,101 +519,138 @@ void Map::GenerateSeenUnseen()
 	// Go to strip creation: 5.9 k/f (and that's total - the code below should get the submit down to 400-500 tris possibly?)
 
 	// Ran at about 4% with out this check. Peaks at 0.5% with. Works surprisingly well.
-	if ( fogOfWar == cachedFogOfWar )
+	if ( fogOfWar == cachedFogOfWar && lightFogMapValid )
 		return;
 
-	cachedFogOfWar = fogOfWar;
+	typedef BitArray<Map::SIZE, Map::SIZE, 1> FogArray;
+	const int WIDTH32 = FogArray::WIDTH32;
+	const U32* fogMem = fogOfWar.Plane( 0 );
+	const U32* cachedMem = cachedFogOfWar.Plane( 0 );
+	const U32* pastMem = pastSeenFOW.Plane( 0 );
 
-#define PUSHQUAD( _arr, _index, _x0, _x1, _y )		\
-		_arr[ _index++ ] = (_y+0)*(SIZE+1)+(_x0);	\
-		_arr[ _index++ ] = (_y+1)*(SIZE+1)+(_x0);	\
-		_arr[ _index++ ] = (_y+1)*(SIZE+1)+(_x1);	\
-		_arr[ _index++ ] = (_y+0)*(SIZE+1)+(_x0);	\
-		_arr[ _index++ ] = (_y+1)*(SIZE+1)+(_x1);	\
-		_arr[ _index++ ] = (_y+0)*(SIZE+1)+(_x1);	
+	// A changed row of fog changes the light fog of the row and its neighbors.
+	bool rowDirty[SIZE];
+	for( int j=0; j<SIZE; ++j ) {
+		rowDirty[j] = !lightFogMapValid;
+	}
+	if ( lightFogMapValid ) {
+		for( int j=0; j<height; ++j ) {
+			if ( memcmp( fogMem + j*WIDTH32, cachedMem + j*WIDTH32, WIDTH32*sizeof(U32) ) ) {
+				if ( j > 0 ) rowDirty[j-1] = true;
+				rowDirty[j] = true;
+				if ( j < SIZE-1 ) rowDirty[j+1] = true;
+			}
+		}
+	}
 
-	int countArr[3] = { 0, 0, 0 };
-	nSeenIndex = nUnseenIndex = nPastSeenIndex = 0;
+	cachedFogOfWar = fogOfWar;
 
-	for( int j=0; j<height; ++j ) {
-		for( int i=0; i<width; i += 32 ) {
+	// Quads in the vertex grid of the map in use.
+#define PUSHQUAD( _arr, _index, _stride, _x0, _x1, _y )	\
+		_arr[ _index++ ] = (_y+0)*(_stride)+(_x0);	\
+		_arr[ _index++ ] = (_y+1)*(_stride)+(_x0);	\
+		_arr[ _index++ ] = (_y+1)*(_stride)+(_x1);	\
+		_arr[ _index++ ] = (_y+0)*(_stride)+(_x0);	\
+		_arr[ _index++ ] = (_y+1)*(_stride)+(_x1);	\
+		_arr[ _index++ ] = (_y+0)*(_stride)+(_x1);	
 
-			U32 fog = fogOfWar.Access32( i, j, 0 );
-			U32 past = pastSeenFOW.Access32( i, j, 0 );
+	if ( !mapVertex ) {
+		AllocRenderArena();
+	}
+	const int stride = width + 1;
+	int count = 0;
+	int countArr[3] = { 0, 0, 0 };
 
-			past = past ^ fog;				// if the fog is set, then we don't draw the past.
-			U32 unseen = ~( fog | past );	// everything else unseen.
+	// The lists are written one after another into the index memory.
+	for ( int k=0; k<3; ++k ) {
+		int listStart = count;
+		for( int j=0; j<height; ++j ) {
+			for( int i=0; i<width; i += 32 ) {
 
-			if ( i+32 > width ) {
-				// mask off the end bits.
-				U32 mask = (1<<(width-i))-1;
+				U32 fog = fogMem[ j*WIDTH32 + (i>>5) ];
+				U32 past = pastMem[ j*WIDTH32 + (i>>5) ];
 
-				fog &= mask;
-				past &= mask;
-				unseen &= mask;
-			}
+				past = past ^ fog;				// if the fog is set, then we don't draw the past.
+				U32 unseen = ~( fog | past );	// everything else unseen.
 
-			const U32 arr[3] = { fog, past, unseen };
-			U16* indexArr[3] = { seenIndex, pastSeenIndex, unseenIndex };
+				U32 bits = ( k == 0 ) ? fog : ( ( k == 1 ) ? past : unseen );
+				if ( i+32 > width ) {
+					// mask off the end bits.
+					bits &= (1U<<(width-i))-1;
+				}
 
-			for ( int k=0; k<3; ++k ) {
+				// Pull the runs of set bits out a word at a time: the start is the
+				// lowest set bit, the end is the lowest clear bit above it.
+				while( bits ) {
+					int start = CountTrailingZeros( bits );
+					U32 above = ~( bits >> start );
+					int end = above ? start + CountTrailingZeros( above ) : 32;
 
-				int start=0;
-				while( start < 32 ) {
-					int end = start+1;
+					PUSHQUAD( mapIndex, count, stride, i+start, i+end, j );
 
-					if ( (1<<start) & arr[k] ) {
-						while( end < 32 ) {
-							if ( ((1<<end) & arr[k] ) == 0 ) {
-								break;
-							}
-							++end;
-						}
-						PUSHQUAD( indexArr[k], countArr[k], i+start, i+end, j );
-					}
-					start = end;
+					if ( end == 32 )
+						break;
+					bits &= ~( (1U<<end)-1 );
 				}
 			}
 		}
+		countArr[k] = count - listStart;
 	}
+	GLASSERT( count <= width*height*6 );
 	nSeenIndex = countArr[0];
 	nPastSeenIndex = countArr[1];
 	nUnseenIndex = countArr[2];
 #ifdef SHOW_FOW
-	memcpy( pastSeenIndex+nPastSeenIndex, unseenIndex, sizeof(U16)*nUnseenIndex );
+	// The unseen quads follow the past seen quads.
 	nPastSeenIndex += nUnseenIndex;
 	nUnseenIndex = 0;
 #endif
 
 #undef PUSHQUAD
 
+	// The light fog is the fog grown by one tile in each direction, which
+	// is a dilation of the fog bits by shifts and ors of the neighbor words.
+	int rowMin = SIZE, rowMax = -1;
 	for( int j=0; j<height; ++j ) {
-		for( int i=0; i<width; ++i ) {
-			if ( fogOfWar.IsSet( i, j ) ) 
-			{
-				U16 c = lightMap->GetImg16( i, j );
-				lightFogMap.SetImg16( i, j, c );
-			}
-			else if (    (i>0      && fogOfWar.IsSet( i-1, j ))
-				      || (i<SIZE-1 && fogOfWar.IsSet( i+1, j ))
-					  || (j>0      && fogOfWar.IsSet( i, j-1 ))
-					  || (j<SIZE-1 && fogOfWar.IsSet( i, j+1 )) ) 
-			{
-				U16 c = lightMap->GetImg16( i, j );
-				lightFogMap.SetImg16( i, j, c );
-			}
-			else 
-			{
-				lightFogMap.SetImg16( i, j, 0 /*0x3333*/ );
+		if ( !rowDirty[j] )
+			continue;
+		rowMin = Min( rowMin, j );
+		rowMax = Max( rowMax, j );
+
+		for( int w=0; w*32<width; ++w ) {
+			const U32* row = fogMem + j*WIDTH32 + w;
+			U32 f = *row;
+			U32 lit = f | (f<<1) | (f>>1);
+			if ( w > 0 )			lit |= row[-1] >> 31;
+			if ( w < WIDTH32-1 )	lit |= row[1] << 31;
+			if ( j > 0 )			lit |= row[-WIDTH32];
+			if ( j < SIZE-1 )		lit |= row[WIDTH32];
+
+			int iEnd = Min( width, w*32+32 );
+			for( int i=w*32; i<iEnd; ++i ) {
+				if ( lit & (1U<<(i&31)) ) {
+					U16 c = lightMap->GetImg16( i, j );
+					lightFogMap.SetImg16( i, j, c );
+				}
+				else {
+					lightFogMap.SetImg16( i, j, 0 /*0x3333*/ );
+				}
 			}
 		}
 	}
-	lightFogMapTex->Upload( lightFogMap );
+	if ( !lightFogMapValid ) {
+		lightFogMapTex->Upload( lightFogMap );
+		lightFogMapValid = true;
+	}
+	else if ( rowMax >= rowMin ) {
+		// The surface is flipped: map row j is texture row SIZE-1-j.
+		lightFogMapTex->Upload( lightFogMap, SIZE-1-rowMax, SIZE-1-rowMin );
+	}
 	quadTree.MarkVisible( fogOfWar );
 }
 
 
-void Map::DoDamage( int x, int y, const MapDamageDesc& damage, Rectangle2I* dBounds, Vector2I* explodes )
+void Map::DoDamage( int x, int y, const MapDamageDesc& damage, Vector2I* explodes )
 {
 	float hp = damage.damage;
 	if ( hp <= 0.0f )
@@ -545,13 +662,13 @@ void Map::DoDamage( int x, int y, const MapDamageDesc& damage, Rectangle2I* dBou
 		if ( root->model ) {
 			GLRELASSERT( root->model->IsFlagSet( Model::MODEL_OWNED_BY_MAP ) );
 
-			DoDamage( root->model, damage, dBounds, explodes );
+			DoDamage( root->model, damage, explodes );
 		}
 	}
 }
 
 
-void Map::DoDamage( Model* m, const MapDamageDesc& damageDesc, Rectangle2I* dBounds, Vector2I* explodes )
+void Map::DoDamage( Model* m, const MapDamageDesc& damageDesc, Vector2I* explodes )
 {
 	if ( m->IsFlagSet( Model::MODEL_OWNED_BY_MAP ) ) 
 	{
@@ -566,12 +683,6 @@ void Map::DoDamage( Model* m, const MapDamageDesc& damageDesc, Rectangle2I* dBou
 		bool destroyed = false;
 		if ( itemDef.CanDamage() && item->DoDamage(hp) ) 
 		{
-			if ( dBounds ) {
-				Rectangle2I r = item->MapBounds();
-				dBounds->DoUnion( r );
-				dBounds->DoIntersection( Bounds() );
-			}
-
 			// Destroy the current model. Replace it with "destroyed"
 			// model if there is one. This is as simple as saving off
 			// the properties, deleting it, and re-adding. A little
@@ -606,12 +717,41 @@ void Map::DoDamage( Model* m, const MapDamageDesc& damageDesc, Rectangle2I* dBou
 }
 
 
-void Map::DoSubTurn( Rectangle2I* change, float fireDamagePerSubTurn )
+static int CompareInt( const void* a, const void* b )
+{
+	return *((const int*)a) - *((const int*)b);
+}
+
+
+void Map::DoSubTurn( float fireDamagePerSubTurn )
 {
-	for( int i=0; i<SIZE*SIZE; ++i ) {
-		if ( pyro[i] ) {
-			int y = i/SIZE;
-			int x = i-y*SIZE;
+	// Drop the tiles that have gone out, and sort so the tiles are processed
+	// in map order, which keeps the random numbers the same as a full scan.
+	int n = 0;
+	for( int i=0; i<pyroActive.Size(); ++i ) {
+		int index = pyroActive[i];
+		if ( tiles.At( index%SIZE, index/SIZE ).pyro )
+			pyroActive[n++] = index;
+		else
+			pyroListed.Clear( index%SIZE, index/SIZE, 0 );
+	}
+	pyroActive.Trim( n );
+	qsort( pyroActive.Mem(), n, sizeof(int), CompareInt );
+
+	// Work from a copy: anything set on the way is processed next sub-turn.
+	pyroWork.Clear();
+	if ( n ) {
+		memcpy( pyroWork.PushArr( n ), pyroActive.Mem(), n*sizeof(int) );
+	}
+
+	// Items destroyed by the fire patch the vis and path maps once, at the end.
+	BeginChange();
+
+	for( int k=0; k<pyroWork.Size(); ++k ) {
+		int i = pyroWork[k];
+		int y = i/SIZE;
+		int x = i-y*SIZE;
+		if ( tiles.At( x, y ).pyro ) {
 
 			if ( PyroSmoke( x, y ) || PyroFlare( x, y ) ) {
 				int duration = PyroDuration( x, y );
@@ -634,29 +774,60 @@ void Map::DoSubTurn( Rectangle2I* change, float fireDamagePerSubTurn )
 					// Will torch a building in no time. (Adjacent fires do multiple damage.)
 					MapDamageDesc d = { fireDamagePerSubTurn, 0 };
 					Vector2I explodes = { -1, -1 };
-					DoDamage( x, y, d, change, &explodes );	// FIXME BUG Burning objects don't blow up. Just needs code, and
+					DoDamage( x, y, d, &explodes );	// FIXME BUG Burning objects don't blow up. Just needs code, and
 															// points out that the damage code probably shouldn't be in the 
 															// map class.
-
-					MapDamageDesc f = { 0, fireDamagePerSubTurn };
-					if ( x > 0 ) DoDamage( x-1, y, f, change, &explodes );
-					if ( x < SIZE-1 ) DoDamage( x+1, y, f, change, &explodes );
-					if ( y > 0 ) DoDamage( x, y-1, f, change, &explodes );
-					if ( y < SIZE-1 ) DoDamage( x, y+1, f, change, &explodes );
+					// Note that fire doesn't spread to the neighbors: DoDamage() returns
+					// early for incendiary-only damage, so those calls were removed.
 				}
 			}
 		}
 	}
+
+	EndChange();
+}
+
+
+void Map::NoteChange( const Rectangle2I& bounds, int flags )
+{
+	pendingChange.Add( bounds, flags );
+	if ( changeDepth == 0 ) {
+		BeginChange();
+		EndChange();
+	}
+}
+
+
+void Map::EndChange( MapChangeSet* changes )
+{
+	GLASSERT( changeDepth > 0 );
+	--changeDepth;
+
+	if ( changeDepth > 0 ) {
+		if ( changes )
+			changes->Clear();
+		return;
+	}
+	if ( pendingChange.flags & MapChangeSet::PATH ) {
+		Rectangle2I b = pendingChange.pathBounds;
+		InvalidatePath( b );
+		ClearVisPathMap( b );
+		CalcVisPathMap( b );
+	}
+	if ( changes )
+		*changes = pendingChange;
+	pendingChange.Clear();
 }
 
 
 void Map::EmitParticles( U32 delta )
 {
 	ParticleSystem* system = ParticleSystem::Instance();
-	for( int i=0; i<SIZE*SIZE; ++i ) {
-		if ( pyro[i] ) {
-			int y = i/SIZE;
-			int x = i-y*SIZE;
+	for( int k=0; k<pyroActive.Size(); ++k ) {
+		int i = pyroActive[k];
+		int y = i/SIZE;
+		int x = i-y*SIZE;
+		if ( tiles.At( x, y ).pyro ) {
 			Vector3F pos = { (float)x+0.5f, 0.0f, (float)y+0.5f };
 			if ( PyroFire( x, y ) ) {
 				system->EmitFlame( delta, pos );
@@ -712,6 +883,7 @@ void Map::SetPyro( int x, int y, int duration, bool fire, bool flare )
 	GLRELASSERT( x >= 0 && x < SIZE );
 	GLRELASSERT( y >= 0 && y < SIZE );
 	U8 p = 0;
+	bool sight = PyroSmoke( x, y ) || PyroFlare( x, y );
 
 	if ( fire ) {
 		p |= 0x80;
@@ -720,7 +892,17 @@ void Map::SetPyro( int x, int y, int duration, bool fire, bool flare )
 		p |= 0x40;
 	}
 	p += Clamp( duration, 0, 0x3f );
-	pyro[y*SIZE+x] = p;
+	tiles.At( x, y ).pyro = p;
+
+	if ( sight != ( PyroSmoke( x, y ) || PyroFlare( x, y ) ) ) {
+		Rectangle2I b( x, y, x, y );
+		NoteChange( b, MapChangeSet::SIGHT );
+	}
+
+	if ( p && !pyroListed.IsSet( x, y ) ) {
+		pyroListed.Set( x, y );
+		pyroActive.Push( y*SIZE+x );
+	}
 }
 
 
@@ -911,7 +1093,8 @@ Map::MapItem* Map::AddItem( int x, int y, int rotation, const MapItemDef* def, i
 	else {
 		res = def->GetModelResource();
 		if ( def->flags & MapItemDef::OBSCURES ) {
-			ChangeObscured( mapBounds, 1 );
+			if ( !bulkDepth )
+				ChangeObscured( mapBounds, 1 );
 			item->amountObscuring = 1;
 		}
 	}
@@ -927,9 +1110,11 @@ Map::MapItem* Map::AddItem( int x, int y, int rotation, const MapItemDef* def, i
 	}
 
 	// Patch the world states:
-	ResetPath();
-	ClearVisPathMap( mapBounds );
-	CalcVisPathMap( mapBounds );
+	if ( !bulkDepth ) {
+		if ( item->flags & MapItem::MI_DOOR )
+			doorArr.Push( item );
+		NoteChange( mapBounds, MapChangeSet::PATH | MapChangeSet::SIGHT );
+	}
 	return item;
 }
 
@@ -941,16 +1126,52 @@ void Map::DeleteItem( MapItem* item )
 	// Delete the light first, if it exists:
 	quadTree.UnlinkItem( item );
 	Rectangle2I mapBounds = item->MapBounds();
-	if ( item->amountObscuring ) {
-		ChangeObscured( mapBounds, -((int)item->amountObscuring) );
+	if ( !bulkDepth ) {
+		if ( item->amountObscuring ) {
+			ChangeObscured( mapBounds, -((int)item->amountObscuring) );
+		}
+		if ( item->flags & MapItem::MI_DOOR ) {
+			for( int i=0; i<doorArr.Size(); ++i ) {
+				if ( doorArr[i] == item ) {
+					doorArr.SwapRemove( i );
+					break;
+				}
+			}
+		}
 	}
 	if ( item->model )
 		tree->FreeModel( item->model );
 
 	itemPool.Free( item );
+	if ( !bulkDepth )
+		NoteChange( mapBounds, MapChangeSet::PATH | MapChangeSet::SIGHT );
+}
+
+
+void Map::EndBulkEdit()
+{
+	GLASSERT( bulkDepth > 0 );
+	--bulkDepth;
+	if ( bulkDepth > 0 )
+		return;
+
+	Rectangle2I b = Bounds();
+	tiles.ClearObscured();
+	doorArr.Clear();
+
+	for( MapItem* item = quadTree.FindItems( b, 0, 0 ); item; item = item->next ) {
+		if ( item->amountObscuring ) {
+			ChangeObscured( item->MapBounds(), item->amountObscuring );
+		}
+		if ( item->flags & MapItem::MI_DOOR ) {
+			doorArr.Push( item );
+		}
+	}
+
 	ResetPath();
-	ClearVisPathMap( mapBounds );
-	CalcVisPathMap( mapBounds );
+	ClearVisPathMap( b );
+	CalcVisPathMap( b );
+	NoteChange( b, MapChangeSet::SIGHT );
 }
 
 
@@ -990,18 +1211,17 @@ void Map::Save( XMLPrinter* printer )
 	printer->CloseElement();	// Images
 
 	printer->OpenElement( "PyroGroup" );
-	for( int i=0; i<SIZE*SIZE; ++i ) {
-		if ( pyro[i] ) {
-			int y = i / SIZE;
-			int x = i - SIZE*y;
-
-			printer->OpenElement( "Pyro" );
-			printer->PushAttribute( "x", x );
-			printer->PushAttribute( "y", y );
-			printer->PushAttribute( "fire", PyroFire( x, y ) ? 1 : 0 );
-			printer->PushAttribute( "flare", PyroFlare( x, y ) ? 1 : 0 );
-			printer->PushAttribute( "duration", PyroDuration( x, y ) );
-			printer->CloseElement();	// Pyro
+	for( int y=0; y<SIZE; ++y ) {
+		for( int x=0; x<SIZE; ++x ) {
+			if ( PyroOn( x, y ) ) {
+				printer->OpenElement( "Pyro" );
+				printer->PushAttribute( "x", x );
+				printer->PushAttribute( "y", y );
+				printer->PushAttribute( "fire", PyroFire( x, y ) ? 1 : 0 );
+				printer->PushAttribute( "flare", PyroFlare( x, y ) ? 1 : 0 );
+				printer->PushAttribute( "duration", PyroDuration( x, y ) );
+				printer->CloseElement();	// Pyro
+			}
 		}
 	}
 	printer->CloseElement();	// PyroGroup
@@ -1009,6 +1229,49 @@ void Map::Save( XMLPrinter* printer )
 }
 
 
+U32 Map::StateHash()
+{
+	struct {
+		S32 a, b, c, d, x, y;
+		U32 hp, flags, open;
+	} s;
+
+	U32 itemSum = 0;
+	MapItem* item = quadTree.FindItems( Bounds(), 0, MapItem::MI_NOT_IN_DATABASE );
+	for( ; item; item=item->next ) {
+		memset( &s, 0, sizeof( s ) );
+		s.a = item->xform.a;	s.b = item->xform.b;
+		s.c = item->xform.c;	s.d = item->xform.d;
+		s.x = item->xform.x;	s.y = item->xform.y;
+		s.hp = item->hp;
+		s.flags = item->flags;
+		s.open = item->open;
+
+		const char* name = item->def->Name();
+		itemSum += Random::Hash( &s, sizeof( s ), Random::Hash( name, strlen( name ) ) );
+	}
+
+	U32 h = Random::Hash( &itemSum, sizeof( itemSum ) );
+	// Hashed in row order, so the hash doesn't depend on the tile layout.
+	U8 rows[SIZE*SIZE];
+	tiles.GetRows( &TileGrid<SIZE>::Tile::pyro, rows );
+	h = Random::Hash( rows, SIZE*SIZE, h );
+	tiles.GetRows( &TileGrid<SIZE>::Tile::obscured, rows );
+	h = Random::Hash( rows, SIZE*SIZE, h );
+
+	U32 sub = SubStateHash();
+	return Random::Hash( &sub, sizeof( sub ), h );
+}
+
+
+U32 Map::FogHash() const
+{
+	typedef BitArray<Map::SIZE, Map::SIZE, 1> FogArray;
+	U32 h = Random::Hash( fogOfWar.Plane( 0 ), FogArray::TOTAL_MEM );
+	return Random::Hash( pastSeenFOW.Plane( 0 ), FogArray::TOTAL_MEM, h );
+}
+
+
 void Map::Load( const XMLElement* mapElement )
 {
 	GLASSERT( mapElement );
@@ -1017,15 +1280,13 @@ void Map::Load( const XMLElement* mapElement )
 	}
 	GLRELASSERT( mapElement );
 	GLASSERT( strcmp( mapElement->Value(), "Map" ) == 0 );
-	int sizeX = 64;
-	int sizeY = 64;
+	int sizeX = SIZE;
+	int sizeY = SIZE;
 
 	mapElement->QueryIntAttribute( "sizeX", &sizeX );
 	mapElement->QueryIntAttribute( "sizeY", &sizeY );
-	SetSize( sizeX, sizeY );
-	nImageData = 0;
+	BeginLoad( sizeX, sizeY );
 
-	pastSeenFOW.ClearAll();
 	const XMLElement* pastSeenElement = mapElement->FirstChildElement( "Seen" );
 	if ( pastSeenElement ) {
 		const char* p = pastSeenElement->GetText();
@@ -1041,36 +1302,13 @@ void Map::Load( const XMLElement* mapElement )
 				image = image->NextSiblingElement( "Image" ) )
 		{
 			int x=0, y=0, size=0;
-			char buffer[128];
 			int tileRotation = 0;
 			image->QueryIntAttribute( "x", &x );
 			image->QueryIntAttribute( "y", &y );
 			image->QueryIntAttribute( "size", &size );
 			image->QueryIntAttribute( "tileRotation", &tileRotation );
 
-			// store it to save later:
-			const char* name = image->Attribute( "name" ); 
-			GLRELASSERT( nImageData < MAX_IMAGE_DATA );
-			imageData[ nImageData ].x = x;
-			imageData[ nImageData ].y = y;
-			imageData[ nImageData ].size = size;
-			imageData[ nImageData ].tileRotation = tileRotation;
-			imageData[ nImageData ].name = name;
-			++nImageData;
-			
-			ImageManager* imageManager = ImageManager::Instance();
-
-			Surface background, day, night;
-
-			SNPrintf( buffer, 128, "%s_TEX", name );
-			imageManager->LoadImage( buffer, &background );
-			SNPrintf( buffer, 128, "%s_DAY", name );
-			imageManager->LoadImage( buffer, &day );
-			SNPrintf( buffer, 128, "%s_NGT", name );
-			imageManager->LoadImage( buffer, &night );
-
-			SetTexture( &background, x*512/64, y*512/64, tileRotation );
-			SetLightMaps( &day, &night, x, y, tileRotation );			
+			LoadImage( image->Attribute( "name" ), x, y, size, tileRotation );
 		}
 	}
 
@@ -1091,6 +1329,57 @@ void Map::Load( const XMLElement* mapElement )
 			SetPyro( x, y, duration, fire ? true : false, flare ? true : false );
 		}
 	}
+	EndLoad();
+}
+
+
+void Map::BeginLoad( int sizeX, int sizeY )
+{
+	SetSize( sizeX, sizeY );
+	nImageData = 0;
+	pastSeenFOW.ClearAll();
+	BeginBulkEdit();
+}
+
+
+void Map::LoadImageSurfaces( const char* name, Surface* surfaces )
+{
+	ImageManager* imageManager = ImageManager::Instance();
+	char buffer[128];
+
+	SNPrintf( buffer, 128, "%s_TEX", name );
+	imageManager->LoadImage( buffer, &surfaces[0] );
+	SNPrintf( buffer, 128, "%s_DAY", name );
+	imageManager->LoadImage( buffer, &surfaces[1] );
+	SNPrintf( buffer, 128, "%s_NGT", name );
+	imageManager->LoadImage( buffer, &surfaces[2] );
+}
+
+
+void Map::LoadImage( const char* name, int x, int y, int size, int tileRotation, const Surface* surfaces )
+{
+	// store it to save later:
+	GLRELASSERT( nImageData < MAX_IMAGE_DATA );
+	imageData[ nImageData ].x = x;
+	imageData[ nImageData ].y = y;
+	imageData[ nImageData ].size = size;
+	imageData[ nImageData ].tileRotation = tileRotation;
+	imageData[ nImageData ].name = name;
+	++nImageData;
+
+	Surface loaded[3];
+	if ( !surfaces ) {
+		LoadImageSurfaces( name, loaded );
+		surfaces = loaded;
+	}
+	SetTexture( &surfaces[0], x*EL_MAP_TEXTURE_SIZE/SIZE, y*EL_MAP_TEXTURE_SIZE/SIZE, tileRotation );
+	SetLightMaps( &surfaces[1], &surfaces[2], x, y, tileRotation );
+}
+
+
+void Map::EndLoad()
+{
+	EndBulkEdit();
 
 	// Remove things that can't burn. (We don't want to generate unnecessary particles.)
 	for( int y=0; y<SIZE; ++y ) {
@@ -1107,7 +1396,7 @@ void Map::Load( const XMLElement* mapElement )
 			}
 		}
 	}
-	QueryAllDoors();
+	MemoryReport();
 }
 
 
@@ -1127,92 +1416,111 @@ void Map::DeleteAt( int x, int y )
 }
 
 
-void Map::QueryAllDoors()
+bool Map::ProcessDoors( const grinliz::Vector2I* openerPos, int nOpeners )
 {
-	Rectangle2I bounds = Bounds();
+	//GRINLIZ_PERFTRACK
+	bool anyChange = false;
 
-	doorArr.Clear();
+	memset( openers, 0, SIZE*SIZE );
+	for( int i=0; i<nOpeners; ++i ) {
+		if ( Bounds().Contains( openerPos[i] ) )
+			++openers[ openerPos[i].y*SIZE + openerPos[i].x ];
+	}
 
-	MapItem* item = quadTree.FindItems( bounds, MapItem::MI_DOOR, 0 );
-	while( item ) {
-		doorArr.Push( item );
-		item = item->next;
+	BeginChange();
+	for( int i=0; i<doorArr.Size(); ++i ) {
+		if ( UpdateDoor( doorArr[i] ) )
+			anyChange = true;
 	}
+	EndChange();
+	return anyChange;
 }
 
 
-bool Map::ProcessDoors( const grinliz::Vector2I* openers, int nOpeners )
+void Map::MoveOpener( const grinliz::Vector2I& from, const grinliz::Vector2I& to )
 {
-	//GRINLIZ_PERFTRACK
-	bool anyChange = false;
+	if ( from == to )
+		return;
 
-	BitArray< SIZE, SIZE, 1 > map;
-	Rectangle2I b;
+	Rectangle2I area;
+	area.SetInvalid();
+	if ( Bounds().Contains( from ) ) {
+		GLASSERT( openers[from.y*SIZE+from.x] > 0 );
+		--openers[from.y*SIZE+from.x];
+		Rectangle2I b;
+		b.Set( from.x-1, from.y-1, from.x+1, from.y+1 );
+		area.DoUnion( b );
+	}
+	if ( Bounds().Contains( to ) ) {
+		++openers[to.y*SIZE+to.x];
+		Rectangle2I b;
+		b.Set( to.x-1, to.y-1, to.x+1, to.y+1 );
+		area.DoUnion( b );
+	}
+	area.DoIntersection( Bounds() );
+	if ( !area.IsValid() )
+		return;
 
-	for( int i=0; i<nOpeners; ++i ) {
-		b.Set( openers[i].x-1, openers[i].y-1, openers[i].x+1, openers[i].y+1 );
-		b.DoIntersection( Bounds() );
-		map.SetRect( b );
+	BeginChange();
+	for( MapItem* item = quadTree.FindItems( area, MapItem::MI_DOOR, 0 ); item; item = item->next ) {
+		UpdateDoor( item );
 	}
-	for( int i=0; i<doorArr.Size(); ++i ) {
-
-		MapItem* item = doorArr[i];
+	EndChange();
+}
 
-		GLRELASSERT( item->def->IsDoor() );
-		GLRELASSERT( item->def->resourceOpen );
-		GLRELASSERT( item->def->cx == 1 && item->def->cy == 1 );
 
-		if ( !item->Destroyed() ) {
-			GLRELASSERT( item->model );
+bool Map::UpdateDoor( MapItem* item )
+{
+	GLRELASSERT( item->def->IsDoor() );
+	GLRELASSERT( item->def->resourceOpen );
+	GLRELASSERT( item->def->cx == 1 && item->def->cy == 1 );
 
-			bool change = false;
+	if ( item->Destroyed() )
+		return false;
+	GLRELASSERT( item->model );
 
-			// Cheat on transform! Doors are 1x1
-			int x = item->XForm().x;
-			int y = item->XForm().y;
-			bool shouldBeOpen = map.IsSet( x, y ) != 0;
+	// Cheat on transform! Doors are 1x1
+	int x = item->XForm().x;
+	int y = item->XForm().y;
 
-			if ( item->open && !shouldBeOpen ) {
-				change = true;
-			}
-			else if ( !item->open && shouldBeOpen ) {
-				change = true;
+	bool shouldBeOpen = false;
+	for( int j=Max( y-1, 0 ); j<=Min( y+1, height-1 ) && !shouldBeOpen; ++j ) {
+		for( int i=Max( x-1, 0 ); i<=Min( x+1, width-1 ); ++i ) {
+			if ( openers[j*SIZE+i] ) {
+				shouldBeOpen = true;
+				break;
 			}
+		}
+	}
+	if ( (item->open != 0) == shouldBeOpen )
+		return false;
 
-			if ( change ) {
-				anyChange = true;
-				Vector3F pos = item->model->Pos();
-				float rot = item->model->GetRotation();
-
-				const ModelResource* res = 0;
-				if ( shouldBeOpen ) {
-					item->open = 1;
-					res = item->def->GetOpenResource();
-				}
-				else {
-					item->open = 0;
-					res = item->def->GetModelResource();
-				}
+	Vector3F pos = item->model->Pos();
+	float rot = item->model->GetRotation();
 
-				if ( res ) {
-					tree->FreeModel( item->model );
+	const ModelResource* res = 0;
+	if ( shouldBeOpen ) {
+		item->open = 1;
+		res = item->def->GetOpenResource();
+	}
+	else {
+		item->open = 0;
+		res = item->def->GetModelResource();
+	}
 
-					Model* model = tree->AllocModel( res );
-					model->SetFlag( Model::MODEL_OWNED_BY_MAP );
-					model->SetPos( pos );
-					model->SetRotation( rot );
-					item->model = model;
+	if ( res ) {
+		tree->FreeModel( item->model );
 
-					Rectangle2I mapBounds = item->MapBounds();
+		Model* model = tree->AllocModel( res );
+		model->SetFlag( Model::MODEL_OWNED_BY_MAP );
+		model->SetPos( pos );
+		model->SetRotation( rot );
+		item->model = model;
 
-					ResetPath();
-					ClearVisPathMap( mapBounds );
-					CalcVisPathMap( mapBounds );
-				}
-			}
-		}
+		Rectangle2I mapBounds = item->MapBounds();
+		NoteChange( mapBounds, MapChangeSet::PATH | MapChangeSet::SIGHT );
 	}
-	return anyChange;
+	return true;
 }
 
 
@@ -1311,29 +1619,69 @@ void Map::ResetPath()
 	microPather->Reset();
 	++pathQueryID;
 	++visibilityQueryID;
+	pathInvalidated = 0;
+}
+
+
+void Map::InvalidatePath( const grinliz::Rectangle2I& bounds )
+{
+	// The cost between 2 tiles depends on both of them (and the tiles
+	// between diagonals) so the neighbors are invalid as well.
+	Rectangle2I b = bounds;
+	b.Outset( 1 );
+	b.DoIntersection( Bounds() );
+	if ( !b.IsValid() )
+		return;
+
+	pathInvalidated += b.Area();
+	if ( pathInvalidated > SIZE*SIZE ) {
+		ResetPath();
+		return;
+	}
+	for( int j=b.min.y; j<=b.max.y; ++j ) {
+		for( int i=b.min.x; i<=b.max.x; ++i ) {
+			Vector2<S16> v = { (S16)i, (S16)j };
+			microPather->StateCostChange( VecToState( v ) );
+		}
+	}
+	++pathQueryID;
+	++visibilityQueryID;
 }
 
 
 void Map::SetPathBlocks( const grinliz::BitArray<Map::SIZE, Map::SIZE, 1>& block )
 {
 	if ( block != pathBlock ) {
-		ResetPath();
+		// Usually one unit has moved: only the tiles that changed are invalid.
+		BitArray<SIZE, SIZE, 1> changed = block;
+		changed.DoXor( pathBlock );
+		for( BitArray<SIZE, SIZE, 1>::Iterator it( changed ); !it.Done(); it.Next() ) {
+			tiles.At( it.X(), it.Y() ).path ^= TileGrid<SIZE>::PATH_BLOCKED;
+			Rectangle2I tile;
+			tile.Set( it.X(), it.Y(), it.X(), it.Y() );
+			InvalidatePath( tile );
+		}
 		pathBlock = block;
 	}
 }
 
 
+void Map::SetPathBlocker( IPathBlocker* blocker )
+{
+	pathBlocker = blocker;
+	for( BitArray<SIZE, SIZE, 1>::Iterator it( pathBlock ); !it.Done(); it.Next() ) {
+		tiles.At( it.X(), it.Y() ).path &= ~TileGrid<SIZE>::PATH_BLOCKED;
+	}
+	pathBlock.ClearAll();
+}
+
+
 void Map::ClearVisPathMap( grinliz::Rectangle2I& _bounds )
 {
 	Rectangle2I bounds = _bounds;
 	bounds.DoIntersection( Bounds() );
 
-	for( int j=bounds.min.y; j<=bounds.max.y; ++j ) {
-		for( int i=bounds.min.x; i<=bounds.max.x; ++i ) {
-			visMap[j*SIZE+i] = 0;
-			pathMap[j*SIZE+i] = 0;
-		}
-	}
+	tiles.ClearVisPath( bounds );
 }
 
 
@@ -1345,7 +1693,8 @@ void Map::CalcVisPathMap( grinliz::Rectangle2I& _bounds )
 
 	MapItem* item = quadTree.FindItems( bounds, 0, 0 );
 	while( item ) {
-		if ( !item->Destroyed() ) {
+		// Open doors don't impede sight or movement.
+		if ( !item->Destroyed() && !item->open ) {
 
 			const MapItemDef& itemDef = *item->def;
 
@@ -1354,6 +1703,12 @@ void Map::CalcVisPathMap( grinliz::Rectangle2I& _bounds )
 
 			Matrix2I mat = item->XForm();
 
+			// The masks are already rotated for the tile rotation. (Actually a bit rotation too, 
+			// which is handy.)
+			const int nCells = itemDef.cx * itemDef.cy;
+			const U8* pather = GetItemMasks( item->def ) + rot*2*nCells;
+			const U8* vis = pather + nCells;
+
 			// Walk the object in object space & write to world.
 			for( int j=0; j<itemDef.cy; ++j ) {
 				for( int i=0; i<itemDef.cx; ++i ) {
@@ -1364,24 +1719,11 @@ void Map::CalcVisPathMap( grinliz::Rectangle2I& _bounds )
 					GLRELASSERT( world.x >= 0 && world.x < SIZE );
 					GLRELASSERT( world.y >= 0 && world.y < SIZE );
 
-					// Account for tile rotation. (Actually a bit rotation too, which is handy.)
 					// The OR operation is important. This routine will write outside of the bounds,
 					// and should do no damage.
-					//
-					// Open doors don't impede sight or movement.
-					//
-					if ( !item->open )
-					{
-						// Path
-						U32 p = ( itemDef.Pather(obj.x, obj.y ) << rot );
-						p = p | (p>>4);
-						pathMap[ world.y*SIZE + world.x ] |= p;
-
-						// Visibility
-						p = ( itemDef.Visibility( obj.x, obj.y ) << rot );
-						p = p | (p>>4);
-						visMap[ world.y*SIZE + world.x ] |= p;
-					}
+					TileGrid<SIZE>::Tile& tile = tiles.At( world.x, world.y );
+					tile.path |= pather[j*itemDef.cx+i];
+					tile.vis |= vis[j*itemDef.cx+i];
 				}
 			}
 		}
@@ -1392,11 +1734,12 @@ void Map::CalcVisPathMap( grinliz::Rectangle2I& _bounds )
 
 int Map::GetPathMask( ConnectionType c, int x, int y )
 {
-	// fast return: if the c is set, we're done.
-	if ( c == PATH_TYPE && pathBlock.IsSet( x, y ) ) {
-		return 0xf;
+	const TileGrid<SIZE>::Tile& tile = tiles.At( x, y );
+	if ( c == PATH_TYPE ) {
+		// A unit on the tile blocks all of it.
+		return ( tile.path & TileGrid<SIZE>::PATH_BLOCKED ) ? 0xf : tile.path;
 	}
-	return ( c==PATH_TYPE) ? pathMap[y*SIZE+x] : visMap[y*SIZE+x];
+	return tile.vis;
 }
 
 
@@ -1713,15 +2056,6 @@ void Map::MapBoundsOfModel( const Model* m, grinliz::Rectangle2I* mapBounds )
 }
 
 
-void Map::ChangeObscured( const grinliz::Rectangle2I& bounds, int delta )
-{
-	for( int y=bounds.min.y; y<=bounds.max.y; ++y ) {
-		for( int x=bounds.min.x; x<=bounds.max.x; ++x ) {
-			obscured[y*SIZE+x] += delta;
-		}
-	}
-}
-
 /*
 void Map::SetLanderFlight( float normal )
 {
@@ -1758,7 +2092,6 @@ void Map::SetLanderFlight( float normal )
 Map::QuadTree::QuadTree()
 {
 	Clear();
-	filterModel = 0;
 
 	int base = 0;
 	for( int i=0; i<QUAD_DEPTH+1; ++i ) {
@@ -1771,7 +2104,13 @@ Map::QuadTree::QuadTree()
 void Map::QuadTree::Clear()
 {
 	memset( tree, 0, sizeof(MapItem*)*NUM_QUAD_NODES );
-	memset( depthUse, 0, sizeof(int)*(QUAD_DEPTH+1) );
+	memset( depthUse, 0, sizeof(int)*(QUAD_DEPTH) );
+
+	for( int i=0; i<SIZE*SIZE; ++i )
+		tileHead[i] = -1;
+	tileRefs.Clear();
+	freeRef = -1;
+	serial = 0;
 }
 
 
@@ -1782,6 +2121,7 @@ void Map::QuadTree::Add( MapItem* item )
 	item->nextQuad = tree[i];
 	tree[i] = item;
 	depthUse[d] += 1;
+	AddTiles( item, d );
 
 //	GLOUTPUT(( "QuadTree::Add %x id=%d (%d,%d)-(%d,%d) at depth=%d\n", item, item->itemDefIndex,
 //				item->mapBounds8.min.x, item->mapBounds8.min.y, item->mapBounds8.max.x, item->mapBounds8.max.y,
@@ -1798,6 +2138,7 @@ void Map::QuadTree::UnlinkItem( MapItem* item )
 	int index = CalcNode( item->mapBounds8, &d );
 	depthUse[d] -= 1;
 	GLRELASSERT( tree[index] ); // the item should be in the linked list somewhere.
+	RemoveTiles( item );
 
 //	GLOUTPUT(( "QuadTree::UnlinkItem %x id=%d\n", item, item->itemDefIndex ));
 
@@ -1815,8 +2156,90 @@ void Map::QuadTree::UnlinkItem( MapItem* item )
 }
 
 
+void Map::QuadTree::AddTiles( MapItem* item, int depth )
+{
+	++serial;
+	const Rectangle2<U8>& b = item->mapBounds8;
+
+	for( int y=b.min.y; y<=b.max.y; ++y ) {
+		for( int x=b.min.x; x<=b.max.x; ++x ) {
+			int r = freeRef;
+			if ( r >= 0 ) {
+				freeRef = tileRefs[r].next;
+			}
+			else {
+				r = tileRefs.Size();
+				tileRefs.Push();
+			}
+			TileRef* ref = &tileRefs[r];
+			ref->item = item;
+			ref->serial = serial;
+			ref->depth = depth;
+
+			// The new item has the highest serial, so it goes after everything
+			// at the same or a deeper level.
+			int* link = &tileHead[y*SIZE+x];
+			while( *link >= 0 && tileRefs[*link].depth >= depth ) {
+				link = &tileRefs[*link].next;
+			}
+			ref->next = *link;
+			*link = r;
+		}
+	}
+}
+
+
+void Map::QuadTree::RemoveTiles( MapItem* item )
+{
+	const Rectangle2<U8>& b = item->mapBounds8;
+
+	for( int y=b.min.y; y<=b.max.y; ++y ) {
+		for( int x=b.min.x; x<=b.max.x; ++x ) {
+			int* link = &tileHead[y*SIZE+x];
+			while( *link >= 0 && tileRefs[*link].item != item ) {
+				link = &tileRefs[*link].next;
+			}
+			GLASSERT( *link >= 0 );
+			if ( *link >= 0 ) {
+				int r = *link;
+				*link = tileRefs[r].next;
+				tileRefs[r].item = 0;
+				tileRefs[r].next = freeRef;
+				freeRef = r;
+			}
+		}
+	}
+}
+
+
+Map::MapItem* Map::QuadTree::FindItems( int x, int y, int required, int excluded )
+{
+	GLASSERT( x >= 0 && x < SIZE && y >= 0 && y < SIZE );
+	MapItem* root = 0;
+	MapItem* tail = 0;
+
+	for( int r=tileHead[y*SIZE+x]; r>=0; r=tileRefs[r].next ) {
+		MapItem* pItem = tileRefs[r].item;
+		if (    ( ( pItem->flags & required) == required )
+			 && ( ( pItem->flags & excluded ) == 0 ) )
+		{
+			pItem->next = 0;
+			if ( tail )
+				tail->next = pItem;
+			else
+				root = pItem;
+			tail = pItem;
+		}
+	}
+	return root;
+}
+
+
 Map::MapItem* Map::QuadTree::FindItems( const Rectangle2I& bounds, int required, int excluded )
 {
+	if ( bounds.min == bounds.max ) {
+		return FindItems( bounds.min.x, bounds.min.y, required, excluded );
+	}
 	//GRINLIZ_PERFTRACK
 	// Walk the map and pull out items in bounds.
 	MapItem* root = 0;
@@ -1841,26 +2264,15 @@ Map::MapItem* Map::QuadTree::FindItems( const Rectangle2I& bounds, int required,
 			for( int i=x0; i<=x1; ++i ) {
 				MapItem* pItem = *(tree + depthBase[depth] + NodeOffset( i, j, depth ) );
 
-				if ( filterModel ) {
-					while( pItem ) {
-						if ( pItem->model == filterModel ) {
-							pItem->next = 0;
-							return pItem;
-						}
-						pItem = pItem->nextQuad;
-					}
-				}
-				else {
-					while( pItem ) { 
-						if (    ( ( pItem->flags & required) == required )
-							 && ( ( pItem->flags & excluded ) == 0 )
-							 && pItem->mapBounds8.Intersect( bounds8 ) )
-						{
-							pItem->next = root;
-							root = pItem;
-						}
-						pItem = pItem->nextQuad;
+				while( pItem ) { 
+					if (    ( ( pItem->flags & required) == required )
+						 && ( ( pItem->flags & excluded ) == 0 )
+						 && pItem->mapBounds8.Intersect( bounds8 ) )
+					{
+						pItem->next = root;
+						root = pItem;
 					}
+					pItem = pItem->nextQuad;
 				}
 			}
 		}
@@ -1886,11 +2298,20 @@ Map::MapItem* Map::QuadTree::FindItem( const Model* model )
 		b.max.x = Clamp( (int)model->X()+2, 0, SIZE-1 );
 		b.max.y = Clamp( (int)model->Z()+2, 0, SIZE-1 );
 //	}
-	filterModel = model;
-	MapItem* root = FindItems( b, 0, 0 );
-	filterModel = 0;
-	GLRELASSERT( root && root->next == 0 );
-	return root;
+	// Search the tiles around the model; most tiles hold one or two items.
+	for( int y=b.min.y; y<=b.max.y; ++y ) {
+		for( int x=b.min.x; x<=b.max.x; ++x ) {
+			for( int r=tileHead[y*SIZE+x]; r>=0; r=tileRefs[r].next ) {
+				MapItem* root = tileRefs[r].item;
+				if ( root->model == model ) {
+					root->next = 0;
+					return root;
+				}
+			}
+		}
+	}
+	GLRELASSERT( 0 );
+	return 0;
 }
 
 
@@ -1955,6 +2376,8 @@ void Map::CreateTexture( Texture* t )
 		t->Upload( backgroundSurface );
 	}
 	else if ( t == greyTexture ) {
+		Surface greySurface;
+		CalcGreySurface( &greySurface );
 		t->Upload( greySurface );
 	}
 	else if ( t == lightMapTex ) {
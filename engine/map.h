@@ -39,6 +39,7 @@
 #include "surface.h"
 #include "texture.h"
 #include "gpustatemanager.h"
+#include "tilegrid.h"
 
 class Model;
 class ModelResource;
@@ -127,6 +128,31 @@ struct MapDamageDesc
 };
 
 
+// The area and kinds of change to the map over an action: a shot, an
+// explosion, a sub-turn. See Map::BeginChange().
+struct MapChangeSet
+{
+	enum {
+		PATH	= 0x01,		// items changed: path and vis masks, pather
+		SIGHT	= 0x02,		// line of sight changed (includes smoke and flares)
+	};
+	int						flags;
+	grinliz::Rectangle2I	bounds;			// all the changes
+	grinliz::Rectangle2I	pathBounds;		// the PATH changes
+
+	MapChangeSet()		{ Clear(); }
+	void Clear()		{ flags = 0; bounds.SetInvalid(); pathBounds.SetInvalid(); }
+	bool Empty() const	{ return flags == 0; }
+
+	void Add( const grinliz::Rectangle2I& b, int f ) {
+		flags |= f;
+		bounds.DoUnion( b );
+		if ( f & PATH )
+			pathBounds.DoUnion( b );
+	}
+};
+
+
 // Map is crazy, crazy heavy weight. Also possible to use
 // just the IMap for minimal function. Yes, this is a 
 // factoring problem.
@@ -146,7 +172,7 @@ class Map : public IMap,
 public:
 	enum {
 		SIZE = EL_MAP_SIZE,
-		LOG2_SIZE = 6,
+		LOG2_SIZE = EL_MAP_LOG2_SIZE,
 	};
 
 
@@ -229,7 +255,7 @@ public:
 	Map( SpaceTree* tree );
 	virtual ~Map();
 
-	void SetPathBlocker( IPathBlocker* blocker ) { pathBlocker = blocker; pathBlock.ClearAll(); }
+	void SetPathBlocker( IPathBlocker* blocker );
 
 	// The size of the map in use, which is <=SIZE
 	int Height() const { return height; }
@@ -247,7 +273,7 @@ public:
 	// 0: Light map that was set in "SetLightMap", or white if none set
 	// Not currently used: 1: Light map 0 + lights
 	// Not currently used: 2: Light map 0 + lights + FogOfWar
-	const Surface* GetLightMap()	{ GenerateLightMap(); return lightMap; }
+	const Surface* GetLightMap()	{ return lightMap; }		// the pixels; doesn't touch the GPU
 	void SetLightMap0( int x, int y, float r, float g, float b );
 
 	void GenerateSeenUnseen();	// NOT cached, so call only once/frame. (I'm not sure how to cache this effectively. Caching 
@@ -259,20 +285,36 @@ public:
 	void DrawPath( int mode );		//< debugging
 	void DrawOverlay( int layer );		//< draw the "where can I walk" alpha overlay. Set up by ShowNearPath().
 
+	// Changes to the map (items destroyed, doors, smoke) are collected between
+	// BeginChange() and EndChange(), and the path and vis masks and the pather
+	// are patched once, at the end. The calls nest. The outermost EndChange()
+	// returns everything that changed, so the caller can invalidate its own
+	// state (the unit visibility) once as well. Outside of a BeginChange() the
+	// map is patched at each change.
+	void BeginChange()						{ ++changeDepth; }
+	void EndChange( MapChangeSet* changes=0 );
+
+	// A bulk edit, like loading a map: AddItem() and DeleteItem() only change
+	// the items and their models. The outermost EndBulkEdit() rebuilds the path
+	// and vis masks, the obscured counts and the door list in one pass over the
+	// map, and resets the pather.
+	void BeginBulkEdit()					{ ++bulkDepth; }
+	void EndBulkEdit();
+
 	// Do damage to a singe map object.
-	void DoDamage( Model* m, const MapDamageDesc& damage, grinliz::Rectangle2I* destroyedBounds, grinliz::Vector2I* explosion  );
+	void DoDamage( Model* m, const MapDamageDesc& damage, grinliz::Vector2I* explosion  );
 	// Do damage to an entire map tile.
-	void DoDamage( int x, int y, const MapDamageDesc& damage, grinliz::Rectangle2I* destroyedBounds, grinliz::Vector2I* explosion );
+	void DoDamage( int x, int y, const MapDamageDesc& damage, grinliz::Vector2I* explosion );
 	
 	// Process a sub-turn: fire moves, smoke goes away, etc.
-	void DoSubTurn( grinliz::Rectangle2I* changeBounds, float fireDamagePerSubTurn );
+	void DoSubTurn( float fireDamagePerSubTurn );
 
 	// Smoke from weapons, explosions, effects, etc.
 	void AddSmoke( int x, int y, int subturns );
 	void AddFlare( int x, int y, int subturns );
 
 	// Returns true if view obscured by smoke, fire, etc.
-	bool Obscured( int x, int y ) const		{ return ( obscured[y*SIZE+x] || PyroSmoke( x, y ) ); }
+	bool Obscured( int x, int y ) const		{ return ( tiles.At( x, y ).obscured || PyroSmoke( x, y ) ); }
 	int  Flared( int x, int y ) const		{ return PyroFlare( x, y ); }
 	void EmitParticles( U32 deltaTime );
 
@@ -296,6 +338,9 @@ public:
 	void MapBoundsOfModel( const Model* m, grinliz::Rectangle2I* mapBounds );
 
 	void ResetPath();	// normally called automatically
+
+	// Writes the memory used by the map, by part, to the debug output.
+	void MemoryReport() const;
 	//void Clear();
 
 	void DumpTile( int x, int z );
@@ -339,7 +384,7 @@ public:
 	virtual void Render( const void* renderState, const void* textureHandle, int nIndex, const uint16_t* index, int nVertex, const gamui::Gamui::Vertex* vertex );
 
 	Texture* BackgroundTexture()	{ return backgroundTexture; }
-	Texture* LightMapTexture()		{ return lightMapTex; }
+	Texture* LightMapTexture()		{ GenerateLightMap(); return lightMapTex; }
 	// IMap
 	Texture* LightFogMapTexture()	{ return lightFogMapTex; }
 	virtual void LightFogMapParam( float* w, float* h, float* dx, float* dy )	{ *w = (float)EL_MAP_SIZE; *h = (float)EL_MAP_SIZE; *dx = 0; *dy = 0; };
@@ -352,14 +397,26 @@ public:
 	// passed in for the connection, it becomes CanWalk
 	bool CanSee( const grinliz::Vector2I& p, const grinliz::Vector2I& q, ConnectionType connection=VISIBILITY_TYPE );
 
+	// Doors are open when an "opener" (a unit) is on or next to them. ProcessDoors()
+	// sets all the openers and checks every door. MoveOpener() moves one opener
+	// from one tile to another (either can be off the map for none) and only
+	// checks the doors around those tiles.
 	bool ProcessDoors( const grinliz::Vector2I* openers, int nOpeners );
+	void MoveOpener( const grinliz::Vector2I& from, const grinliz::Vector2I& to );
 	void SetPyro( int x, int y, int duration, bool fire, bool flare );
 
 	void Save( tinyxml2::XMLPrinter* );
 	void Load( const tinyxml2::XMLElement* mapNode );
 
+	// Hashes of the state that Save() writes, stable between builds. The items
+	// are hashed independent of order: a change to one item changes only its term.
+	U32 StateHash();			// items, pyro, obscured, and the SubStateHash()
+	U32 FogHash() const;		// current and past seen fog of war
+
 
 	static void MapImageToWorld( int x, int y, int w, int h, int tileRotation, Matrix2I* mat );
+	// Loads the TEX, DAY and NGT surfaces of a map image into surfaces[0..2].
+	static void LoadImageSurfaces( const char* name, Surface* surfaces );
 
 	enum {
 		LAYER_UNDER_LOW,		// obscurred by unseen and past-seen
@@ -376,6 +433,17 @@ public:
 protected:
 	virtual void SubSave( tinyxml2::XMLPrinter* ) = 0;
 	virtual void SubLoad( const tinyxml2::XMLElement* mapNode ) = 0;
+	virtual U32 SubStateHash() = 0;
+
+	// The steps of Load(), for a map that is put together without XML:
+	// BeginLoad(), then the images, items and pyro, then EndLoad().
+	void BeginLoad( int sizeX, int sizeY );
+	// 'surfaces' are the TEX, DAY and NGT surfaces of the image, if already loaded.
+	void LoadImage( const char* name, int x, int y, int size, int tileRotation, const Surface* surfaces=0 );
+	void EndLoad();
+	// The pather and visibility bits of 'def', compiled and rotated. For each of the
+	// 4 rotations: cx*cy pather masks, then cx*cy visibility masks, in object space (y*cx+x).
+	virtual const U8* GetItemMasks( const MapItemDef* def ) = 0;
 	virtual void InitWalkingMapAtoms( gamui::RenderAtom* atoms, int nWalkingMaps ) = 0;	// 3 colors per walking map
 
 	// 0,90,180,270 rotation
@@ -387,9 +455,10 @@ protected:
 	class QuadTree
 	{
 	public:
+		// The deepest nodes are 4x4 tiles, whatever the size of the map.
 		enum {
-			QUAD_DEPTH = 5,
-			NUM_QUAD_NODES = 1+4+16+64+256,
+			QUAD_DEPTH = LOG2_SIZE-1,
+			NUM_QUAD_NODES = ((1<<(2*QUAD_DEPTH))-1)/3,		// 1+4+16+...
 		};
 
 		QuadTree();
@@ -398,16 +467,14 @@ protected:
 		void Add( MapItem* );
 
 		MapItem* FindItems( const grinliz::Rectangle2I& bounds, int required, int excluded );
-		MapItem* FindItems( int x, int y, int required, int excluded ) 
-		{ 
-			grinliz::Rectangle2I b( x, y, x, y ); 
-			return FindItems( b, required, excluded ); 
-		}
+		// Uses the tile index: cost is the number of items on the tile.
+		MapItem* FindItems( int x, int y, int required, int excluded );
 		MapItem* FindItem( const Model* model );
 
 		void UnlinkItem( MapItem* item );
 
 		void MarkVisible( const grinliz::BitArray<Map::SIZE, Map::SIZE, 1>& fogOfWar );
+		int MemoryUsed() const		{ return tileRefs.Capacity()*sizeof(TileRef); }		// allocated outside of the tree
 
 	private:
 		int WorldToNode( int x, int depth )					
@@ -430,10 +497,26 @@ protected:
 
 		int CalcNode( const grinliz::Rectangle2<U8>& bounds, int* depth );
 
+		// The tile index: a list of the items that cover each tile. The lists are
+		// kept in the order the tree walk finds them (deepest node first, then the
+		// order added) so a point query returns the same list either way.
+		struct TileRef {
+			MapItem*	item;
+			U32			serial;
+			int			depth;
+			int			next;	// index in tileRefs, -1 at the end
+		};
+		void AddTiles( MapItem* item, int depth );
+		void RemoveTiles( MapItem* item );
+
 		int			depthUse[QUAD_DEPTH];
 		int			depthBase[QUAD_DEPTH+1];
 		MapItem*	tree[NUM_QUAD_NODES];
-		const Model* filterModel;
+
+		int						tileHead[SIZE*SIZE];	// -1 if no items
+		CDynArray< TileRef >	tileRefs;
+		int						freeRef;				// free list in tileRefs
+		U32						serial;
 	};
 
 	SpaceTree*	tree;
@@ -484,10 +567,13 @@ private:
 	Surface backgroundSurface;		// background surface
 
 	Texture* greyTexture;			// version for previous seen terrain
-	Surface greySurface;
+	bool backgroundValid;			// false if the textures need to be uploaded
+	void UploadBackground();
+	void CalcGreySurface( Surface* grey );
 
-	void QueryAllDoors();			// figure out where the doors are, and write the doorArray
+	bool UpdateDoor( MapItem* door );	// opens or closes the door for the openers around it
 	CDynArray< MapItem* >	doorArr;
+	U8						openers[SIZE*SIZE];	// number of openers on each tile
 
 	enum { MAX_IMAGE_DATA = 16 };
 	struct ImageData {
@@ -505,30 +591,41 @@ private:
 
 	Surface lightFogMap;
 	Texture* lightFogMapTex;
+	bool lightFogMapValid;		// if false, GenerateSeenUnseen() rebuilds all of the lightFogMap
 
 	grinliz::BitArray<Map::SIZE, Map::SIZE, 1> fogOfWar;
 	grinliz::BitArray<Map::SIZE, Map::SIZE, 1> cachedFogOfWar;
 	grinliz::BitArray<Map::SIZE, Map::SIZE, 1> pastSeenFOW;
-	Surface lightObject;
 
 	U32 pathQueryID;
 	U32 visibilityQueryID;
 
+	// Throws away the pather cache of the tiles in 'bounds' and their neighbors.
+	// Falls back to ResetPath() once the abandoned cache would be more than a map.
+	void InvalidatePath( const grinliz::Rectangle2I& bounds );
+	int pathInvalidated;		// states invalidated since the last ResetPath()
+
 	micropather::MicroPather* microPather;
 	micropather::MPVector<void*> mpVector;
 
 	// 0x80 fire bit		(128)
 	// 0x40 flare bit		(64)
 	// duration: 1->64
-	int PyroOn( int x, int y ) const		{ return pyro[y*SIZE+x]; }
-	int PyroFire( int x, int y ) const		{ return pyro[y*SIZE+x] & 0x80; }
-	int PyroFlare( int x, int y ) const		{ return pyro[y*SIZE+x] & 0x40; }
-	bool PyroSmoke( int x, int y ) const	{ int p = pyro[y*SIZE+x]; return ((p & 0xC0) == 0) && (p>0); }
-	int PyroDuration( int x, int y ) const	{ return pyro[y*SIZE+x] & 0x3F; }
+	int PyroOn( int x, int y ) const		{ return tiles.At( x, y ).pyro; }
+	int PyroFire( int x, int y ) const		{ return tiles.At( x, y ).pyro & 0x80; }
+	int PyroFlare( int x, int y ) const		{ return tiles.At( x, y ).pyro & 0x40; }
+	bool PyroSmoke( int x, int y ) const	{ int p = tiles.At( x, y ).pyro; return ((p & 0xC0) == 0) && (p>0); }
+	int PyroDuration( int x, int y ) const	{ return tiles.At( x, y ).pyro & 0x3F; }
+
+	void ChangeObscured( const grinliz::Rectangle2I& bounds, int delta )	{ tiles.ChangeObscured( bounds, delta ); }
 
-	void ChangeObscured( const grinliz::Rectangle2I& bounds, int delta );
+	// Adds to the current change set, or patches the map now if there isn't one.
+	void NoteChange( const grinliz::Rectangle2I& bounds, int flags );
+	int											changeDepth;
+	int											bulkDepth;
+	MapChangeSet								pendingChange;
 
-	grinliz::BitArray<SIZE, SIZE, 1>			pathBlock;	// spaces the pather can't use (units are there)	
+	grinliz::BitArray<SIZE, SIZE, 1>			pathBlock;	// spaces the pather can't use (units are there), also TileGrid::PATH_BLOCKED
 
 	MP_VECTOR<void*>							mapPath;
 	MP_VECTOR< micropather::StateCost >			stateCostArr;
@@ -544,22 +641,33 @@ private:
 
 	ImageData imageData[ MAX_IMAGE_DATA ];
 
-	// U8:
+	// The pyro, obscured count, and vis and path masks of each tile.
+	// pyro is a U8:
 	// bits 0-6:	sub-turns remaining (0-127)		(0x7F)
 	// bit    7:	set: fire, clear: smoke			(0x80)
-	U8 pyro[SIZE*SIZE];
-	// This is a count. As an object (that obscures) is added, this gets added too.
-	// Subtracted back out when the object is removed.
-	U8 obscured[SIZE*SIZE];
-
-	U8									visMap[SIZE*SIZE];
-	U8									pathMap[SIZE*SIZE];
-
-	grinliz::Vector2F					mapVertex[(SIZE+1)*(SIZE+1)];		// in TEXTURE coordinates - need to scale up and swizzle for vertices.
-
-	U16									seenIndex[SIZE*SIZE*6];		
-	U16									unseenIndex[SIZE*SIZE*6];		
-	U16									pastSeenIndex[SIZE*SIZE*6];		
+	// The obscured count goes up as an object that obscures is added, and
+	// back down when it is removed.
+	TileGrid<SIZE>								tiles;
+	// The tiles (y*SIZE+x) with pyro set, so the sub-turn and the particles don't
+	// walk the whole map. Can hold tiles that have burned out; they are removed
+	// at the next sub-turn. 'pyroListed' marks the tiles in the list.
+	CDynArray< int >							pyroActive;
+	CDynArray< int >							pyroWork;
+	grinliz::BitArray<SIZE, SIZE, 1>			pyroListed;
+
+	// The seen, unseen and past seen parts of the map in use (width x height) are
+	// drawn from one vertex grid and index memory, allocated when the map is first
+	// drawn. A tile is in exactly one of the lists, so the three share the index
+	// memory: the seen quads, then the past seen, then the unseen.
+	const U16* SeenIndex() const		{ return mapIndex; }
+	const U16* PastSeenIndex() const	{ return mapIndex + nSeenIndex; }
+	const U16* UnseenIndex() const		{ return mapIndex + nSeenIndex + nPastSeenIndex; }
+	int RenderArenaSize() const;
+	void AllocRenderArena();
+	grinliz::Vector2F*					mapVertex;		// (width+1)*(height+1), in TEXTURE coordinates - need to scale up and swizzle for vertices.
+	U16*								mapIndex;		// width*height*6
+	U8*									renderArena;
+	int									renderArenaSize;
 };
 
 #endif // UFOATTACK_MAP_INCLUDED
@@ -85,7 +85,7 @@ int ModelResource::Intersect(	const grinliz::Vector3F& point,
 }
 
 
-void ModelLoader::Load( const gamedb::Item* item, ModelResource* res )
+void ModelLoader::LoadData( const gamedb::Item* item, ModelResource* res )
 {
 	res->header.Load( item );
 
@@ -111,21 +111,11 @@ void ModelLoader::Load( const gamedb::Item* item, ModelResource* res )
 		ModelGroup group;
 		group.Load( groupItem );
 
-		const char* textureName = group.textureName.c_str();
-		if ( !textureName[0] ) {
-			textureName = "white";
-		}
-
-		GLString base, texname, extension;
-		StrSplitFilename( GLString( textureName ), &base, &texname, &extension );
-		Texture* t = TextureManager::Instance()->GetTexture( texname.c_str() );
-
-		GLASSERT( t );                       
-		res->atom[i].texture = t;
+		res->atom[i].texture = 0;
 		res->atom[i].nVertex = group.nVertex;
 		res->atom[i].nIndex = group.nIndex;
 
-		//GLOUTPUT(( "  '%s' vertices=%d tris=%d\n", textureName, (int)res->atom[i].nVertex, (int)(res->atom[i].nIndex/3) ));
+		//GLOUTPUT(( "  '%s' vertices=%d tris=%d\n", group.textureName.c_str(), (int)res->atom[i].nVertex, (int)(res->atom[i].nIndex/3) ));
 	}
 
 	int vOffset = 0;
@@ -141,6 +131,28 @@ void ModelLoader::Load( const gamedb::Item* item, ModelResource* res )
 }
 
 
+void ModelLoader::LoadTextures( const gamedb::Item* item, ModelResource* res )
+{
+	for( U32 i=0; i<res->header.nGroups; ++i )
+	{
+		ModelGroup group;
+		group.Load( item->Child( i ) );
+
+		const char* textureName = group.textureName.c_str();
+		if ( !textureName[0] ) {
+			textureName = "white";
+		}
+
+		GLString base, texname, extension;
+		StrSplitFilename( GLString( textureName ), &base, &texname, &extension );
+		Texture* t = TextureManager::Instance()->GetTexture( texname.c_str() );
+
+		GLASSERT( t );                       
+		res->atom[i].texture = t;
+	}
+}
+
+
 Model::Model()		
 {	
 	// WARNING: in the normal case, the constructor isn't called. Models usually come from a pool!
@@ -125,7 +125,12 @@ public:
 	ModelLoader() 	{}
 	~ModelLoader()	{}
 
-	void Load( const gamedb::Item*, ModelResource* res );
+	// Reads the vertices and indices of the model. Can be called from any thread.
+	void LoadData( const gamedb::Item*, ModelResource* res );
+	// Sets the textures of the groups, from the TextureManager. Main thread only.
+	void LoadTextures( const gamedb::Item*, ModelResource* res );
+
+	void Load( const gamedb::Item* item, ModelResource* res )	{ LoadData( item, res ); LoadTextures( item, res ); }
 
 private:
 };
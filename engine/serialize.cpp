@@ -18,8 +18,10 @@
 #include <string.h>
 #include "serialize.h"
 #include "../grinliz/glstringutil.h"
+#include "../shared/glmap.h"
 
 using namespace grinliz;
+using namespace tinyxml2;
 
 void ModelHeader::Load( const gamedb::Item* item )
 {
@@ -68,6 +70,332 @@ void ModelGroup::Load( const gamedb::Item* item )
 }
 
 
+BinaryXMLPrinter::BinaryXMLPrinter() : XMLPrinter( 0, true ), depth( 0 )
+{
+	int* table = hashTable.PushArr( 256 );
+	memset( table, 0, 256*sizeof(int) );
+}
+
+
+int BinaryXMLPrinter::Intern( const char* str )
+{
+	// Open addressing, kept under half full.
+	int mask = hashTable.Size()-1;
+	int i = CMapBase::HashStr( str ) & mask;
+	while ( hashTable[i] ) {
+		int index = hashTable[i]-1;
+		if ( StrEqual( strings.Mem() + stringOffset[index], str ) )
+			return index;
+		i = (i+1) & mask;
+	}
+
+	int index = stringOffset.Size();
+	stringOffset.Push( strings.Size() );
+	int len = strlen( str ) + 1;
+	memcpy( strings.PushArr( len ), str, len );
+	hashTable[i] = index+1;
+
+	if ( stringOffset.Size()*2 > hashTable.Size() ) {
+		int size = hashTable.Size()*2;
+		hashTable.Clear();
+		int* table = hashTable.PushArr( size );
+		memset( table, 0, size*sizeof(int) );
+		for( int k=0; k<stringOffset.Size(); ++k ) {
+			int j = CMapBase::HashStr( strings.Mem() + stringOffset[k] ) & (size-1);
+			while ( table[j] )
+				j = (j+1) & (size-1);
+			table[j] = k+1;
+		}
+	}
+	return index;
+}
+
+
+void BinaryXMLPrinter::OpenElement( const char* name )
+{
+	WriteOp( OP_OPEN, name );
+	++depth;
+}
+
+
+void BinaryXMLPrinter::CloseElement()
+{
+	GLASSERT( depth > 0 );
+	tree.Push( OP_CLOSE );
+	--depth;
+}
+
+
+void BinaryXMLPrinter::PushAttribute( const char* name, const char* value )
+{
+	WriteOp( OP_ATTR_STRING, name );
+	WriteVar( Intern( value ) );
+}
+
+
+void BinaryXMLPrinter::PushAttribute( const char* name, int value )
+{
+	// Zig-zag, so small negative numbers are small too.
+	WriteOp( OP_ATTR_INT, name );
+	WriteVar( ( (U32)value << 1 ) ^ (U32)( value >> 31 ) );
+}
+
+
+void BinaryXMLPrinter::PushAttribute( const char* name, unsigned value )
+{
+	WriteOp( OP_ATTR_UINT, name );
+	WriteVar( value );
+}
+
+
+void BinaryXMLPrinter::PushAttribute( const char* name, bool value )
+{
+	WriteOp( value ? OP_ATTR_TRUE : OP_ATTR_FALSE, name );
+}
+
+
+void BinaryXMLPrinter::PushAttribute( const char* name, double value )
+{
+	WriteOp( OP_ATTR_DOUBLE, name );
+	U8* p = tree.PushArr( 8 );
+	memcpy( p, &value, 8 );
+}
+
+
+void BinaryXMLPrinter::PushText( const char* text, bool /*cdata*/ )
+{
+	tree.Push( OP_TEXT );
+	WriteVar( Intern( text ) );
+}
+
+
+static int VarSize( U32 v )
+{
+	int n = 1;
+	while( v >= 0x80 ) { v >>= 7; ++n; }
+	return n;
+}
+
+
+static void WriteU32( U8* p, U32 v )
+{
+	p[0] = (U8)v;
+	p[1] = (U8)(v>>8);
+	p[2] = (U8)(v>>16);
+	p[3] = (U8)(v>>24);
+}
+
+
+int BinaryXMLPrinter::SaveSize() const
+{
+	return 8 + 8 + VarSize( stringOffset.Size() ) + strings.Size() + 8 + tree.Size();
+}
+
+
+void BinaryXMLPrinter::Save( CDynArray< U8 >* mem ) const
+{
+	GLASSERT( depth == 0 );
+	int nCount = VarSize( stringOffset.Size() );
+	U8* p = mem->PushArr( SaveSize() );
+
+	WriteU32( p, MAGIC );		p += 4;
+	WriteU32( p, VERSION );		p += 4;
+
+	WriteU32( p, CHUNK_STRINGS );			p += 4;
+	WriteU32( p, nCount + strings.Size() );	p += 4;
+	for( U32 v = stringOffset.Size(); v >= 0x80; v >>= 7 ) {
+		*p++ = (U8)(v|0x80);
+	}
+	*p++ = (U8)( stringOffset.Size() >> ( 7*(nCount-1) ) );
+	memcpy( p, strings.Mem(), strings.Size() );	p += strings.Size();
+
+	WriteU32( p, CHUNK_TREE );	p += 4;
+	WriteU32( p, tree.Size() );	p += 4;
+	memcpy( p, tree.Mem(), tree.Size() );
+}
+
+
+bool BinaryXMLPrinter::Save( FILE* fp ) const
+{
+	CDynArray< U8 > mem( SaveSize() );
+	Save( &mem );
+	return fwrite( mem.Mem(), mem.Size(), 1, fp ) == 1;
+}
+
+
+class BinaryXMLReader
+{
+public:
+	BinaryXMLReader( const U8* p, const U8* end ) : p( p ), end( end ), error( false ) {}
+
+	bool Error() const	{ return error; }
+	bool Done() const	{ return p >= end; }
+
+	U32 ReadU32() {
+		if ( end - p < 4 ) { error = true; p = end; return 0; }
+		U32 v = p[0] | (p[1]<<8) | (p[2]<<16) | (p[3]<<24);
+		p += 4;
+		return v;
+	}
+	int ReadU8() {
+		if ( p >= end ) { error = true; return 0; }
+		return *p++;
+	}
+	U32 ReadVar() {
+		U32 v = 0;
+		for( int shift=0; shift<35; shift+=7 ) {
+			int b = ReadU8();
+			v |= (U32)(b & 0x7f) << shift;
+			if ( !(b & 0x80) )
+				return v;
+		}
+		error = true;
+		return 0;
+	}
+	const U8* Skip( int n ) {
+		if ( n < 0 || end - p < n ) { error = true; p = end; return 0; }
+		const U8* r = p;
+		p += n;
+		return r;
+	}
+
+private:
+	const U8* p;
+	const U8* end;
+	bool error;
+};
+
+
+bool BinaryXMLPrinter::IsBinary( const void* mem, int size )
+{
+	BinaryXMLReader reader( (const U8*)mem, (const U8*)mem + size );
+	return reader.ReadU32() == MAGIC && !reader.Error();
+}
+
+
+bool BinaryXMLPrinter::Load( const void* mem, int size, XMLDocument* doc )
+{
+	BinaryXMLReader file( (const U8*)mem, (const U8*)mem + size );
+	if ( file.ReadU32() != MAGIC || file.ReadU32() > VERSION || file.Error() ) {
+		GLOUTPUT(( "BinaryXML: bad magic or version.\n" ));
+		return false;
+	}
+
+	CDynArray< const char* > str;
+	const U8* treeMem = 0;
+	int treeSize = 0;
+
+	while( !file.Done() && !file.Error() ) {
+		U32 id = file.ReadU32();
+		int chunkSize = (int)file.ReadU32();
+		const U8* chunk = file.Skip( chunkSize );
+		if ( !chunk )
+			break;
+
+		if ( id == CHUNK_STRINGS ) {
+			BinaryXMLReader reader( chunk, chunk + chunkSize );
+			U32 count = reader.ReadVar();
+			const char* s = (const char*)reader.Skip( 0 );
+			const char* sEnd = (const char*)chunk + chunkSize;
+			for( U32 i=0; i<count && s && s<sEnd; ++i ) {
+				str.Push( s );
+				const char* z = (const char*)memchr( s, 0, sEnd - s );
+				s = z ? z+1 : 0;
+			}
+			if ( str.Size() != (int)count || !s ) {
+				GLOUTPUT(( "BinaryXML: bad string table.\n" ));
+				return false;
+			}
+		}
+		else if ( id == CHUNK_TREE ) {
+			treeMem = chunk;
+			treeSize = chunkSize;
+		}
+	}
+	if ( file.Error() || !treeMem ) {
+		GLOUTPUT(( "BinaryXML: truncated file.\n" ));
+		return false;
+	}
+
+	doc->DeleteChildren();
+	CDynArray< XMLNode* > stack;
+	stack.Push( doc );
+	XMLElement* element = 0;
+
+	BinaryXMLReader reader( treeMem, treeMem + treeSize );
+	while( !reader.Done() && !reader.Error() ) {
+		int op = reader.ReadU8();
+		if ( op == OP_CLOSE ) {
+			if ( stack.Size() <= 1 ) 
+				return false;
+			stack.Pop();
+			element = 0;
+			continue;
+		}
+
+		U32 name = reader.ReadVar();
+		if ( name >= (U32)str.Size() )
+			return false;
+		if ( op >= OP_ATTR_STRING && !element )
+			return false;
+
+		switch( op ) {
+			case OP_OPEN:
+				element = doc->NewElement( str[name] );
+				stack[stack.Size()-1]->InsertEndChild( element );
+				stack.Push( element );
+				break;
+
+			case OP_TEXT:
+				stack[stack.Size()-1]->InsertEndChild( doc->NewText( str[name] ) );
+				element = 0;
+				break;
+
+			case OP_ATTR_STRING:
+				{
+					U32 value = reader.ReadVar();
+					if ( value >= (U32)str.Size() )
+						return false;
+					element->SetAttribute( str[name], str[value] );
+				}
+				break;
+
+			case OP_ATTR_INT:
+				{
+					U32 v = reader.ReadVar();
+					element->SetAttribute( str[name], (int)( ( v >> 1 ) ^ ( 0 - ( v & 1 ) ) ) );
+				}
+				break;
+
+			case OP_ATTR_UINT:
+				element->SetAttribute( str[name], (unsigned)reader.ReadVar() );
+				break;
+
+			case OP_ATTR_TRUE:
+			case OP_ATTR_FALSE:
+				element->SetAttribute( str[name], op == OP_ATTR_TRUE );
+				break;
+
+			case OP_ATTR_DOUBLE:
+				{
+					const U8* p = reader.Skip( 8 );
+					if ( !p )
+						return false;
+					double d;
+					memcpy( &d, p, 8 );
+					element->SetAttribute( str[name], d );
+				}
+				break;
+
+			default:
+				GLOUTPUT(( "BinaryXML: bad op %d.\n", op ));
+				return false;
+		}
+	}
+	return !reader.Error() && stack.Size() == 1;
+}
+
+
 /*
 void XMLUtil::OpenElement( FILE* fp, int depth, const char* value )
 {
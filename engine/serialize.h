@@ -27,7 +27,9 @@
 #include "../grinliz/glvector.h"
 #include "../grinliz/glstringutil.h"
 #include "../shared/gamedbreader.h"
+#include "../tinyxml2/tinyxml2.h"
 #include "enginelimits.h"
+#include "ufoutil.h"
 
 struct SDL_RWops;
 
@@ -70,6 +72,76 @@ struct ModelHeader
 
 #define XML_PUSH_ATTRIB( printer, value ) { printer->PushAttribute( #value, value ); }
 
+
+/*	The saved games are written with the XMLPrinter, but stored in a compact
+	binary form. BinaryXMLPrinter collects the printer calls and Save() writes:
+
+		U32 magic ("UFOB"), U32 version
+		chunks of: U32 id, U32 size, data
+			STRS	varint count, then the null terminated strings
+			TREE	the ops: open element, attribute, text, close element
+
+	Element names, attribute names and string values go in the string table
+	once and are referred to by index. Integers are varints and doubles are
+	stored exactly. Unknown chunks are skipped, so chunks can be added.
+
+	Load() builds the XMLDocument straight from the ops: there is no text to
+	parse, and the Load() code of the scenes doesn't change. Writing the same
+	stream with a plain XMLPrinter gives the XML, which is handy for debugging.
+*/
+class BinaryXMLPrinter : public tinyxml2::XMLPrinter
+{
+public:
+	BinaryXMLPrinter();
+	virtual ~BinaryXMLPrinter()	{}
+
+	virtual void OpenElement( const char* name );
+	virtual void PushAttribute( const char* name, const char* value );
+	virtual void PushAttribute( const char* name, int value );
+	virtual void PushAttribute( const char* name, unsigned value );
+	virtual void PushAttribute( const char* name, bool value );
+	virtual void PushAttribute( const char* name, double value );
+	virtual void CloseElement();
+	virtual void PushText( const char* text, bool cdata=false );
+	using tinyxml2::XMLPrinter::PushText;
+
+	bool Save( FILE* fp ) const;
+	void Save( CDynArray< U8 >* mem ) const;	// appends the file to 'mem'
+	int SaveSize() const;						// size of the file Save() writes
+
+	static bool IsBinary( const void* mem, int size );
+	static bool Load( const void* mem, int size, tinyxml2::XMLDocument* doc );
+
+private:
+	enum {
+		MAGIC			= 0x424f4655,	// "UFOB"
+		VERSION			= 1,
+		CHUNK_STRINGS	= 0x53525453,	// "STRS"
+		CHUNK_TREE		= 0x45455254,	// "TREE"
+
+		OP_OPEN = 1,
+		OP_CLOSE,
+		OP_TEXT,
+		OP_ATTR_STRING,
+		OP_ATTR_INT,
+		OP_ATTR_UINT,
+		OP_ATTR_TRUE,
+		OP_ATTR_FALSE,
+		OP_ATTR_DOUBLE
+	};
+
+	int Intern( const char* str );
+	void WriteVar( U32 v )			{ while( v >= 0x80 ) { tree.Push( (U8)(v|0x80) ); v >>= 7; } tree.Push( (U8)v ); }
+	void WriteOp( int op, const char* name )	{ tree.Push( (U8)op ); WriteVar( Intern( name ) ); }
+
+	CDynArray< U8 >		tree;
+	CDynArray< char >	strings;		// the string table, null terminated strings
+	CDynArray< int >	stringOffset;	// offset of each string in 'strings'
+	CDynArray< int >	hashTable;		// string index+1, or 0 if empty
+	int					depth;
+};
+
+
 /*
 class XMLUtil
 {
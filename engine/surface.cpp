@@ -134,10 +134,11 @@ void Surface::Load( const gamedb::Item* node )
 
 	Set( Surface::QueryFormat( formatBuf.c_str() ), w, h );
 		
-	int size = node->GetDataSize( "pixels" );
-	GLASSERT( size == BytesInImage() );
+	// Through the data cache: the same light maps are loaded for many missions.
+	gamedb::DataHandle pixels = gamedb::Reader::GetContext( node )->CacheData( node, "pixels" );
+	GLASSERT( pixels.Size() == BytesInImage() );
 
-	node->GetData( "pixels", Pixels(), size );
+	memcpy( Pixels(), pixels.Data(), pixels.Size() );
 }
 
 
@@ -165,5 +166,7 @@ void ImageManager::LoadImage( const char* name, Surface* surface )
 	const gamedb::Item* item = textures->Child( name );
 	GLASSERT( item );
 	item = database->ChainItem( item ); 
+
+	grinliz::MutexLock lock( &mutex );
 	surface->Load( item );
 }
@@ -22,6 +22,7 @@
 #include "../grinliz/glrectangle.h"
 #include "../grinliz/glvector.h"
 #include "../grinliz/glstringutil.h"
+#include "../grinliz/glthread.h"
 
 #include "../shared/glmap.h"
 #include "../engine/ufoutil.h"
@@ -191,6 +192,7 @@ class ImageManager
 public:
 	static ImageManager* Instance()	{ GLASSERT( instance ); return instance; }
 
+	// Can be called from any thread.
 	void LoadImage( const char* name, Surface* surface );
 
 	static void Create(  const gamedb::Reader* db );
@@ -201,6 +203,7 @@ private:
 
 	static ImageManager* instance;
 	const gamedb::Reader* database;
+	grinliz::Mutex mutex;		// the Reader's data cache is used by one thread at a time
 };
 
 #endif // UFOATTACK_SURFACE_INCLUDED
\ No newline at end of file
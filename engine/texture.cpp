@@ -287,7 +287,7 @@ U32 Texture::GLID()
 			const gamedb::Reader* database = gamedb::Reader::GetContext( m_item );
 			GLASSERT( m_item->HasAttribute( "pixels" ) );
 			int size;
-			const void* pixels = database->AccessData( m_item, "pixels", &size );
+			const void* pixels = database->AccessBinary( m_item, "pixels", &size );
 			Upload( pixels, size );
 		}
 		else if ( m_creator ) {
@@ -426,6 +426,31 @@ void Texture::Upload( const Surface& surface )
 }
 
 
+void Texture::Upload( const Surface& surface, int y0, int y1 )
+{
+	GLASSERT( surface.Width() == m_w && surface.Height() == m_h );
+	GLASSERT( y0 >= 0 && y0 <= y1 && y1 < m_h );
+
+	if ( !m_gpuMem ) {
+		// Lost the GPU memory; getting it back uploads the whole texture.
+		GLID();
+		return;
+	}
+
+	int glFormat, glType;
+	TextureManager::Instance()->CalcOpenGL( m_format, &glFormat, &glType );
+	glBindTexture( GL_TEXTURE_2D, m_gpuMem->glID );
+	glTexSubImage2D(	GL_TEXTURE_2D,
+						0,
+						0, y0,
+						m_w, y1-y0+1,
+						glFormat,
+						glType,
+						surface.Pixels() + y0*surface.Pitch() );
+	CHECK_GL_ERROR;
+}
+
+
 U32 TextureManager::CalcTextureMem() const
 {
 	U32 mem = 0;
@@ -48,6 +48,8 @@ public:
 
 	void Upload( const void* mem, int size );
 	void Upload( const Surface& surface );
+	// Uploads rows y0 through y1 (inclusive, in texture/memory order) of the surface.
+	void Upload( const Surface& surface, int y0, int y1 );
 	bool Empty() const			{ return m_creator == 0 && m_item == 0 && m_gpuMem == 0 && m_name.empty(); }
 
 	U32 GLID();
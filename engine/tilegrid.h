@@ -0,0 +1,101 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef UFOATTACK_TILEGRID_INCLUDED
+#define UFOATTACK_TILEGRID_INCLUDED
+
+#include <string.h>
+#include "../grinliz/gldebug.h"
+#include "../grinliz/gltypes.h"
+#include "../grinliz/glrectangle.h"
+
+
+/*	The per-tile state the visibility, pather and fire code read together:
+	the pyro, the obscured count, and the vis and path masks. One 4 byte
+	Tile holds all of them, and the tiles are stored in 8x8 blocks, so a
+	tile and its neighbors (in any direction) are usually in the same
+	256 byte block, rather than spread over 4 arrays of SIZE strided rows.
+
+	Always addressed by (x,y); the block layout is private.
+*/
+template< int SIZE >
+class TileGrid
+{
+public:
+	struct Tile {
+		U8 pyro;		// see Map::SetPyro
+		U8 obscured;	// count of the items obscuring the tile
+		U8 vis;			// visibility mask
+		U8 path;		// path mask, and PATH_BLOCKED
+	};
+	enum {
+		PATH_MASK		= 0x0f,
+		PATH_BLOCKED	= 0x10,		// a unit is on the tile (see Map::SetPathBlocks)
+
+		BLOCK_LOG2		= 3,
+		BLOCK			= 1<<BLOCK_LOG2,
+		BLOCKS			= SIZE / BLOCK
+	};
+
+	TileGrid()		{ GLASSERT( SIZE % BLOCK == 0 ); Clear(); }
+
+	void Clear()	{ memset( tiles, 0, sizeof( tiles ) ); }
+
+	Tile& At( int x, int y )				{ return tiles[ Index( x, y ) ]; }
+	const Tile& At( int x, int y ) const	{ return tiles[ Index( x, y ) ]; }
+
+	// Clears the vis and path masks (but not PATH_BLOCKED) in 'b'.
+	void ClearVisPath( const grinliz::Rectangle2I& b ) {
+		for( int y=b.min.y; y<=b.max.y; ++y ) {
+			for( int x=b.min.x; x<=b.max.x; ++x ) {
+				Tile* t = &tiles[ Index( x, y ) ];
+				t->vis = 0;
+				t->path &= PATH_BLOCKED;
+			}
+		}
+	}
+
+	void ChangeObscured( const grinliz::Rectangle2I& b, int delta ) {
+		for( int y=b.min.y; y<=b.max.y; ++y ) {
+			for( int x=b.min.x; x<=b.max.x; ++x ) {
+				tiles[ Index( x, y ) ].obscured += delta;
+			}
+		}
+	}
+
+	void ClearObscured() {
+		for( int i=0; i<SIZE*SIZE; ++i )
+			tiles[i].obscured = 0;
+	}
+
+	// Copies one field out in row order (y*SIZE+x), for hashing.
+	void GetRows( U8 Tile::*field, U8* out ) const {
+		for( int y=0; y<SIZE; ++y )
+			for( int x=0; x<SIZE; ++x )
+				*out++ = tiles[ Index( x, y ) ].*field;
+	}
+
+private:
+	static int Index( int x, int y ) {
+		GLASSERT( x >= 0 && x < SIZE && y >= 0 && y < SIZE );
+		return   ( ( (y>>BLOCK_LOG2)*BLOCKS + (x>>BLOCK_LOG2) ) << (BLOCK_LOG2*2) )
+			   + ( (y&(BLOCK-1)) << BLOCK_LOG2 )
+			   + ( x&(BLOCK-1) );
+	}
+
+	Tile tiles[ SIZE*SIZE ];
+};
+
+#endif // UFOATTACK_TILEGRID_INCLUDED
@@ -146,6 +146,7 @@ public:
 	}
 
 	int Size() const		{ return (int)size; }
+	int Capacity() const	{ return (int)(capInBytes / sizeof(T)); }
 	void Trim( int sz )		{ GLASSERT( sz <= (int)size );
 							  size = (unsigned)sz;
 							}
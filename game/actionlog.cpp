@@ -0,0 +1,364 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "actionlog.h"
+
+#include <stdarg.h>
+#include <string.h>
+
+using namespace grinliz;
+
+
+ActionLog::ActionLog()
+{
+	recording = false;
+	playing = false;
+	seed = 0;
+	teamAI = 0;
+	savedSize = -1;
+	readPos = 0;
+	readPastEnd = false;
+	errorPos = -1;
+	errorReason = "";
+
+	frameStart = 0;
+	totalTime = 0;
+	maxFrame = 0;
+	nFrames = 0;
+	nTurns = 0;
+	nMismatch = 0;
+}
+
+
+void ActionLog::WriteU16( int v )
+{
+	data.Push( (U8)(v & 0xff) );
+	data.Push( (U8)((v>>8) & 0xff) );
+}
+
+
+void ActionLog::WriteU32( U32 v )
+{
+	for( int i=0; i<4; ++i ) {
+		data.Push( (U8)(v & 0xff) );
+		v >>= 8;
+	}
+}
+
+
+void ActionLog::WriteFloat( float v )
+{
+	// The exact bits: a replay is only useful if it is exact.
+	U32 u;
+	memcpy( &u, &v, 4 );
+	WriteU32( u );
+}
+
+
+/*static*/ void ActionLog::Print( FILE* fp, const char* format, ... )
+{
+	va_list va;
+	va_start( va, format );
+	vfprintf( fp ? fp : stderr, format, va );
+	va_end( va );
+}
+
+
+int ActionLog::ReadU8()
+{
+	if ( readPos >= data.Size() ) {
+		readPastEnd = true;
+		return 0;
+	}
+	return data[readPos++];
+}
+
+
+int ActionLog::ReadU16()
+{
+	int v = ReadU8();
+	v |= ReadU8() << 8;
+	return v;
+}
+
+
+U32 ActionLog::ReadU32()
+{
+	U32 v = 0;
+	for( int i=0; i<4; ++i ) {
+		v |= (U32)ReadU8() << (i*8);
+	}
+	return v;
+}
+
+
+float ActionLog::ReadFloat()
+{
+	U32 u = ReadU32();
+	float v;
+	memcpy( &v, &u, 4 );
+	return v;
+}
+
+
+void ActionLog::StartRecording( U32 seed, U32 teamAI, const char* stateStr, int stateLen )
+{
+	GLASSERT( !playing );
+	recording = true;
+	this->seed = seed;
+	this->teamAI = teamAI;
+
+	state.Clear();
+	char* p = state.PushArr( stateLen+1 );
+	memcpy( p, stateStr, stateLen );
+	p[stateLen] = 0;
+	data.Clear();
+	savedSize = -1;
+}
+
+
+void ActionLog::RecordTurn( int team, U32 hash )
+{
+	if ( !recording ) return;
+	WriteU8( REC_TURN );
+	WriteU8( team );
+	WriteU32( hash );
+}
+
+
+void ActionLog::RecordMove( int unit, const U8* pathData, int pathLen )
+{
+	if ( !recording ) return;
+	WriteU8( REC_MOVE );
+	WriteU8( unit );
+	WriteU16( pathLen );
+	for( int i=0; i<pathLen*2; ++i ) {
+		WriteU8( pathData[i] );
+	}
+}
+
+
+void ActionLog::RecordRotate( int unit, float rotation )
+{
+	if ( !recording ) return;
+	WriteU8( REC_ROTATE );
+	WriteU8( unit );
+	WriteFloat( rotation );
+}
+
+
+void ActionLog::RecordShoot( int unit, int mode, const Vector3F& target, float width, float height, float error )
+{
+	if ( !recording ) return;
+	WriteU8( REC_SHOOT );
+	WriteU8( unit );
+	WriteU8( mode );
+	WriteFloat( target.x );
+	WriteFloat( target.y );
+	WriteFloat( target.z );
+	WriteFloat( width );
+	WriteFloat( height );
+	WriteFloat( error );
+}
+
+
+void ActionLog::RecordPsi( int unit, int target )
+{
+	if ( !recording ) return;
+	WriteU8( REC_PSI );
+	WriteU8( unit );
+	WriteU8( target );
+}
+
+
+void ActionLog::RecordInventory( int unit )
+{
+	if ( !recording ) return;
+	WriteU8( REC_INVENTORY );
+	WriteU8( unit );
+}
+
+
+void ActionLog::Save( FILE* fp )
+{
+	if ( !Saved() ) {
+		U8 header[HEADER_SIZE];
+		U32 v[5] = { MAGIC, VERSION, seed, teamAI, (U32)(state.Size() ? state.Size()-1 : 0) };
+		for( int i=0; i<5; ++i ) {
+			for( int k=0; k<4; ++k ) {
+				header[i*4+k] = (U8)((v[i] >> (k*8)) & 0xff);
+			}
+		}
+		fwrite( header, HEADER_SIZE, 1, fp );
+		if ( v[4] )
+			fwrite( state.Mem(), v[4], 1, fp );
+		savedSize = 0;
+	}
+	if ( data.Size() > savedSize )
+		fwrite( data.Mem()+savedSize, data.Size()-savedSize, 1, fp );
+	savedSize = data.Size();
+}
+
+
+bool ActionLog::Load( FILE* fp )
+{
+	GLASSERT( !recording );
+
+	fseek( fp, 0, SEEK_END );
+	long size = ftell( fp );
+	fseek( fp, 0, SEEK_SET );
+	if ( size < HEADER_SIZE )
+		return false;
+
+	data.Clear();
+	U8* mem = data.PushArr( (int)size );
+	if ( fread( mem, size, 1, fp ) != 1 )
+		return false;
+
+	readPos = 0;
+	readPastEnd = false;
+	errorPos = -1;
+	U32 magic = ReadU32();
+	U32 version = ReadU32();
+	if ( magic != MAGIC || version != VERSION ) {
+		GLOUTPUT(( "ActionLog: bad magic or version.\n" ));
+		return false;
+	}
+	seed = ReadU32();
+	teamAI = ReadU32();
+	int stateLen = (int)ReadU32();
+	if ( stateLen < 0 || stateLen > data.Size() - readPos ) {
+		GLOUTPUT(( "ActionLog: bad state length.\n" ));
+		return false;
+	}
+
+	state.Clear();
+	char* p = state.PushArr( stateLen+1 );
+	memcpy( p, data.Mem() + readPos, stateLen );
+	p[stateLen] = 0;
+	readPos += stateLen;
+
+	playing = true;
+	return true;
+}
+
+
+bool ActionLog::Next( Record* r )
+{
+	GLASSERT( playing );
+	memset( r, 0, sizeof( *r ) );
+	if ( Error() || readPos >= data.Size() )
+		return false;
+
+	int start = readPos;
+	r->type = ReadU8();
+	switch( r->type ) {
+		case REC_TURN:
+			r->team = ReadU8();
+			r->hash = ReadU32();
+			break;
+
+		case REC_MOVE:
+			r->unit = ReadU8();
+			r->pathLen = ReadU16();
+			if ( r->pathLen*2 > data.Size() - readPos ) {
+				readPastEnd = true;
+			}
+			else {
+				r->pathData = data.Mem() + readPos;
+				readPos += r->pathLen*2;
+			}
+			break;
+
+		case REC_ROTATE:
+			r->unit = ReadU8();
+			r->rotation = ReadFloat();
+			break;
+
+		case REC_SHOOT:
+			r->unit = ReadU8();
+			r->mode = ReadU8();
+			r->pos.x = ReadFloat();
+			r->pos.y = ReadFloat();
+			r->pos.z = ReadFloat();
+			r->width = ReadFloat();
+			r->height = ReadFloat();
+			r->error = ReadFloat();
+			break;
+
+		case REC_PSI:
+			r->unit = ReadU8();
+			r->target = ReadU8();
+			break;
+
+		case REC_INVENTORY:
+			r->unit = ReadU8();
+			break;
+
+		default:
+			readPos = start;
+			SetError( "bad record type" );
+			return false;
+	}
+	if ( readPastEnd ) {
+		readPos = start;
+		SetError( "record past the end of the log" );
+		return false;
+	}
+	return true;
+}
+
+
+void ActionLog::SetError( const char* reason )
+{
+	if ( !Error() ) {
+		errorPos = readPos;
+		errorReason = reason;
+	}
+	readPos = data.Size();
+}
+
+
+void ActionLog::EndFrame()
+{
+	TimeUnit t = FastTime() - frameStart;
+	totalTime += t;
+	if ( t > maxFrame )
+		maxFrame = t;
+	++nFrames;
+}
+
+
+void ActionLog::CheckHash( U32 expected, U32 actual, FILE* fp )
+{
+	++nTurns;
+	if ( expected != actual ) {
+		++nMismatch;
+		Print( fp, "ActionLog: turn %d hash mismatch. expected=%08x actual=%08x\n", nTurns, expected, actual );
+	}
+}
+
+
+void ActionLog::Report( FILE* fp ) const
+{
+	if ( Error() ) {
+		Print( fp, "ActionLog: replay stopped at offset %d: %s\n", errorPos, errorReason );
+	}
+	Print( fp, "ActionLog replay: turns=%d mismatches=%d frames=%d total=%d kClocks avg=%d kClocks max=%d kClocks\n",
+		   nTurns, nMismatch, nFrames,
+		   (int)(totalTime/1000),
+		   nFrames ? (int)(totalTime/nFrames/1000) : 0,
+		   (int)(maxFrame/1000) );
+}
@@ -0,0 +1,154 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef UFO_ACTION_LOG_INCLUDED
+#define UFO_ACTION_LOG_INCLUDED
+
+#include <stdio.h>
+
+#include "../grinliz/gldebug.h"
+#include "../grinliz/gltypes.h"
+#include "../grinliz/glvector.h"
+#include "../grinliz/glperformance.h"
+#include "../engine/ufoutil.h"
+
+
+/*	A compact binary log of the commands given in a tactical battle, by the
+	player and by the AI, so the battle can be replayed and the cost of the
+	game logic compared between builds.
+
+	The log starts with the seed of the battle random number generator, the
+	teams played by the AI, and the saved state of the battle (the BattleScene
+	XML) at the start of the recording. Then a list of records:
+		TURN		team, state hash after the turn change
+		MOVE		unit, path
+		ROTATE		unit, rotation
+		SHOOT		unit, mode, target, target size, error
+		PSI			unit, target unit
+		INVENTORY	unit (AI inventory management)
+
+	Reaction fire, explosions and so on are not recorded: they follow from
+	the commands, which is what the state hashes check.
+
+	All values are written little endian. The log is saved as it is
+	recorded: the first Save() writes the header and the state, and later
+	ones append the new records.
+
+	A replay log is read with real bounds checks: a truncated or corrupt log
+	ends the replay, and the error is in the Report().
+*/
+class ActionLog
+{
+public:
+	enum {
+		REC_NONE,
+		REC_TURN,
+		REC_MOVE,
+		REC_ROTATE,
+		REC_SHOOT,
+		REC_PSI,
+		REC_INVENTORY,
+		REC_COUNT
+	};
+
+	struct Record {
+		int					type;
+		int					unit;
+		int					team;		// TURN
+		U32					hash;		// TURN
+		int					mode;		// SHOOT
+		int					target;		// PSI
+		float				rotation;	// ROTATE
+		grinliz::Vector3F	pos;		// SHOOT
+		float				width;		// SHOOT
+		float				height;		// SHOOT
+		float				error;		// SHOOT
+		int					pathLen;	// MOVE
+		const U8*			pathData;	// MOVE, 2 bytes (x,y) per step. Points into the log.
+	};
+
+	ActionLog();
+	~ActionLog()	{}
+
+	bool Recording() const	{ return recording; }
+	bool Playing() const	{ return playing; }
+
+	// Recording.
+	void StartRecording( U32 seed, U32 teamAI, const char* state, int stateLen );
+	void RecordTurn( int team, U32 hash );
+	void RecordMove( int unit, const U8* pathData, int pathLen );
+	void RecordRotate( int unit, float rotation );
+	void RecordShoot( int unit, int mode, const grinliz::Vector3F& target, float width, float height, float error );
+	void RecordPsi( int unit, int target );
+	void RecordInventory( int unit );
+	// Writes what hasn't been saved. Open the file to write if nothing has
+	// been Saved(), and to append after that.
+	void Save( FILE* fp );
+	bool Saved() const			{ return savedSize >= 0; }
+
+	// Playback.
+	bool Load( FILE* fp );
+	U32 Seed() const			{ return seed; }
+	bool TeamAI( int team ) const	{ return ( teamAI & (1<<team) ) != 0; }
+	const char* State() const	{ return state.Mem(); }		// null terminated
+	bool Next( Record* record );	// returns false at the end of the log, or an error
+	bool Error() const			{ return errorPos >= 0; }
+
+	// Called by the TacticalReplay: the frame timing and the hash
+	// checks are summarized by Report(). A mismatch, and the report,
+	// are written to 'fp' in every build, or stderr if 'fp' is null.
+	void BeginFrame()			{ frameStart = grinliz::FastTime(); }
+	void EndFrame();
+	void CheckHash( U32 expected, U32 actual, FILE* fp );
+	void SetError( const char* reason );	// the replay driver found a bad record
+	void Report( FILE* fp ) const;
+
+private:
+	enum { MAGIC = 0x4c4f4655, VERSION = 3, HEADER_SIZE = 20 };	// "UFOL"
+
+	void WriteU8( int v )		{ data.Push( (U8)v ); }
+	void WriteU16( int v );
+	void WriteU32( U32 v );
+	void WriteFloat( float v );
+
+	static void Print( FILE* fp, const char* format, ... );
+
+	int  ReadU8();
+	int  ReadU16();
+	U32  ReadU32();
+	float ReadFloat();
+
+	bool recording;
+	bool playing;
+	U32	 seed;
+	U32	 teamAI;		// bit per team
+	CDynArray< char >	state;
+	CDynArray< U8 >		data;
+	int					savedSize;		// the records already saved, or -1 if nothing is
+	int					readPos;
+	bool				readPastEnd;
+	int					errorPos;		// where the log was bad, or -1
+	const char*			errorReason;
+
+	grinliz::TimeUnit	frameStart;
+	grinliz::TimeUnit	totalTime;
+	grinliz::TimeUnit	maxFrame;
+	int					nFrames;
+	int					nTurns;
+	int					nMismatch;
+};
+
+
+#endif // UFO_ACTION_LOG_INCLUDED
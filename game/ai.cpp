@@ -16,9 +16,6 @@
 #include "ai.h"
 #include "unit.h"
 #include "targets.h"
-#include "../engine/model.h"
-#include "../engine/engine.h"
-#include "../engine/map.h"
 #include "../grinliz/glperformance.h"
 #include "../grinliz/glutil.h"
 #include "tacmap.h"
@@ -29,13 +26,12 @@
 using namespace grinliz;
 
 
-AI::AI( int team, Visibility* vis, Engine* engine, const Unit* units, BattleScene* battleScene )
+AI::AI( int team, TacticalSim* sim, const Unit* units )
 {
 	m_team = team;
-	m_visibility = vis;
-	m_engine = engine;
+	m_sim = sim;
+	m_visibility = sim->GetVisibility();
 	m_units = units;
-	m_battleScene = battleScene;
 
 	for( int i=0; i<MAX_UNITS; ++i ) {
 		m_enemy[i] = 0.0f;
@@ -102,102 +98,6 @@ void AI::Inform( const Unit* theUnit, int quality )
 }
 
 
-bool AI::SafeLineOfSight(	const Unit* source, 
-							const Unit* target, 
-							int mode,
-							bool multicast,
-							Engine* engine,
-							BattleScene* battle )
-{
-	const Model* sourceModel		= battle->GetModel( source );
-	const Model* sourceWeaponModel	= battle->GetWeaponModel( source );
-	const Model* targetModel		= battle->GetModel( target );
-
-	if ( !sourceModel || !targetModel ) {
-		return false;
-	}
-
-	int sourceTeam = source->Team();
-	int targetTeam = target->Team();
-
-	Vector3F sourcePos, targetPos;
-
-	float fireRotation = source->AngleBetween( target->MapPos(), false );
-	sourceModel->CalcTrigger( &sourcePos, &fireRotation );
-	targetModel->CalcTarget( &targetPos );
-
-	float length = ( targetPos - sourcePos ).Length();
-	
-	Vector3F normal = ( targetPos - sourcePos );
-	normal.Normalize();
-
-	static const Vector3F up = { 0, 1, 0 };
-	Vector3F tangent;
-	CrossProduct( normal, up, &tangent );
-	
-	const WeaponItemDef* wid = source->GetWeaponDef();
-	Accuracy accuracy = source->CalcAccuracy( mode );
-
-	// Don't blow ourselves up.
-	if ( wid->IsExplosive( mode ) && length <= EXPLOSIVE_RANGE ) {
-		return false;
-	}
-
-	const int COUNT = multicast ? 5 : 1;
-
-	// Send out rays over the possible shooting space, see what happens. Basically want to know:
-	// 1. Does the center ray hit.
-	// 2. Do other possible solutions do bad things.
-
-	for( int i=0; i<COUNT; ++i ) {
-		float delta = 0;
-		if ( COUNT > 1 ) {
-			delta = Interpolate(  0.f,             -accuracy.RadiusAtOne()*length,
-								(float)(COUNT-1), accuracy.RadiusAtOne()*length,
-								float(i) );
-		}
-		Vector3F t = sourcePos + normal*length + tangent*delta;
-
-		Ray ray;
-		ray.origin = sourcePos;
-		ray.direction = t - sourcePos;
-		Vector3F intersection;
-
-		const Model* ignore[3] = { sourceModel, sourceWeaponModel, 0 };
-		Model* m = engine->IntersectModel( ray, TEST_TRI, 0, 0, ignore, &intersection );
-		float distanceToImpact = m ? (intersection - sourcePos).Length() : (float)MAP_SIZE;
-
-		// Did we hit our own team?
-		const Unit* u = battle->GetUnit( m, false );
-		if ( !u ) {
-			u = battle->GetUnit( m, true );
-		}
-		if ( u && u->Team() == sourceTeam ) {
-			GLOUTPUT(( "Ray fail %d: hit own team\n", battle->GetUnitID( source ) ));
-			return false;
-		}
-		// Is an explosive weapon too close?
-		if ( wid->IsExplosive(mode) && m && distanceToImpact <= EXPLOSIVE_RANGE ) {
-			GLOUTPUT(( "Ray fail %d: blow up in face.\n", battle->GetUnitID( source ) ));
-			return false;
-		}
-
-		// Do we actually hit the target? Only check for the center ray cast.
-		if ( i == COUNT/2 ) {
-			if ( u && u->Team() == targetTeam ) {
-				// all good.
-				GLOUTPUT(( "Ray main pass %d.\n", battle->GetUnitID( source ) ));
-			}
-			else {
-				GLOUTPUT(( "Ray fail %d: no line of site to target.\n", battle->GetUnitID( source ) ));
-				return false;
-			}
-		}
-	}
-	return true;
-}
-
-
 void AI::TrimPathToCost( MP_VECTOR< grinliz::Vector2<S16> >* path, float maxCost )
 {
 	float cost = 0.0f;
@@ -258,13 +158,16 @@ int AI::ThinkShoot(	const Unit* theUnit,
 
 	const WeaponItemDef* wid = theUnit->GetWeaponDef();
 	GLASSERT( wid );
+	Vector3F target;
 
 	for( int i=0; i<MAX_UNITS; ++i ) {
+		BulletTarget bulletTarget;
+
 		if (    m_enemy[i] > 0
 			 && m_units[i].IsAlive() 
-			 && m_battleScene->GetModel( &m_units[i] )
+			 && map->CalcTarget( &m_units[i], &target, &bulletTarget.width, &bulletTarget.height )
 			 && m_visibility->UnitCanSee( theUnit, &m_units[i] )
-			 && SafeLineOfSight( theUnit, &m_units[i], 0, false, m_engine, m_battleScene ) )
+			 && m_sim->SafeLineOfSight( theUnit, &m_units[i], 0, false ) )
 		{
 			// special case: aliens won't shoot terrans if they have spitters.
 			if (    m_numSpitters
@@ -278,8 +181,7 @@ int AI::ThinkShoot(	const Unit* theUnit,
 			int len2 = (m_units[i].MapPos() - theUnit->MapPos()).LengthSquared();
 			float len = sqrtf( (float)len2 );
 
-			BulletTarget bulletTarget( len );
-			m_battleScene->GetModel( &m_units[i] )->CalcTargetSize( &bulletTarget.width, &bulletTarget.height );
+			bulletTarget.distance = len;
 
 
 			for ( int mode=0; mode<WeaponItemDef::BASE_MODES; ++mode ) {
@@ -318,8 +220,7 @@ int AI::ThinkShoot(	const Unit* theUnit,
 	if ( best >= 0 ) {
 		action->actionID = ACTION_SHOOT;
 		action->shoot.mode = bestMode;
-		m_battleScene->GetModel( &m_units[best] )->CalcTarget( &action->shoot.target );
-		m_battleScene->GetModel( &m_units[best] )->CalcTargetSize( &action->shoot.targetWidth, &action->shoot.targetHeight );
+		map->CalcTarget( &m_units[best], &action->shoot.target, &action->shoot.targetWidth, &action->shoot.targetHeight );
 		return THINK_ACTION;
 	}
 	return THINK_NO_ACTION;
@@ -457,7 +358,6 @@ int AI::ThinkSearch(const Unit* theUnit,
 	for( int i=0; i<MAX_UNITS; ++i ) {
 		if (    m_enemy[i] > 0 
 			 &&	m_units[i].IsAlive() 
-			 && m_battleScene->GetModel( &m_units[i] )
 			 && m_lkp[i].turns < MAX_TURNS_LKP ) 
 		{
 			
@@ -617,7 +517,6 @@ int AI::ThinkRotate(	const Unit* theUnit,
 	for( int i=0; i<MAX_UNITS; ++i ) {
 		if (    m_enemy[i] > 0
 			 && m_units[i].IsAlive() 
-			 && m_battleScene->GetModel( &m_units[i] )
 			 && m_visibility->TeamCanSee( m_team, m_units[i].MapPos() )
 			 && m_lkp[i].turns < MAX_TURNS_LKP ) 
 		{
@@ -694,7 +593,7 @@ bool WarriorAI::Think(	const Unit* theUnit,
 
 	// Special case: Crawler always runs around.
 	if ( theUnit->AlwaysCivAI() ) {
-		CivAI civAI( theUnit->Team(), m_visibility, m_engine, m_units, m_battleScene );
+		CivAI civAI( theUnit->Team(), m_sim, m_units );
 		return civAI.Think( theUnit, flags, map, action );
 	}
 
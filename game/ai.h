@@ -23,12 +23,11 @@
 #include "../grinliz/glrandom.h"
 
 #include "gamelimits.h"
-#include "battlescene.h"	// FIXME: for MotionPath. Factor out?
+#include "unit.h"
+#include "tacticalsim.h"
 #include "battlevisibility.h"
 
-class Unit;
-class SpaceTree;
-class Map;
+class TacMap;
 
 class AI
 {
@@ -79,10 +78,8 @@ public:
 	};
 
 	AI( int team,					// AI in instantiated for a TEAM, not a unit
-		Visibility* visibilit,	
-		Engine* engine, 			// Line of site checking
-		const Unit* units,			// all the units we can scan
-		BattleScene* battleScene );	// FIXME: hack to get unit->model conversion
+		TacticalSim* sim,			// visibility, line of site checking
+		const Unit* units );		// all the units we can scan
 
 	virtual ~AI()	{}
 
@@ -90,10 +87,10 @@ public:
 	void Inform( const Unit* theUnit, int quality );	// 'theUnit' is spotted.
 
 	enum {
-		AI_NORMAL = 0x00,
-		AI_WANDER = 0x01,
-		AI_GUARD  = 0x02,
-		AI_TRAVEL = 0x04,
+		AI_NORMAL = Unit::AI_NORMAL,
+		AI_WANDER = Unit::AI_WANDER,
+		AI_GUARD  = Unit::AI_GUARD,
+		AI_TRAVEL = Unit::AI_TRAVEL,
 	};
 
 	// Return true if done.
@@ -102,12 +99,6 @@ public:
 						TacMap* map,
 						AIAction* action ) = 0;
 
-	static bool SafeLineOfSight(	const Unit* source, 
-									const Unit* target, 
-									int mode,
-									bool multicast,
-									Engine* engine,
-									BattleScene* battle );
 protected:
 	enum {
 		THINK_NOT_OPTION,			// can't do this (if (no weapon) can't shoot)
@@ -173,14 +164,13 @@ protected:
 		int					turns;
 	};
 	const Unit* m_units;
-	BattleScene* m_battleScene;
+	TacticalSim* m_sim;
 
 	int m_team;
 	int m_numSpitters;	// the number of spitters on this team, at the start of turn
 
 	Visibility* m_visibility;
 	grinliz::Random m_random;
-	Engine* m_engine;	// for ray queries.
 	MP_VECTOR< grinliz::Vector2<S16> > m_path[4];
 
 	enum {
@@ -196,7 +186,7 @@ protected:
 class WarriorAI : public AI
 {
 public:
-	WarriorAI( int team, Visibility* vis, Engine* engine, const Unit* units, BattleScene* battleScene ) : AI( team, vis, engine, units, battleScene )		{}
+	WarriorAI( int team, TacticalSim* sim, const Unit* units ) : AI( team, sim, units )		{}
 	virtual ~WarriorAI()					{}
 
 	virtual bool Think( const Unit* move,
@@ -210,7 +200,7 @@ public:
 class CivAI : public AI
 {
 public:
-	CivAI( int team, Visibility* vis, Engine* engine, const Unit* units, BattleScene* battleScene ) : AI( team, vis, engine, units, battleScene )		{}
+	CivAI( int team, TacticalSim* sim, const Unit* units ) : AI( team, sim, units )		{}
 	virtual ~CivAI()																		{}
 	virtual bool Think( const Unit* move,
 						int flags,
@@ -222,7 +212,7 @@ public:
 class NullAI : public AI
 {
 public:
-	NullAI( int team, Visibility* vis, Engine* engine, const Unit* units, BattleScene* battleScene ) : AI( team, vis, engine, units, battleScene )		{}
+	NullAI( int team, TacticalSim* sim, const Unit* units ) : AI( team, sim, units )		{}
 	virtual ~NullAI()																		{}
 	virtual bool Think( const Unit* move,
 						int flags,
@@ -18,7 +18,7 @@
 #include "cgame.h"
 #include "storageWidget.h"
 #include "unit.h"
-#include "tacticalintroscene.h"
+#include "unitgen.h"
 #include "helpscene.h"
 
 using namespace grinliz;
@@ -159,10 +159,10 @@ void BaseTradeScene::SceneDone()
 				memset( &data->soldiers[i], 0, sizeof(Unit) );
 			}
 			int seed = *data->cash ^ nSoldiers;
-			TacticalIntroScene::GenerateTerranTeam( &data->soldiers[minSoldiers], nSoldiers-minSoldiers, 
-													data->soldierBoost ? 0.8f : 0,
-													game->GetItemDefArr(),
-													seed );
+			UnitGen::GenerateTerranTeam( &data->soldiers[minSoldiers], nSoldiers-minSoldiers, 
+										 data->soldierBoost ? 0.8f : 0,
+										 game->GetItemDefArr(),
+										 seed );
 		}
 	}		
 	// And scientists
@@ -1,4 +1,6 @@
 #include "battledata.h"
+#include "research.h"
+#include "tacticalintroscene.h"
 #include "../engine/serialize.h"
 #include "../tinyxml2/tinyxml2.h"
 
@@ -26,6 +28,61 @@ int BattleData::CalcResult() const
 }
 
 
+void BattleData::EndBattle( const Storage* collect, const Research* research )
+{
+	// Note that the end scene can get pushed multiple times in a save/load
+	// cycle. It's important to not do anything that can "accumulate".
+	storage.Clear();
+	int result = CalcResult();
+
+	if ( result == VICTORY ) {
+		if ( collect ) {
+			storage.AddStorage( *collect );
+			storage.SetFullRounds();
+		}
+
+		// Remembering the accumulation problem: this is okay, because the
+		// battle storage was just cleared. Storage hasn't been committed
+		// back to the base yet.
+
+		// Award UFO stuff
+		if ( TacticalIntroScene::IsScoutScenario( scenario ) ) {
+			storage.AddItem( "Cor:S" );
+		}
+		else if ( TacticalIntroScene::IsFrigateScenario( scenario ) ) {
+			storage.AddItem( "Cor:F" );
+		}
+		else if ( scenario == BATTLESHIP ) {
+			storage.AddItem( "Cor:B" );
+		}
+
+		// Alien corpses:
+		for( int i=ALIEN_UNITS_START; i<ALIEN_UNITS_END; ++i ) {
+			if ( units[i].InUse() ) {
+				storage.AddItem( units[i].AlienShortName() );
+			}
+		}
+	}
+	if ( result == DEFEAT ) {
+		// The Civs don't make it.
+		for( int i=CIV_UNITS_START; i<CIV_UNITS_END; ++i ) {
+			if ( units[i].IsAlive() ) {
+				units[i].Kill( 0 );
+			}
+		}
+	}
+	// If the tech isn't high enough, can't use cells and anti
+	if ( research ) {
+		static const char* remove[2] = { "Cell", "Anti" };
+		for( int i=0; i<2; ++i ) {
+			if ( research->GetStatus( remove[i] ) != Research::TECH_RESEARCH_COMPLETE ) {
+				storage.ClearItem( remove[i] );
+			}
+		}
+	}
+}
+
+
 void BattleData::Save( XMLPrinter* printer )
 {
 	printer->OpenElement( "BattleData" );
@@ -7,6 +7,8 @@
 #include "item.h"
 #include "unit.h"
 
+class Research;
+
 
 /*	If a battle is in progress, this saves the data
 	across the many scenes. (BattleScene, EndScene,
@@ -44,6 +46,11 @@ public:
 	void Save( tinyxml2::XMLPrinter* );
 	void Load( const tinyxml2::XMLElement* doc );
 
+	// Fills the storage with the rewards of the battle: 'collected' (everything
+	// left on the battlefield, can be null), UFO cores, and alien corpses. Safe
+	// to call more than once; the storage is cleared first.
+	void EndBattle( const Storage* collected, const Research* research );
+
 	const Unit* Units( int start=0 ) const  { GLASSERT( start >= 0 && start < MAX_UNITS ); return units + start; }
 	const Storage& GetStorage() const		{ return storage; }
 	Storage* StoragePtr()					{ return &storage; }
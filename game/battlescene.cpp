@@ -28,10 +28,12 @@
 
 #include "../engine/uirendering.h"
 #include "../engine/particle.h"
+#include "../engine/particleeffect.h"
 #include "../engine/text.h"
 
 #include "battlestream.h"
 #include "ai.h"
+#include "actionlog.h"
 #include "tacticalendscene.h"
 
 #include "../grinliz/glfixed.h"
@@ -48,35 +50,145 @@ using namespace tinyxml2;
 
 //#define REACTION_FIRE_EVENT_ONLY
 
+// The bolt or smoke trail of a shot, and the splash or explosion where it lands.
+static void RenderWeapon(	const WeaponItemDef* wid,
+							int mode,
+							ParticleSystem* system,
+							const Vector3F& p0, 
+							const Vector3F& p1,
+							bool useImpact,
+							U32 currentTime,
+							U32* duration )
+{
+	enum { BEAM, TRAIL };
+	enum { SPLASH, EXPLOSION };
+
+	const ClipItemDef* cid = wid->clipItemDef[mode];
+
+	int first = (wid->weapon[mode]->flags & WEAPON_EXPLOSIVE) ? TRAIL : BEAM;
+	int second = (wid->weapon[mode]->flags & WEAPON_EXPLOSIVE) ? EXPLOSION : SPLASH;
+
+	// effects: 
+	//		bolt then particle
+	//		beam
+
+	if ( first == BEAM ) {
+		BoltEffect* bolt = (BoltEffect*) system->EffectFactory( "BoltEffect" );
+		if ( !bolt ) { 
+			bolt = new BoltEffect( system );
+		}
+		
+		bolt->Clear();
+		bolt->SetColor( cid->color );
+		bolt->SetSpeed( cid->speed );
+		bolt->SetLength( cid->length );
+		bolt->SetWidth( cid->width );
+		bolt->Init( p0, p1, currentTime );
+
+		*duration = bolt->CalcDuration();
+		system->AddEffect( bolt );
+	}
+	else if ( first == TRAIL ) {
+		SmokeTrailEffect* trail = (SmokeTrailEffect*) system->EffectFactory( "SmokeTrailEffect" );
+		if ( !trail ) {
+			trail = new SmokeTrailEffect( system );
+		}
+
+		trail->Clear();
+
+		Color4F c = { 1, 1, 1, 1 };
+
+		if ( wid->IsAlien() ) {
+			trail->SetQuad( ParticleSystem::CIRCLE, 1 );
+			c = cid->color;
+		}
+
+		trail->SetColor( c );
+		trail->SetSpeed( cid->speed*0.4f );
+		trail->Init( p0, p1, currentTime );
+		*duration = trail->CalcDuration();
+		system->AddEffect( trail );
+	}
+	else {
+		GLASSERT( 0 );
+	}
+
+	if ( useImpact ) {
+
+		ImpactEffect* impact = (ImpactEffect*) system->EffectFactory( "ImpactEffect" );
+		if ( !impact ) {
+			impact = new ImpactEffect( system );
+		}
+
+		Vector3F n = p0 - p1;
+		n.Normalize();
+		impact->Clear();
+		impact->Init( p1, currentTime + *duration );
+		impact->SetColor( cid->color );
+		impact->SetNormal( n );
+		if ( second == SPLASH ) {
+			impact->SetRadius( 1.5f );
+		}
+		else {
+			// explosion
+			impact->SetRadius( 3.5f );
+			impact->SetConfig( ParticleSystem::PARTICLE_SPHERE );
+
+			// 2nd set of particles:
+			ImpactEffect* impact2 = (ImpactEffect*) system->EffectFactory( "ImpactEffect" );
+			if ( !impact2 ) {
+				impact2 = new ImpactEffect( system );
+			}
+			impact2->Clear();
+			impact2->Init( p1, currentTime + *duration + 250 );
+			impact2->SetColor( cid->color );
+			impact2->SetNormal( n );
+			impact2->SetRadius( 3.5f );
+			impact2->SetConfig( ParticleSystem::PARTICLE_SPHERE );
+			system->AddEffect( impact2 );
+		}
+		system->AddEffect( impact );
+	}
+}
+
+
 BattleScene::BattleScene( Game* game ) : Scene( game )
 {
 	units = game->battleData.UnitsPtr();
 	subTurnCount = 0;
-	turnCount = 0;
 	isDragging = false;
 	lockedStorage = 0;
 	cameraSet = false;
 	battleEnding = false;
 	confirmDest.Set( -1, -1 );
-	random.SetSeedFromTime();
 	orbit = 0;
+	simTime = 0;
+	fastForward = false;
+	actionLog = 0;
 
 	engine  = game->engine;
 	tacMap = new TacMap( engine->GetSpaceTree(), game->GetItemDefArr() );
 
-	visibility.Init( this, units, tacMap );
+	tacMap->SetUnits( units, unitRenderers );
+	sim.Init( units, tacMap, &game->GetItemDefArr(), this );
+	visibility = sim.GetVisibility();
+	visibility->SetSeeAll( Engine::mapMakerMode );
 	nearPathState.Clear();
 	tacMap->SetPathBlocker( this );
 	dragUnit = 0;
 
-	aiArr[ALIEN_TEAM]		= new WarriorAI( ALIEN_TEAM, &visibility, engine, units, this );
+	aiArr[ALIEN_TEAM]		= new WarriorAI( ALIEN_TEAM, &sim, units );
 	aiArr[TERRAN_TEAM]		= 0;
 	if ( GameSettingsManager::Instance()->GetPlayerAI() ) {
-		aiArr[TERRAN_TEAM] = new WarriorAI( TERRAN_TEAM, &visibility, engine, units, this );
+		aiArr[TERRAN_TEAM] = new WarriorAI( TERRAN_TEAM, &sim, units );
+	}
+	aiArr[CIV_TEAM]			= new CivAI( CIV_TEAM, &sim, units );
+	for( int i=0; i<NUM_TEAMS; ++i ) {
+		sim.SetTeamAI( i, aiArr[i] != 0 );
 	}
-	aiArr[CIV_TEAM]			= new CivAI( CIV_TEAM, &visibility, engine, units, this );
 
 	for( int i=0; i<MAX_UNITS; ++i ) {
+		prevUnitPos[i] = units[i].Pos();
 		unitRenderers[i].Update( GetEngine()->GetSpaceTree(), &units[i] );
 	}
 
@@ -246,7 +358,7 @@ BattleScene::BattleScene( Game* game ) : Scene( game )
 						   Game::CalcControllerAtom( false, GAME_JOY_BUTTON_UP, false, 0 ));
 	}
 
-	currentTeamTurn = ALIEN_TEAM;
+	sim.SetTeamTurn( ALIEN_TEAM );
 	NextTurn( false );
 }
 
@@ -265,6 +377,10 @@ BattleScene::~BattleScene()
 	for( int i=0; i<3; ++i ) {
 		delete aiArr[i];
 	}
+	if ( actionLog && actionLog->Recording() ) {
+		SaveActionLog();
+	}
+	delete actionLog;
 	delete tacMap;
 	//delete consoleWidget;
 }
@@ -368,23 +484,8 @@ const Model* BattleScene::GetWeaponModel( const Unit* unit )
 }
 
 
-void BattleScene::UpgradeCrawlerToSpitter( Unit* unit )
+void BattleScene::UnitUpgraded( Unit* unit )
 {
-	bool okay = (unit->Team() == ALIEN_TEAM) && (unit->AlienType() == Unit::ALIEN_CRAWLER );
-	GLASSERT( okay );
-	if ( !okay )
-		return;
-
-	int rank = unit->GetStats().Rank();
-	Vector3F pos = unit->Pos();
-	float rot = unit->Rotation();
-
-	unit->Free();
-	int alienCount[Unit::NUM_ALIEN_TYPES] = { 0 };
-	alienCount[Unit::ALIEN_SPITTER] = 1;
-	TacticalIntroScene::GenerateAlienTeam( unit, alienCount, (float)rank, game->GetItemDefArr(), random.Rand() );
-	unit->SetPos( pos, rot );
-
 	Color4F color = Convert_4U8_4F( game->MainPaletteColor( 4, 3 ) );
 	Color4F colorVec = { 0, 0, 0, -0.5f};
 	Vector3F particleVel = { 0, 1, 0 };
@@ -397,19 +498,114 @@ void BattleScene::UpgradeCrawlerToSpitter( Unit* unit )
 }
 
 
+void BattleScene::UnitDown( Unit* unit )
+{
+	if ( unit->Team() == TERRAN_TEAM )
+		SoundManager::Instance()->QueueSound( "terrandown0" );
+	else if ( unit->Team() == ALIEN_TEAM )
+		SoundManager::Instance()->QueueSound( "aliendown0" );
+
+	if ( unit == selection.targetUnit || unit == selection.soldierUnit ) {
+		selection.ClearTarget();
+	}
+}
+
+
+U32 BattleScene::ShotFired(	const Unit* unit, const WeaponItemDef* weaponDef, int mode,
+							const Vector3F& p0, const Vector3F& p1,
+							bool impact, bool hitModel )
+{
+	// Shooting announces the units location.
+	for( int i=0; i<3; ++i ) {
+		if ( aiArr[i] )
+			aiArr[i]->Inform( unit, 2 );
+	}
+
+	U32 delayTime = 0;
+	if ( p0 != p1 ) {
+		RenderWeapon(	weaponDef, mode,
+						ParticleSystem::Instance(),
+						p0, p1, 
+						impact, 
+						game->CurrentTime(), 
+						&delayTime );
+		if ( !battleEnding )
+			SoundManager::Instance()->QueueSound( weaponDef->weapon[mode]->sound );
+	}
+
+	if ( impact && hitModel ) {
+		int x = Clamp( (int)LRintf( p1.x ), 0, MAP_SIZE-1 );
+		int y = Clamp( (int)LRintf( p1.z ), 0, MAP_SIZE-1 );
+		if ( tacMap->GetFogOfWar().IsSet( x, y, 0 ) ) {
+			PushScrollOnScreen( p1 );
+		}
+	}
+	return delayTime;
+}
+
+
+void BattleScene::ShotLanded( bool direct, bool explosion )
+{
+	if ( battleEnding )
+		return;
+	if ( direct )
+		SoundManager::Instance()->QueueSound( "hit" );
+	if ( explosion )
+		SoundManager::Instance()->QueueSound( "explosion" );
+}
+
+
+void BattleScene::PsiAttacked( const Unit* unit, const Unit* targetUnit, bool success )
+{
+	// Set up the particle effects.
+	static const int LAYERS=3;
+	ParticleSystem* ps = ParticleSystem::Instance();
+	Color4F colors[LAYERS];
+	colors[0] = Convert_4U8_4F( game->MainPaletteColor( 0, 2 ) );
+	colors[1] = Convert_4U8_4F( game->MainPaletteColor( 4, 3 ) );
+	colors[2] = Convert_4U8_4F( game->MainPaletteColor( 2, 2 ) );
+	Color4F colorVelocity = { 0, 0, 0, -0.4f };
+	Vector3F velocity = { 0, 0, 0 };
+
+	Vector3F pos = targetUnit->Pos();
+	if ( GetModel( targetUnit ) ) GetModel( targetUnit )->CalcTrigger( &pos );
+
+	if ( success ) {
+
+		for( int i=0; i<LAYERS; ++i ) {
+			ps->EmitQuad(	ParticleSystem::RING,	
+							colors[i],	colorVelocity,
+							pos, 0.1f,
+							velocity, 0.1f,
+							0, 0.7f/(1.0f+i) );
+			pos.y += 0.1f;
+		}
+
+		for( int i=0; i<MAX_UNITS; ++i ) {
+			if ( units[i].IsAlive() && units[i].Team() == targetUnit->Team() ) {
+				aiArr[unit->Team()]->Inform( &units[i], 0 );
+			}
+		}
+	}
+	else {
+		velocity.y = 1;
+		ps->EmitPoint( 5, ParticleSystem::PARTICLE_SPHERE,
+					   colors[0], colorVelocity,
+					   pos, 0.1f, velocity, 0.2f );
+	}
+	if ( targetUnit->Team() == TERRAN_TEAM ) {
+		PushScrollOnScreen( targetUnit->Pos() );
+	}
+}
+
+
 void BattleScene::NextTurn( bool saveOnTerranTurn )
 {
-	currentTeamTurn++;
-	if ( currentTeamTurn == NUM_TEAMS )
-		currentTeamTurn = 0;
-	turnCount++;
+	sim.NextTurn();
 
-	switch ( currentTeamTurn ) {
+	switch ( sim.CurrentTeamTurn() ) {
 		case TERRAN_TEAM:
 			{
-				GLOUTPUT(( "New Turn: Terran\n" ));
-				for( int i=TERRAN_UNITS_START; i<TERRAN_UNITS_END; ++i )
-					units[i].NewTurn();
 				currentUnitAI = TERRAN_UNITS_START;
 			
 				turnImage.SetAtom( Game::CalcDecoAtom( DECO_TERRAN_TURN ) );
@@ -418,15 +614,6 @@ void BattleScene::NextTurn( bool saveOnTerranTurn )
 			break;
 
 		case ALIEN_TEAM:
-			GLOUTPUT(( "New Turn: Alien\n" ));
-			for( int i=ALIEN_UNITS_START; i<ALIEN_UNITS_END; ++i ) {
-				if ( units[i].IsAlive() && units[i].AlienType() == Unit::ALIEN_CRAWLER ) {
-					if ( random.Uniform() < CRAWLER_GROWTH ) {
-						UpgradeCrawlerToSpitter( &units[i] );
-					}
-				}
-				units[i].NewTurn();
-			}
 			currentUnitAI = ALIEN_UNITS_START;
 
 			decoEffect.Play( 1000, false );
@@ -437,9 +624,6 @@ void BattleScene::NextTurn( bool saveOnTerranTurn )
 			break;
 
 		case CIV_TEAM:
-			GLOUTPUT(( "New Turn: Civ\n" ));
-			for( int i=CIV_UNITS_START; i<CIV_UNITS_END; ++i )
-				units[i].NewTurn();
 			currentUnitAI = CIV_UNITS_START;
 
 			decoEffect.Play( 1000, false );
@@ -454,24 +638,23 @@ void BattleScene::NextTurn( bool saveOnTerranTurn )
 			break;
 	}
 
-	// Allow the map to change (fire and smoke)
-	Rectangle2I change;
-	change.SetInvalid();
-	tacMap->DoSubTurn( &change, FIRE_DAMAGE_PER_SUBTURN );
-	visibility.InvalidateAll( change );
+	// Cheap enough to do every turn; compare the output between builds.
+	TacticalSim::BattleHash hash;
+	sim.CalcStateHash( &hash );
+	LogStateHash( hash );
 
-	// Since the map has changed:
-	ProcessDoors();
-	CalcTeamTargets();
-	targetEvents.Clear();
+	if ( actionLog && actionLog->Recording() ) {
+		actionLog->RecordTurn( sim.CurrentTeamTurn(), hash.total );
+		SaveActionLog();
+	}
 
-	// Per turn save:
-	if ( saveOnTerranTurn && currentTeamTurn == TERRAN_TEAM ) {
-		game->Save( 0, false, true );
+	// Per turn save. Written over the next frames, so the turn change doesn't wait on the disk.
+	if ( saveOnTerranTurn && sim.CurrentTeamTurn() == TERRAN_TEAM ) {
+		game->Save( 0, false, true, true );
 	}
 
-	if ( aiArr[currentTeamTurn] ) {
-		aiArr[currentTeamTurn]->StartTurn( units );
+	if ( aiArr[sim.CurrentTeamTurn()] ) {
+		aiArr[sim.CurrentTeamTurn()]->StartTurn( units );
 	}
 	else {
 		OrderNextPrev();
@@ -568,8 +751,7 @@ void BattleScene::OrderNextPrev()
 void BattleScene::Save( XMLPrinter* printer )
 {
 	printer->OpenElement( "BattleScene" );
-	printer->PushAttribute( "currentTeamTurn", currentTeamTurn );
-	printer->PushAttribute( "turnCount", turnCount );
+	sim.Save( printer );
 
 	tacMap->Save( printer );
 	game->battleData.Save( printer );
@@ -578,6 +760,18 @@ void BattleScene::Save( XMLPrinter* printer )
 
 
 void BattleScene::Load( const XMLElement* battleElement )
+{
+	LoadBattle( battleElement, 0 );
+}
+
+
+void BattleScene::Load( const XMLElement* battleElement, const MapDesc& mapDesc )
+{
+	LoadBattle( battleElement, &mapDesc );
+}
+
+
+void BattleScene::LoadBattle( const XMLElement* battleElement, const MapDesc* mapDesc )
 {
 	// FIXME: Save/Load AI? Memory state is lost.
 
@@ -587,18 +781,27 @@ void BattleScene::Load( const XMLElement* battleElement )
 	if ( !battleElement )
 		return;
 
-	battleElement->QueryIntAttribute( "currentTeamTurn", &currentTeamTurn );
-	turnCount = 0;
-	battleElement->QueryIntAttribute( "turnCount", &turnCount );
+	sim.Load( battleElement );
 	
-	tacMap->Load( battleElement->FirstChildElement( "Map") );
+	if ( mapDesc )
+		tacMap->LoadDesc( *mapDesc );
+	else
+		tacMap->Load( battleElement->FirstChildElement( "Map") );
 
 	game->battleData.Load( battleElement );
 	tacMap->SetDayTime( game->battleData.GetDayTime() );
 
 	for( int i=0; i<MAX_UNITS; ++i ) {
-		if ( units[i].InUse() )
-			units[i].InitLoc( tacMap );
+		if ( units[i].InUse() && units[i].Pos().x == 0.0f ) {
+			// New to the map: place it.
+			GLASSERT( units[i].Pos().z == 0.0f );
+			Vector2I pi;
+			float rot = units[i].Rotation();
+			tacMap->PopLocation( units[i].Team(), units[i].AI() == AI::AI_GUARD, &pi, &rot );
+			Vector3F pos = { (float)pi.x+0.5f, 0.0f, (float)pi.y+0.5f };
+			units[i].SetPos( pos, rot );
+		}
+		prevUnitPos[i] = units[i].Pos();
 
 		// Turn off guard AI behavior for final battle, so
 		// aliens aren't just standing around the temple.
@@ -609,12 +812,10 @@ void BattleScene::Load( const XMLElement* battleElement )
 		}
 	}
 
-	ProcessDoors();
-	CalcTeamTargets();
-	targetEvents.Clear();
+	sim.StartBattle();
 
-	if ( aiArr[currentTeamTurn] ) {
-		aiArr[currentTeamTurn]->StartTurn( units );
+	if ( aiArr[sim.CurrentTeamTurn()] ) {
+		aiArr[sim.CurrentTeamTurn()]->StartTurn( units );
 	}
 	OrderNextPrev();
 
@@ -624,38 +825,85 @@ void BattleScene::Load( const XMLElement* battleElement )
 			break;
 		}
 	}
+
+	if ( !actionLog && GameSettingsManager::Instance()->GetRecordReplay() ) {
+		StartRecording();
+	}
 }
 
 
-void BattleScene::SetFogOfWar()
+void BattleScene::StartRecording()
 {
-	//GRINLIZ_PERFTRACK
+	GLASSERT( !actionLog );
 
-	if ( visibility.FogCheckAndClear() ) {
-		grinliz::BitArray<Map::SIZE, Map::SIZE, 1>* fow = tacMap->LockFogOfWar();
+	// Re-seed so the log knows the state of the random number generator.
+	U32 seed = sim.GetRandom()->Rand();
+	sim.GetRandom()->SetSeed( seed );
 
-		if ( Engine::mapMakerMode ) {
-			fow->SetAll();
-		}
-		else {
-			for( int j=0; j<MAP_SIZE; ++j ) {
-				for( int i=0; i<MAP_SIZE; ++i ) {
-					if ( visibility.TeamCanSee( TERRAN_TEAM, i, j ) )
-						fow->Set( i, j );
-					else
-						fow->Clear( i, j );
-				}
-			}
+	XMLPrinter printer;
+	Save( &printer );
 
-			// Can always see around the lander.		
-			const Model* landerModel = tacMap->GetLanderModel();
-			if ( landerModel ) {
-				Rectangle2I bounds;
-				tacMap->MapBoundsOfModel( landerModel, &bounds );
-				fow->SetRect( bounds );
-			}
+	// The AI teams stop a move for a new target, the players only for a new team.
+	U32 teamAI = 0;
+	for( int i=0; i<NUM_TEAMS; ++i ) {
+		if ( aiArr[i] )
+			teamAI |= 1<<i;
+	}
+
+	actionLog = new ActionLog();
+	actionLog->StartRecording( seed, teamAI, printer.CStr(), printer.CStrSize()-1 );
+	SaveActionLog();
+}
+
+
+void BattleScene::LogStateHash( const TacticalSim::BattleHash& hash )
+{
+	GLOUTPUT(( "StateHash turn=%d team=%d units=%08x map=%08x fog=%08x vis=%08x total=%08x\n",
+			   sim.TurnCount(), sim.CurrentTeamTurn(),
+			   hash.units, hash.map, hash.fog, hash.visibility, hash.total ));
+
+	if ( GameSettingsManager::Instance()->GetHashLog() ) {
+		FILE* fp = game->GameSavePath( SAVEPATH_HASHLOG, SAVEPATH_APPEND, 0 );
+		if ( fp ) {
+			fprintf( fp, "turn=%d team=%d units=%08x map=%08x fog=%08x vis=%08x total=%08x\n",
+					 sim.TurnCount(), sim.CurrentTeamTurn(),
+					 hash.units, hash.map, hash.fog, hash.visibility, hash.total );
+			fclose( fp );
 		}
-		tacMap->ReleaseFogOfWar();
+	}
+}
+
+
+void BattleScene::SaveActionLog()
+{
+	GLASSERT( actionLog && actionLog->Recording() );
+	FILE* fp = game->GameSavePath( SAVEPATH_REPLAY, actionLog->Saved() ? SAVEPATH_APPEND : SAVEPATH_WRITE, 0 );
+	if ( fp ) {
+		actionLog->Save( fp );
+		fclose( fp );
+	}
+}
+
+
+void BattleScene::RecordAction( const Action* action )
+{
+	if ( !actionLog || !actionLog->Recording() )
+		return;
+
+	int id = GetUnitID( action->unit );
+	switch( action->actionID ) {
+		case ACTION_MOVE:
+			actionLog->RecordMove( id, action->type.move.path.pathData, action->type.move.path.pathLen );
+			break;
+		case ACTION_ROTATE:
+			actionLog->RecordRotate( id, action->type.rotate.rotation );
+			break;
+		case ACTION_PSI_ATTACK:
+			actionLog->RecordPsi( id, action->type.psi.targetID );
+			break;
+		default:
+			GLASSERT( 0 );
+			break;
 	}
 }
 
@@ -767,10 +1015,9 @@ void BattleScene::SetUnitOverlays()
 	orangeAtom1.renderState = (const void*)Map::RENDERSTATE_MAP_NORMAL;
 
 	const Unit* unitMoving = 0;
-	if ( !actionStack.Empty() ) {
-		if ( actionStack.Top()->actionID == ACTION_MOVE ) {
-			unitMoving = actionStack.Top()->unit;
-		}
+	const Action* current = sim.CurrentAction();
+	if ( current && current->actionID == ACTION_MOVE ) {
+		unitMoving = current->unit;
 	}
 	
 	static const float HP_DX = 0.10f;
@@ -780,7 +1027,7 @@ void BattleScene::SetUnitOverlays()
 		// layer 0 target arrow
 		// layer 1 target arrow
 
-		if ( unitMoving != &units[i] && units[i].IsAlive() && visibility.TeamCanSee( TERRAN_TEAM, units[i].MapPos() ) ) {
+		if ( unitMoving != &units[i] && units[i].IsAlive() && visibility->TeamCanSee( TERRAN_TEAM, units[i].MapPos() ) ) {
 			Vector3F p = units[i].Pos();
 
 			// Is the unit on screen? If so, put in a simple foot decal. Else
@@ -892,7 +1139,6 @@ void BattleScene::DoTick( U32 currentTime, U32 deltaTime )
 {
 	GRINLIZ_PERFTRACK
 	TestHitTesting();
-	tacMap->EmitParticles( deltaTime );
 
 #if 0
 		// Debug unit targets.
@@ -918,20 +1164,28 @@ void BattleScene::DoTick( U32 currentTime, U32 deltaTime )
 #endif
 
 
-	int result = ProcessAction( deltaTime );
-	SetFogOfWar();	// fast if nothing changed.	
-
-	if ( result & STEP_COMPLETE ) {
-		ProcessDoors();			// Not fast. Only calc when needed.
-		CalcTeamTargets();
-
-		DumpTargetEvents();
-
-		StopForNewTeamTarget();
-		DoReactionFire();
-		targetEvents.Clear();	// All done! They don't get to carry on beyond the moment.
+	// The sim runs in fixed steps, whatever the frame rate. The time left over
+	// is used to interpolate the unit models between the last two steps.
+	int steps = 0;
+	if ( fastForward ) {
+		while ( steps < FAST_FORWARD_STEPS && !battleEnding && !game->battleData.IsBattleOver() ) {
+			SimStep( false );
+			++steps;
+		}
+		simTime = SIM_STEP;
+	}
+	else {
+		simTime += deltaTime;
+		while ( simTime >= SIM_STEP && steps < MAX_SIM_STEPS ) {
+			SimStep( true );
+			simTime -= SIM_STEP;
+			++steps;
+		}
+		if ( simTime > SIM_STEP ) {
+			// A slow frame: let the sim fall behind rather than jump.
+			simTime = SIM_STEP;
+		}
 	}
-
 	SetUnitOverlays();
 	moveOkayCancelUI.SetVisible( confirmDest.x >= 0 );
 	decoEffect.DoTick( deltaTime );
@@ -946,11 +1200,11 @@ void BattleScene::DoTick( U32 currentTime, U32 deltaTime )
 		PushEndScene();
 	}
 	{ 
-		if ( currentTeamTurn == TERRAN_TEAM ) {
+		if ( sim.CurrentTeamTurn() == TERRAN_TEAM ) {
 			if ( selection.soldierUnit && !selection.soldierUnit->IsAlive() ) {
 				SetSelection( 0 );
 			}
-			if ( actionStack.Empty() ) {
+			if ( NoAction() ) {
 				ShowNearPath( selection.soldierUnit );	// fast if it does nothing.
 			}
 			// Render the target (if it is on-screen)
@@ -964,18 +1218,8 @@ void BattleScene::DoTick( U32 currentTime, U32 deltaTime )
 				fireWidget.Hide();
 			}
 		}
-		if ( actionStack.Empty() ) {
-			if ( aiArr[currentTeamTurn] ) {
-				bool done = ProcessAI();
-				if ( done ) {
-					NextTurn( true );
-				}
-			}
-		}
-	}
-	for( int i=0; i<MAX_UNITS; ++i ) {
-		unitRenderers[i].Update( GetEngine()->GetSpaceTree(), &units[i] );
 	}
+	UpdateUnitRenderers( (float)simTime / (float)SIM_STEP );
 	engine->camera.Orbit( orbit );
 	//consoleWidget->DoTick( deltaTime );
 
@@ -987,57 +1231,56 @@ void BattleScene::DoTick( U32 currentTime, U32 deltaTime )
 }
 
 
-void BattleScene::PushEndScene()
+void BattleScene::SimStep( bool emitParticles )
 {
-	battleEnding = true;
-	// Note that the end scene can get pushed multiple times in a save/load
-	// cycle. It's important to not do anything that can "accumulate".
-	game->battleData.ClearStorage();
-	Storage* collect = tacMap->CollectAllStorage();
-	if ( collect && game->battleData.CalcResult() == BattleData::VICTORY ) {
-		game->battleData.StoragePtr()->AddStorage( *collect );
-		game->battleData.StoragePtr()->SetFullRounds();
-
-		// Remembering the accumulation problem: this is okay, because the
-		// battle storage was just cleared. Storage hasn't been committed
-		// back to the base yet.
-
-		// Award UFO stuff
-		if ( TacticalIntroScene::IsScoutScenario( game->battleData.GetScenario() ) ) {
-			game->battleData.StoragePtr()->AddItem( "Cor:S" );
-		}
-		else if ( TacticalIntroScene::IsFrigateScenario( game->battleData.GetScenario() ) ) {
-			game->battleData.StoragePtr()->AddItem( "Cor:F" );
-		}
-		else if ( game->battleData.GetScenario() == BATTLESHIP ) {
-			game->battleData.StoragePtr()->AddItem( "Cor:B" );
-		}
+	for( int i=0; i<MAX_UNITS; ++i ) {
+		prevUnitPos[i] = units[i].Pos();
+	}
+	if ( emitParticles ) {
+		tacMap->EmitParticles( SIM_STEP );
+	}
 
-		// Alien corpses:
-		for( int i=ALIEN_UNITS_START; i<ALIEN_UNITS_END; ++i ) {
-			if ( units[i].InUse() ) {
-				game->battleData.StoragePtr()->AddItem( units[i].AlienShortName() );
-			}
-		}
+	if ( !cameraStack.Empty() ) {
+		if ( ProcessActionCameraBounds( SIM_STEP, cameraStack.Top() ) )
+			cameraStack.Pop();
 	}
-	if ( game->battleData.CalcResult() == BattleData::DEFEAT ) {
-		// The Civs don't make it.
-		for( int i=CIV_UNITS_START; i<CIV_UNITS_END; ++i ) {
-			if ( units[i].IsAlive() ) {
-				units[i].Kill( 0, false );
+	else {
+		sim.Step( SIM_STEP );
+	}
+
+	// Once the battle is over nothing more is decided; the end scene is pushed
+	// after the steps of this frame.
+	if ( NoAction() && !battleEnding && !game->battleData.IsBattleOver() ) {
+		if ( aiArr[sim.CurrentTeamTurn()] ) {
+			bool done = ProcessAI();
+			if ( done ) {
+				NextTurn( true );
 			}
 		}
 	}
-	// If the tech isn't high enough, can't use cells and anti
-	const Research* research = game->GetResearch();
-	if ( research ) {
-		static const char* remove[2] = { "Cell", "Anti" };
-		for( int i=0; i<2; ++i ) {
-			if ( research->GetStatus( remove[i] ) != Research::TECH_RESEARCH_COMPLETE ) {
-				game->battleData.StoragePtr()->ClearItem( remove[i] );
-			}
+}
+
+
+void BattleScene::UpdateUnitRenderers( float fraction )
+{
+	for( int i=0; i<MAX_UNITS; ++i ) {
+		Vector3F pos = units[i].Pos();
+		Vector3F delta = pos - prevUnitPos[i];
+		// Only interpolate a step along a path; anything else is a jump.
+		if ( fraction < 1.0f && delta.LengthSquared() < 2.0f ) {
+			pos = prevUnitPos[i] + delta*fraction;
 		}
+		unitRenderers[i].Update( GetEngine()->GetSpaceTree(), &units[i], &pos );
 	}
+}
+
+
+void BattleScene::PushEndScene()
+{
+	battleEnding = true;
+	Storage* collect = tacMap->CollectAllStorage();
+	game->battleData.EndBattle( collect, game->GetResearch() );
+
 	GLASSERT( !game->IsScenePushed() );
 	game->PushScene( Game::END_SCENE, 0 );
 }
@@ -1159,14 +1402,10 @@ void BattleScene::PushScrollOnScreen( const Vector3F& pos, bool center )
 	Rectangle2F inset = CalcInsetUIBounds();
 
 	if ( !inset.Contains( ui ) ) {
-		Vector3F c;
-		engine->CameraLookingAt( &c );
-
-		Action* action = actionStack.Push();
-		action->Init( ACTION_CAMERA_BOUNDS, 0 );
-		action->type.cameraBounds.target = pos;
-		action->type.cameraBounds.speed = (float)MAP_SIZE / 3.0f;
-		action->type.cameraBounds.center = center;
+		CameraBoundsAction* action = cameraStack.Push();
+		action->target = pos;
+		action->speed = (float)MAP_SIZE / 3.0f;
+		action->center = center;
 	}
 }
 
@@ -1198,258 +1437,16 @@ void BattleScene::SetSelection( Unit* unit )
 }
 
 
-void BattleScene::PushRotateAction( Unit* src, const Vector3F& dst3F, bool quantize )
-{
-	GLRELASSERT( GetModel( src ) );
-
-	Vector2I dst = { (int)dst3F.x, (int)dst3F.z };
-
-	float rot = src->AngleBetween( dst, quantize );
-	if ( src->Rotation() != rot ) {
-		Action* action = actionStack.Push();
-		action->Init( ACTION_ROTATE, src );
-		action->type.rotate.rotation = rot;
-	}
-}
-
-
-bool BattleScene::PushShootAction( Unit* unit, 
-								   const grinliz::Vector3F& target, 
-								   float targetWidth, float targetHeight,
-								   int mode,
-								   float useError,
-								   bool clearMoveIfShoot )
-{
-	GLRELASSERT( unit );
-
-	if ( !unit->IsAlive() )
-		return false;
-	
-	Item* weapon = unit->GetWeapon();
-	if ( !weapon )
-		return false;
-
-	const WeaponItemDef* wid = weapon->IsWeapon();
-
-	Vector3F normal, right, up;
-	Vector3F p = unit->Pos();
-
-	normal = target - p;
-	float length = normal.Length();
-	float range = length;
-	normal.Normalize();
-
-	up.Set( 0.0f, 1.0f, 0.0f );
-	CrossProduct( normal, up, &right );
-	CrossProduct( normal, right, &up );
-
-	BulletTarget bulletTarget( length );
-	if ( targetWidth )
-		bulletTarget.width = targetWidth;
-	if ( targetHeight )
-		bulletTarget.height = targetHeight;
-
-	if ( unit->CanFire( mode ) )
-	{
-		int nShots = wid->RoundsNeeded( mode );
-		unit->UseTU( unit->FireTimeUnits( mode ) );
-
-		// Could be removed, if optimization needed. Computes the metrics.
-		float chanceToHit, chanceAnyHit, tu, dptu;
-		unit->FireStatistics( mode, bulletTarget, &chanceToHit, &chanceAnyHit, &tu, &dptu );
-
-		for( int i=0; i<nShots; ++i ) {
-			Vector3F t = target;
-			if ( useError ) {
-				BulletSpread bulletSpread;
-				bulletSpread.Generate( random.Rand(), 
-									   unit->CalcAccuracy( mode ), length,
-									   normal, target, &t );
-			}
-
-			if ( clearMoveIfShoot && !actionStack.Empty() && actionStack.Top()->actionID == ACTION_MOVE ) {
-				actionStack.Clear();
-			}
-
-			Action* action = actionStack.Push();
-			action->Init( ACTION_SHOOT, unit );
-			action->type.shoot.target = t;
-			action->type.shoot.mode = mode;
-			action->type.shoot.chanceToHit = chanceToHit;
-			action->type.shoot.range = range;
-			GLASSERT( InRange( chanceToHit, 0.0f, 1.0f ) );
-			unit->GetInventory()->UseClipRound( wid->GetClipItemDef( mode ) );
-		}
-		PushRotateAction( unit, target, false );
-		return true;
-	}
-	return false;
-}
-
-
-void BattleScene::DoReactionFire()
-{
-	if ( currentTeamTurn == CIV_TEAM )
-		return;
-
-	int antiTeam = ALIEN_TEAM;
-	if ( currentTeamTurn == ALIEN_TEAM )
-		antiTeam = TERRAN_TEAM;
-
-	bool react = false;
-	if ( actionStack.Empty() ) {
-		react = true;
-	}
-	else { 
-		const Action& action = *actionStack.Top();
-		if (    action.actionID == ACTION_MOVE
-			&& action.unit
-			&& action.unit->Team() == currentTeamTurn
-			&& action.type.move.pathFraction == 0 )
-		{
-			react = true;		
-		}
-	}
-	if ( react ) {
-		int i=0;
-		while( i < targetEvents.Size() ) {
-			TargetEvent t = targetEvents[i];
-
-			// Reaction fire occurs on the *antiTeam*. It's a little
-			// strange to get the ol' head wrapped around.
-			if (    t.team == 0				// individual
-				 && units[t.viewerID].Team() == antiTeam
-				 && units[t.targetID].Team() == currentTeamTurn ) 
-			{
-				// Reaction fire
-				Unit* targetUnit = &units[t.targetID];
-				Unit* srcUnit = &units[t.viewerID];
-
-				if (    targetUnit->IsAlive()
-					 && GetModel( targetUnit )
-					 && srcUnit->GetWeapon() ) 
-				{
-					if ( AI::SafeLineOfSight( srcUnit, 
-											  targetUnit,
-											  srcUnit->CanFire( 1 ) ? 1 : 0,
-											  srcUnit->Team() == TERRAN_TEAM ? true : false,
-											  GetEngine(), this ) )
-					{
-						// Do we really react? Are we that lucky? Well, are you, punk?
-						float r = random.Uniform();
-						float reaction = srcUnit->GetStats().Reaction();
-
-						// Reaction is impacted by rotation.
-						// Multiple ways to do the math. Go with the normal of the src facing to
-						// the normal of the target.
-
-						Vector2I targetMapPos = targetUnit->MapPos();
-						Vector2I srcMapPos = srcUnit->MapPos();
-
-						Vector2F normalToTarget = { (float)(targetMapPos.x - srcMapPos.x), (float)(targetMapPos.y - srcMapPos.y) };
-						normalToTarget.Normalize();
-
-						Vector2F facing = { 0, 0 };
-						facing.x = sinf( ToRadian( srcUnit->Rotation() ) );
-						facing.y = cosf( ToRadian( srcUnit->Rotation() ) );
-
-						float mod = DotProduct( facing, normalToTarget ) * 0.5f + 0.5f;  
-						reaction *= mod;				// linear with angle.
-						float error = 2.0f - mod;		// doubles with rotation
-						
-						GLOUTPUT(( "reaction fire %s. (if %.2f < %.2f)\n", r <= reaction ? "Yes" : "No", r, reaction ));
-
-						if ( r <= reaction ) {
-							Vector3F target = { 0, 0, 0 };
-							GLASSERT( GetModel( targetUnit ) );
-							const Model* targetModel = GetModel( targetUnit );
-							targetModel->CalcTarget( &target );
-
-							float targetWidth, targetHeight;
-							targetModel->CalcTargetSize( &targetWidth, &targetHeight );
-							
-							int shot = PushShootAction( srcUnit, target, targetWidth, targetHeight, 1, error, true );	// auto
-							if ( !shot )
-								PushShootAction( srcUnit, target, targetWidth, targetHeight, 0, error, true );	// snap
-						}
-				}
-				}
-				targetEvents.SwapRemove( i );
-			}
-			else {
-				++i;
-			}
-		}
-	}
-}
-
-
-void BattleScene::ProcessInventoryAI( Unit* theUnit )
-{
-	AI_LOG(( "[ai] Unit %d INVENTORY: ", currentUnitAI ));
-	// Drop all the weapons and clips. Pick up new weapons and clips.
-	Vector2I pos = theUnit->MapPos();
-	Storage* storage = tacMap->LockStorage( pos.x, pos.y );
-	GLRELASSERT( storage );
-
-	Inventory* inventory = theUnit->GetInventory();
-	Item item;
-
-	if ( storage ) {
-		// Exception version=490 device=win32 at 	Sat, November 27, 2010 6:25 pm
-		// The IsResupply() is used by the AI query, an the same thing needs to 
-		// be used here, else we can infinte loop.
-		const WeaponItemDef* wid = storage->IsResupply( theUnit->GetWeaponDef() );
-		if ( wid ) {
-
-			// Clear out everything actually being carried so we don't run out of space.
-			for( int i=0; i<Inventory::NUM_SLOTS; ++i ) {
-				item = inventory->GetItem( i );
-				if ( item.IsWeapon() || item.IsClip() ) {
-					storage->AddItem( item );
-					inventory->RemoveItem( i );
-				}
-			}
-
-			storage->RemoveItem( wid, &item );
-#ifdef DEBUG
-			int slot = 
-#endif
-			inventory->AddItem( item, 0 );
-			GLRELASSERT( slot == Inventory::WEAPON_SLOT );
-			AI_LOG(( "'%s' ", item.Name() ));
-
-			// clips.
-			for( int k=0; k<2; ++k ) {
-				while ( storage->GetCount( wid->GetClipItemDef( k ) ) ) {
-					Item item;
-					storage->RemoveItem( wid->GetClipItemDef( k ), &item );
-					if ( inventory->AddItem( item, 0 ) < 0 ) {
-						storage->AddItem( item );
-						break;
-					}
-					else {
-						AI_LOG(( "'%s' ", item.Name() ));
-					}
-				}
-			}
-			AI_LOG(( "\n" ));
-		}
-	}
-	tacMap->ReleaseStorage( storage );
-}
-
-
 bool BattleScene::ProcessAI()
 {
-	GLRELASSERT( actionStack.Empty() );
-	GLASSERT( aiArr[currentTeamTurn] );
+	GLRELASSERT( sim.NoAction() );
+	GLASSERT( aiArr[sim.CurrentTeamTurn()] );
 
 	//int count = 0;
 
-	while ( actionStack.Empty() ) {
+	while ( sim.NoAction() ) {
 
-		if ( currentUnitAI == MAX_UNITS || units[currentUnitAI].Team() != currentTeamTurn )
+		if ( currentUnitAI == MAX_UNITS || units[currentUnitAI].Team() != sim.CurrentTeamTurn() )
 			return true;	// indexed out of the correct team.
 
 		if ( !units[currentUnitAI].IsAlive() ) {
@@ -1457,808 +1454,131 @@ bool BattleScene::ProcessAI()
 			continue;
 		}
 
-		int flags = units[currentUnitAI].AI();
-		AI::AIAction aiAction;
-
-		bool done = aiArr[currentTeamTurn]->Think( &units[currentUnitAI], flags, tacMap, &aiAction );
-
-		switch ( aiAction.actionID ) {
-			case AI::ACTION_SHOOT:
-				{
-					AI_LOG(( "[ai] Unit %d SHOOT\n", currentUnitAI ));
-					bool shot = PushShootAction( &units[currentUnitAI], 
-												 aiAction.shoot.target, 
-												 aiAction.shoot.targetWidth, aiAction.shoot.targetHeight, 
-												 aiAction.shoot.mode, 1.0f, false );
-					GLRELASSERT( shot );
-					if ( !shot )
-						done = true;
-				}
-				break;
-
-			case AI::ACTION_PSI_ATTACK:
-				{
-					AI_LOG(( "[ai] Unit %d PSI target=%d\n", currentUnitAI, aiAction.psi.targetID ));
-					Action* action = actionStack.Push();
-					action->Init( ACTION_PSI_ATTACK, &units[currentUnitAI] );
-					action->type.psi.targetID = aiAction.psi.targetID;
-				}
-				break;
-
-			case AI::ACTION_MOVE:
-				{
-					AI_LOG(( "[ai] Unit %d MOVE pathlen=%d\n", currentUnitAI, aiAction.move.path.pathLen ));
-					Action* action = actionStack.Push();
-					action->Init( ACTION_MOVE, &units[currentUnitAI] );
-					action->type.move.path = aiAction.move.path;
-				}
-				break;
-
-			case AI::ACTION_ROTATE:
-				{
-					AI_LOG(( "[ai] Unit %d ROTATE\n", currentUnitAI ));
-					Vector3F target = { (float)aiAction.rotate.x, 0, (float)aiAction.rotate.y};
-					PushRotateAction( &units[currentUnitAI], target, true );
-				}
-				break;
-
-			case AI::ACTION_INVENTORY:
-				ProcessInventoryAI( &units[currentUnitAI] );
-				break;
-
-			case AI::ACTION_NONE:
-				break;
-
-			default:
-				GLRELASSERT( 0 );
-				break;
-		}
-		if ( done ) {
-			currentUnitAI++;
-		}
-	}
-	return false;
-}
-
-
-void BattleScene::ProcessDoors()
-{
-	Vector2I loc[MAX_UNITS];
-	int nLoc = 0;
-
-	for( int i=0; i<MAX_UNITS; ++i ) {
-		if ( units[i].IsAlive() )
-			loc[nLoc++] = units[i].MapPos();
-	}
-	if ( tacMap->ProcessDoors( loc, nLoc ) ) {
-		visibility.InvalidateAll();
-	}
-}
-
-
-void BattleScene::StopForNewTeamTarget()
-{
-	if ( currentTeamTurn == CIV_TEAM )
-		return;
-
-	//int antiTeam = ALIEN_TEAM;
-	//if ( currentTeamTurn == ALIEN_TEAM )
-	//	antiTeam = TERRAN_TEAM;
-
-	if ( actionStack.Size() == 1 ) {
-		const Action& action = *actionStack.Top();
-		if (   action.actionID == ACTION_MOVE
-			&& action.unit
-			&& action.unit->Team() == currentTeamTurn
-			&& action.type.move.pathFraction == 0 )
-		{
-			// THEN check for interuption.
-			// Clear out the current team events, look for "new team"
-			// Player: only pauses on "new team"
-			// AI: pauses on "new team" OR "new target"
-			// No one pauses for Civs.
-			int i=0;
-			bool newTeam = false;
-			while( i < targetEvents.Size() ) {
-				TargetEvent t = targetEvents[i];
-				if (	( aiArr[currentTeamTurn] || t.team == 1 )	// AI always pause. Players pause on new team.
-					 && t.viewerID == currentTeamTurn
-					 && units[t.targetID].Team() != CIV_TEAM )
-				{
-					// New sighting!
-					GLOUTPUT(( "Sighting: Team %d sighted target %d on team %d.\n", t.viewerID, t.targetID, units[t.targetID].Team() ));
-					newTeam = true;
-					targetEvents.SwapRemove( i );
-				}
-				else {
-					++i;
-				}
-			}
-			if ( newTeam ) {
-				actionStack.Clear();
-			}
-		}
-	}
-}
-
-
-bool BattleScene::ProcessActionCameraBounds( U32 deltaTime, Action* action )
-{
-	bool pop = false;
-	Vector3F lookingAt;
-	float t = Travel( deltaTime, action->type.cameraBounds.speed );
-					
-	// Don't let it over-shoot!
-	engine->CameraLookingAt( &lookingAt );
-	Vector3F atToTarget = action->type.cameraBounds.target - lookingAt;
-
-	Vector3F normal = atToTarget;
-	Vector3F d;
-	Vector2F ui;
-
-	if ( normal.Length() > 0.01 ) {
-		normal.Normalize();
-		d = normal * t;
-	}
-	else {
-		normal.Set( 0, 0, 0 );
-		d = atToTarget;
-	}
-
-	if ( d.Length() < atToTarget.Length() ) {
-		engine->camera.DeltaPosWC( d.x, d.y, d.z );
-	}
-	else {
-		float yrot = engine->camera.GetYRotation();
-		float tilt = engine->camera.GetTilt();
-		float height = engine->camera.PosWC().y;
-		engine->CameraLookAt( action->type.cameraBounds.target.x, action->type.cameraBounds.target.z, height, yrot, tilt );
-		//pop = true;
-	}
-
-	const Screenport& port = engine->GetScreenport();
-	port.WorldToUI( action->type.cameraBounds.target, &ui );
-
-	Rectangle2F inset = CalcInsetUIBounds();
-	if ( action->type.cameraBounds.center ) {
-		Vector2F center = inset.Center();
-		inset.min = center;
-		inset.max = center;
-		inset.Outset( 70 );		// There is a 50 pixel sidebar that throws off this computation. Just make sure outset is large enough.
-	}
-
-	/*GLOUTPUT(( "ProcessActionCameraBounds\n" )); 
-	GLOUTPUT(( "Camera (%.1f,%.1f) ui (%.1f,%.1f)-(%.1f,%.1f)\n",
-				ui.x, ui.y, 
-				inset.min.x, inset.min.y, inset.max.x, inset.max.y ));*/
-
-	if ( inset.Contains( ui ) ) {
-		pop = true;
-	}
-	return pop;
-}
-
-
-int BattleScene::ProcessAction( U32 deltaTime )
-{
-	int result = 0;
-
-	if ( !actionStack.Empty() )
-	{
-		Action* action = actionStack.Top();
-
-		Unit* unit = 0;
-		//const Model* model = 0;
-
-		if ( action->unit ) {
-			if ( !action->unit->IsAlive() ) {
-				actionStack.Pop();
-				return true;
-			}
-			unit = action->unit;
-			//model = GetModel( action->unit );
-		}
-
-		switch ( action->actionID ) {
-			case ACTION_MOVE: 
-				{
-					// Move the unit. Be careful to never move more than one step (Travel() does not).
-					// Used to do intermedia rotation, but it was annoying. Once vision was switched
-					// to 360 it did nothing. So rotation is free now.
-					//
-					float SPEED = 4.5f;
-					float x, z, r;
-
-					MoveAction* move = &action->type.move;
-						
-					move->path.GetPos( action->type.move.pathStep, move->pathFraction, &x, &z, &r );
-					// Face in the direction of walking.
-					unit->SetYRotation( r );
-
-					// Move fast when can't be seen:
-					if ( move->pathStep < move->path.pathLen-1 ) {
-						Vector2<S16> v0 = move->path.GetPathAt( move->pathStep );
-						Vector2<S16> v1 = move->path.GetPathAt( move->pathStep+1 );
-						if (    !visibility.TeamCanSee( TERRAN_TEAM, v0.x, v0.y )
-							 && !visibility.TeamCanSee( TERRAN_TEAM, v1.x, v1.y ) )
-						{
-							SPEED *= 10.0f;
-						}
-					}
-
-					float travel = Travel( deltaTime, SPEED );
-
-					while(    (move->pathStep < move->path.pathLen-1 )
-						   && travel > 0.0f
-						   && (!(result & STEP_COMPLETE))) 
-					{
-						move->path.Travel( &travel, &move->pathStep, &move->pathFraction );
-						if ( move->pathFraction == 0.0f ) {
-							// crossed a path boundary.
-							GLRELASSERT( unit->TU() >= 0.99 );	// one move is one TU. Should never be less than one, but
-																// occasionally see magic floating point number bugs.
-							
-							Vector2<S16> v0 = move->path.GetPathAt( move->pathStep-1 );
-							Vector2<S16> v1 = move->path.GetPathAt( move->pathStep );
-							int d = abs( v0.x-v1.x ) + abs( v0.y-v1.y );
-
-							if ( d == 1 )
-								unit->UseTU( 1.0f );
-							else if ( d == 2 )
-								unit->UseTU( 1.41f );
-							else { GLRELASSERT( 0 ); }
-
-							visibility.InvalidateUnit( unit-units );
-							result |= STEP_COMPLETE;
-						}
-						move->path.GetPos( move->pathStep, move->pathFraction, &x, &z, &r );
-						Vector3F v = { x+0.5f, 0.0f, z+0.5f };
-						unit->SetPos( v, unit->Rotation() );
-					}
-					if ( move->pathStep == move->path.pathLen-1 ) {
-						actionStack.Pop();
-						visibility.InvalidateUnit( unit-units );
-						result |= STEP_COMPLETE | UNIT_ACTION_COMPLETE;
-					}
-				}
-				break;
+		int flags = units[currentUnitAI].AI();
+		AI::AIAction aiAction;
 
-			case ACTION_PSI_ATTACK:
-				{
-					ProcessPsiAttack( action );
-					result |= UNIT_ACTION_COMPLETE;
-					// actionStack.Pop(); called by the ProcessPsiAttack
-				}
-				break;
+		bool done = aiArr[sim.CurrentTeamTurn()]->Think( &units[currentUnitAI], flags, tacMap, &aiAction );
 
-			case ACTION_ROTATE:
+		switch ( aiAction.actionID ) {
+			case AI::ACTION_SHOOT:
 				{
-					const float ROTSPEED = 400.0f;
-					float travel = Travel( deltaTime, ROTSPEED );
-
-					float delta, bias;
-					MinDeltaDegrees( unit->Rotation(), 
-									 action->type.rotate.rotation, 
-									 &delta, &bias );
-
-					if ( delta <= travel ) {
-						unit->SetYRotation( action->type.rotate.rotation );
-						actionStack.Pop();
-						result |= UNIT_ACTION_COMPLETE;
-					}
-					else {
-						unit->SetYRotation( unit->Rotation() + bias*travel );
-					}
+					AI_LOG(( "[ai] Unit %d SHOOT\n", currentUnitAI ));
+					bool shot = sim.PushShootAction( &units[currentUnitAI], 
+												 aiAction.shoot.target, 
+												 aiAction.shoot.targetWidth, aiAction.shoot.targetHeight, 
+												 aiAction.shoot.mode, 1.0f, false );
+					GLRELASSERT( shot );
+					if ( !shot )
+						done = true;
+					else if ( actionLog )
+						actionLog->RecordShoot( currentUnitAI, aiAction.shoot.mode, aiAction.shoot.target, 
+												aiAction.shoot.targetWidth, aiAction.shoot.targetHeight, 1.0f );
 				}
 				break;
 
-			case ACTION_SHOOT:
+			case AI::ACTION_PSI_ATTACK:
 				{
-					int r = ProcessActionShoot( action, unit );
-					result |= r;
+					AI_LOG(( "[ai] Unit %d PSI target=%d\n", currentUnitAI, aiAction.psi.targetID ));
+					Action* action = sim.PushAction( ACTION_PSI_ATTACK, &units[currentUnitAI] );
+					action->type.psi.targetID = aiAction.psi.targetID;
+					RecordAction( action );
 				}
 				break;
 
-			case ACTION_HIT:
+			case AI::ACTION_MOVE:
 				{
-					int r = ProcessActionHit( action );
-					result |= r;
+					AI_LOG(( "[ai] Unit %d MOVE pathlen=%d\n", currentUnitAI, aiAction.move.path.pathLen ));
+					Action* action = sim.PushAction( ACTION_MOVE, &units[currentUnitAI] );
+					action->type.move.path = aiAction.move.path;
+					RecordAction( action );
 				}
 				break;
 
-			case ACTION_DELAY:
+			case AI::ACTION_ROTATE:
 				{
-					if ( deltaTime >= action->type.delay.delay ) {
-						actionStack.Pop();
-						result |= OTHER_ACTION_COMPLETE;
-					}
-					else {
-						action->type.delay.delay -= deltaTime;
-					}
+					AI_LOG(( "[ai] Unit %d ROTATE\n", currentUnitAI ));
+					Vector3F target = { (float)aiAction.rotate.x, 0, (float)aiAction.rotate.y};
+					sim.PushRotateAction( &units[currentUnitAI], target, true );
+					if ( !sim.NoAction() )
+						RecordAction( sim.CurrentAction() );
 				}
 				break;
 
-/*
-			case ACTION_CAMERA:
-				{
-					action->type.camera.timeLeft -= deltaTime;
-					if ( action->type.camera.timeLeft > 0 ) {
-						Vector3F v;
-						for( int i=0; i<3; ++i ) {
-							v.X(i) = Interpolate(	(float)action->type.camera.time, 
-													action->type.camera.start.X(i),
-													0.0f,							
-													action->type.camera.end.X(i),
-													(float)action->type.camera.timeLeft );
-						}
-						engine->camera.SetPosWC( v );
-					}
-					else {
-						actionStack.Pop();
-						result |= OTHER_ACTION_COMPLETE;
-					}
-				}
+			case AI::ACTION_INVENTORY:
+				sim.ProcessInventoryAI( &units[currentUnitAI] );
+				if ( actionLog )
+					actionLog->RecordInventory( currentUnitAI );
 				break;
-*/
 
-			case ACTION_CAMERA_BOUNDS:
-				{
-					if ( ProcessActionCameraBounds( deltaTime, action ) )
-						actionStack.Pop();
-				}
+			case AI::ACTION_NONE:
 				break;
 
 			default:
 				GLRELASSERT( 0 );
 				break;
 		}
+		if ( done ) {
+			currentUnitAI++;
+		}
 	}
-	return result;
+	return false;
 }
 
 
-int BattleScene::ProcessActionShoot( Action* action, Unit* unit )
+bool BattleScene::ProcessActionCameraBounds( U32 deltaTime, CameraBoundsAction* action )
 {
-	DamageDesc damageDesc;
-	bool impact = false;
-	Model* modelHit = 0;
-	Vector3F intersection;
-	U32 delayTime = 0;
-	const WeaponItemDef* weaponDef = 0;
-	Ray ray;
-	int mode = action->type.shoot.mode;
-	const Model* unitModel = GetModel( unit );
-
-	int result = 0;
-
-	if ( unit && unitModel && unit->IsAlive() ) {
-		// Shooting announces the units location.
-		for( int i=0; i<3; ++i ) {
-			if ( aiArr[i] )
-				aiArr[i]->Inform( unit, 2 );
-		}
-
-		Vector3F p0, p1;
-		Vector3F beam0 = { 0, 0, 0 }, beam1 = { 0, 0, 0 };
-
-		const Item* weaponItem = unit->GetWeapon();
-		GLRELASSERT( weaponItem );
-		weaponDef = weaponItem->GetItemDef()->IsWeapon();
-		GLRELASSERT( weaponDef );
-
-		unitModel->CalcTrigger( &p0 );
-		p1 = action->type.shoot.target;
-
-		ray.origin = p0;
-		ray.direction = p1-p0;
-
-		// What can we hit?
-		// model
-		//		unit, alive (does damage)
-		//		unit, dead (does nothing)
-		//		model, world (does damage)
-		//		gun, does nothing
-		// ground / bounds
-
-		// Don't hit the shooter:
-		const Model* ignore[] = { unitModel, GetWeaponModel(unit), 0 };
-		Model* m = engine->IntersectModel( ray, TEST_TRI, 0, 0, ignore, &intersection );
-
-		if ( m && intersection.y < 0.0f ) {
-			// hit ground before the unit (intesection is with the part under ground)
-			// The world bounds will pick this up later.
-			m = 0;
-		}
-		if ( weaponDef->weapon[mode]->flags & WEAPON_DISTANCE ) {
-			if ( m ) {
-				float len = (intersection-ray.origin).Length();
-				if ( len > action->type.shoot.range ) {
-					m = 0;
-				}
-			}
-			if ( m == 0 ) {
-				impact = true;
-				Vector3F normal = ray.direction;
-				normal.Normalize();
-				intersection = ray.origin + normal*action->type.shoot.range;
-				if ( intersection.y < 0 ) intersection.y = 0;
-				beam0 = ray.origin;
-				beam1 = intersection;
-			}
-		}
-
-		weaponDef->DamageBase( mode, &damageDesc );
-
-		if ( m ) {
-			impact = true;
-			GLASSERT( intersection.x >= 0 && intersection.x <= (float)MAP_SIZE );
-			GLASSERT( intersection.z >= 0 && intersection.z <= (float)MAP_SIZE );
-			GLASSERT( intersection.y >= 0 && intersection.y <= 10.0f );
-			beam0 = p0;
-			beam1 = intersection;
-			GLASSERT( m->AABB().Contains( intersection ) );
-			modelHit = m;
-		}
-		else if ( !impact ) {		
-			Vector3F in, out;
-			int inResult, outResult;
-			Rectangle3F worldBounds;
-			worldBounds.Set( 0, 0, 0, 
-							(float)tacMap->Width(), 
-							8.0f,
-							(float)tacMap->Height() );
-
-			int result = IntersectRayAllAABB( ray.origin, ray.direction, worldBounds, 
-											  &inResult, &in, &outResult, &out );
-
-			GLASSERT( result == grinliz::INTERSECT );
-			if ( result == grinliz::INTERSECT ) {
-				beam0 = p0;
-				beam1 = out;
-				intersection = out;
-				GLASSERT( intersection.x >= 0 && intersection.x <= (float)MAP_SIZE );
-				GLASSERT( intersection.z >= 0 && intersection.z <= (float)MAP_SIZE );
-				GLASSERT( intersection.y >= 0 && intersection.y <= 10.0f );
-
-				if ( out.y < 0.01 ) {
-					// hit the ground
-					impact = true;
-
-				}
-			}
-		}
-
-		if ( beam0 != beam1 ) {
-			weaponDef->RenderWeapon( mode,
-									 ParticleSystem::Instance(),
-									 beam0, beam1, 
-									 impact, 
-									 game->CurrentTime(), 
-									 &delayTime );
-			if ( !battleEnding )
-				SoundManager::Instance()->QueueSound( weaponDef->weapon[mode]->sound );
-		}
-	}
-
-	// Messy. Did we hit a target? Problems with code below:
-	// - accepts any target as a hit...not necessary what we were aiming for.
-	// - Ignore explosive data! It is too hard to get right.
-
-	if ( weaponDef && !weaponDef->IsExplosive( mode ) ) {
-		Unit* hitUnit = 0;
-		Unit* hitWeapon = 0;
-		if ( modelHit ) {
-			hitUnit = UnitFromModel( modelHit, false );
-			if ( hitUnit && hitUnit->Team() == unit->Team() )
-				hitUnit = 0;	// don't count friendly fire
-			hitWeapon = UnitFromModel( modelHit, true );
-			if ( hitWeapon && hitWeapon->Team() == unit->Team() )
-				hitWeapon = 0;
-		}
-		WeaponItemDef::AddAccData( action->type.shoot.chanceToHit, hitUnit || hitWeapon );
-	}
-
-	actionStack.Pop();
-	result |= UNIT_ACTION_COMPLETE;
-	action = 0;	// invalidated by pop!!
-
-	if ( impact ) {
-		GLRELASSERT( weaponDef );
-		GLASSERT( intersection.x >= 0 && intersection.x <= (float)MAP_SIZE );
-		GLASSERT( intersection.z >= 0 && intersection.z <= (float)MAP_SIZE );
-		GLASSERT( intersection.y >= 0 && intersection.y <= 10.0f );
-
-		Action *h = actionStack.Push();
-		h->Init( ACTION_HIT, unit );
-		h->type.hit.damageDesc = damageDesc;
-		h->type.hit.weapon = weaponDef->weapon[mode];
-		h->type.hit.p = intersection;
-		
-		h->type.hit.n = ray.direction;
-		h->type.hit.n.Normalize();
+	bool pop = false;
+	Vector3F lookingAt;
+	float t = Travel( deltaTime, action->speed );
+					
+	// Don't let it over-shoot!
+	engine->CameraLookingAt( &lookingAt );
+	Vector3F atToTarget = action->target - lookingAt;
 
-		h->type.hit.m = modelHit;
-	}
+	Vector3F normal = atToTarget;
+	Vector3F d;
+	Vector2F ui;
 
-	if ( delayTime ) {
-		Action* a = actionStack.Push();
-		a->Init( ACTION_DELAY, 0 );
-		a->type.delay.delay = delayTime;
+	if ( normal.Length() > 0.01 ) {
+		normal.Normalize();
+		d = normal * t;
 	}
-
-	if ( impact && modelHit ) {
-		int x = Clamp( (int)LRintf( intersection.x ), 0, MAP_SIZE-1 );
-		int y = Clamp( (int)LRintf( intersection.z ), 0, MAP_SIZE-1 );
-		if ( tacMap->GetFogOfWar().IsSet( x, y, 0 ) ) {
-			PushScrollOnScreen( intersection );
-		}
+	else {
+		normal.Set( 0, 0, 0 );
+		d = atToTarget;
 	}
 
-	return result;
-}
-
-
-void BattleScene::ProcessPsiAttack( Action* action )
-{
-	Unit* unit = action->unit;
-	GLASSERT( unit->TU() > TU_PSI - 0.1f );
-	unit->UseTU( TU_PSI );
-
-	const Unit* targetUnit = &units[action->type.psi.targetID];
-	int psiAttack = unit->GetStats().PsiPower();
-	int psiDefense = targetUnit->PsiDefense();
-	bool success = random.Rand( psiAttack ) > (U32)psiDefense;
-	GLOUTPUT(( "Psi: id=%d attack=%d defense=%d %s\n", targetUnit-units, psiAttack, psiDefense, success ? "success" : "fail" ));
-
-	// Set up the particle effects.
-	static const int LAYERS=3;
-	ParticleSystem* ps = ParticleSystem::Instance();
-	Color4F colors[LAYERS];
-	colors[0] = Convert_4U8_4F( game->MainPaletteColor( 0, 2 ) );
-	colors[1] = Convert_4U8_4F( game->MainPaletteColor( 4, 3 ) );
-	colors[2] = Convert_4U8_4F( game->MainPaletteColor( 2, 2 ) );
-	Color4F colorVelocity = { 0, 0, 0, -0.4f };
-	Vector3F velocity = { 0, 0, 0 };
-
-	Vector3F pos = targetUnit->Pos();
-	if ( GetModel( targetUnit ) ) GetModel( targetUnit )->CalcTrigger( &pos );
-
-	if ( success ) {
-
-		for( int i=0; i<LAYERS; ++i ) {
-			ps->EmitQuad(	ParticleSystem::RING,	
-							colors[i],	colorVelocity,
-							pos, 0.1f,
-							velocity, 0.1f,
-							0, 0.7f/(1.0f+i) );
-			pos.y += 0.1f;
-		}
-
-		for( int i=0; i<MAX_UNITS; ++i ) {
-			if ( units[i].IsAlive() && units[i].Team() == targetUnit->Team() ) {
-				aiArr[unit->Team()]->Inform( &units[i], 0 );
-			}
-		}
+	if ( d.Length() < atToTarget.Length() ) {
+		engine->camera.DeltaPosWC( d.x, d.y, d.z );
 	}
 	else {
-		velocity.y = 1;
-		ps->EmitPoint( 5, ParticleSystem::PARTICLE_SPHERE,
-					   colors[0], colorVelocity,
-					   pos, 0.1f, velocity, 0.2f );
-	}
-	// Pop this - the PSI_ATTACK
-	actionStack.Pop();
-	if ( targetUnit->Team() == TERRAN_TEAM ) {
-		PushScrollOnScreen( targetUnit->Pos() );
+		float yrot = engine->camera.GetYRotation();
+		float tilt = engine->camera.GetTilt();
+		float height = engine->camera.PosWC().y;
+		engine->CameraLookAt( action->target.x, action->target.z, height, yrot, tilt );
+		//pop = true;
 	}
-}
 
-void BattleScene::GenerateCrawler( const Unit* unit, const Unit* shooter )
-{
-	if (    unit->Team() == CIV_TEAM
-		 && shooter->Team() == ALIEN_TEAM
-		 && shooter->AlienType() == Unit::ALIEN_SPITTER ) 
-	{
-		for( int i=ALIEN_UNITS_START; i<ALIEN_UNITS_END; ++i ) {
-			if ( !units[i].InUse() ) {
-				int rank = shooter->GetStats().Rank();
-				Vector3F pos = unit->Pos();
-				float rot = unit->Rotation();
-
-				int alienCount[Unit::NUM_ALIEN_TYPES] = { 0 };
-				alienCount[Unit::ALIEN_CRAWLER] = 1;
-				TacticalIntroScene::GenerateAlienTeam( &units[i], alienCount, (float)rank, game->GetItemDefArr(), random.Rand() );
-				units[i].SetPos( pos, rot );
+	const Screenport& port = engine->GetScreenport();
+	port.WorldToUI( action->target, &ui );
 
-				return;
-			}
-		}
+	Rectangle2F inset = CalcInsetUIBounds();
+	if ( action->center ) {
+		Vector2F center = inset.Center();
+		inset.min = center;
+		inset.max = center;
+		inset.Outset( 70 );		// There is a 50 pixel sidebar that throws off this computation. Just make sure outset is large enough.
 	}
-}
-
-
-int BattleScene::ProcessActionHit( Action* action )
-{
-	Rectangle2I destroyed;
-	destroyed.SetInvalid();
-	int result = 0;
-	static const int MAX_EXPLOSION = 8;
-	Vector2I explosion[MAX_EXPLOSION];
 
-	int nExplosion = 0;
-	bool flareExplosion = (action->type.hit.weapon->flags & WEAPON_FLARE) != 0;
-	bool smokeExplosion = (action->type.hit.weapon->flags & WEAPON_SMOKE) != 0;
-
-	if ( !(action->type.hit.weapon->flags & WEAPON_EXPLOSIVE) ) {
-		if ( !battleEnding )
-			SoundManager::Instance()->QueueSound( "hit" );
-
-		// Apply direct hit damage
-		Model* m = action->type.hit.m;
-		Unit* hitUnit = 0;
-		Unit* hitWeapon = 0;
-
-		if ( m ) {
-			hitUnit = UnitFromModel( m, false );
-			hitWeapon = UnitFromModel( m, true );
-		}
-
-		if ( hitUnit ) {
-			if ( hitUnit->IsAlive() ) {
-				hitUnit->DoDamage( action->type.hit.damageDesc, tacMap, true );
-				if ( !hitUnit->IsAlive() ) {
-					GenerateCrawler( hitUnit, action->unit );
-					selection.ClearTarget();			
-					visibility.InvalidateUnit( hitUnit - units );
-					if ( action->unit ) {
-						action->unit->CreditKill();
-					}
-				}
-				GLOUTPUT(( "Hit Unit 0x%x hp=%d/%d\n", (unsigned)hitUnit, (int)hitUnit->HP(), (int)hitUnit->GetStats().TotalHP() ));
-			}
-		}
-		else if ( hitWeapon ) {
-			Inventory* inv = hitWeapon->GetInventory();
-			inv->RemoveItem( Inventory::WEAPON_SLOT );
-			GLOUTPUT(( "Shot the weapon out of Unit 0x%x hand.\n", (unsigned)hitWeapon ));
-		}
-		else if ( m && m->IsFlagSet( Model::MODEL_OWNED_BY_MAP ) ) {
-			Rectangle2I bounds;
-			tacMap->MapBoundsOfModel( m, &bounds );
-
-			// Hit world object.
-			Vector2I exp = { -1, -1 };
-
-			MapDamageDesc damage;
-			action->type.hit.damageDesc.MapDamage( &damage );
+	/*GLOUTPUT(( "ProcessActionCameraBounds\n" )); 
+	GLOUTPUT(( "Camera (%.1f,%.1f) ui (%.1f,%.1f)-(%.1f,%.1f)\n",
+				ui.x, ui.y, 
+				inset.min.x, inset.min.y, inset.max.x, inset.max.y ));*/
 
-			tacMap->DoDamage( m, damage, &destroyed, &exp );
-			if ( exp.x >= 0 )
-				explosion[nExplosion++] = exp;
-		}
-	}
-	else {
-		// There is a small offset to move the explosion back towards the shooter.
-		// If it hits a wall (common) this will move it to the previous square.
-		// Also means a model hit may be a "near miss"...but explosions are messy.
-		explosion[0].Set(	(int)(action->type.hit.p.x - 0.2f*action->type.hit.n.x), 
-							(int)(action->type.hit.p.z - 0.2f*action->type.hit.n.z) );
-
-		nExplosion = 1;
-	}
-
-
-	int totalExplosion = nExplosion;
-	if ( nExplosion ) {
-		// Explosion
-		if (!battleEnding)
-			SoundManager::Instance()->QueueSound( "explosion" );
-
-		const int MAX_RAD = 2;
-		const int MAX_RAD_2 = MAX_RAD*MAX_RAD;
-		Rectangle2I mapBounds = tacMap->Bounds();
-
-		while ( nExplosion ) {
-			// generates smoke:
-			int x0 = explosion[nExplosion-1].x;
-			int y0 = explosion[nExplosion-1].y;
-
-			destroyed.Set( x0-MAX_RAD, y0-MAX_RAD, x0+MAX_RAD, y0+MAX_RAD );
-
-			for( int rad=0; rad<=MAX_RAD; ++rad ) {
-				DamageDesc dd = action->type.hit.damageDesc;
-				dd.Scale( (float)(1+MAX_RAD-rad) / (float)(1+MAX_RAD) );
-
-				for( int y=y0-rad; y<=y0+rad; ++y ) {
-					for( int x=x0-rad; x<=x0+rad; ++x ) {
-						if ( x==(x0-rad) || x==(x0+rad) || y==(y0-rad) || y==(y0+rad) ) {
-
-							Vector2I x0y0 = { x, y };
-							if ( !mapBounds.Contains( x0y0 ) )	// keep explosions in-bounds
-								continue;
-
-							// Tried to do this with the pather, but the issue with 
-							// walls being on the inside and outside of squares got 
-							// ugly. But the other option - ray casting - also nasty.
-							// Finally settled on a line walk with CanSee()
-							int radius2 = (x-x0)*(x-x0) + (y-y0)*(y-y0);
-							if ( radius2 > MAX_RAD_2 )
-								continue;
-						
-							// can the tile to be damaged be reached by the explosion?
-							// visibility is checked up to the tile before this one, else
-							// it is possible to miss because "you can't see yourself"
-							bool canSee = true;
-							if ( rad > 0 ) {
-								LineWalk walk( x0, y0, x, y );
-								// Actually 'less than' so that damage goes through walls a little.
-								while( walk.CurrentStep() < walk.NumSteps() ) {
-									Vector2I p = walk.P();
-									Vector2I q = walk.Q();
-
-									if ( !tacMap->CanSee( p, q ) ) {
-										canSee = false;
-										break;
-									}
-									walk.Step();
-								}
-								if ( !canSee )
-									continue;
-							}
-
-							Unit* unit = GetUnitFromTile( x, y );
-							if ( unit && unit->IsAlive() ) {
-								unit->DoDamage( dd, tacMap, true );
-								if ( !unit->IsAlive() ) {
-									visibility.InvalidateUnit( unit - units );
-									if ( unit == SelectedSoldierUnit() ) {
-										selection.ClearTarget();			
-									}
-									if ( action->unit )
-										action->unit->CreditKill();
-								}
-							}
-							bool hitAnything = false;
-							Vector2I exp = { -1, -1 };
-							MapDamageDesc damage;
-							dd.MapDamage( &damage );
-							tacMap->DoDamage( x, y, damage, &destroyed, &exp );
-
-							if (    totalExplosion < MAX_EXPLOSION 
-								 && exp.x >= 0 && nExplosion < MAX_EXPLOSION ) 
-							{
-								explosion[nExplosion++] = exp;
-								++totalExplosion;
-							}
-
-							// Where to add smoke?
-							// - if we hit anything
-							// - chance of smoke anyway
-							if ( flareExplosion ) {
-								int turns = 12 + random.Rand( 6 );
-								tacMap->AddFlare( x, y, turns );
-							}
-							else if ( smokeExplosion ) {
-								int turns = 12 + random.Rand( 6 );
-								tacMap->AddSmoke( x, y, turns );
-							}
-							else if ( hitAnything || random.Bit() ) {
-								int turns = 4 + random.Rand( 4 );
-								tacMap->AddSmoke( x, y, turns );
-							}
-						}
-					}
-				}
-			}
-			nExplosion--;
-			flareExplosion = false;
-			smokeExplosion = false;
-		}
+	if ( inset.Contains( ui ) ) {
+		pop = true;
 	}
-	visibility.InvalidateAll( destroyed ); 
-	actionStack.Pop();
-	result |= UNIT_ACTION_COMPLETE;
-	return true;
+	return pop;
 }
 
 
@@ -2288,6 +1608,9 @@ void BattleScene::HandleHotKeyMask( int mask )
 		controlButton[PREV_BUTTON].SetVisible( visible );
 
 	}
+	if ( mask & GAME_HK_TOGGLE_FAST ) {
+		fastForward = !fastForward;
+	}
 }
 
 
@@ -2339,7 +1662,7 @@ void BattleScene::HandleNextUnit( int bias )
 
 void BattleScene::HandleRotation( float bias )
 {
-	if ( actionStack.Empty() && SelectedSoldierUnit() ) {
+	if ( NoAction() && SelectedSoldierUnit() ) {
 		Unit* unit = SelectedSoldierUnit();
 
 		float r = unit->Rotation();
@@ -2347,9 +1670,9 @@ void BattleScene::HandleRotation( float bias )
 		r = NormalizeAngleDegrees( r );
 		r = 45.f * float( (int)((r+20.0f) / 45.f) );
 
-		Action* action = actionStack.Push();
-		action->Init( ACTION_ROTATE, unit );
+		Action* action = sim.PushAction( ACTION_ROTATE, unit );
 		action->type.rotate.rotation = r;
+		RecordAction( action );
 	}
 }
 
@@ -2384,7 +1707,10 @@ bool BattleScene::HandleIconTap( const gamui::UIItem* tapped )
 					targetModel->CalcTargetSize( &targetWidth, &targetHeight );
 				}
 			}
-			PushShootAction( selection.soldierUnit, target, targetWidth, targetHeight, mode, 1.0f, false );
+			if ( sim.PushShootAction( selection.soldierUnit, target, targetWidth, targetHeight, mode, 1.0f, false ) ) {
+				if ( actionLog ) 
+					actionLog->RecordShoot( GetUnitID( selection.soldierUnit ), mode, target, targetWidth, targetHeight, 1.0f );
+			}
 		}
 		selection.targetUnit = 0;
 		selection.targetPos.Set( -1, -1 );
@@ -2398,7 +1724,7 @@ bool BattleScene::HandleIconTap( const gamui::UIItem* tapped )
 			HandleRotation( -45.f );
 		}
 		else if ( tapped == &invButton ) {
-			if ( actionStack.Empty() && SelectedSoldierUnit() ) {
+			if ( NoAction() && SelectedSoldierUnit() ) {
 				CharacterSceneData* input = new CharacterSceneData();
 				input->unit = SelectedSoldierUnit();
 				input->nUnits = 1;
@@ -2431,9 +1757,9 @@ bool BattleScene::HandleIconTap( const gamui::UIItem* tapped )
 		}
 		else if ( tapped == &moveOkayCancelUI.okayButton && confirmDest.x >= 0 ) {
 			// Go!
-			Action* action = actionStack.Push();
-			action->Init( ACTION_MOVE, SelectedSoldierUnit() );
+			Action* action = sim.PushAction( ACTION_MOVE, SelectedSoldierUnit() );
 			action->type.move.path.Init( pathCache );
+			RecordAction( action );
 			tacMap->ClearNearPath();
 			confirmDest.Set( -1, -1 );
 		}
@@ -2467,7 +1793,7 @@ void BattleScene::SceneResult( int sceneID, int result )
 		for( int i=CIV_UNITS_START; i<CIV_UNITS_END; ++i ) {
 			DamageDesc d = { 100, 100, 100 };
 			if ( units[i].IsAlive() )
-				units[i].DoDamage( d, tacMap, true );
+				units[i].DoDamage( d, tacMap );
 		}
 
 		PushEndScene();
@@ -2640,7 +1966,7 @@ void BattleScene::Tap(	int action,
 	}
 #endif
 
-	bool uiActive = actionStack.Empty() && (currentTeamTurn == TERRAN_TEAM);
+	bool uiActive = NoAction() && (sim.CurrentTeamTurn() == TERRAN_TEAM);
 	Vector2F ui;
 	engine->GetScreenport().ViewToUI( view, &ui );
 	bool processTap = false;
@@ -2670,7 +1996,7 @@ void BattleScene::Tap(	int action,
 
 			if (    action == GAME_TAP_UP
 				 && dragLength <= 1.0f 
-				 && actionStack.Empty() )
+				 && NoAction() )
 			{
 				processTap = true;
 			}
@@ -2776,7 +2102,7 @@ void BattleScene::Tap(	int action,
 		}
 		for( int i=ALIEN_UNITS_START; i<ALIEN_UNITS_END; ++i ) {
 			if ( GetModel( &units[i] ) ) {
-				if ( canSelectAlien && units[i].IsAlive() && visibility.TeamCanSee( TERRAN_TEAM, units[i].MapPos() ) ) {
+				if ( canSelectAlien && units[i].IsAlive() && visibility->TeamCanSee( TERRAN_TEAM, units[i].MapPos() ) ) {
 					unitRenderers[i].SetSelectable( true );
 					if ( units[i].MapPos() == tilePos ) {
 						GLRELASSERT( !tappedUnit );
@@ -2824,9 +2150,9 @@ void BattleScene::Tap(	int action,
 				}
 				else {
 					// Go!
-					Action* action = actionStack.Push();
-					action->Init( ACTION_MOVE, SelectedSoldierUnit() );
+					Action* action = sim.PushAction( ACTION_MOVE, SelectedSoldierUnit() );
 					action->type.move.path.Init( pathCache );
+					RecordAction( action );
 					tacMap->ClearNearPath();
 				}
 			}
@@ -2918,100 +2244,6 @@ Unit* BattleScene::UnitFromModel( const Model* m, bool useWeaponModel )
 }
 
 
-Unit* BattleScene::GetUnitFromTile( int x, int z )
-{
-	for( int i=0; i<MAX_UNITS; ++i ) {
-		int ux = (int)units[i].Pos().x;
-		if ( ux == x ) {
-			int uz = (int)units[i].Pos().z;
-			if ( uz == z ) { 
-				return &units[i];
-			}
-		}
-	}
-	return 0;
-}
-
-
-void BattleScene::DumpTargetEvents()
-{
-#if 0
-	for( int i=0; i<targetEvents.Size(); ++i ) {
-		const TargetEvent& e = targetEvents[i];
-		const char* teams[] = { "Terran", "Civ", "Alien" };
-
-		if ( !e.team ) {
-			GLOUTPUT(( "%s Unit %d %s %d\n",
-						teams[ units[e.viewerID].Team() ],
-						e.viewerID, 
-						teams[ units[e.targetID].Team() ],
-						e.targetID ));
-		}
-		else {
-			GLOUTPUT(( "%s Team %s %d\n",
-						teams[ e.viewerID ],
-						teams[ units[e.targetID].Team() ],
-						e.targetID ));
-		}
-	}
-#endif
-}
-
-
-void BattleScene::CalcTeamTargets()
-{
-	GRINLIZ_PERFTRACK
-	// generate events.
-	// - if team gets/loses target
-	// - if unit gets/loses target
-
-	grinliz::BitArray<MAX_UNITS, MAX_UNITS, 1> newUnitVis;
-	visibility.CalcVisMap( &newUnitVis );
-
-	const static Vector2I range[3] = {
-		{ TERRAN_UNITS_START, TERRAN_UNITS_END },
-		{ CIV_UNITS_START, CIV_UNITS_END },
-		{ ALIEN_UNITS_START, ALIEN_UNITS_END }
-	};
-
-	for( int src=0; src<MAX_UNITS; ++src ) {
-		if ( !units[src].IsAlive() )
-			continue;
-
-		for( int dst=0; dst<MAX_UNITS; ++dst ) {
-			if (    !units[src].IsAlive()
-				 || units[src].Team() == units[dst].Team() )	// Don't generate messages about team mates.
-			{
-				 continue;
-			}
-
-			// check unit change - did we see something new?
-			if ( !unitVis.IsSet( src, dst ) && newUnitVis.IsSet( src, dst ) )
-			{
-				int srcTeam = units[src].Team();
-
-				TargetEvent e = { 0, src, dst };
-				targetEvents.Push( e );
-				//e.Dump();
-
-				// Check team change.
-				Rectangle2I teamRange;
-				teamRange.Set( range[srcTeam].x, dst, range[srcTeam].y-1, dst );	// note the -1 inclusive/exclusive thing
-
-				// No one on this team, prior to this check, could see the unit.
-				if ( unitVis.IsRectEmpty( teamRange ) )
-				{	
-					TargetEvent e = { 1, srcTeam, dst };
-					targetEvents.Push( e );
-					//e.Dump();
-				}
-			}
-		}
-	}
-	unitVis = newUnitVis;
-}
-
-
 void BattleScene::DragUnitStart( const grinliz::Vector2I& map )
 {
 	for( int i=TERRAN_UNITS_START; i<TERRAN_UNITS_END; ++i ) {
@@ -3116,9 +2348,9 @@ void BattleScene::DragUnitEnd( const grinliz::Vector2I& map )
 				confirmDest.Set( end.x, end.y );
 			}
 			else {
-				Action* action = actionStack.Push();
-				action->Init( ACTION_MOVE, SelectedSoldierUnit() );
+				Action* action = sim.PushAction( ACTION_MOVE, SelectedSoldierUnit() );
 				action->type.move.path.Init( pathCache );
+				RecordAction( action );
 			}
 		}
 	}
@@ -3301,14 +2533,14 @@ void BattleScene::DrawHUD()
 	}
 	else {
 		{
-			bool enabled = SelectedSoldierUnit() && actionStack.Empty() && targetButton.Up();
+			bool enabled = SelectedSoldierUnit() && NoAction() && targetButton.Up();
 			targetButton.SetEnabled( enabled );
 			invButton.SetEnabled( enabled );
 			controlButton[ROTATE_CCW_BUTTON].SetEnabled( enabled );
 			controlButton[ROTATE_CW_BUTTON].SetEnabled( enabled );
 		}
 		{
-			bool enabled = actionStack.Empty() && targetButton.Up();
+			bool enabled = NoAction() && targetButton.Up();
 			controlButton[NEXT_BUTTON].SetEnabled( enabled );
 			controlButton[PREV_BUTTON].SetEnabled( enabled );
 			exitButton.SetEnabled( enabled );
@@ -3329,8 +2561,8 @@ void BattleScene::DrawHUD()
 		//if ( turnImage.Visible() ) {
 		//	turnImage.SetRotationY( rotation );
 		//}
-		if ( currentTeamTurn == TERRAN_TEAM ) {
-			int count = visibility.NumTeamCanSee( TERRAN_TEAM, ALIEN_TEAM );
+		if ( sim.CurrentTeamTurn() == TERRAN_TEAM ) {
+			int count = visibility->NumTeamCanSee( TERRAN_TEAM, ALIEN_TEAM );
 			if ( count > 0 ) {
 				CStr<6> str;
 				if ( count < 10 )
@@ -3372,114 +2604,6 @@ void BattleScene::DrawHUD()
 }
 
 
-float MotionPath::DeltaToRotation( int dx, int dy )
-{
-	float rot = 0.0f;
-	GLRELASSERT( dx || dy );
-	GLRELASSERT( dx >= -1 && dx <= 1 );
-	GLRELASSERT( dy >= -1 && dy <= 1 );
-
-	if ( dx == 1 ) 
-		if ( dy == 1 )
-			rot = 45.0f;
-		else if ( dy == 0 )
-			rot = 90.0f;
-		else
-			rot = 135.0f;
-	else if ( dx == 0 )
-		if ( dy == 1 )
-			rot = 0.0f;
-		else
-			rot = 180.0f;
-	else
-		if ( dy == 1 )
-			rot = 315.0f;
-		else if ( dy == 0 )
-			rot = 270.0f;
-		else
-			rot = 225.0f;
-	return rot;
-}
-
-
-void MotionPath::Init( const MP_VECTOR< Vector2<S16> >& pathCache ) 
-{
-	GLRELASSERT( pathCache.size() <= (unsigned)MAX_TU );
-	GLRELASSERT( pathCache.size() > 1 );	// at least start and end
-
-	pathLen = (int)pathCache.size();
-	for( unsigned i=0; i<pathCache.size(); ++i ) {
-		GLRELASSERT( pathCache[i].x < 256 );
-		GLRELASSERT( pathCache[i].y < 256 );
-		pathData[i*2+0] = (U8) pathCache[i].x;
-		pathData[i*2+1] = (U8) pathCache[i].y;
-	}
-}
-
-		
-void MotionPath::CalcDelta( int i0, int i1, grinliz::Vector2I* vec, float* rot )
-{
-	Vector2<S16> path0 = GetPathAt( i0 );
-	Vector2<S16> path1 = GetPathAt( i1 );
-
-	int dx = path1.x - path0.x;
-	int dy = path1.y - path0.y;
-	if ( vec ) {
-		vec->x = dx;
-		vec->y = dy;
-	}
-	if ( rot ) {
-		*rot = DeltaToRotation( dx, dy );
-	}
-}
-
-
-void MotionPath::Travel(	float* travel,
-							int* pos,
-							float* fraction )
-{
-	// fraction is a bit funny. It is the lerp value between 2 path locations,
-	// so it isn't a constant distance.
-	Vector2I vec;
-	CalcDelta( *pos, *pos+1, &vec, 0 );
-
-	float distBetween = 1.0f;
-	if ( vec.x && vec.y ) {
-		distBetween = 1.41f;
-	}
-	float distRemain = (1.0f-*fraction) * distBetween;
-
-	if ( *travel >= distRemain ) {
-		*travel -= distRemain;
-		(*pos)++;
-		*fraction = 0.0f;
-	}
-	else {
-		*fraction += *travel / distBetween;
-		*travel = 0.0f;
-	}
-}
-
-
-void MotionPath::GetPos( int step, float fraction, float* x, float* z, float* rot )
-{
-	GLRELASSERT( step < pathLen );
-	GLRELASSERT( fraction >= 0.0f && fraction < 1.0f );
-	if ( step == pathLen-1 ) {
-		step = pathLen-2;
-		fraction = 1.0f;
-	}
-	Vector2<S16> path0 = GetPathAt( step );
-	Vector2<S16> path1 = GetPathAt( step+1 );
-
-	int dx = path1.x - path0.x;
-	int dy = path1.y - path0.y;
-	*x = (float)path0.x + fraction*(float)( dx );
-	*z = (float)path0.y + fraction*(float)( dy );
-	*rot = DeltaToRotation( dx, dy );
-}
-
-
 #if 0
 // TEST CODE
 void BattleScene::MouseMove( int x, int y )
@@ -29,6 +29,8 @@
 #include "../gamui/gamui.h"
 #include "tacticalendscene.h"
 #include "battlevisibility.h"
+#include "tacticalsim.h"
+#include "unitrenderer.h"
 #include "consolewidget.h"
 #include "firewidget.h"
 
@@ -40,28 +42,10 @@ class UIImage;
 class Engine;
 class Texture;
 class AI;
+class ActionLog;
+class TacMap;
 struct MapDamageDesc;
-
-// Needs to be a POD because it gets 'union'ed in a bunch of events.
-// size is important for the same reason.
-struct MotionPath
-{
-	int						pathLen;
-	U8						pathData[MAX_TU*2];
-
-	grinliz::Vector2<S16>	GetPathAt( int i ) 
-	{
-		GLRELASSERT( i < pathLen );
-		grinliz::Vector2<S16> v = { pathData[i*2+0], pathData[i*2+1] };
-		return v;
-	}
-	void Init( const MP_VECTOR< grinliz::Vector2<S16> >& pathCache );
-	void CalcDelta( int i0, int i1, grinliz::Vector2I* vec, float* rot );
-	void Travel( float* travelDistance, int* pathPos, float* fraction );
-	void GetPos( int step, float fraction, float* x, float* z, float* rot );
-private:
-	float DeltaToRotation( int dx, int dy );
-};
+struct MapDesc;
 
 /*
 	Naming:			
@@ -86,7 +70,7 @@ private:
 	Variation:
 		00-99
 */
-class BattleScene : public Scene, public IPathBlocker
+class BattleScene : public Scene, public IPathBlocker, public ITacticalSimListener
 {
 public:
 	BattleScene( Game* );
@@ -117,7 +101,11 @@ public:
 
 	virtual SavePathType CanSave()										{ return SAVEPATH_TACTICAL; }
 	virtual void Save( tinyxml2::XMLPrinter* );
+	virtual int SaveTurn()												{ return sim.TurnCount(); }
 	virtual void Load( const tinyxml2::XMLElement* doc );
+	// Loads a new battle, where the map comes from TacticalIntroScene::CreateMap
+	// and the <Map> element of 'doc' is not read.
+	void Load( const tinyxml2::XMLElement* doc, const MapDesc& mapDesc );
 
 	// debugging / MapMaker
 	void MouseMove( int x, int y );
@@ -128,11 +116,17 @@ public:
 
 	virtual void MakePathBlockCurrent( Map* map, const void* user );
 
+	// ITacticalSimListener
+	virtual void UnitDown( Unit* unit );
+	virtual void UnitUpgraded( Unit* unit );
+	virtual U32 ShotFired(	const Unit* unit, const WeaponItemDef* weaponDef, int mode,
+							const grinliz::Vector3F& p0, const grinliz::Vector3F& p1,
+							bool impact, bool hitModel );
+	virtual void ShotLanded( bool direct, bool explosion );
+	virtual void PsiAttacked( const Unit* unit, const Unit* target, bool success );
+
 	const Model* GetModel( const Unit* unit );
 	const Model* GetWeaponModel( const Unit* unit );
-	const Unit* GetUnit( const Model* m, bool isWeaponModel ) {
-		return UnitFromModel( m, isWeaponModel );
-	}
 	int GetUnitID( const Unit* u ) const { return u-units; }
 
 private:
@@ -152,119 +146,25 @@ private:
 		BTN_COUNT
 	};
 
-	enum {
-		ACTION_NONE,
-		ACTION_MOVE,
-		ACTION_ROTATE,
-		ACTION_SHOOT,
-		ACTION_DELAY,
-		ACTION_HIT,
-		ACTION_CAMERA_BOUNDS,
-		ACTION_PSI_ATTACK
-	};
-
-	struct MoveAction	{
-		int			pathStep;
-		float		pathFraction;
-		MotionPath	path;
-	};
-
-	struct RotateAction {
-		float rotation;
-	};
-
-	struct ShootAction {
-		int					mode;
-		float				chanceToHit;
-		float				range;
-		grinliz::Vector3F	target;
-	};
-
-	struct PsiAction {
-		int targetID;
-	};
-
-	struct DelayAction {
-		U32 delay;
-	};
-
-	struct HitAction {
-		DamageDesc						damageDesc;		// damage done.
-		const WeaponItemDef::Weapon*	weapon;			// by what
-		
-		grinliz::Vector3F	p;				// point of impact
-		grinliz::Vector3F	n;				// normal from shooter to target
-		Model*				m;				// model impacted - may be 0
-	};
-
-	struct CameraAction {
-		grinliz::Vector3F	start;
-		grinliz::Vector3F	end;
-		int					time;
-		int					timeLeft;
-	};
-
+	// The camera moves are done before the actions of the sim.
 	struct CameraBoundsAction {
 		grinliz::Vector3F	target;
 		float				speed;
 		bool				center;
 	};
-
-	struct Action
-	{
-		int actionID;
-		Unit* unit;			// unit performing the action (sometimes null)
-
-		union {
-			MoveAction			move;
-			RotateAction		rotate;
-			ShootAction			shoot;
-			PsiAction			psi;
-			DelayAction			delay;
-			HitAction			hit;
-			CameraAction		camera;
-			CameraBoundsAction	cameraBounds;
-		} type;
-
-		void Clear()							{ actionID = ACTION_NONE; memset( &type, 0, sizeof( type ) ); }
-		void Init( int id, Unit* unit )			{ Clear(); actionID = id; this->unit = unit; }
-		bool NoAction()							{ return actionID == ACTION_NONE; }
-	};
-	CStack< Action > actionStack;
+	CStack< CameraBoundsAction > cameraStack;
 
 	void PushEndScene();
-	void PushRotateAction( Unit* src, const grinliz::Vector3F& dst, bool quantize );
-	
-	// Try to shoot. Return true if success.
-	bool PushShootAction(	Unit* src, 
-							const grinliz::Vector3F& target, 
-							float targetWidth, 
-							float targetHeight,
-							int mode,
-							float useError,				// if 0, perfect shot. <1 improve, 1 normal error, >1 more error
-							bool clearMoveIfShoot );	// clears move commands if needed
-
 	void PushScrollOnScreen( const grinliz::Vector3F& v, bool center=false );
-
-	// Process the current action. Returns flags that describe what happened.
-	enum { 
-		STEP_COMPLETE			= 0x01,		// the step of a unit on a path completed. The unit is centered on the map grid
-		UNIT_ACTION_COMPLETE	= 0x02,		// shooting, rotating, some other unit action finished (resulted in Pop() )
-		OTHER_ACTION_COMPLETE	= 0x04,		// a non unit action (camera motion) finised (resulted in a Pop() )
-	};		
-	int ProcessAction( U32 deltaTime );
-	int ProcessActionShoot( Action* action, Unit* unit );
-	int ProcessActionHit( Action* action );	
-	bool ProcessActionCameraBounds( U32 deltaTime, Action* action );
-	void ProcessPsiAttack( Action* action );
+	// Returns true when the camera move is done.
+	bool ProcessActionCameraBounds( U32 deltaTime, CameraBoundsAction* action );
+	// True if the camera and the sim have nothing to do.
+	bool NoAction()		{ return cameraStack.Empty() && sim.NoAction(); }
 	
 	grinliz::Rectangle2F CalcInsetUIBounds();
 
 	void OrderNextPrev();
 
-	void StopForNewTeamTarget();
-	void DoReactionFire();
-
 	int CenterRectIntersection( const grinliz::Vector2F& p,
 								const grinliz::Rectangle2F& rect,
 								grinliz::Vector2F* out );
@@ -284,6 +184,17 @@ private:
 	grinliz::Vector2I		confirmDest;
 	void ShowNearPath( const Unit* unit );		// call freely; does nothing if the current path is valid.
 
+	// The sim advances in fixed steps of SIM_STEP msec, at most MAX_SIM_STEPS
+	// per frame. Fast forward runs FAST_FORWARD_STEPS per frame.
+	enum {
+		SIM_STEP			= 20,
+		MAX_SIM_STEPS		= 5,
+		FAST_FORWARD_STEPS	= 25
+	};
+	void SimStep( bool emitParticles );
+	// Places the models between the previous and current step.
+	void UpdateUnitRenderers( float fraction );
+
 	// set the fire widget to the primary and secondary weapon
 	float Travel( U32 timeMSec, float speed ) { return speed * (float)timeMSec / 1000.0f; }
 
@@ -292,12 +203,10 @@ private:
 	void TestCoordinates();
 
 	Unit* UnitFromModel( const Model* m, bool useWeaponModel=false );
-	Unit* GetUnitFromTile( int x, int z );
 
 	bool HandleIconTap( const gamui::UIItem* item );
 	void HandleNextUnit( int bias );
 	void HandleRotation( float bias );
-	void SetFogOfWar();
 	void SetUnitOverlays();
 
 	struct Selection
@@ -324,8 +233,13 @@ private:
 	void	SetSelection( Unit* unit );
 
 	void NextTurn( bool saveOnTerranTurn );
-	void GenerateCrawler( const Unit* unitKilled, const Unit* shooter );
-	void UpgradeCrawlerToSpitter( Unit* unit );
+	void LoadBattle( const tinyxml2::XMLElement* battleElement, const MapDesc* mapDesc );
+	void LogStateHash( const TacticalSim::BattleHash& hash );
+
+	// Recording of the ActionLog. It is played back by the TacticalReplay.
+	void StartRecording();
+	void SaveActionLog();		// appends the records since the last save
+	void RecordAction( const Action* action );
 
 	void Drag( int action, bool uiActivated, const grinliz::Vector2F& view );
 	void DragUnitStart( const grinliz::Vector2I& map );
@@ -379,42 +293,24 @@ private:
 
 	int	subTurnOrder[MAX_TERRANS];
 	int	subTurnCount;
-	int turnCount;
 	
 	Engine*			engine;
 	TacMap*			tacMap;
 	Storage*		lockedStorage;	// locked for use by the character scene
-	grinliz::Random random;			// "the" random number generator for the battle
-	int				currentTeamTurn;
+	TacticalSim		sim;			// the rules of the battle; BattleScene is the view
+	ActionLog*		actionLog;		// null unless recording
 	AI*				aiArr[3];
 	int				currentUnitAI;
 	bool			battleEnding;		// not saved - used to prevent event loops
 	bool			cameraSet;
 	float			orbit;
+	U32				simTime;			// time not yet simulated, < SIM_STEP
+	bool			fastForward;		// skip animations: run the sim as fast as possible
+	grinliz::Vector3F	prevUnitPos[MAX_UNITS];	// unit positions before the last sim step
 
-	struct TargetEvent
-	{
-		U8 team;		// 1: team, 0: unit
-		U8 viewerID;	// unit id of viewer, or teamID if team event
-		U8 targetID;	// unit id of target
-
-		void Dump() { GLOUTPUT(( "TargetEvent team=%d viewerID=%d targetID=%d\n", team, viewerID, targetID )); }
-	};
-
-	grinliz::BitArray<MAX_UNITS, MAX_UNITS, 1>	unitVis;	// map of "previous" unit vis. Difference between this and current creates targetEvents.
-	CDynArray< TargetEvent >					targetEvents;
-
-	CDynArray< grinliz::Vector2I > doors;
-	void ProcessDoors();
 	bool ProcessAI();			// return true if turn over.
-	void ProcessInventoryAI( Unit* unit );			// return true if turn over.
-
-	// Updates what units can and can not see. Sets the 'Targets' structure above,
-	// and generates targetEvents.
-	void CalcTeamTargets();
-	void DumpTargetEvents();
 
-	Visibility visibility;
+	Visibility*	visibility;		// owned by the sim
 
 	Unit*				units;
 	UnitRenderer		unitRenderers[MAX_UNITS];
@@ -14,8 +14,8 @@
 */
 
 #include "battlevisibility.h"
-#include "battlescene.h"
-#include "../engine/engine.h"
+#include "unit.h"
+#include "tacticalsim.h"
 
 #include "../grinliz/glrectangle.h"
 
@@ -23,7 +23,7 @@
 
 using namespace grinliz;
 
-Visibility::Visibility() : battleScene( 0 ), units( 0 ), map( 0 )
+Visibility::Visibility() : units( 0 ), map( 0 ), seeAll( false )
 {
 	for( int i=0; i<MAX_UNITS; ++i )
 		current[i] = false;
@@ -72,6 +72,24 @@ void Visibility::InvalidateAll()
 }
 
 
+U32 Visibility::StateHash()
+{
+	typedef BitArray< MAP_SIZE, MAP_SIZE, MAX_UNITS > VisArray;
+	U32 h = Random::HASH_SEED;
+	for( int i=0; i<MAX_UNITS; ++i ) {
+		if ( units[i].IsAlive() ) {
+			if ( !current[i] ) {
+				CalcUnitVisibility( i );
+				current[i] = true;
+			}
+			h = Random::Hash( &i, sizeof( i ), h );
+			h = Random::Hash( visibilityMap.Plane( i ), VisArray::PLANE32*4, h );
+		}
+	}
+	return h;
+}
+
+
 void Visibility::CalcTeam( int team, int* r0, int* r1 )
 {
 	if ( team == TERRAN_TEAM ) {
@@ -132,7 +150,7 @@ bool Visibility::UnitCanSee( int i, int x, int y )
 {
 	GLASSERT( i >= 0 && i <MAX_UNITS );
 
-	if ( Engine::mapMakerMode ) {
+	if ( seeAll ) {
 		return true;
 	}
 	else if ( units[i].IsAlive() ) {
@@ -231,9 +249,6 @@ void Visibility::CalcVisibilityRay( int unitID, const Vector2I& pos, const Vecto
 #endif
 #endif
 
-	const Surface* lightMap = map->GetLightMap();
-	GLRELASSERT( lightMap->Format() == Surface::RGB16 );
-
 	const float OBSCURED = 0.50f;
 	const float DARK  = ((units[unitID].Team() == ALIEN_TEAM) ? 1.5f :2.0f) / (float)MAX_EYESIGHT_RANGE;
 	const float LIGHT = 1.0f / (float)MAX_EYESIGHT_RANGE;
@@ -255,9 +270,6 @@ void Visibility::CalcVisibilityRay( int unitID, const Vector2I& pos, const Vecto
 			canSee = map->CanSee( p, q );
 
 			if ( canSee ) {
-				U16 c = lightMap->GetImg16( q.x, q.y );
-				Color4U8 rgba = Surface::CalcRGB16( c );
-
 				const float distance = ( delta.LengthSquared() > 1 ) ? 1.4f : 1.0f;
 
 				if ( map->Obscured( q.x, q.y ) ) {
@@ -271,7 +283,7 @@ void Visibility::CalcVisibilityRay( int unitID, const Vector2I& pos, const Vecto
 					// Blue channel is typically high. So 
 					// very dark  ~255
 					// very light ~255*3 (white)
-					int lum = rgba.r + rgba.g + rgba.b;
+					int lum = map->Luminance( q.x, q.y );
 					float fraction = Interpolate( 255.0f, DARK, 765.0f, LIGHT, (float)lum ); 
 					light -= fraction * distance;
 				}
@@ -23,9 +23,8 @@
 
 #include "gamelimits.h"
 
-class BattleScene;
 class Unit;
-class Map;
+class ITacticalMap;
 
 // Groups all the visibility code together. In the battlescene itself, visibility quickly
 // becomes difficult to track. 'Visibility' groups it all together and does the minimum
@@ -35,7 +34,9 @@ public:
 	Visibility();
 	~Visibility()					{}
 
-	void Init( BattleScene* bs, const Unit* u, Map* m )	{ battleScene = bs; this->units = u; map = m; }
+	void Init( const Unit* u, ITacticalMap* m )	{ this->units = u; map = m; }
+	// Everyone sees everything (the MapMaker.)
+	void SetSeeAll( bool all )			{ seeAll = all; }
 
 	void InvalidateAll();
 	// The 'bounds' reflect the area that is invalid, not the visibility of the units.
@@ -51,6 +52,10 @@ public:
 	
 	void CalcVisMap( grinliz::BitArray<MAX_UNITS, MAX_UNITS, 1>* canSeeMap );
 
+	// Hash of the visibility of the alive units. Brings them all current first,
+	// so the result doesn't depend on what was queried before.
+	U32 StateHash();
+
 	// returs the current state of the FoW bit - and clears it!
 	bool FogCheckAndClear()	{ bool result = fogInvalid; fogInvalid = false; return result; }
 
@@ -59,10 +64,10 @@ private:
 	void CalcVisibilityRay( int unitID, const grinliz::Vector2I& pos, const grinliz::Vector2I& origin );
 	void CalcTeam( int team, int* start, int* end );
 
-	BattleScene*	battleScene;
 	const Unit*		units;
-	Map*			map;
+	ITacticalMap*	map;
 	bool			fogInvalid;
+	bool			seeAll;
 
 	bool	current[MAX_UNITS];	//< Is the visibility current? Triggers CalcUnitVisibility if not.
 
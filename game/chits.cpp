@@ -21,7 +21,7 @@
 #include "../engine/particle.h"
 #include "../engine/uirendering.h"
 
-#include "tacticalintroscene.h"		// fixme: only for unit generation
+#include "unitgen.h"
 #include "game.h"
 #include "ufosound.h"
 
@@ -637,7 +637,7 @@ BaseChit::BaseChit( SpaceTree* tree, const grinliz::Vector2I& posi, int index, c
 	random.SetSeedFromTime();
 
 	if ( firstBase ) {
-		TacticalIntroScene::GenerateTerranTeam( units, MAX_TERRANS, soldierBoost ? 0.8f : 0, itemDefArr, random.Rand() );
+		UnitGen::GenerateTerranTeam( units, MAX_TERRANS, soldierBoost ? 0.8f : 0, itemDefArr, random.Rand() );
 	}
 
 	for( int i=0; i<NUM_FACILITIES; ++i ) {
@@ -367,6 +367,7 @@ public:
 
 	const grinliz::Vector2I& Dest() const { return dest; }
 	const grinliz::Vector2I& Origin() const { return origin; }
+	bool Outbound() const { return outbound; }
 
 private:
 	void Init();
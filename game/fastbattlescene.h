@@ -24,6 +24,12 @@
 
 
 
+/*	Auto-resolve of a tactical battle. Generates the alien and civ teams the
+	same way the BattleScene does, runs the FastBattleSim, and writes the
+	result to the Game::battleData. From there the flow is the same as a
+	normal battle: END_SCENE, UNIT_SCORE_SCENE, and the result is returned
+	to the GeoScene.
+*/
 class FastBattleScene : public Scene
 {
 public:
@@ -47,7 +53,7 @@ public:
 
 
 private:
-	int RunSim( Unit* soldier, Unit* aliens, bool dayTime );
+	void RunSim();
 
 	enum {
 		TL_SCENARIO,
@@ -55,9 +61,13 @@ private:
 		TL_DAYTIME,
 		TL_ALIEN_RANK,
 		TL_RESULT,
+		TL_VICTORY,
+		TL_TERRANS,
+		TL_ALIENS,
+		TL_CIVS,
 		NUM_TL,
 
-		NUM_BATTLE = 24
+		NUM_BATTLE = MAX_TERRANS
 	};
 	BattleSceneData*		data;
 	BackgroundUI			backgroundUI;
@@ -66,11 +76,6 @@ private:
 	gamui::PushButton		button;
 
 	int						battleResult;
-	grinliz::Random			random;
-
-	Storage					foundStorage;
-	Unit aliens[MAX_ALIENS];
-	Unit civs[MAX_CIVS];
 };
 
 
@@ -0,0 +1,542 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fastbattlesim.h"
+#include "battledata.h"
+#include "item.h"
+#include "stats.h"
+
+#include <float.h>
+
+#include "../grinliz/glutil.h"
+#include "../grinliz/glperformance.h"
+
+using namespace grinliz;
+
+
+static const float ENGAGE_RANGE	= 6.0f;		// units try to close to this range before shooting
+static const int   ALERT_TURN	= 3;		// aliens start hunting after this turn
+
+
+FastBattleSim::FastBattleSim( const Unit* units, int scenario, bool dayTime, U32 seed )
+{
+	GLASSERT( units );
+	this->source = units;
+	this->scenario = scenario;
+	this->dayTime = dayTime;
+	this->seed = seed;
+	memset( fireCache, 0, sizeof(fireCache) );
+}
+
+
+float FastBattleSim::SightRange( int team ) const
+{
+	// Matches the light falloff in Visibility::CalcVisibilityRay: in the dark,
+	// terrans see half as far and aliens 2/3 as far.
+	if ( dayTime )
+		return (float)MAX_EYESIGHT_RANGE;
+	return (team == ALIEN_TEAM) ? (float)MAX_EYESIGHT_RANGE / 1.5f : (float)MAX_EYESIGHT_RANGE / 2.0f;
+}
+
+
+void FastBattleSim::FillFireCache()
+{
+	// The stats and the weapon of a unit don't change over a trial.
+	for( int i=0; i<MAX_UNITS; ++i ) {
+		const Unit* unit = &source[i];
+		if ( !unit->IsAlive() || !unit->GetWeaponDef() )
+			continue;
+
+		for( int mode=0; mode<WeaponItemDef::BASE_MODES; ++mode ) {
+			for( int r=1; r<CACHE_RANGE; ++r ) {
+				FireCache* fc = &fireCache[i][mode][r];
+				if ( fc->valid )
+					continue;
+
+				float chanceAnyHit = 0;
+				BulletTarget target( (float)r );
+
+				fc->valid = true;
+				fc->supported = unit->FireStatistics( mode, target, &fc->chanceToHit, &chanceAnyHit, &fc->tu, &fc->damagePerTU );
+			}
+		}
+	}
+}
+
+
+const FastBattleSim::FireCache& FastBattleSim::FireStats( int index, int mode, float range ) const
+{
+	GLASSERT( index >= 0 && index < MAX_UNITS );
+	GLASSERT( mode >= 0 && mode < WeaponItemDef::BASE_MODES );
+
+	int r = Clamp( (int)LRintf( range ), 1, (int)CACHE_RANGE-1 );
+	const FireCache& fc = fireCache[index][mode][r];
+	GLASSERT( fc.valid );
+	return fc;
+}
+
+
+void FastBattleSim::InitField( int trial, Field* field )
+{
+	U32 key[2] = { seed, (U32)trial };
+	field->random.SetSeed( Random::Hash( key, sizeof(key) ) );
+	field->random.Rand();
+
+	// The abstract map: the terrans come out of the lander at one edge, the aliens
+	// are spread out around the UFO (or the middle of the map), and the civs are
+	// anywhere.
+	static const float S = (float)MAP_SIZE;
+	for( int i=0; i<MAX_UNITS; ++i ) {
+		field->unit[i] = source[i];
+		field->alerted[i] = ( scenario == TERRAN_BASE );
+
+		float x = 0, y = 0;
+		if ( i >= TERRAN_UNITS_START && i < TERRAN_UNITS_END ) {
+			x = S*0.5f + (field->random.Uniform()-0.5f)*6.0f;
+			y = 3.0f + field->random.Uniform()*3.0f;
+		}
+		else if ( i >= ALIEN_UNITS_START && i < ALIEN_UNITS_END ) {
+			x = S*0.5f + (field->random.Uniform()-0.5f)*S*0.6f;
+			y = S*0.65f + (field->random.Uniform()-0.5f)*S*0.5f;
+		}
+		else {
+			x = field->random.Uniform()*S;
+			y = S*0.2f + field->random.Uniform()*S*0.75f;
+		}
+		field->pos[i].Set( x, y );
+		field->unit[i].NewTurn();
+	}
+}
+
+
+bool FastBattleSim::CanSee( Field* field, int viewer, int target )
+{
+	const Unit& v = field->unit[viewer];
+	const Unit& t = field->unit[target];
+	if ( !v.IsAlive() || !t.IsAlive() )
+		return false;
+
+	float d2 = (field->pos[viewer] - field->pos[target]).LengthSquared();
+	float range = SightRange( v.Team() );
+	if ( d2 > range*range )
+		return false;
+
+	// Walls, trees, and buildings are abstracted into a chance that
+	// the line of sight is blocked.
+	float los = 0.70f;
+	if ( scenario == CITY || scenario == TERRAN_BASE || scenario == ALIEN_BASE || scenario == BATTLESHIP )
+		los = 0.55f;
+	return field->random.Uniform() < los;
+}
+
+
+int FastBattleSim::FindTarget( Field* field, int shooter )
+{
+	int team = field->unit[shooter].Team();
+	int best = -1;
+	float bestD2 = FLT_MAX;
+
+	for( int i=0; i<MAX_UNITS; ++i ) {
+		const Unit& t = field->unit[i];
+		if ( !t.IsAlive() || t.Team() == team )
+			continue;
+		// Terrans don't shoot civs. Civs don't shoot at all.
+		if ( team == TERRAN_TEAM && t.Team() == CIV_TEAM )
+			continue;
+		if ( team == CIV_TEAM )
+			continue;
+
+		float d2 = (field->pos[shooter] - field->pos[i]).LengthSquared();
+		if ( d2 < bestD2 && CanSee( field, shooter, i ) ) {
+			bestD2 = d2;
+			best = i;
+		}
+	}
+	return best;
+}
+
+
+void FastBattleSim::Hit( Field* field, int shooter, int target, int mode, const Vector2F& impact )
+{
+	const WeaponItemDef* wid = field->unit[shooter].GetWeaponDef();
+	GLASSERT( wid );
+	DamageDesc dd;
+	wid->DamageBase( mode, &dd );
+
+	if ( !wid->IsExplosive( mode ) ) {
+		Unit* t = &field->unit[target];
+		if ( t->IsAlive() ) {
+			t->DoDamage( dd, 0 );
+			if ( !t->IsAlive() )
+				field->unit[shooter].CreditKill();
+		}
+		return;
+	}
+
+	// Same falloff as BattleScene::ProcessActionHit: full damage in the
+	// center, falling off linearly to the edge of the radius.
+	const int MAX_RAD = 2;
+	for( int i=0; i<MAX_UNITS; ++i ) {
+		Unit* t = &field->unit[i];
+		if ( !t->IsAlive() )
+			continue;
+
+		Vector2F d = field->pos[i] - impact;
+		if ( d.LengthSquared() > (float)(MAX_RAD*MAX_RAD) )
+			continue;
+
+		int rad = Max( LRintf( fabsf( d.x ) ), LRintf( fabsf( d.y ) ) );
+		rad = Min( rad, MAX_RAD );
+		DamageDesc scaled = dd;
+		scaled.Scale( (float)(1+MAX_RAD-rad) / (float)(1+MAX_RAD) );
+
+		t->DoDamage( scaled, 0 );
+		if ( !t->IsAlive() && t->Team() != field->unit[shooter].Team() )
+			field->unit[shooter].CreditKill();
+	}
+}
+
+
+bool FastBattleSim::Shoot( Field* field, int shooter, int target, bool reaction )
+{
+	Unit* unit = &field->unit[shooter];
+	const WeaponItemDef* wid = unit->GetWeaponDef();
+	if ( !wid || !unit->IsAlive() )
+		return false;
+
+	float range = Max( 1.0f, (field->pos[shooter] - field->pos[target]).Length() );
+
+	// Use the mode that does the most damage per TU. Reaction fire is always a snap shot.
+	int mode = -1;
+	float bestDPTU = 0;
+	for( int m=0; m<WeaponItemDef::BASE_MODES; ++m ) {
+		if ( reaction && m != SNAP_SHOT )
+			continue;
+		if ( !unit->CanFire( m ) )
+			continue;
+		const FireCache& fc = FireStats( shooter, m, range );
+		if ( fc.supported && fc.damagePerTU > bestDPTU ) {
+			bestDPTU = fc.damagePerTU;
+			mode = m;
+		}
+	}
+	if ( mode < 0 )
+		return false;
+
+	const FireCache& fc = FireStats( shooter, mode, range );
+	const ClipItemDef* cid = wid->GetClipItemDef( mode );
+	int nRounds = wid->RoundsNeeded( mode );
+
+	unit->UseTU( fc.tu );
+	field->alerted[target] = true;
+
+	Accuracy acc = unit->CalcAccuracy( mode );
+	Vector2F dir = field->pos[target] - field->pos[shooter];
+	dir.Normalize();
+
+	for( int r=0; r<nRounds; ++r ) {
+		if ( unit->GetInventory()->CalcClipRoundsTotal( cid ) == 0 )
+			break;
+		unit->GetInventory()->UseClipRound( cid );
+
+		bool hit = field->random.Uniform() < fc.chanceToHit;
+		Vector2F impact = field->pos[target];
+
+		if ( !hit && wid->IsExplosive( mode ) ) {
+			// Where does the miss land? The spread is in the target plane: the
+			// horizontal part moves the impact sideways, and the vertical part
+			// moves it long or short.
+			BulletSpread spread;
+			Vector2F s;
+			spread.Generate( field->random.Rand(), &s );
+			s.x *= range * acc.RadiusAtOne();
+			s.y *= range * acc.RadiusAtOne();
+
+			impact.x += dir.y*s.x + dir.x*s.y*4.0f;
+			impact.y += -dir.x*s.x + dir.y*s.y*4.0f;
+			hit = true;
+		}
+		if ( hit ) {
+			Hit( field, shooter, target, mode, impact );
+		}
+		if ( !field->unit[target].IsAlive() )
+			break;
+	}
+	return true;
+}
+
+
+void FastBattleSim::DoReaction( Field* field, int mover )
+{
+	int team = field->unit[mover].Team();
+	for( int i=0; i<MAX_UNITS && field->unit[mover].IsAlive(); ++i ) {
+		const Unit& r = field->unit[i];
+		if ( !r.IsAlive() || r.Team() == team || r.Team() == CIV_TEAM )
+			continue;
+		if ( r.Team() == TERRAN_TEAM && team == CIV_TEAM )
+			continue;
+		if ( CanSee( field, i, mover ) && field->random.Uniform() < r.GetStats().Reaction() ) {
+			Shoot( field, i, mover, true );
+		}
+	}
+}
+
+
+void FastBattleSim::Advance( Field* field, int mover, int target )
+{
+	Unit* unit = &field->unit[mover];
+	Vector2F delta = field->pos[target] - field->pos[mover];
+	float dist = delta.Length();
+
+	// Keep enough TU to take a snap shot.
+	float reserve = unit->FireTimeUnits( SNAP_SHOT );
+	float move = Min( dist - ENGAGE_RANGE, unit->TU() - reserve );
+	if ( move <= 0.0f )
+		return;
+
+	delta.Normalize();
+	field->pos[mover] = field->pos[mover] + delta*move;
+	unit->UseTU( move );
+
+	DoReaction( field, mover );
+}
+
+
+void FastBattleSim::DoTeamTurn( Field* field, int team )
+{
+	static const int START[3] = { TERRAN_UNITS_START, CIV_UNITS_START, ALIEN_UNITS_START };
+	static const int END[3]   = { TERRAN_UNITS_END, CIV_UNITS_END, ALIEN_UNITS_END };
+
+	for( int i=START[team]; i<END[team]; ++i ) {
+		field->unit[i].NewTurn();
+	}
+	if ( team == CIV_TEAM )
+		return;		// civs hide
+
+	for( int i=START[team]; i<END[team]; ++i ) {
+		Unit* unit = &field->unit[i];
+		if ( !unit->IsAlive() )
+			continue;
+
+		int target = FindTarget( field, i );
+		if ( target >= 0 ) {
+			field->alerted[i] = true;
+		}
+		else if ( team == TERRAN_TEAM || field->alerted[i] ) {
+			// Walk towards the closest enemy. The terrans know where the
+			// UFO is; alerted aliens know where the terrans are.
+			int closest = -1;
+			float bestD2 = FLT_MAX;
+			for( int k=0; k<MAX_UNITS; ++k ) {
+				const Unit& t = field->unit[k];
+				if ( t.IsAlive() && ( t.Team() == ( team == TERRAN_TEAM ? ALIEN_TEAM : TERRAN_TEAM ))) {
+					float d2 = (field->pos[i] - field->pos[k]).LengthSquared();
+					if ( d2 < bestD2 ) {
+						bestD2 = d2;
+						closest = k;
+					}
+				}
+			}
+			if ( closest >= 0 ) {
+				Advance( field, i, closest );
+				target = FindTarget( field, i );
+			}
+		}
+
+		while( target >= 0 && unit->IsAlive() ) {
+			if ( !Shoot( field, i, target, false ) )
+				break;
+			if ( !field->unit[target].IsAlive() )
+				target = FindTarget( field, i );
+		}
+	}
+}
+
+
+int FastBattleSim::CalcResult( const Field* field ) const
+{
+	int nTerrans = Unit::Count( field->unit+TERRAN_UNITS_START, MAX_TERRANS, Unit::STATUS_ALIVE );
+	int nAliens  = Unit::Count( field->unit+ALIEN_UNITS_START, MAX_ALIENS, Unit::STATUS_ALIVE );
+
+	if ( nTerrans > 0 && nAliens == 0 )
+		return BattleData::VICTORY;
+	else if ( nTerrans == 0 && nAliens > 0 )
+		return BattleData::DEFEAT;
+	return BattleData::TIE;
+}
+
+
+void FastBattleSim::RunTrial( int trial, Field* field, Trial* out )
+{
+	InitField( trial, field );
+
+	int result = BattleData::TIE;
+	int turn = 0;
+	for( turn=0; turn<MAX_TURNS; ++turn ) {
+		if ( turn == ALERT_TURN ) {
+			for( int i=ALIEN_UNITS_START; i<ALIEN_UNITS_END; ++i )
+				field->alerted[i] = true;
+		}
+		DoTeamTurn( field, TERRAN_TEAM );
+		result = CalcResult( field );
+		if ( result != BattleData::TIE )
+			break;
+
+		DoTeamTurn( field, ALIEN_TEAM );
+		result = CalcResult( field );
+		if ( result != BattleData::TIE )
+			break;
+
+		DoTeamTurn( field, CIV_TEAM );
+	}
+	if ( result == BattleData::DEFEAT ) {
+		// The civs don't make it.
+		for( int i=CIV_UNITS_START; i<CIV_UNITS_END; ++i ) {
+			if ( field->unit[i].IsAlive() )
+				field->unit[i].Kill( 0 );
+		}
+	}
+
+	out->result = result;
+	out->turns = turn+1;
+	out->terransDown  = Unit::Count( field->unit+TERRAN_UNITS_START, MAX_TERRANS, Unit::STATUS_KIA )
+					  + Unit::Count( field->unit+TERRAN_UNITS_START, MAX_TERRANS, Unit::STATUS_UNCONSCIOUS );
+	out->aliensKilled = Unit::Count( field->unit+ALIEN_UNITS_START, MAX_ALIENS, Unit::STATUS_KIA );
+	out->civsKilled   = Unit::Count( field->unit+CIV_UNITS_START, MAX_CIVS, Unit::STATUS_KIA );
+	for( int i=0; i<MAX_UNITS; ++i ) {
+		out->alive[i] = field->unit[i].IsAlive();
+	}
+}
+
+
+/*static*/ void FastBattleSim::WorkerMain( void* data )
+{
+	Worker* worker = (Worker*)data;
+	for( int t=worker->start; t<worker->end; ++t ) {
+		worker->sim->RunTrial( t, &worker->field, &worker->trials[t] );
+	}
+}
+
+
+void FastBattleSim::Run( int nTrials, Outcome* outcome, Unit* result )
+{
+	GRINLIZ_PERFTRACK
+	nTrials = Clamp( nTrials, 1, (int)MAX_TRIALS );
+
+	Trial trials[MAX_TRIALS];
+	FillFireCache();
+
+	// Worker 0 is the calling thread. The Fields are big: off the stack.
+	Worker* worker = new Worker[NUM_THREADS];
+	for( int i=0; i<NUM_THREADS; ++i ) {
+		worker[i].sim = this;
+		worker[i].start = nTrials * i / NUM_THREADS;
+		worker[i].end = nTrials * (i+1) / NUM_THREADS;
+		worker[i].trials = trials;
+	}
+	for( int i=1; i<NUM_THREADS; ++i ) {
+		if ( worker[i].start < worker[i].end && !worker[i].thread.Start( WorkerMain, &worker[i] ) ) {
+			// No thread: run its share here.
+			WorkerMain( &worker[i] );
+		}
+	}
+	WorkerMain( &worker[0] );
+	for( int i=1; i<NUM_THREADS; ++i ) {
+		worker[i].thread.Join();
+	}
+
+	memset( outcome, 0, sizeof(*outcome) );
+	outcome->nTrials = nTrials;
+
+	int count[4] = { 0, 0, 0, 0 };
+	for( int t=0; t<nTrials; ++t ) {
+		const Trial& tr = trials[t];
+		count[tr.result]++;
+		outcome->terransDown	+= (float)tr.terransDown;
+		outcome->aliensKilled	+= (float)tr.aliensKilled;
+		outcome->civsKilled		+= (float)tr.civsKilled;
+		outcome->turns			+= (float)tr.turns;
+		for( int i=0; i<MAX_UNITS; ++i ) {
+			if ( tr.alive[i] ) outcome->alive[i] += 1.0f;
+		}
+	}
+
+	const float inv = 1.0f / (float)nTrials;
+	outcome->victory		= (float)count[BattleData::VICTORY] * inv;
+	outcome->defeat			= (float)count[BattleData::DEFEAT] * inv;
+	outcome->tie			= (float)count[BattleData::TIE] * inv;
+	outcome->terransDown	*= inv;
+	outcome->aliensKilled	*= inv;
+	outcome->civsKilled		*= inv;
+	outcome->turns			*= inv;
+	for( int i=0; i<MAX_UNITS; ++i ) {
+		outcome->alive[i] *= inv;
+	}
+
+	// The most likely result...
+	int common = BattleData::VICTORY;
+	if ( count[BattleData::DEFEAT] > count[common] ) common = BattleData::DEFEAT;
+	if ( count[BattleData::TIE] > count[common] ) common = BattleData::TIE;
+
+	// ...and the trial with that result closest to the average losses.
+	int rep = 0;
+	float bestErr = FLT_MAX;
+	for( int t=0; t<nTrials; ++t ) {
+		if ( trials[t].result != common )
+			continue;
+		float err =   fabsf( (float)trials[t].terransDown - outcome->terransDown )
+					+ fabsf( (float)trials[t].aliensKilled - outcome->aliensKilled )
+					+ 0.5f * fabsf( (float)trials[t].civsKilled - outcome->civsKilled );
+		if ( err < bestErr ) {
+			bestErr = err;
+			rep = t;
+		}
+	}
+	outcome->representative = rep;
+	outcome->result = common;
+
+	if ( result ) {
+		// Trials are deterministic; re-run the representative one to get the units.
+		Field* field = &worker[0].field;
+		Trial tr;
+		RunTrial( rep, field, &tr );
+		GLASSERT( tr.result == common );
+		for( int i=0; i<MAX_UNITS; ++i ) {
+			result[i] = field->unit[i];
+		}
+	}
+	delete [] worker;
+	GLOUTPUT(( "FastBattleSim trials=%d victory=%.2f defeat=%.2f tie=%.2f terransDown=%.1f aliensKilled=%.1f rep=%d\n",
+			   nTrials, outcome->victory, outcome->defeat, outcome->tie, outcome->terransDown, outcome->aliensKilled, rep ));
+}
+
+
+/*static*/ void FastBattleSim::CollectDowned( Unit* units, Storage* loot )
+{
+	for( int i=0; i<MAX_UNITS; ++i ) {
+		Unit* unit = &units[i];
+		if ( unit->IsKIA() || unit->IsUnconscious() ) {
+			Inventory* inv = unit->GetInventory();
+			for( int k=0; k<Inventory::NUM_SLOTS; ++k ) {
+				Item* item = inv->AccessItem( k );
+				if ( item->IsSomething() ) {
+					if ( loot )
+						loot->AddItem( *item );
+					item->Clear();
+				}
+			}
+		}
+	}
+}
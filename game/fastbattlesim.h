@@ -0,0 +1,148 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef UFO_FAST_BATTLE_SIM_INCLUDED
+#define UFO_FAST_BATTLE_SIM_INCLUDED
+
+#include "../grinliz/gldebug.h"
+#include "../grinliz/gltypes.h"
+#include "../grinliz/glrandom.h"
+#include "../grinliz/glvector.h"
+#include "../grinliz/glthread.h"
+
+#include "gamelimits.h"
+#include "unit.h"
+
+class Storage;
+
+
+/*	Monte-Carlo auto-resolve of a tactical battle. Uses the real Unit, Stats,
+	WeaponItemDef::FireStatistics and BulletSpread rules, but plays them out
+	on an abstract map: units have a position and a line-of-sight roll, but
+	no walls, doors, or pathing.
+
+	Every trial is independent and seeded from (seed, trial), so the results
+	are deterministic and the trials can be run in any order. They are split
+	between worker threads and the calling thread, each with its own Field,
+	and merged in trial order. The outcome is the average over all the trials,
+	and one "representative" trial (the one closest to the average) is used as
+	the actual result of the battle.
+
+	The DEFAULT_TRIALS of a farm battle (8 terrans, 9 aliens, 6 civs) take
+	about 15 msec on one desktop core, filling the fire cache included, well
+	inside the 100 msec the auto-resolve can take.
+
+	Does not depend on the Engine, the map, or gamui.
+*/
+class FastBattleSim
+{
+public:
+	enum {
+		DEFAULT_TRIALS	= 32,
+		MAX_TRIALS		= 128,
+		MAX_TURNS		= 20,		// after this many turns, the battle is a tie
+		NUM_THREADS		= 4,		// including the calling thread
+	};
+
+	struct Outcome {
+		int		nTrials;
+		int		result;					// BattleData::VICTORY, DEFEAT, TIE of the representative trial
+		float	victory;				// fraction of the trials that were a victory
+		float	defeat;
+		float	tie;
+		float	terransDown;			// average number of terrans down (KIA or unconscious)
+		float	aliensKilled;
+		float	civsKilled;
+		float	turns;					// average length of the battle, in turns
+		float	alive[MAX_UNITS];		// chance each unit is alive at the end of the battle
+		int		representative;			// index of the trial used for the result
+	};
+
+	// 'units' is the MAX_UNITS battle array (terrans, civs, aliens.)
+	FastBattleSim( const Unit* units, int scenario, bool dayTime, U32 seed );
+	~FastBattleSim()	{}
+
+	// Runs 'nTrials' simulations. Writes the units of the representative trial
+	// to 'result' (MAX_UNITS) if not null.
+	void Run( int nTrials, Outcome* outcome, Unit* result );
+
+	// Moves the inventory of every unit that is down into 'loot'. Used for the
+	// fast battle, where there is no map to drop things on.
+	static void CollectDowned( Unit* units, Storage* loot );
+
+private:
+	struct Trial {
+		int		result;
+		int		turns;
+		int		terransDown;
+		int		aliensKilled;
+		int		civsKilled;
+		bool	alive[MAX_UNITS];
+	};
+
+	// State of one trial. The units are copies; the source units are never changed.
+	struct Field {
+		Unit				unit[MAX_UNITS];
+		grinliz::Vector2F	pos[MAX_UNITS];
+		bool				alerted[MAX_UNITS];		// aliens sit tight until they know where the terrans are
+		grinliz::Random		random;
+	};
+
+	// A share of the trials, run on its own thread.
+	struct Worker {
+		FastBattleSim*	sim;
+		int				start, end;		// trials [start,end)
+		Trial*			trials;
+		Field			field;
+		grinliz::Thread	thread;
+	};
+	static void WorkerMain( void* data );
+
+	void RunTrial( int trial, Field* field, Trial* out );
+	void InitField( int trial, Field* field );
+	void DoTeamTurn( Field* field, int team );
+	void DoReaction( Field* field, int mover );
+	bool CanSee( Field* field, int viewer, int target );
+	int  FindTarget( Field* field, int shooter );
+	bool Shoot( Field* field, int shooter, int target, bool reaction );
+	void Hit( Field* field, int shooter, int target, int mode, const grinliz::Vector2F& impact );
+	void Advance( Field* field, int mover, int target );
+	float SightRange( int team ) const;
+	int  CalcResult( const Field* field ) const;
+
+	// FireStatistics is expensive (BulletSpread::ComputePercent samples the
+	// target) and only depends on the unit, mode, and range. The cache is
+	// filled before the trials start, so the threads only read it.
+	struct FireCache {
+		bool	valid;
+		bool	supported;
+		float	chanceToHit;
+		float	tu;
+		float	damagePerTU;
+	};
+	enum { CACHE_RANGE = MAX_EYESIGHT_RANGE+2 };
+	void FillFireCache();
+	const FireCache& FireStats( int index, int mode, float range ) const;
+
+	const Unit*		source;
+	int				scenario;
+	bool			dayTime;
+	U32				seed;
+
+	FireCache		fireCache[MAX_UNITS][WeaponItemDef::BASE_MODES][CACHE_RANGE];
+};
+
+
+#endif // UFO_FAST_BATTLE_SIM_INCLUDED
@@ -18,6 +18,7 @@
 #include "scene.h"
 
 #include "battlescene.h"
+#include "fastbattlescene.h"
 #include "characterscene.h"
 #include "tacticalintroscene.h"
 #include "tacticalendscene.h"
@@ -33,6 +34,7 @@
 #include "saveloadscene.h"
 #include "newtacticaloptions.h"
 #include "newgeooptions.h"
+#include "tacticalreplay.h"
 
 #include "../engine/text.h"
 #include "../engine/model.h"
@@ -41,6 +43,7 @@
 #include "../engine/gpustatemanager.h"
 #include "../engine/renderqueue.h"
 #include "../engine/shadermanager.h"
+#include "../engine/serialize.h"
 
 #include "../grinliz/glmatrix.h"
 #include "../grinliz/glutil.h"
@@ -53,6 +56,7 @@
 #include "gamesettings.h"
 
 #include <time.h>
+#include <sys/stat.h>
 
 using namespace grinliz;
 using namespace gamui;
@@ -100,6 +104,9 @@ Game::Game( int width, int height, int rotation, const char* path ) :
 	}	
 	
 	Init();
+	if ( GameSettingsManager::Instance()->GetPlayReplay() ) {
+		PlayReplay();
+	}
 
 	PushScene( INTRO_SCENE, 0 );
 	PushPopScene();
@@ -167,6 +174,9 @@ void Game::Init()
 	mapmaker_showPathing = 0;
 	scenePopQueued = false;
 	loadSlot = 0;
+	saveIndexLoaded = false;
+	lastSnapshotSlot = -1;
+	deltaCount = 0;
 	currentFrame = 0;
 	surface.Set( Surface::RGBA16, 256, 256 );		// All the memory we will ever need (? or that is the intention)
 	joyStickAccum.Set( 0, 0 );
@@ -290,18 +300,152 @@ Game::~Game()
 
 bool Game::HasSaveFile( SavePathType type, int slot ) const
 {
-	bool result = false;
+	return SlotInfo( type, slot )->valid != 0;
+}
 
-	FILE* fp = GameSavePath( type, SAVEPATH_READ, slot );
+
+Game::SaveSlotInfo* Game::SlotInfo( SavePathType type, int slot ) const
+{
+	GLASSERT( type == SAVEPATH_GEO || type == SAVEPATH_TACTICAL );
+	GLASSERT( slot >= 0 && slot <= MAX_SAVE_SLOT );
+	if ( !saveIndexLoaded ) {
+		ReadSaveIndex();
+	}
+	return &saveIndex[ type == SAVEPATH_GEO ? 0 : 1 ][slot];
+}
+
+
+void Game::ReadSaveIndex() const
+{
+	saveIndexLoaded = true;
+	memset( saveIndex, 0, sizeof( saveIndex ) );
+
+	GLString path = savePath;
+	path += "saveindex.dat";
+	saveWriter.Finish( path.c_str() );
+
+	FILE* fp = fopen( path.c_str(), "rb" );
 	if ( fp ) {
-		fseek( fp, 0, SEEK_END );
-		long d = ftell( fp );
-		if ( d > 100 ) {	// has to be something there: sanity check
-			result = true;
-		}
+		U32 header[3] = { 0 };
+		bool okay =    fread( header, sizeof( header ), 1, fp ) == 1
+					&& header[0] == SAVE_INDEX_MAGIC
+					&& header[1] == SAVE_INDEX_VERSION
+					&& header[2] == sizeof( saveIndex )
+					&& fread( saveIndex, sizeof( saveIndex ), 1, fp ) == 1;
 		fclose( fp );
+		if ( !okay ) {
+			memset( saveIndex, 0, sizeof( saveIndex ) );
+		}
+	}
+
+	// A save changed (or removed, or copied in) behind the index is read
+	// again. No index (or an old one) reads all the saves, once.
+	bool changed = false;
+	for( int t=0; t<2; ++t ) {
+		SavePathType type = t ? SAVEPATH_TACTICAL : SAVEPATH_GEO;
+		for( int slot=0; slot<=MAX_SAVE_SLOT; ++slot ) {
+			const SaveSlotInfo& info = saveIndex[t][slot];
+			U32 size = 0, deltaSize = 0;
+			SaveFileSizes( type, slot, &size, &deltaSize );
+			if ( size != info.size || deltaSize != info.deltaSize ) {
+				GLOUTPUT(( "Game: rebuilding the save index, type=%d slot=%d.\n", t, slot ));
+				RebuildSlotInfo( type, slot );
+				changed = true;
+			}
+		}
+	}
+	if ( changed ) {
+		WriteSaveIndex();
+	}
+}
+
+
+void Game::RebuildSlotInfo( SavePathType type, int slot ) const
+{
+	SaveSlotInfo* info = SlotInfo( type, slot );
+	memset( info, 0, sizeof( *info ) );
+
+	U32 size = 0, deltaSize = 0;
+	SaveFileSizes( type, slot, &size, &deltaSize );
+
+	// The sizes are kept for a save that doesn't load, so it isn't read again.
+	info->size = size;
+	info->deltaSize = deltaSize;
+
+	XMLDocument doc;
+	if ( size > 100 && LoadSaveFile( type, slot, &doc ) && doc.RootElement() ) {
+		const XMLElement* root = doc.RootElement();
+		info->valid = 1;
+		info->sceneID = (U8)( type == SAVEPATH_TACTICAL ? BATTLE_SCENE : GEO_SCENE );
+		unsigned version = 0;
+		root->QueryUnsignedAttribute( "version", &version );
+		info->version = (U16)version;		// the hash and turn aren't known
+		if ( root->Attribute( "timestamp" ) ) {
+			StrNCpy( info->timestamp, root->Attribute( "timestamp" ), sizeof( info->timestamp ) );
+		}
 	}
-	return result;
+}
+
+
+static U32 FileSize( const char* path )
+{
+	struct stat st;
+	if ( stat( path, &st ) == 0 )
+		return (U32)st.st_size;
+	return 0;
+}
+
+
+void Game::SaveFileSizes( SavePathType type, int slot, U32* size, U32* deltaSize ) const
+{
+	// Sizes of the files as they will be once the queued writes are done.
+	GLString path;
+	SavePathName( type, slot, false, &path );
+	saveWriter.Finish( path.c_str() );
+	*size = FileSize( path.c_str() );
+	if ( *size == 0 ) {
+		// Saved before the binary format.
+		SavePathName( type, slot, true, &path );
+		*size = FileSize( path.c_str() );
+	}
+
+	*deltaSize = 0;
+	if ( type == SAVEPATH_TACTICAL ) {
+		DeltaPathName( slot, &path );
+		saveWriter.Finish( path.c_str() );
+		*deltaSize = FileSize( path.c_str() );
+	}
+}
+
+
+void Game::WriteSaveIndex() const
+{
+	GLString path = savePath;
+	path += "saveindex.dat";
+
+	U8 mem[12 + sizeof( saveIndex )];
+	U32 header[3] = { SAVE_INDEX_MAGIC, SAVE_INDEX_VERSION, sizeof( saveIndex ) };
+	memcpy( mem, header, 12 );
+	memcpy( mem+12, saveIndex, sizeof( saveIndex ) );
+
+	// Queued after any save it describes, so it is written after it.
+	saveWriter.Queue( path.c_str(), mem, sizeof( mem ) );
+}
+
+
+void Game::TimeStamp( char* buf, int size )
+{
+	// Somewhat scary c code to get the current time.
+	time_t rawtime;
+	struct tm * timeinfo;  
+	time ( &rawtime );
+	timeinfo = localtime ( &rawtime );
+	const char* atime = asctime( timeinfo );
+
+	StrNCpy( buf, atime, size );
+	int len = strlen( buf );
+	if ( len && buf[len-1] == '\n' )
+		buf[len-1] = 0;	// remove trailing newline.
 }
 
 
@@ -311,6 +455,174 @@ void Game::DeleteSaveFile( SavePathType type, int slot )
 	if ( fp ) {
 		fclose( fp );
 	}
+	if ( type == SAVEPATH_GEO || type == SAVEPATH_TACTICAL ) {
+		fp = GameSavePath( type, SAVEPATH_WRITE, slot, true );
+		if ( fp ) {
+			fclose( fp );
+		}
+		SaveSlotInfo* info = SlotInfo( type, slot );
+		if ( info->valid || info->size || info->deltaSize ) {
+			memset( info, 0, sizeof( *info ) );
+			WriteSaveIndex();
+		}
+	}
+	if ( type == SAVEPATH_TACTICAL ) {
+		GLString path;
+		DeltaPathName( slot, &path );
+		saveWriter.Queue( path.c_str(), 0, 0 );
+		saveWriter.Finish( path.c_str() );
+		if ( slot == lastSnapshotSlot )
+			lastSnapshotSlot = -1;
+	}
+}
+
+
+void Game::DeltaPathName( int slot, GLString* path ) const
+{
+	SavePathName( SAVEPATH_TACTICAL, slot, false, path );
+	*path += ".dlt";
+}
+
+
+bool Game::LoadSaveFile( SavePathType type, int slot, XMLDocument* doc ) const
+{
+	FILE* fp = GameSavePath( type, SAVEPATH_READ, slot );
+	if ( !fp )
+		return false;
+
+	fseek( fp, 0, SEEK_END );
+	long size = ftell( fp );
+	fseek( fp, 0, SEEK_SET );
+
+	::CDynArray< char > mem( size+1 );
+	char* p = mem.PushArr( size+1 );
+	bool okay = size > 0 && fread( p, size, 1, fp ) == 1;
+	p[size] = 0;
+	fclose( fp );
+
+	if ( okay && type == SAVEPATH_TACTICAL && BinaryXMLPrinter::IsBinary( p, size ) ) {
+		// Bring the save up to date with the deltas written since it.
+		GLString path;
+		DeltaPathName( slot, &path );
+		saveWriter.Finish( path.c_str() );
+		fp = fopen( path.c_str(), "rb" );
+		if ( fp ) {
+			fseek( fp, 0, SEEK_END );
+			long deltaSize = ftell( fp );
+			fseek( fp, 0, SEEK_SET );
+
+			::CDynArray< U8 > delta( deltaSize+1 );
+			if ( deltaSize > 0 && fread( delta.PushArr( deltaSize ), deltaSize, 1, fp ) == 1 ) {
+				::CDynArray< U8 > snapshot( size );
+				memcpy( snapshot.PushArr( size ), p, size );
+				int n = SaveDelta::Apply( &snapshot, delta.Mem(), delta.Size() );
+				GLOUTPUT(( "LoadSaveFile: %d deltas applied to '%s'\n", n, path.c_str() ));
+				if ( n ) {
+					size = snapshot.Size();
+					mem.Clear();
+					p = mem.PushArr( size+1 );
+					memcpy( p, snapshot.Mem(), size );
+					p[size] = 0;
+				}
+			}
+			fclose( fp );
+		}
+	}
+
+	if ( okay ) {
+		if ( BinaryXMLPrinter::IsBinary( p, size ) ) {
+			okay = BinaryXMLPrinter::Load( p, size, doc );
+		}
+		else {
+			doc->Parse( p );
+			okay = !doc->Error();
+		}
+	}
+	return okay;
+}
+
+
+void Game::WriteSaveFile( SavePathType type, int slot, const BinaryXMLPrinter& printer, bool async,
+						  int turn, const char* timestamp ) const
+{
+	GLString path;
+	SavePathName( type, slot, false, &path );
+
+	::CDynArray< U8 > mem( printer.SaveSize() );
+	printer.Save( &mem );
+
+	// The index is read before anything is queued, so it doesn't see this write.
+	SaveSlotInfo* info = SlotInfo( type, slot );
+	bool keyframe = true;
+	U32 deltaWritten = 0;
+	if ( type == SAVEPATH_TACTICAL ) {
+		GLString deltaPath;
+		DeltaPathName( slot, &deltaPath );
+
+		// Only the autosaves (async) are deltas: a save the player
+		// asked for is written whole.
+		if ( async && slot == lastSnapshotSlot && deltaCount < KEYFRAME_SAVES ) {
+			::CDynArray< U8 > delta( mem.Size()/4 );
+			SaveDelta::Create( lastSnapshot.Mem(), lastSnapshot.Size(), mem.Mem(), mem.Size(), &delta );
+			// If most of it changed, the full save is as good.
+			if ( delta.Size() < mem.Size()/2 ) {
+				saveWriter.Queue( deltaPath.c_str(), delta.Mem(), delta.Size(), true );
+				++deltaCount;
+				deltaWritten = delta.Size();
+				keyframe = false;
+			}
+		}
+		if ( keyframe ) {
+			// The old deltas don't apply to the new save. The writes are
+			// done in order, so they are cut only once the save is in place.
+			saveWriter.Queue( path.c_str(), mem.Mem(), mem.Size() );
+			saveWriter.Queue( deltaPath.c_str(), 0, 0 );
+			deltaCount = 0;
+		}
+		lastSnapshot.Clear();
+		memcpy( lastSnapshot.PushArr( mem.Size() ), mem.Mem(), mem.Size() );
+		lastSnapshotSlot = slot;
+	}
+	else {
+		saveWriter.Queue( path.c_str(), mem.Mem(), mem.Size() );
+	}
+
+	U32 size = mem.Size();
+	U32 deltaSize = 0;
+	if ( !keyframe ) {
+		// The save file is the one the deltas are from.
+		size = info->size;
+		deltaSize = info->deltaSize + deltaWritten;
+	}
+	memset( info, 0, sizeof( *info ) );
+	info->hash = Random::Hash( mem.Mem(), mem.Size() );
+	info->size = size;
+	info->deltaSize = deltaSize;
+	info->version = VERSION;
+	info->valid = 1;
+	info->sceneID = (U8)( type == SAVEPATH_GEO ? GEO_SCENE : BATTLE_SCENE );
+	info->turn = turn;
+	if ( timestamp )
+		StrNCpy( info->timestamp, timestamp, sizeof( info->timestamp ) );
+	else
+		TimeStamp( info->timestamp, sizeof( info->timestamp ) );
+	WriteSaveIndex();
+
+	if ( !async ) {
+		saveWriter.Finish( path.c_str() );
+		saveWriter.Flush();		// and the index
+	}
+
+	if ( GameSettingsManager::Instance()->GetSaveXML() ) {
+		XMLDocument doc;
+		if ( LoadSaveFile( type, slot, &doc ) ) {
+			FILE* fp = GameSavePath( type, SAVEPATH_WRITE, slot, true );
+			if ( fp ) {
+				doc.SaveFile( fp );
+				fclose( fp );
+			}
+		}
+	}
 }
 
 
@@ -427,15 +739,9 @@ void Game::PushPopScene()
 		{
 			SavePathType savePath = node->scene->CanSave();
 			if ( HasSaveFile( savePath, loadSlot ) ) {
-				FILE* fp = GameSavePath( savePath, SAVEPATH_READ, loadSlot );
-				if ( fp ) {
-					XMLDocument doc;
-					doc.LoadFile( fp );
-
-					if ( !doc.Error() ) {
-						Load( doc );
-					}
-					fclose( fp );
+				XMLDocument doc;
+				if ( LoadSaveFile( savePath, loadSlot, &doc ) ) {
+					Load( doc );
 				}
 			}
 			loadSlot = 0;	// queried during the load; don't clear until after load.
@@ -460,6 +766,7 @@ void Game::CreateScene( const SceneNode& in, SceneNode* node )
 	Scene* scene = 0;
 	switch ( in.sceneID ) {
 		case BATTLE_SCENE:		battleData.Init(); scene = new BattleScene( this );									break;
+		case FASTBATTLE_SCENE:	battleData.Init(); scene = new FastBattleScene( this, (BattleSceneData*)in.data );		break;
 		case CHARACTER_SCENE:	scene = new CharacterScene( this, (CharacterSceneData*)in.data );					break;
 		case INTRO_SCENE:		scene = new TacticalIntroScene( this );												break;
 		case END_SCENE:			scene = new TacticalEndScene( this );												break;
@@ -501,6 +808,30 @@ const gamui::ButtonLook& Game::GetButtonLook( int id )
 }
 
 
+void Game::PlayReplay()
+{
+	FILE* fp = GameSavePath( SAVEPATH_REPLAY, SAVEPATH_READ, 0 );
+	if ( !fp )
+		return;
+
+	TacticalReplay* replay = new TacticalReplay( itemDefArr );
+	bool okay = replay->Load( fp );
+	fclose( fp );
+
+	// The report is written in every build: a replay is run to find divergences.
+	FILE* report = GameSavePath( SAVEPATH_HASHLOG, SAVEPATH_APPEND, 0 );
+	if ( okay )
+		replay->Run( report );
+	else
+		fprintf( report ? report : stderr, "ActionLog: replay could not be loaded.\n" );
+	if ( report )
+		fclose( report );
+
+	delete replay;
+	ParticleSystem::Instance()->Clear();
+}
+
+
 void Game::Load( const XMLDocument& doc )
 {
 	ParticleSystem::Instance()->Clear();
@@ -515,54 +846,64 @@ void Game::Load( const XMLDocument& doc )
 }
 
 
-FILE* Game::GameSavePath( SavePathType type, SavePathMode mode, int slot ) const
-{	
-	grinliz::GLString str( savePath );
+void Game::SavePathName( SavePathType type, int slot, bool xml, GLString* str ) const
+{
+	*str = savePath;
 	if ( type == SAVEPATH_GEO )
-		str += "geogame";
+		*str += "geogame";
 	else if ( type == SAVEPATH_TACTICAL )
-		str += "tacgame";
+		*str += "tacgame";
+	else if ( type == SAVEPATH_REPLAY )
+		*str += "tacreplay";
+	else if ( type == SAVEPATH_HASHLOG )
+		*str += "tachash";
 	else
 		GLASSERT( 0 );
 
 	if ( slot > 0 ) {
-		str += "-";
-		str += '0' + slot;
+		*str += "-";
+		*str += '0' + slot;
 	}
-	str += ".xml";
+	if ( type == SAVEPATH_REPLAY )
+		*str += ".dat";
+	else if ( type == SAVEPATH_HASHLOG )
+		*str += ".txt";
+	else if ( xml )
+		*str += ".xml";
+	else
+		*str += ".sav";
+}
+
+
+FILE* Game::GameSavePath( SavePathType type, SavePathMode mode, int slot, bool xml ) const
+{	
+	grinliz::GLString str;
+	SavePathName( type, slot, xml, &str );
+
+	// A queued write has to be on disk before the file is read, or replaced.
+	saveWriter.Finish( str.c_str() );
+
+	static const char* fileMode[] = { "rb", "wb", "ab" };
+	FILE* fp = fopen( str.c_str(), fileMode[mode] );
 
-	FILE* fp = fopen( str.c_str(), (mode == SAVEPATH_WRITE) ? "wb" : "rb" );
+	if (    !fp && !xml && mode == SAVEPATH_READ
+		 && ( type == SAVEPATH_GEO || type == SAVEPATH_TACTICAL ) )
+	{
+		// Saved before the binary format.
+		fp = GameSavePath( type, mode, slot, true );
+	}
 	return fp;
 }
 
 
 void Game::SavePathTimeStamp( SavePathType type, int slot, GLString* stamp )
 {
-	*stamp = "";
-	FILE* fp = GameSavePath( type, SAVEPATH_READ, slot );
-	if ( fp ) {
-		char buf[400];
-		for( int i=0; i<10; ++i ) {
-			fgets( buf, 400, fp );
-			buf[399] = 0;
-			const char* p = strstr( buf, "timestamp" );
-			if ( p ) {
-				const char* q0 = strstr( p+1, "\"" );
-				if ( q0 ) {
-					const char* q1 = strstr( q0+1, "\"" );
-					if ( q1 && (q1-q0)>2 ) {
-						stamp->append( q0+1, q1-q0-1 );
-					}
-				}
-				break;
-			}
-		}
-		fclose( fp );
-	}
+	const SaveSlotInfo* info = SlotInfo( type, slot );
+	*stamp = info->valid ? info->timestamp : "";
 }
 
 
-void Game::Save( int slot, bool saveGeo, bool saveTac )
+void Game::Save( int slot, bool saveGeo, bool saveTac, bool async )
 {
 	// For loading, the BOTTOM loads and then loads higher scenes.
 	// For saving, the GeoScene saves itself before pushing the tactical
@@ -572,34 +913,25 @@ void Game::Save( int slot, bool saveGeo, bool saveTac )
 		if (    ( saveGeo && node->scene->CanSave() == SAVEPATH_GEO )
 			 || ( saveTac && node->scene->CanSave() == SAVEPATH_TACTICAL ) )
 		{
-			FILE* fp = GameSavePath( node->scene->CanSave(), SAVEPATH_WRITE, slot );
-			GLASSERT( fp );
-			if ( fp ) {
-				XMLPrinter printer( fp );
-				printer.OpenElement( "Game" );
-				printer.PushAttribute( "version", VERSION );
-				printer.PushAttribute( "sceneID", node->sceneID );
-
-				// Somewhat scary c code to get the current time.
-				char buf[40];
-			    time_t rawtime;
-				struct tm * timeinfo;  
-				time ( &rawtime );
-				timeinfo = localtime ( &rawtime );
-				const char* atime = asctime( timeinfo );
+			BinaryXMLPrinter printer;
+			printer.OpenElement( "Game" );
+			printer.PushAttribute( "version", VERSION );
+			printer.PushAttribute( "sceneID", node->sceneID );
 
-				StrNCpy( buf, atime, 40 );
-				buf[ strlen(buf)-1 ] = 0;	// remove trailing newline.
+			char buf[40];
+			TimeStamp( buf, 40 );
+			printer.PushAttribute( "timestamp", buf );
 
-				printer.PushAttribute( "timestamp", buf );
+			node->scene->Save( &printer );
 
-				node->scene->Save( &printer );
-	
-				printer.CloseElement();		// Game
-				fclose( fp );
-			}
+			printer.CloseElement();		// Game
+			WriteSaveFile( node->scene->CanSave(), slot, printer, async, node->scene->SaveTurn(), buf );
 		}
 	}
+	if ( !async ) {
+		// Everything is on disk when this returns: the app may be shutting down.
+		saveWriter.Flush();
+	}
 }
 
 
@@ -33,6 +33,7 @@
 #include "unit.h"
 #include "cgame.h"
 #include "battledata.h"
+#include "savewriter.h"
 
 #include <limits.h>
 
@@ -45,6 +46,7 @@ class TiXmlDocument;
 class Stats;
 class Unit;
 class Research;
+class BinaryXMLPrinter;
 
 static const float ONE8  = 1.0f / 8.0f;
 static const float ONE16 = 1.0f / 16.0f;
@@ -83,7 +85,10 @@ struct TileSetDesc {
 
 	Serialization (Saving and Loading)
 	----------------------------------
-	Everything at runtime is saved as XML. This includes:
+	Everything at runtime is saved through the XMLPrinter, and stored as binary
+	XML (see BinaryXMLPrinter). The "saveXML" setting also writes each save
+	as XML text for debugging, and XML saves from older versions still load.
+	This includes:
 	Map (copied from the database, but then changed as the game plays)
 	Engine
 	Units
@@ -170,14 +175,39 @@ public:
 	void SetDebugLevel( int level )		{ debugLevel = (level%4); }
 	int GetDebugLevel() const			{ return debugLevel; }
 
-	FILE* GameSavePath( SavePathType type, SavePathMode mode, int slot ) const;
+	// 'xml' is the XML text copy of a geo or tactical save. Reading a save
+	// falls back to the XML if there is no binary file.
+	FILE* GameSavePath( SavePathType type, SavePathMode mode, int slot, bool xml=false ) const;
+	void SavePathName( SavePathType type, int slot, bool xml, grinliz::GLString* path ) const;
 	bool HasSaveFile( SavePathType type, int slot ) const;
 	void DeleteSaveFile( SavePathType type, int slot );
 	void SavePathTimeStamp( SavePathType type, int slot, grinliz::GLString* stamp );
 	int LoadSlot() const				{ return loadSlot; }
 
+	// Reads a binary or XML save into 'doc'.
+	bool LoadSaveFile( SavePathType type, int slot, tinyxml2::XMLDocument* doc ) const;
+	// With 'async' the file is written over the next ticks (see SaveWriter).
+	// 'turn' and 'timestamp' go in the save index; the timestamp is now if null.
+	void WriteSaveFile( SavePathType type, int slot, const BinaryXMLPrinter& printer, bool async=false,
+						int turn=0, const char* timestamp=0 ) const;
+
+	// The index of the geo and tactical saves, kept in one small file so the
+	// save/load screen (and HasSaveFile) don't open the saves themselves.
+	// The sizes are checked against the files when the index is read.
+	struct SaveSlotInfo {
+		U32		hash;			// of the save as loaded (a tactical save with its deltas applied)
+		U32		size;			// of the save file
+		U32		deltaSize;		// of the tactical delta file
+		U16		version;
+		U8		valid;
+		U8		sceneID;
+		S32		turn;			// tactical: the turn, geo: the minutes of game time
+		char	timestamp[28];
+	};
+	const SaveSlotInfo& GetSaveSlotInfo( SavePathType type, int slot ) const	{ return *SlotInfo( type, slot ); }
+
 	void Load( const tinyxml2::XMLDocument& doc );
-	void Save( int slot, bool saveGeo, bool saveTac );
+	void Save( int slot, bool saveGeo, bool saveTac, bool async=false );
 
 	bool PopSound( int* database, int* offset, int* size );
 
@@ -269,11 +299,33 @@ private:
 
 	bool scenePopQueued;
 	int loadSlot;
+	mutable SaveWriter saveWriter;		// every open of a save file finishes its write first
+
+	// The tactical autosaves are written as a delta (see SaveDelta) from the
+	// last one, appended to "<save>.dlt", with the full save every KEYFRAME_SAVES.
+	enum { KEYFRAME_SAVES = 8 };
+	mutable CDynArray< U8 > lastSnapshot;	// the tactical save the next delta is from
+	mutable int lastSnapshotSlot;			// -1 if none
+	mutable int deltaCount;
+	void DeltaPathName( int slot, grinliz::GLString* path ) const;
+
+	enum { SAVE_INDEX_MAGIC = 0x49464f55, SAVE_INDEX_VERSION = 2 };	// "UFOI"
+	mutable SaveSlotInfo saveIndex[2][MAX_SAVE_SLOT+1];		// geo, tactical
+	mutable bool saveIndexLoaded;
+	SaveSlotInfo* SlotInfo( SavePathType type, int slot ) const;
+	void ReadSaveIndex() const;		// or rebuilds it from the saves, if there isn't one
+	void RebuildSlotInfo( SavePathType type, int slot ) const;
+	// The sizes on disk (0 if missing), without opening the files.
+	void SaveFileSizes( SavePathType type, int slot, U32* size, U32* deltaSize ) const;
+	void WriteSaveIndex() const;
+	static void TimeStamp( char* buf, int size );
 
 	void Init();
+	// Plays the ActionLog of the last recorded battle (without drawing it) and
+	// writes the report to the hash log.
+	void PlayReplay();
 	void LoadTextures();
 	void LoadModels();
-	void LoadModel( const char* name );
 	void LoadItemResources();
 	void LoadAtoms();
 
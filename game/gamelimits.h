@@ -30,11 +30,17 @@
 enum SavePathType {
 	SAVEPATH_NONE,
 	SAVEPATH_GEO,
-	SAVEPATH_TACTICAL
+	SAVEPATH_TACTICAL,
+	SAVEPATH_REPLAY,	// binary ActionLog of the tactical battle
+	SAVEPATH_HASHLOG	// text log of the per-turn battle state hashes
 };
 enum SavePathMode {
 	SAVEPATH_READ,
-	SAVEPATH_WRITE
+	SAVEPATH_WRITE,
+	SAVEPATH_APPEND
+};
+enum {
+	MAX_SAVE_SLOT = 4		// slots 1-4 are the player's, 0 is the autosave
 };
 
 
@@ -18,6 +18,7 @@
 #include "unit.h"
 #include "material.h"
 #include "../grinliz/glstringutil.h"
+#include "../grinliz/glthread.h"
 #include "../engine/text.h"
 #include "../faces/faces.h"
 
@@ -208,31 +209,65 @@ Texture* Game::CalcFaceTexture( const Unit* unit, grinliz::Rectangle2F* uv )
 }
 
 
-void Game::LoadModel( const char* name )
+// The models still to read, shared by the loading threads.
+struct ModelLoadJob
 {
-	GLASSERT( modelLoader );
+	enum { NUM_THREADS = 4 };	// including the main thread
 
-	const gamedb::Item* item = database0->Root()->Child( "models" )->Child( name );
-	GLASSERT( item );
-//	item = database0->ChainItem( item );
+	ModelLoader*			loader;
+	const gamedb::Item*		parent;
+	ModelResource**			res;
+	int						next;
+	grinliz::Mutex			mutex;
 
-	ModelResource* res = new ModelResource();
-	modelLoader->Load( item, res );
-	ModelResourceManager::Instance()->AddModelResource( res );
-}
+	static void ThreadMain( void* data )
+	{
+		ModelLoadJob* job = (ModelLoadJob*)data;
+		while( true ) {
+			job->mutex.Lock();
+			int i = job->next++;
+			job->mutex.Unlock();
+			if ( i >= job->parent->NumChildren() )
+				break;
+
+			job->res[i] = new ModelResource();
+			job->loader->LoadData( job->parent->Child( i ), job->res[i] );
+		}
+	}
+};
 
 
 void Game::LoadModels()
 {
-	// Run through the database, and load all the models.
+	// Run through the database, and load all the models. The vertex and index
+	// data is read and inflated by the threads; the textures are set and the
+	// resources added here, in database order.
+	GLASSERT( modelLoader );
 	const gamedb::Item* parent = database0->Root()->Child( "models" );
 	GLASSERT( parent );
 
+	ModelLoadJob job;
+	job.loader = modelLoader;
+	job.parent = parent;
+	job.res = new ModelResource*[ parent->NumChildren() ];
+	job.next = 0;
+
+	Thread thread[ModelLoadJob::NUM_THREADS-1];
+	for( int i=0; i<ModelLoadJob::NUM_THREADS-1; ++i ) {
+		thread[i].Start( ModelLoadJob::ThreadMain, &job );
+	}
+	ModelLoadJob::ThreadMain( &job );
+	for( int i=0; i<ModelLoadJob::NUM_THREADS-1; ++i ) {
+		thread[i].Join();
+	}
+
 	for( int i=0; i<parent->NumChildren(); ++i )
 	{
 		const gamedb::Item* node = parent->Child( i );
-		LoadModel( node->Name() );
+		modelLoader->LoadTextures( node, job.res[i] );
+		ModelResourceManager::Instance()->AddModelResource( job.res[i] );
 	}
+	delete [] job.res;
 }
 
 
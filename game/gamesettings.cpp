@@ -50,6 +50,11 @@ GameSettingsManager::GameSettingsManager( const char* savepath ) : SettingsManag
 		#endif
 	allowDrag = true;
 	testAlien = 0;
+	autoResolve = 0;
+	recordReplay = 0;
+	playReplay = 0;
+	hashLog = 0;
+	saveXML = 0;
 }
 
 
@@ -63,6 +68,11 @@ void GameSettingsManager::ReadAttributes( const XMLElement* root )
 	root->QueryBoolAttribute( "confirmMove", &confirmMove );
 	root->QueryBoolAttribute( "allowDrag", &allowDrag );
 	root->QueryIntAttribute( "testAlien", &testAlien );
+	root->QueryIntAttribute( "autoResolve", &autoResolve );
+	root->QueryIntAttribute( "recordReplay", &recordReplay );
+	root->QueryIntAttribute( "playReplay", &playReplay );
+	root->QueryIntAttribute( "hashLog", &hashLog );
+	root->QueryIntAttribute( "saveXML", &saveXML );
 	currentMod = "";
 	if ( root->Attribute( "currentMod" ) ) {
 		currentMod = root->Attribute( "currentMod" );
@@ -81,6 +91,11 @@ void GameSettingsManager::WriteAttributes( XMLPrinter* printer )
 	printer->PushAttribute( "confirmMove", confirmMove );
 	printer->PushAttribute( "allowDrag", allowDrag );
 	printer->PushAttribute( "testAlien", testAlien );
+	printer->PushAttribute( "autoResolve", autoResolve );
+	printer->PushAttribute( "recordReplay", recordReplay );
+	printer->PushAttribute( "playReplay", playReplay );
+	printer->PushAttribute( "hashLog", hashLog );
+	printer->PushAttribute( "saveXML", saveXML );
 }
 
 
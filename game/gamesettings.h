@@ -34,6 +34,11 @@ public:
 	bool GetPlayerAI() const			{ return playerAI != 0; }
 	bool GetBattleShipParty() const		{ return battleShipParty != 0; }
 	int GetTestAlien() const			{ return testAlien; }
+	bool GetAutoResolve() const		{ return autoResolve != 0; }	// resolve geo battles with the FastBattleScene
+	bool GetRecordReplay() const		{ return recordReplay != 0; }	// write an ActionLog of tactical battles
+	bool GetPlayReplay() const			{ return playReplay != 0; }		// replay the ActionLog, headless, when the game starts
+	bool GetHashLog() const				{ return hashLog != 0; }		// append the per-turn state hashes to a text file
+	bool GetSaveXML() const				{ return saveXML != 0; }		// also write the saved games as XML text
 	
 	// read-write
 	void SetConfirmMove( bool confirm );
@@ -59,6 +64,11 @@ private:
 	int playerAI;
 	int battleShipParty;
 	int testAlien;
+	int autoResolve;
+	int recordReplay;
+	int playReplay;
+	int hashLog;
+	int saveXML;
 	bool confirmMove;
 	bool allowDrag;
 	grinliz::GLString currentMod;
@@ -23,6 +23,7 @@
 #include "../engine/particleeffect.h"
 #include "../engine/ufoutil.h"
 #include "../engine/text.h"
+#include "../engine/serialize.h"
 
 #include "../grinliz/glutil.h"
 
@@ -239,6 +240,12 @@ GeoScene::GeoScene( Game* _game, const GeoSceneData* data ) : Scene( _game ), re
 	nBattles = 0;
 	gameVictory = false;
 	loadSlot = 0;
+	pregenMap = 0;
+	pregenUFOID = 0;
+	pregenScenario = 0;
+	pregenCrash = false;
+	pregenSeed = 0;
+	pregenCancel = false;
 	difficulty = NORMAL;
 	if ( data ) {
 		difficulty = data->difficulty;
@@ -307,6 +314,7 @@ GeoScene::~GeoScene()
 	}
 	delete geoMap;
 	delete geoAI;
+	FreePregenMap();
 }
 
 
@@ -1012,27 +1020,7 @@ void GeoScene::DoBattle( CargoChit* landerChit, UFOChit* ufoChit )
 			TimeState state;
 			CalcTimeState( timeline, &state );
 
-			int scenario = FARM_SCOUT;
-			if ( baseAttack ) {
-				scenario = TERRAN_BASE;
-			}
-			else if ( ufoChit->Type() == UFOChit::BATTLESHIP ) {
-				scenario = BATTLESHIP;
-			}
-			else if ( ufoChit->Type() == UFOChit::BASE ) {
-				scenario = ALIEN_BASE;
-			}
-			else {
-				int type = geoMapData.GetType( ufoChit->MapPos().x, ufoChit->MapPos().y );
-				switch ( type ) {
-				case GeoMapData::CITY:		scenario = CITY;	break;
-				case GeoMapData::FARM:		scenario = (ufoChit->Type() == UFOChit::SCOUT ) ? FARM_SCOUT : FARM_DESTROYER;	break;
-				case GeoMapData::FOREST:	scenario = (ufoChit->Type() == UFOChit::SCOUT ) ? FRST_SCOUT : FRST_DESTROYER;	break;
-				case GeoMapData::DESERT:	scenario = (ufoChit->Type() == UFOChit::SCOUT ) ? DSRT_SCOUT : DSRT_DESTROYER;	break;
-				case GeoMapData::TUNDRA:	scenario = (ufoChit->Type() == UFOChit::SCOUT ) ? TNDR_SCOUT : TNDR_DESTROYER;	break;
-				default: GLASSERT( 0 ); break;
-				}
-			}
+			int scenario = CalcScenario( ufoChit, baseAttack );
 
 			float alienRank = state.alienRank;
 			if ( scenario == ALIEN_BASE ) {
@@ -1067,45 +1055,170 @@ void GeoScene::DoBattle( CargoChit* landerChit, UFOChit* ufoChit )
 			game->DeleteSaveFile( SAVEPATH_TACTICAL, 0 );
 			game->Save( 0, true, false );
 
-			game->PushScene( Game::BATTLE_SCENE, data );
+			// The pre-generated map is kept only if it is the map of this battle.
+			if (    ufoChit->ID() != pregenUFOID
+				 || scenario != pregenScenario
+				 || data->crash != pregenCrash )
+			{
+				FreePregenMap();
+			}
+
+			if ( GameSettingsManager::Instance()->GetAutoResolve() ) {
+				// No map: the battle is resolved by simulation. There is no
+				// tactical save file, so nothing to load in ChildActivated().
+				FreePregenMap();
+				game->PushScene( Game::FASTBATTLE_SCENE, data );
+			}
+			else {
+				game->PushScene( Game::BATTLE_SCENE, data );
+			}
 
 		}
 	}
 }
 
 
+int GeoScene::CalcScenario( UFOChit* ufoChit, bool baseAttack )
+{
+	int scenario = FARM_SCOUT;
+	if ( baseAttack ) {
+		scenario = TERRAN_BASE;
+	}
+	else if ( ufoChit->Type() == UFOChit::BATTLESHIP ) {
+		scenario = BATTLESHIP;
+	}
+	else if ( ufoChit->Type() == UFOChit::BASE ) {
+		scenario = ALIEN_BASE;
+	}
+	else {
+		int type = geoMapData.GetType( ufoChit->MapPos().x, ufoChit->MapPos().y );
+		switch ( type ) {
+		case GeoMapData::CITY:		scenario = CITY;	break;
+		case GeoMapData::FARM:		scenario = (ufoChit->Type() == UFOChit::SCOUT ) ? FARM_SCOUT : FARM_DESTROYER;	break;
+		case GeoMapData::FOREST:	scenario = (ufoChit->Type() == UFOChit::SCOUT ) ? FRST_SCOUT : FRST_DESTROYER;	break;
+		case GeoMapData::DESERT:	scenario = (ufoChit->Type() == UFOChit::SCOUT ) ? DSRT_SCOUT : DSRT_DESTROYER;	break;
+		case GeoMapData::TUNDRA:	scenario = (ufoChit->Type() == UFOChit::SCOUT ) ? TNDR_SCOUT : TNDR_DESTROYER;	break;
+		default: GLASSERT( 0 ); break;
+		}
+	}
+	return scenario;
+}
+
+
+void GeoScene::FreePregenMap()
+{
+	if ( pregenThread.Started() ) {
+		// The thread stops after the image it is on.
+		pregenMutex.Lock();
+		pregenCancel = true;
+		pregenMutex.Unlock();
+		pregenThread.Join();
+	}
+	delete pregenMap;
+	pregenMap = 0;
+	pregenUFOID = 0;
+}
+
+
+void GeoScene::PregenerateMap()
+{
+	// Find the UFO a lander is on its way to. Landers only go to parked UFOs.
+	UFOChit* ufoChit = 0;
+	for( Chit* chitIt=chitBag.Begin(); chitIt != chitBag.End(); chitIt=chitIt->Next() ) {
+		CargoChit* lander = chitIt->IsCargoChit();
+		if ( lander && lander->Type() == CargoChit::TYPE_LANDER && lander->Outbound() && !lander->IsDestroyed() ) {
+			Chit* chitAt = chitBag.GetParkedChitAt( lander->Dest() );
+			ufoChit = chitAt ? chitAt->IsUFOChit() : 0;
+			if ( ufoChit )
+				break;
+		}
+	}
+
+	if ( !ufoChit ) {
+		FreePregenMap();
+		return;
+	}
+
+	int scenario = CalcScenario( ufoChit, false );
+	bool crash = ( ufoChit->AI() == UFOChit::AI_CRASHED );
+
+	if ( pregenMap && ( ufoChit->ID() != pregenUFOID || scenario != pregenScenario || crash != pregenCrash ) ) {
+		FreePregenMap();
+	}
+	if ( !pregenMap ) {
+		pregenMap = new MapDesc();
+		pregenUFOID = ufoChit->ID();
+		pregenScenario = scenario;
+		pregenCrash = crash;
+		pregenCancel = false;
+
+		// The map seed doesn't come from the geo random number generator,
+		// which would change the game depending on when a lander is sent.
+		Random seedRandom;
+		seedRandom.SetSeedFromTime();
+		pregenSeed = seedRandom.Rand();
+
+		if ( !pregenThread.Start( PregenThreadMain, this ) ) {
+			// No thread: make it now.
+			PregenThreadMain( this );
+		}
+	}
+}
+
+
+void GeoScene::PregenThreadMain( void* data )
+{
+	// Only the pregenMap is written here. The scene doesn't change the other
+	// pregen members until the thread is joined.
+	GeoScene* scene = (GeoScene*)data;
+	MapDesc* mapDesc = scene->pregenMap;
+
+	TacticalIntroScene::SceneInfo info( scene->pregenScenario, scene->pregenCrash, TacticalIntroScene::CivsInScenario( scene->pregenScenario ) );
+	TacticalIntroScene::CreateMap( mapDesc, scene->pregenSeed, info, scene->game->GetDatabase() );
+
+	while( true ) {
+		scene->pregenMutex.Lock();
+		bool cancel = scene->pregenCancel;
+		scene->pregenMutex.Unlock();
+
+		if ( cancel || !mapDesc->LoadSurfaces() )
+			break;
+	}
+}
+
+
+MapDesc* GeoScene::JoinPregenMap()
+{
+	// If the battle starts before the thread is done, waits for the rest.
+	pregenThread.Join();
+	return pregenMap;
+}
+
+
 
 void GeoScene::ChildActivated( int childID, Scene* childScene, SceneData* data )
 {
 	if ( childID == Game::BATTLE_SCENE ) {
 		XMLDocument doc;
+		MapDesc newDesc;
+		// Use the map made while the lander was on its way, if there is one.
+		MapDesc* pregen = JoinPregenMap();
+		MapDesc* mapDesc = pregen ? pregen : &newDesc;
 
 		if ( !data ) {
 			// Load existing map
 			GLASSERT( game->HasSaveFile( SAVEPATH_TACTICAL, loadSlot ));
 			if ( game->HasSaveFile( SAVEPATH_TACTICAL, loadSlot ) ) {
-				FILE* fp = game->GameSavePath( SAVEPATH_TACTICAL, SAVEPATH_READ, loadSlot );
-				GLASSERT( fp );
-				if ( fp ) {
-					doc.LoadFile( fp );
-					fclose( fp );
-				}
+				game->LoadSaveFile( SAVEPATH_TACTICAL, loadSlot, &doc );
 			}
 		}
 		else {
 			// Create new map.
 			GLASSERT( !game->HasSaveFile( SAVEPATH_TACTICAL, loadSlot ) );
-			FILE* fp = game->GameSavePath( SAVEPATH_TACTICAL, SAVEPATH_WRITE, loadSlot );
-			if ( fp ) {
-				TacticalIntroScene::WriteXML( fp, (const BattleSceneData*)data, game->GetItemDefArr(), game->GetDatabase() );
-				fclose( fp );
-
-				fp = game->GameSavePath( SAVEPATH_TACTICAL, SAVEPATH_READ, loadSlot );
-				if ( fp ) {
-					doc.LoadFile( fp );
-					fclose( fp );
-				}
-			}
+			BinaryXMLPrinter printer;
+			TacticalIntroScene::WriteXML( &printer, (const BattleSceneData*)data, game->GetItemDefArr(), game->GetDatabase(), mapDesc );
+			game->WriteSaveFile( SAVEPATH_TACTICAL, loadSlot, printer );
+			game->LoadSaveFile( SAVEPATH_TACTICAL, loadSlot, &doc );
 		}
 		GLASSERT( doc.FirstChildElement() );
 		GLASSERT( !doc.Error() );
@@ -1116,10 +1229,15 @@ void GeoScene::ChildActivated( int childID, Scene* childScene, SceneData* data )
 				XMLElement* scene = game->FirstChildElement( "BattleScene" );
 				GLASSERT( scene );
 				if ( scene ) {
-					((BattleScene*)childScene)->Load( scene );
+					// A new map is loaded straight from the MapDesc.
+					if ( data )
+						((BattleScene*)childScene)->Load( scene, *mapDesc );
+					else
+						((BattleScene*)childScene)->Load( scene );
 				}
 			}
 		}
+		FreePregenMap();
 	}
 	loadSlot = 0;
 }
@@ -1384,6 +1502,10 @@ void GeoScene::DoTick( U32 currentTime, U32 deltaTime )
 		}
 	}
 
+	if ( !game->IsScenePushed() ) {
+		PregenerateMap();
+	}
+
 	char cashBuf[16];
 	SNPrintf( cashBuf, 16, "$%d", cash );
 	cashImage.SetText( cashBuf );
@@ -19,6 +19,7 @@
 #include "../grinliz/gltypes.h"
 #include "../grinliz/gldebug.h"
 #include "../grinliz/glrandom.h"
+#include "../grinliz/glthread.h"
 
 #include "scene.h"
 #include "chits.h"
@@ -40,6 +41,7 @@ class GeoAI;
 class RingEffect;
 class BaseChit;
 class UFOChit;
+struct MapDesc;
 class Chit;
 class Storage;
 class ItemDefArr;
@@ -263,6 +265,7 @@ public:
 
 	virtual SavePathType CanSave()										{ return SAVEPATH_GEO; }
 	virtual void Save( tinyxml2::XMLPrinter* );
+	virtual int SaveTurn()												{ return (int)(timeline / 60000); }
 	virtual void Load( const tinyxml2::XMLElement* doc );
 
 	virtual void DrawHUD();
@@ -308,6 +311,15 @@ private:
 
 	void HandleItemTapped( const gamui::UIItem* item );
 	void DoBattle( CargoChit* cargoChit, UFOChit* ufoChit );		// cargo OR ufo, not both
+	int CalcScenario( UFOChit* ufoChit, bool baseAttack );
+
+	// The map of the likely next battle, and the surfaces of its images, are
+	// made on the pregenThread while a lander is on its way to a UFO. The
+	// battle then starts without creating or loading the map.
+	void PregenerateMap();
+	void FreePregenMap();
+	MapDesc* JoinPregenMap();
+	static void PregenThreadMain( void* data );
 	void CalcTimeState( U32 seconds, TimeState* state );
 
 	enum {
@@ -339,6 +351,15 @@ private:
 	float				savedCameraX;
 	int					loadSlot;
 
+	MapDesc*			pregenMap;			// the pregenThread's until it is joined
+	int					pregenUFOID;
+	int					pregenScenario;
+	bool				pregenCrash;
+	int					pregenSeed;
+	bool				pregenCancel;		// locked by pregenMutex
+	grinliz::Mutex		pregenMutex;
+	grinliz::Thread		pregenThread;
+
 	grinliz::Random		random;
 
 	gamui::PushButton	helpButton, researchButton;
@@ -14,7 +14,6 @@
 */
 
 #include "inventory.h"
-#include "game.h"
 #include "../tinyxml2/tinyxml2.h"
 #include "../grinliz/glstringutil.h"
 
@@ -15,13 +15,11 @@
 
 #include "item.h"
 #include "material.h"
-#include "../engine/model.h"
 #include "../engine/serialize.h"
 #include "gamelimits.h"
-#include "../engine/particleeffect.h"
-#include "../engine/particle.h"
 #include "../tinyxml2/tinyxml2.h"
 #include "../grinliz/glstringutil.h"
+#include "../grinliz/glrandom.h"
 #include "stats.h"
 
 using namespace grinliz;
@@ -32,13 +30,6 @@ int   WeaponItemDef::accHit = 0;
 int   WeaponItemDef::accTotal = 0;
 
 
-void DamageDesc::MapDamage( MapDamageDesc* damage )
-{
-	damage->damage = kinetic + energy;
-	damage->incendiary = incend;
-}
-
-
 void ItemDef::InitBase( const char* name, const char* desc, int deco, int price, bool isAlien, const ModelResource* resource )
 {
 	this->name = name; 
@@ -76,106 +67,6 @@ void ItemDef::PrintDesc( char* buffer, int nChar ) const
 }
 
 
-void WeaponItemDef::RenderWeapon(	int mode,
-									ParticleSystem* system,
-									const Vector3F& p0, 
-									const Vector3F& p1,
-									bool useImpact,
-									U32 currentTime,
-									U32* duration ) const
-{
-	enum { BEAM, TRAIL };
-	enum { SPLASH, EXPLOSION };
-
-	const ClipItemDef* cid = clipItemDef[mode];
-
-	int first = (weapon[mode]->flags & WEAPON_EXPLOSIVE) ? TRAIL : BEAM;
-	int second = (weapon[mode]->flags & WEAPON_EXPLOSIVE) ? EXPLOSION : SPLASH;
-
-	// effects: 
-	//		bolt then particle
-	//		beam
-
-	if ( first == BEAM ) {
-		BoltEffect* bolt = (BoltEffect*) system->EffectFactory( "BoltEffect" );
-		if ( !bolt ) { 
-			bolt = new BoltEffect( system );
-		}
-		
-		bolt->Clear();
-		bolt->SetColor( cid->color );
-		bolt->SetSpeed( cid->speed );
-		bolt->SetLength( cid->length );
-		bolt->SetWidth( cid->width );
-		bolt->Init( p0, p1, currentTime );
-
-		*duration = bolt->CalcDuration();
-		system->AddEffect( bolt );
-	}
-	else if ( first == TRAIL ) {
-		SmokeTrailEffect* trail = (SmokeTrailEffect*) system->EffectFactory( "SmokeTrailEffect" );
-		if ( !trail ) {
-			trail = new SmokeTrailEffect( system );
-		}
-
-		trail->Clear();
-
-		Color4F c = { 1, 1, 1, 1 };
-
-		if ( IsAlien() ) {
-			trail->SetQuad( ParticleSystem::CIRCLE, 1 );
-			c = cid->color;
-		}
-
-		trail->SetColor( c );
-		trail->SetSpeed( cid->speed*0.4f );
-		trail->Init( p0, p1, currentTime );
-		*duration = trail->CalcDuration();
-		system->AddEffect( trail );
-	}
-	else {
-		GLASSERT( 0 );
-	}
-
-	if ( useImpact ) {
-
-		ImpactEffect* impact = (ImpactEffect*) system->EffectFactory( "ImpactEffect" );
-		if ( !impact ) {
-			impact = new ImpactEffect( system );
-		}
-
-		Vector3F n = p0 - p1;
-		n.Normalize();
-		impact->Clear();
-		impact->Init( p1, currentTime + *duration );
-		impact->SetColor( cid->color );
-		impact->SetNormal( n );
-		if ( second == SPLASH ) {
-			impact->SetRadius( 1.5f );
-		}
-		else {
-			// explosion
-			impact->SetRadius( 3.5f );
-			impact->SetConfig( ParticleSystem::PARTICLE_SPHERE );
-
-			// 2nd set of particles:
-			ImpactEffect* impact2 = (ImpactEffect*) system->EffectFactory( "ImpactEffect" );
-			if ( !impact2 ) {
-				impact2 = new ImpactEffect( system );
-			}
-			impact2->Clear();
-			impact2->Init( p1, currentTime + *duration + 250 );
-			impact2->SetColor( cid->color );
-			impact2->SetNormal( n );
-			impact2->SetRadius( 3.5f );
-			impact2->SetConfig( ParticleSystem::PARTICLE_SPHERE );
-			system->AddEffect( impact2 );
-		}
-		system->AddEffect( impact );
-	}
-}
-
-
 bool WeaponItemDef::CompatibleClip( const ItemDef* id, int* which ) const
 {
 	if ( id->IsClip() ) {
@@ -504,6 +395,22 @@ void Storage::Save( XMLPrinter* printer )
 }
 
 
+U32 Storage::StateHash() const
+{
+	// Same items as Save(): hashed by name so the hash is stable between builds.
+	U32 h = Random::Hash( &x, sizeof( x ) );
+	h = Random::Hash( &y, sizeof( y ), h );
+	for( int i=0; i<itemDefArr.Size(); ++i ) {
+		if ( rounds[i] > 0 ) {
+			const char* name = itemDefArr.Query(i)->name;
+			h = Random::Hash( name, strlen( name ), h );
+			h = Random::Hash( &rounds[i], sizeof( rounds[i] ), h );
+		}
+	}
+	return h;
+}
+
+
 void Storage::Load( const XMLElement* element )
 {
 	memset( rounds, 0, sizeof(int)*EL_MAX_ITEM_DEFS );
@@ -532,11 +439,10 @@ void Storage::Load( const XMLElement* element )
 
 
 // Return the "best" item for on-screen rendering.
-const ModelResource* Storage::VisualRep( bool* zRotate ) const
+const ItemDef* Storage::VisualRep() const
 {
 	float bestScore = 0;
 	const ItemDef* best = 0;
-	*zRotate = false;
 
 	for( int i=0; i<itemDefArr.Size(); ++i ) {
 		if ( rounds[i] > 0 ) {
@@ -554,11 +460,7 @@ const ModelResource* Storage::VisualRep( bool* zRotate ) const
 			}
 		}
 	}
-	if ( best ) {
-		*zRotate = true;
-		return ModelResourceManager::Instance()->GetModelResource( best->resource->header.name.c_str() );
-	}
-	return ModelResourceManager::Instance()->GetModelResource( "smallcrate" );
+	return best;
 }
 
 
@@ -31,8 +31,6 @@
 class ModelResource;
 class TiXmlElement;
 class Engine;
-class ParticleSystem;
-struct MapDamageDesc;
 
 
 enum {
@@ -72,7 +70,6 @@ struct DamageDesc
 											}
 
 	float Dot( const DamageDesc& other ) const	{ return other.kinetic*kinetic + other.energy*energy + other.incend*incend; }
-	void MapDamage( MapDamageDesc* );
 };
 
 
@@ -195,14 +192,6 @@ public:
 	int RoundsNeeded( int mode ) const								{ return ( weapon[mode] && weapon[mode]->flags & WEAPON_AUTO ) ? 3 : 1; }
 	bool IsExplosive( int mode ) const								{ return ( weapon[mode] && weapon[mode]->flags & WEAPON_EXPLOSIVE ) != 0; }
 
-	void RenderWeapon(	int mode,
-						ParticleSystem*,
-						const grinliz::Vector3F& p0, 
-						const grinliz::Vector3F& p1,
-						bool impact,
-						U32 currentTime,
-						U32* doneTime ) const;
-
 	bool CompatibleClip( const ItemDef* itemDef, int* which ) const;
 	
 	// Basic damage for this weapon.
@@ -354,7 +343,10 @@ public:
 	void Save( tinyxml2::XMLPrinter* printer );
 	void Load( const tinyxml2::XMLElement* mapNode );
 
-	const ModelResource* VisualRep( bool* zRotate ) const;
+	U32 StateHash() const;
+
+	// The weapon that best shows what is stored, or null if it is shown as a crate.
+	const ItemDef* VisualRep() const;
 
 	int X() const { return x; }
 	int Y() const { return y; }
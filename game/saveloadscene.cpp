@@ -54,18 +54,21 @@ SaveLoadScene::SaveLoadScene( Game* _game, const SaveLoadSceneData* _data ) : Sc
 		slotText[i].Init( &gamui2D );
 		slotTime[i].Init( &gamui2D );
 		
-		GLString t;
+		// From the save index: the saves themselves aren't opened.
+		const Game::SaveSlotInfo& geo = game->GetSaveSlotInfo( SAVEPATH_GEO, i+1 );
+		const Game::SaveSlotInfo& tac = game->GetSaveSlotInfo( SAVEPATH_TACTICAL, i+1 );
+		const char* t = "";
 		CStr<16> str = " <empty>";
-		if ( game->HasSaveFile( SAVEPATH_GEO, i+1 )) {
+		if ( geo.valid ) {
 			str = " Geo";
-			game->SavePathTimeStamp( SAVEPATH_GEO, i+1, &t );
+			t = geo.timestamp;
 		}
-		else if ( game->HasSaveFile( SAVEPATH_TACTICAL, i+1 )) {
+		else if ( tac.valid ) {
 			str = " Tactical";
-			game->SavePathTimeStamp( SAVEPATH_TACTICAL, i+1, &t );
+			t = tac.timestamp;
 		}
 		slotText[i].SetText( str.c_str() );
-		slotTime[i].SetText( t.c_str() );
+		slotTime[i].SetText( t );
 	}
 	EnableSlots();
 	Confirm( false );
@@ -0,0 +1,455 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "savewriter.h"
+#include "../grinliz/glrandom.h"
+
+#if defined( _WIN32 )
+#	define WIN32_LEAN_AND_MEAN
+#	include <windows.h>
+#	include <io.h>
+#else
+#	include <unistd.h>
+#endif
+
+#ifdef ANDROID_NDK
+#	include <zlib.h>		// Built in zlib support.
+#else
+#	include "../zlib/zlib.h"
+#endif
+
+using namespace grinliz;
+
+
+SaveWriter::SaveWriter() : quit( false ), sequence( 0 )
+{
+	for( int i=0; i<MAX_JOBS; ++i ) {
+		job[i].state = JOB_FREE;
+		job[i].append = false;
+		job[i].sequence = 0;
+	}
+}
+
+
+SaveWriter::~SaveWriter()
+{
+	if ( thread.Started() ) {
+		{
+			MutexLock lock( &mutex );
+			quit = true;
+		}
+		work.Set();
+		thread.Join();		// the thread writes what is queued before it quits
+	}
+}
+
+
+SaveWriter::Job* SaveWriter::Next()
+{
+	Job* next = 0;
+	for( int i=0; i<MAX_JOBS; ++i ) {
+		if ( job[i].state == JOB_QUEUED && ( !next || job[i].sequence < next->sequence ) )
+			next = &job[i];
+	}
+	return next;
+}
+
+
+bool SaveWriter::Busy()
+{
+	MutexLock lock( &mutex );
+	for( int i=0; i<MAX_JOBS; ++i ) {
+		if ( job[i].state != JOB_FREE )
+			return true;
+	}
+	return false;
+}
+
+
+void SaveWriter::ThreadMain( void* data )
+{
+	SaveWriter* writer = (SaveWriter*)data;
+
+	while ( true ) {
+		Job* j = 0;
+		{
+			MutexLock lock( &writer->mutex );
+			j = writer->Next();
+			if ( j )
+				j->state = JOB_WRITING;		// the main thread leaves it alone until it is free
+			else if ( writer->quit )
+				break;
+		}
+		if ( !j ) {
+			writer->work.Wait();
+			continue;
+		}
+
+		Write( *j );
+
+		{
+			MutexLock lock( &writer->mutex );
+			j->state = JOB_FREE;
+			j->data.Clear();
+		}
+		writer->done.Set();
+	}
+}
+
+
+void SaveWriter::Queue( const char* path, const U8* data, int size, bool append )
+{
+	if ( !thread.Started() && !thread.Start( ThreadMain, this ) ) {
+		GLOUTPUT(( "SaveWriter: no thread, writing '%s' now\n", path ));
+		Job now;
+		now.append = append;
+		now.path = path;
+		if ( size ) {
+			memcpy( now.data.PushArr( size ), data, size );
+		}
+		Write( now );
+		return;
+	}
+
+	Job* j = 0;
+	while ( !j ) {
+		{
+			MutexLock lock( &mutex );
+
+			// A full write that is the last one waiting for 'path' is replaced
+			// by a new full write. Anything queued after it may depend on it,
+			// so the order of the writes to a file never changes.
+			if ( !append ) {
+				Job* last = 0;
+				for( int i=0; i<MAX_JOBS; ++i ) {
+					if (    job[i].state == JOB_QUEUED && job[i].path == path
+						 && ( !last || job[i].sequence > last->sequence ) )
+					{
+						last = &job[i];
+					}
+				}
+				if ( last && !last->append ) {
+					last->state = JOB_FREE;
+					last->data.Clear();
+				}
+			}
+
+			for( int i=0; i<MAX_JOBS; ++i ) {
+				if ( job[i].state == JOB_FREE ) {
+					j = &job[i];
+					break;
+				}
+			}
+			if ( j ) {
+				j->state = JOB_QUEUED;
+				j->append = append;
+				j->sequence = sequence++;
+				j->path = path;
+				j->data.Clear();
+				if ( size ) {
+					memcpy( j->data.PushArr( size ), data, size );
+				}
+			}
+		}
+		if ( !j ) {
+			// Every job is in use: wait for the thread to finish one.
+			done.Wait();
+		}
+	}
+	work.Set();
+}
+
+
+void SaveWriter::Wait( const char* path )
+{
+	while ( true ) {
+		{
+			MutexLock lock( &mutex );
+			bool pending = false;
+			for( int i=0; i<MAX_JOBS; ++i ) {
+				if ( job[i].state != JOB_FREE && ( !path || job[i].path == path ) ) {
+					pending = true;
+					break;
+				}
+			}
+			if ( !pending )
+				return;
+		}
+		done.Wait();
+	}
+}
+
+
+void SaveWriter::Finish( const char* path )
+{
+	Wait( path );
+}
+
+
+void SaveWriter::Flush()
+{
+	Wait( 0 );
+}
+
+
+bool SaveWriter::Write( const Job& j )
+{
+	GLString tmp = j.path;
+	tmp += ".tmp";
+	const char* name = j.append ? j.path.c_str() : tmp.c_str();
+
+	FILE* fp = fopen( name, j.append ? "ab" : "wb" );
+	if ( !fp ) {
+		GLOUTPUT(( "SaveWriter: could not open '%s'\n", name ));
+		return false;
+	}
+	if ( j.data.Size() ) {
+		fwrite( j.data.Mem(), j.data.Size(), 1, fp );
+	}
+
+	// The bytes have to be on the disk before the rename makes them the
+	// save; otherwise a power loss can leave a renamed but empty file.
+	bool okay = ( fflush( fp ) == 0 ) && ( ferror( fp ) == 0 );
+#if defined( _WIN32 )
+	okay = okay && ( _commit( _fileno( fp ) ) == 0 );
+#else
+	okay = okay && ( fsync( fileno( fp ) ) == 0 );
+#endif
+	okay = ( fclose( fp ) == 0 ) && okay;
+
+	if ( j.append ) {
+		if ( !okay ) {
+			GLOUTPUT(( "SaveWriter: failed to append to '%s'\n", j.path.c_str() ));
+		}
+		return okay;
+	}
+
+	if ( okay ) {
+#if defined( _WIN32 )
+		// rename() won't replace an existing file on Windows.
+		okay = MoveFileExA( tmp.c_str(), j.path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH ) != 0;
+#else
+		okay = rename( tmp.c_str(), j.path.c_str() ) == 0;
+#endif
+	}
+	if ( !okay ) {
+		GLOUTPUT(( "SaveWriter: failed to write '%s'\n", j.path.c_str() ));
+		remove( tmp.c_str() );
+	}
+	return okay;
+}
+
+
+static void PutU32( U8* p, U32 v )
+{
+	for( int i=0; i<4; ++i ) {
+		p[i] = (U8)(v & 0xff);
+		v >>= 8;
+	}
+}
+
+
+static U32 GetU32( const U8* p )
+{
+	return (U32)p[0] | ((U32)p[1]<<8) | ((U32)p[2]<<16) | ((U32)p[3]<<24);
+}
+
+
+static bool ReadVar( const U8** p, const U8* end, U32* v )
+{
+	*v = 0;
+	for( int shift=0; shift<32; shift+=7 ) {
+		if ( *p >= end )
+			return false;
+		U8 b = *(*p)++;
+		*v |= (U32)(b & 0x7f) << shift;
+		if ( !(b & 0x80) )
+			return true;
+	}
+	return false;
+}
+
+
+U32 SaveDelta::BlockHash( const U8* p )
+{
+	U32 h = Random::Hash( p, BLOCK );
+	return h & ((1<<HASH_BITS)-1);
+}
+
+
+void SaveDelta::WriteVar( CDynArray< U8 >* out, U32 v )
+{
+	while ( v >= 0x80 ) {
+		out->Push( (U8)(v | 0x80) );
+		v >>= 7;
+	}
+	out->Push( (U8)v );
+}
+
+
+void SaveDelta::Literal( CDynArray< U8 >* out, const U8* p, int len )
+{
+	if ( len > 0 ) {
+		WriteVar( out, OP_LITERAL );
+		WriteVar( out, len );
+		memcpy( out->PushArr( len ), p, len );
+	}
+}
+
+
+void SaveDelta::Create( const U8* base, int baseSize, const U8* data, int size, CDynArray< U8 >* out )
+{
+	// Index the blocks of the base. The table holds the offset+1 of the
+	// last block with that hash; a collision just loses a match.
+	const int TABLE_SIZE = 1<<HASH_BITS;
+	CDynArray< int > table( TABLE_SIZE );
+	memset( table.PushArr( TABLE_SIZE ), 0, TABLE_SIZE*sizeof(int) );
+	for( int i=0; i+BLOCK<=baseSize; i+=BLOCK ) {
+		table[ BlockHash( base+i ) ] = i+1;
+	}
+
+	CDynArray< U8 > ops( size/8+64 );
+	int literal = 0;	// start of the pending literal run
+	int pos = 0;
+	while ( pos+BLOCK <= size ) {
+		int b = table[ BlockHash( data+pos ) ] - 1;
+		if ( b < 0 || memcmp( base+b, data+pos, BLOCK ) != 0 ) {
+			++pos;
+			continue;
+		}
+		// Extend the match back into the literal, and forward.
+		int start = pos;
+		while ( start > literal && b > 0 && base[b-1] == data[start-1] ) {
+			--start;
+			--b;
+		}
+		int len = pos - start + BLOCK;
+		while ( start+len < size && b+len < baseSize && base[b+len] == data[start+len] ) {
+			++len;
+		}
+		Literal( &ops, data+literal, start-literal );
+		WriteVar( &ops, OP_COPY );
+		WriteVar( &ops, b );
+		WriteVar( &ops, len );
+		pos = start + len;
+		literal = pos;
+	}
+	Literal( &ops, data+literal, size-literal );
+
+	uLongf compressedSize = compressBound( ops.Size() );
+	U8* header = out->PushArr( HEADER_SIZE + (int)compressedSize );
+	int result = compress2( header+HEADER_SIZE, &compressedSize, ops.Mem(), ops.Size(), Z_DEFAULT_COMPRESSION );
+	GLASSERT( result == Z_OK );
+	(void)result;
+
+	PutU32( header+0,  MAGIC );
+	PutU32( header+4,  Random::Hash( base, baseSize ) );
+	PutU32( header+8,  baseSize );
+	PutU32( header+12, Random::Hash( data, size ) );
+	PutU32( header+16, size );
+	PutU32( header+20, ops.Size() );
+	PutU32( header+24, (U32)compressedSize );
+	out->Trim( out->Size() - (int)compressBound( ops.Size() ) + (int)compressedSize );
+}
+
+
+int SaveDelta::Apply( CDynArray< U8 >* snapshot, const U8* delta, int deltaSize )
+{
+	CDynArray< U8 > ops, result;
+	int count = 0;
+	const U8* p = delta;
+	const U8* end = delta + deltaSize;
+
+	while ( end - p >= HEADER_SIZE ) {
+		U32 baseHash	= GetU32( p+4 );
+		U32 baseSize	= GetU32( p+8 );
+		U32 resultHash	= GetU32( p+12 );
+		U32 resultSize	= GetU32( p+16 );
+		U32 opsSize		= GetU32( p+20 );
+		U32 compressed	= GetU32( p+24 );
+
+		if (    GetU32( p ) != MAGIC
+			 || compressed > (U32)(end - p - HEADER_SIZE)
+			 || baseSize != (U32)snapshot->Size()
+			 || baseHash != Random::Hash( snapshot->Mem(), snapshot->Size() ) )
+		{
+			// Damaged, cut short by a crash, or doesn't follow on.
+			break;
+		}
+		// The header isn't trusted until the hash of the result checks out, so
+		// the ops are bounded before they are allocated: zlib can't expand
+		// more than ZLIB_MAX_RATIO times, and the ops are the bytes of the
+		// result plus a few bytes of varints for each (at least BLOCK long) copy.
+		if (    opsSize / ZLIB_MAX_RATIO > compressed
+			 || ( opsSize > resultSize && ( opsSize - resultSize ) / MAX_OP_OVERHEAD > resultSize / BLOCK + 1 ) )
+		{
+			GLOUTPUT(( "SaveDelta: bad record %d\n", count ));
+			break;
+		}
+
+		ops.Clear();
+		uLongf opsLen = opsSize;
+		if (    uncompress( ops.PushArr( opsSize ), &opsLen, p+HEADER_SIZE, compressed ) != Z_OK
+			 || opsLen != opsSize )
+		{
+			break;
+		}
+
+		// Every op is checked against the result size before it grows the
+		// result, so a bad record never takes more than resultSize.
+		const U8* base = snapshot->Mem();
+		const U8* q = ops.Mem();
+		const U8* qEnd = q + opsSize;
+		bool okay = true;
+		result.Clear();
+		while ( okay && q < qEnd ) {
+			U32 op=0, a=0, b=0;
+			okay = ReadVar( &q, qEnd, &op ) && ReadVar( &q, qEnd, &a );
+			if ( !okay )
+				break;
+			U32 room = resultSize - (U32)result.Size();
+			if ( op == OP_LITERAL ) {
+				okay = a <= (U32)(qEnd - q) && a <= room;
+				if ( okay ) {
+					memcpy( result.PushArr( a ), q, a );
+					q += a;
+				}
+			}
+			else if ( op == OP_COPY ) {
+				okay = ReadVar( &q, qEnd, &b ) && a <= baseSize && b <= baseSize - a && b <= room;
+				if ( okay ) {
+					memcpy( result.PushArr( b ), base+a, b );
+				}
+			}
+			else {
+				okay = false;
+			}
+		}
+		if (    !okay
+			 || (U32)result.Size() != resultSize
+			 || Random::Hash( result.Mem(), result.Size() ) != resultHash )
+		{
+			GLOUTPUT(( "SaveDelta: bad record %d\n", count ));
+			break;
+		}
+
+		snapshot->Clear();
+		if ( result.Size() )
+			memcpy( snapshot->PushArr( result.Size() ), result.Mem(), result.Size() );
+		p += HEADER_SIZE + compressed;
+		++count;
+	}
+	return count;
+}
@@ -0,0 +1,118 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef UFO_SAVE_WRITER_INCLUDED
+#define UFO_SAVE_WRITER_INCLUDED
+
+#include <stdio.h>
+
+#include "../grinliz/gldebug.h"
+#include "../grinliz/gltypes.h"
+#include "../grinliz/glstringutil.h"
+#include "../grinliz/glthread.h"
+#include "../engine/ufoutil.h"
+
+
+/*	Writes the saved games on a background thread, so an autosave doesn't
+	stall the turn change on slow flash storage. A save is serialized to
+	memory (a snapshot of the game when it is queued) and the thread writes
+	the queued files in the order they were queued.
+
+	Each file is written to "<path>.tmp", flushed to the disk, and renamed
+	over the save, so a crash (or a full disk) in the middle of a write leaves
+	the old save as it was. Appends (the SaveDelta records) go straight to
+	the file; a record cut short by a crash is ignored when it is loaded.
+*/
+class SaveWriter
+{
+public:
+	SaveWriter();
+	~SaveWriter();
+
+	// Copies the data. A full write still waiting for 'path' is dropped:
+	// the new one replaces it. Appends are never dropped.
+	void Queue( const char* path, const U8* data, int size, bool append=false );
+
+	void Finish( const char* path );	// waits for the writes to 'path'
+	void Flush();						// waits for all the writes
+	bool Busy();
+
+private:
+	enum {
+		MAX_JOBS	= 8
+	};
+	enum {
+		JOB_FREE,
+		JOB_QUEUED,
+		JOB_WRITING
+	};
+
+	struct Job {
+		int					state;
+		bool				append;
+		U32					sequence;	// order queued
+		grinliz::GLString	path;
+		CDynArray< U8 >		data;
+	};
+
+	static void ThreadMain( void* data );
+	Job* Next();						// the oldest queued job
+	void Wait( const char* path );		// waits for the jobs for 'path', or all of them if null
+	static bool Write( const Job& job );
+
+	grinliz::Mutex	mutex;				// guards the jobs, 'sequence' and 'quit'
+	grinliz::Signal	work;				// set when a job is queued, or to quit
+	grinliz::Signal	done;				// set when a job is done
+	grinliz::Thread	thread;
+	bool			quit;
+
+	Job job[MAX_JOBS];
+	U32 sequence;
+};
+
+
+/*	Incremental saves. A delta record is the difference between two snapshots
+	of a save (the bytes of the save file): copies from the old snapshot and
+	literal bytes, compressed with zlib. Each record holds the hash and size
+	of the snapshot it applies to and of the result, so a record that doesn't
+	follow on from the snapshot (or is damaged) is detected rather than applied.
+*/
+class SaveDelta
+{
+public:
+	// Appends a record to 'out'.
+	static void Create( const U8* base, int baseSize, const U8* data, int size, CDynArray< U8 >* out );
+	// Applies the records in 'delta', in order, while they follow on from 'snapshot'.
+	// Returns the number applied.
+	static int Apply( CDynArray< U8 >* snapshot, const U8* delta, int deltaSize );
+
+private:
+	enum {
+		MAGIC		= 0x44464f55,	// "UFOD"
+		HEADER_SIZE	= 7*4,
+		BLOCK		= 16,			// the minimum copy
+		HASH_BITS	= 14,
+		OP_LITERAL	= 0,
+		OP_COPY		= 1,
+		MAX_OP_OVERHEAD	= 17,		// the varints of a copy and the literal before it
+		ZLIB_MAX_RATIO	= 1032		// the most deflate can compress
+	};
+	static U32 BlockHash( const U8* p );
+	static void WriteVar( CDynArray< U8 >* out, U32 v );
+	static void Literal( CDynArray< U8 >* out, const U8* p, int len );
+};
+
+
+#endif // UFO_SAVE_WRITER_INCLUDED
@@ -91,6 +91,7 @@ public:
 
 	virtual SavePathType CanSave()								{ return SAVEPATH_NONE; }
 	virtual void Save( tinyxml2::XMLPrinter* )					{}
+	virtual int SaveTurn()										{ return 0; }	// shown with the save (see Game::SaveSlotInfo)
 	virtual void Load( const tinyxml2::XMLElement* doc )		{}
 	virtual void HandleHotKeyMask( int mask )					{}
 	virtual void Resize()										{}
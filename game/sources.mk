@@ -11,8 +11,14 @@ sources :=  ai.cpp \
 			gamesettings.cpp \
 			stats.cpp \
 			tacmap.cpp \
+			tacticalsim.cpp \
+			unitgen.cpp \
+			actionlog.cpp \
+			tacticalreplay.cpp \
+			savewriter.cpp \
 			ufosound.cpp \
 			unit.cpp \
+			unitrenderer.cpp \
 			areawidget.cpp \
 			inventoryWidget.cpp \
 			firewidget.cpp \
@@ -25,6 +31,7 @@ sources :=  ai.cpp \
 			characterscene.cpp \
 			dialogscene.cpp \
 			fastbattlescene.cpp \
+			fastbattlesim.cpp \
 			geoendscene.cpp \
 			geomap.cpp \
 			geoscene.cpp \
@@ -16,6 +16,8 @@
 #include "tacmap.h"
 #include "item.h"
 #include "game.h"
+#include "unit.h"
+#include "unitrenderer.h"
 
 #include "../engine/loosequadtree.h"
 #include "../grinliz/glrectangle.h"
@@ -160,6 +162,8 @@ const MapItemDef TacMap::itemDefArr[NUM_ITEM_DEF] =
 TacMap::TacMap( SpaceTree* tree, const ItemDefArr& _itemDefArr ) : Map( tree ),
 	gameItemDefArr( _itemDefArr )
 {
+	units = 0;
+	unitRenderers = 0;
 	lander = 0;
 	nLanderPos = 0;
 	random.SetSeedFromTime();	// was putting the battleship units in the same place each time.
@@ -173,6 +177,44 @@ TacMap::TacMap( SpaceTree* tree, const ItemDefArr& _itemDefArr ) : Map( tree ),
 	for( int i=0; i<4; ++i ) {
 		border[i].Init( &overlay[LAYER_UNDER_HIGH], borderAtom, false );
 	}
+	CompileItemMasks();
+}
+
+
+void TacMap::CompileItemMasks()
+{
+	itemMasks.Clear();
+	for( int k=0; k<NUM_ITEM_DEF; ++k ) {
+		const MapItemDef& def = itemDefArr[k];
+		const int nCells = def.cx * def.cy;
+
+		itemMaskOffset[k] = itemMasks.Size();
+		U8* mem = itemMasks.PushArr( nCells*2*4 );
+
+		for( int rot=0; rot<4; ++rot ) {
+			U8* pather = mem + rot*2*nCells;
+			U8* vis = pather + nCells;
+
+			for( int j=0; j<def.cy; ++j ) {
+				for( int i=0; i<def.cx; ++i ) {
+					// Rotate the bits with the tile, wrapping the high bits around.
+					U32 p = def.Pather( i, j ) << rot;
+					pather[j*def.cx+i] = (U8)( p | (p>>4) );
+
+					p = def.Visibility( i, j ) << rot;
+					vis[j*def.cx+i] = (U8)( p | (p>>4) );
+				}
+			}
+		}
+	}
+}
+
+
+const U8* TacMap::GetItemMasks( const MapItemDef* def )
+{
+	int index = def - itemDefArr;
+	GLRELASSERT( index >= 0 && index < NUM_ITEM_DEF );
+	return itemMasks.Mem() + itemMaskOffset[index];
 }
 
 
@@ -406,6 +448,17 @@ void TacMap::SubSave( XMLPrinter* printer )
 }
 
 
+U32 TacMap::SubStateHash()
+{
+	U32 h = Random::HASH_SEED;
+	for( int i=0; i<debris.Size(); ++i ) {
+		U32 d = debris[i].storage->StateHash();
+		h = Random::Hash( &d, sizeof( d ), h );
+	}
+	return h;
+}
+
+
 void TacMap::SubLoad( const XMLElement* mapElement )
 {
 	const XMLElement* itemsElement = mapElement->FirstChildElement( "Items" );
@@ -463,6 +516,94 @@ void TacMap::SubLoad( const XMLElement* mapElement )
 }
 
 
+void TacMap::LoadDesc( const MapDesc& desc )
+{
+	BeginLoad( desc.sizeX, desc.sizeY );
+
+	GLASSERT( desc.images.Size() <= MapDesc::MAX_IMAGES );
+	for( int i=0; i<desc.images.Size(); ++i ) {
+		const MapDesc::Image& image = desc.images[i];
+		const Surface* surfaces = ( i < desc.nSurfaces ) ? desc.surface[i] : 0;
+		LoadImage( image.name, image.x, image.y, image.size, image.tileRotation, surfaces );
+	}
+	for( int i=0; i<desc.items.Size(); ++i ) {
+		const MapDesc::Item& item = desc.items[i];
+		GLASSERT( item.def < NUM_ITEM_DEF );
+		const MapItemDef* def = &itemDefArr[item.def];
+		int hp = ( item.hp == MapDesc::DEFAULT_HP ) ? def->hp : item.hp;
+		AddItem( item.x, item.y, item.rot, def, hp, item.flags );
+	}
+	for( int i=0; i<desc.fires.Size(); ++i ) {
+		SetPyro( desc.fires[i].x, desc.fires[i].y, 0, true, false );
+	}
+	EndLoad();
+}
+
+
+bool MapDesc::LoadSurfaces()
+{
+	if ( nSurfaces < images.Size() ) {
+		GLASSERT( nSurfaces < MAX_IMAGES );
+		Map::LoadImageSurfaces( images[nSurfaces].name, surface[nSurfaces] );
+		++nSurfaces;
+	}
+	return nSurfaces < images.Size();
+}
+
+
+void MapDesc::Save( XMLPrinter* printer ) const
+{
+	printer->OpenElement( "Map" );
+	printer->PushAttribute( "sizeX", sizeX );
+	printer->PushAttribute( "sizeY", sizeY );
+
+	printer->OpenElement( "Items" );
+	for( int i=0; i<items.Size(); ++i ) {
+		const Item& item = items[i];
+		printer->OpenElement( "Item" );
+		printer->PushAttribute( "x", item.x );
+		printer->PushAttribute( "y", item.y );
+		if ( item.rot != 0 ) {
+			printer->PushAttribute( "rot", item.rot );
+		}
+		printer->PushAttribute( "name", TacMap::StaticGetItemDef( item.def )->Name() );
+		if ( item.hp != DEFAULT_HP )
+			printer->PushAttribute( "hp", item.hp );
+		if ( item.flags )
+			printer->PushAttribute( "flags", item.flags );
+		printer->CloseElement();
+	}
+	printer->CloseElement();	// Items
+
+	printer->OpenElement( "Images" );
+	for( int i=0; i<images.Size(); ++i ) {
+		printer->OpenElement( "Image" );
+		printer->PushAttribute( "x", images[i].x );
+		printer->PushAttribute( "y", images[i].y );
+		printer->PushAttribute( "size", images[i].size );
+		printer->PushAttribute( "tileRotation", images[i].tileRotation );
+		printer->PushAttribute( "name", images[i].name );
+		printer->CloseElement();
+	}
+	printer->CloseElement();	// Images
+
+	if ( fires.Size() ) {
+		printer->OpenElement( "PyroGroup" );
+		for( int i=0; i<fires.Size(); ++i ) {
+			printer->OpenElement( "Pyro" );
+			printer->PushAttribute( "x", fires[i].x );
+			printer->PushAttribute( "y", fires[i].y );
+			printer->PushAttribute( "fire", 1 );
+			printer->PushAttribute( "duration", 0 );
+			printer->CloseElement();
+		}
+		printer->CloseElement();	// PyroGroup
+	}
+
+	printer->CloseElement();	// Map
+}
+
+
 const Storage* TacMap::GetStorage( int x, int y ) const
 {
 	for( int i=0; i<debris.Size(); ++i ) {
@@ -539,12 +680,14 @@ void TacMap::ReleaseStorage( Storage* storage )
 		return;
 	}
 
-	bool zRotate = false;
-	const ModelResource* res = storage->VisualRep( &zRotate );
+	const ItemDef* rep = storage->VisualRep();
+	ModelResourceManager* modman = ModelResourceManager::Instance();
+	const ModelResource* res = rep ? modman->GetModelResource( rep->resource->header.name.c_str() )
+								   : modman->GetModelResource( "smallcrate" );
 
 	Model* model = tree->AllocModel( res );
 	Vector2I v = { storage->X(), storage->Y() };
-	if ( zRotate ) {
+	if ( rep ) {
 		model->SetRotation( 90.0f, 2 );
 		
 		int yRot = Random::Hash( &v, sizeof(v) ) % 360;	// generate a random yet consistent rotation
@@ -586,3 +729,133 @@ Storage* TacMap::CollectAllStorage()
 	return debris[0].storage;
 }
 
+
+
+int TacMap::Luminance( int x, int y )
+{
+	const Surface* lightMap = GetLightMap();
+	GLRELASSERT( lightMap->Format() == Surface::RGB16 );
+	Color4U8 rgba = Surface::CalcRGB16( lightMap->GetImg16( x, y ) );
+	return rgba.r + rgba.g + rgba.b;
+}
+
+
+void TacMap::EndChange( Rectangle2I* bounds )
+{
+	MapChangeSet changes;
+	Map::EndChange( &changes );
+	*bounds = changes.bounds;
+}
+
+
+static void CalcMapDamage( const DamageDesc& d, MapDamageDesc* damage )
+{
+	damage->damage = d.kinetic + d.energy;
+	damage->incendiary = d.incend;
+}
+
+
+void TacMap::DoDamage( int x, int y, const DamageDesc& d, Vector2I* explosion )
+{
+	MapDamageDesc damage;
+	CalcMapDamage( d, &damage );
+	Map::DoDamage( x, y, damage, explosion );
+}
+
+
+void TacMap::DamageItem( const void* item, const DamageDesc& d, Vector2I* explosion )
+{
+	MapDamageDesc damage;
+	CalcMapDamage( d, &damage );
+	Map::DoDamage( (Model*)item, damage, explosion );
+}
+
+
+void TacMap::SetFogOfWar( Visibility* visibility )
+{
+	grinliz::BitArray<Map::SIZE, Map::SIZE, 1>* fow = LockFogOfWar();
+
+	if ( Engine::mapMakerMode ) {
+		fow->SetAll();
+	}
+	else {
+		for( int j=0; j<MAP_SIZE; ++j ) {
+			for( int i=0; i<MAP_SIZE; ++i ) {
+				if ( visibility->TeamCanSee( TERRAN_TEAM, i, j ) )
+					fow->Set( i, j );
+				else
+					fow->Clear( i, j );
+			}
+		}
+
+		// Can always see around the lander.		
+		const Model* landerModel = GetLanderModel();
+		if ( landerModel ) {
+			Rectangle2I bounds;
+			MapBoundsOfModel( landerModel, &bounds );
+			fow->SetRect( bounds );
+		}
+	}
+	ReleaseFogOfWar();
+}
+
+
+const Model* TacMap::UnitModel( const Unit* unit )
+{
+	GLASSERT( units && unitRenderers );
+	int i = unit - units;
+	GLASSERT( i >= 0 && i < MAX_UNITS );
+	unitRenderers[i].Update( tree, unit );
+	return unitRenderers[i].GetModel();
+}
+
+
+bool TacMap::CalcTrigger( const Unit* unit, Vector3F* trigger, const float* rotation )
+{
+	const Model* model = UnitModel( unit );
+	if ( model )
+		model->CalcTrigger( trigger, rotation );
+	return model != 0;
+}
+
+
+bool TacMap::CalcTarget( const Unit* unit, Vector3F* target, float* width, float* height )
+{
+	const Model* model = UnitModel( unit );
+	if ( model ) {
+		model->CalcTarget( target );
+		if ( width && height )
+			model->CalcTargetSize( width, height );
+	}
+	return model != 0;
+}
+
+
+bool TacMap::IntersectShot( const Ray& ray, const Unit* shooter, Vector3F* at, ShotHit* hit )
+{
+	GLASSERT( units && unitRenderers );
+	hit->unit = 0;
+	hit->weapon = 0;
+	hit->item = 0;
+
+	// Shots are hit-tested against the models, which can be drawn between
+	// sim steps. Put them where the sim has the units.
+	for( int i=0; i<MAX_UNITS; ++i ) {
+		unitRenderers[i].Update( tree, &units[i] );
+	}
+	int s = shooter - units;
+	const Model* ignore[] = { unitRenderers[s].GetModel(), unitRenderers[s].GetWeapon(), 0 };
+	Model* m = tree->QueryRay( ray.origin, ray.direction, 0, 0, ignore, TEST_TRI, at );
+	if ( !m )
+		return false;
+
+	for( int i=0; i<MAX_UNITS; ++i ) {
+		if ( unitRenderers[i].GetModel() == m )
+			hit->unit = &units[i];
+		else if ( unitRenderers[i].GetWeapon() == m )
+			hit->weapon = &units[i];
+	}
+	if ( m->IsFlagSet( Model::MODEL_OWNED_BY_MAP ) )
+		hit->item = m;
+	return true;
+}
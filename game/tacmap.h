@@ -18,14 +18,60 @@
 
 #include "../engine/map.h"
 #include "../tinyxml2/tinyxml2.h"
+#include "tacticalsim.h"
 
 
 class Storage;
 class ItemDefArr;
 class ItemDef;
+class Unit;
+class UnitRenderer;
 
 
-class TacMap : public Map
+/*	A new battle map as TacticalIntroScene::CreateMap puts it together from
+	the map snippets: the images, items and fires, in binary. TacMap::LoadDesc()
+	instantiates it without going through XML. Save() writes it as the <Map>
+	element of a save file.
+
+	The surfaces of the images can be loaded ahead of time, one image per
+	call to LoadSurfaces(), so a map can be prepared (on another thread, even)
+	before the battle starts.
+*/
+struct MapDesc
+{
+	enum { DEFAULT_HP = 0xffff, MAX_IMAGES = 16 };
+
+	struct Item {
+		U8	def;			// index of the TacMap item def
+		U8	x, y;
+		U8	rot;
+		U16	hp;				// DEFAULT_HP for the hp of the def
+		U16	flags;
+	};
+	struct Image {
+		int x, y, size, tileRotation;
+		char name[EL_FILE_STRING_LEN];
+	};
+
+	MapDesc() : sizeX( 0 ), sizeY( 0 ), nSurfaces( 0 )	{}
+	void Clear()		{ sizeX = sizeY = 0; items.Clear(); images.Clear(); fires.Clear(); nSurfaces = 0; }
+	bool Empty() const	{ return sizeX == 0; }
+	void Save( tinyxml2::XMLPrinter* printer ) const;
+
+	// Loads the surfaces of the next image. Returns true if there are more to load.
+	bool LoadSurfaces();
+
+	int sizeX, sizeY;
+	CDynArray< Item >				items;
+	CDynArray< Image >				images;
+	CDynArray< grinliz::Vector2I >	fires;
+
+	int		nSurfaces;							// images with surfaces loaded
+	Surface	surface[MAX_IMAGES][3];				// TEX, DAY, NGT
+};
+
+
+class TacMap : public Map, public ITacticalMap
 {
 public:
 	enum {
@@ -36,8 +82,39 @@ public:
 	TacMap( SpaceTree* tree, const ItemDefArr& itemDefArr );
 	virtual ~TacMap();
 
-	Storage* LockStorage( int x, int y );	// always returns something.
-	void ReleaseStorage( Storage* storage );				// updates the image
+	// The units, and the models the shots are tested against.
+	void SetUnits( Unit* units, UnitRenderer* renderers )	{ this->units = units; unitRenderers = renderers; }
+
+	// ITacticalMap
+	virtual grinliz::Rectangle2I Bounds() const			{ return Map::Bounds(); }
+	virtual bool CanSee( const grinliz::Vector2I& p, const grinliz::Vector2I& q )	{ return Map::CanSee( p, q ); }
+	virtual bool Obscured( int x, int y ) const			{ return Map::Obscured( x, y ); }
+	virtual int  Flared( int x, int y ) const			{ return Map::Flared( x, y ); }
+	virtual int  Luminance( int x, int y );
+
+	virtual void BeginChange()							{ Map::BeginChange(); }
+	virtual void EndChange( grinliz::Rectangle2I* bounds );
+	using Map::EndChange;
+	virtual void DoSubTurn( float fireDamagePerSubTurn )	{ Map::DoSubTurn( fireDamagePerSubTurn ); }
+	virtual void DoDamage( int x, int y, const DamageDesc& damage, grinliz::Vector2I* explosion );
+	using Map::DoDamage;
+	virtual void DamageItem( const void* item, const DamageDesc& damage, grinliz::Vector2I* explosion );
+	virtual void AddSmoke( int x, int y, int subturns )	{ Map::AddSmoke( x, y, subturns ); }
+	virtual void AddFlare( int x, int y, int subturns )	{ Map::AddFlare( x, y, subturns ); }
+
+	virtual bool ProcessDoors( const grinliz::Vector2I* openers, int nOpeners )		{ return Map::ProcessDoors( openers, nOpeners ); }
+	virtual void MoveOpener( const grinliz::Vector2I& from, const grinliz::Vector2I& to )	{ Map::MoveOpener( from, to ); }
+
+	virtual Storage* LockStorage( int x, int y );	// always returns something.
+	virtual void ReleaseStorage( Storage* storage );				// updates the image
+
+	virtual U32 StateHash()								{ return Map::StateHash(); }
+	virtual U32 FogHash() const							{ return Map::FogHash(); }
+	virtual void SetFogOfWar( Visibility* visibility );
+
+	virtual bool CalcTrigger( const Unit* unit, grinliz::Vector3F* trigger, const float* rotation=0 );
+	virtual bool CalcTarget( const Unit* unit, grinliz::Vector3F* target, float* width=0, float* height=0 );
+	virtual bool IntersectShot( const grinliz::Ray& ray, const Unit* shooter, grinliz::Vector3F* at, ShotHit* hit );
 
 	const Storage* GetStorage( int x, int y ) const;		//< take a peek
 	grinliz::Vector2I FindStorage( const ItemDef* itemDef, const grinliz::Vector2I& source );
@@ -56,15 +133,25 @@ public:
 	virtual const char* GetItemDefName( int i );
 	virtual const MapItemDef* GetItemDef( const char* name );
 	static const MapItemDef* StaticGetItemDef( const char* name );		// slow...but doesn't need an instance.
+	static const MapItemDef* StaticGetItemDef( int index )				{ GLASSERT( index >= 0 && index < NUM_ITEM_DEF ); return &itemDefArr[index]; }
+
+	// Loads a new map. (An existing map is loaded with Load().)
+	void LoadDesc( const MapDesc& desc );
 
 	const Model* GetLanderModel();
 
 protected:
 	virtual void SubSave( tinyxml2::XMLPrinter* printer );
 	virtual void SubLoad( const tinyxml2::XMLElement* mapNode );
+	virtual U32 SubStateHash();
+	virtual const U8* GetItemMasks( const MapItemDef* def );
 
 private:
 	const MapItem* FindLander();
+	const Model* UnitModel( const Unit* unit );		// brings the model to the unit first
+
+	Unit*			units;
+	UnitRenderer*	unitRenderers;
 
 	struct Debris {
 		Storage* storage;
@@ -82,6 +169,11 @@ private:
 
 	static const MapItemDef itemDefArr[NUM_ITEM_DEF];
 	CStringMap< const MapItemDef* >	itemDefMap;
+
+	// The pather and visibility strings of the itemDefArr, compiled to masks.
+	void CompileItemMasks();
+	CDynArray< U8 >	itemMasks;
+	int				itemMaskOffset[NUM_ITEM_DEF];
 };
 
 
@@ -17,17 +17,19 @@
 
 #include "../grinliz/glbitarray.h"
 #include "../grinliz/glstringutil.h"
+#include "../grinliz/glthread.h"
 #include "../engine/uirendering.h"
 #include "../engine/engine.h"
+#include "../engine/serialize.h"
 #include "game.h"
 #include "cgame.h"
 #include "helpscene.h"
 #include "gamesettings.h"
-#include "ai.h"
 #include "tacmap.h"
 #include "saveloadscene.h"
 #include "geoscene.h"
 #include "tacticalintroscene.h"
+#include "unitgen.h"
 
 #include "../version.h"
 
@@ -326,30 +328,27 @@ void TacticalIntroScene::SceneResult( int sceneID, int r )
 		NewSceneOptionsReturn result;
 		result = *((NewSceneOptionsReturn*)&r);
 
-		FILE* fp = game->GameSavePath( SAVEPATH_TACTICAL, SAVEPATH_WRITE, 0 );
-		GLASSERT( fp );
-		if ( fp ) {
-			BattleSceneData data;
-			data.seed = random.Rand();
-			data.scenario = result.scenario;
-			data.crash = result.crash != 0;
-
-			Unit units[MAX_TERRANS];
-
-			GenerateTerranTeam( units, result.nTerrans, (float)result.terranRank, 
-							    game->GetItemDefArr(), random.Rand() );
-			data.soldierUnits = units;
-			data.nScientists = 8;
-
-			data.dayTime = result.dayTime != 0;
-			data.alienRank = (float)result.alienRank;
-			data.storage = 0;
-
-			WriteXML( fp, &data, game->GetItemDefArr(), game->GetDatabase() );
-			fclose( fp );
-			game->PopScene();
-			game->PushScene( Game::BATTLE_SCENE, 0 );
-		}
+		BattleSceneData data;
+		data.seed = random.Rand();
+		data.scenario = result.scenario;
+		data.crash = result.crash != 0;
+
+		Unit units[MAX_TERRANS];
+
+		UnitGen::GenerateTerranTeam( units, result.nTerrans, (float)result.terranRank, 
+						    game->GetItemDefArr(), random.Rand() );
+		data.soldierUnits = units;
+		data.nScientists = 8;
+
+		data.dayTime = result.dayTime != 0;
+		data.alienRank = (float)result.alienRank;
+		data.storage = 0;
+
+		BinaryXMLPrinter printer;
+		WriteXML( &printer, &data, game->GetItemDefArr(), game->GetDatabase() );
+		game->WriteSaveFile( SAVEPATH_TACTICAL, 0, printer );
+		game->PopScene();
+		game->PushScene( Game::BATTLE_SCENE, 0 );
 	}
 	else if ( sceneID == Game::NEW_GEO_OPTIONS ) {
 		GLOUTPUT(( "Difficulty=%d\n", r ));
@@ -359,7 +358,7 @@ void TacticalIntroScene::SceneResult( int sceneID, int r )
 }
 
 
-/*static*/ void TacticalIntroScene::WriteXML( FILE* fp, const BattleSceneData* data, const ItemDefArr& itemDefArr, const gamedb::Reader* database )
+/*static*/ void TacticalIntroScene::WriteXML( XMLPrinter* printer, const BattleSceneData* data, const ItemDefArr& itemDefArr, const gamedb::Reader* database, MapDesc* mapDesc )
  {
 	//	Game
 	//		BattleScene
@@ -371,15 +370,13 @@ void TacticalIntroScene::SceneResult( int sceneID, int r )
 	//		Units
 	//			Unit
 
-	XMLPrinter printer( fp );
+	printer->OpenElement( "Game" );
+	printer->PushAttribute( "version", VERSION );
+	printer->PushAttribute( "sceneID", Game::BATTLE_SCENE );
 
-	printer.OpenElement( "Game" );
-	printer.PushAttribute( "version", VERSION );
-	printer.PushAttribute( "sceneID", Game::BATTLE_SCENE );
-
-	printer.OpenElement( "BattleScene" );
-	printer.PushAttribute( "dayTime", data->dayTime ? 1 : 0 );
-	printer.PushAttribute( "scenario", data->scenario );
+	printer->OpenElement( "BattleScene" );
+	printer->PushAttribute( "dayTime", data->dayTime ? 1 : 0 );
+	printer->PushAttribute( "scenario", data->scenario );
 
 	Random random;
 	random.SetSeedFromTime();
@@ -387,7 +384,13 @@ void TacticalIntroScene::SceneResult( int sceneID, int r )
 	int nCivs = ( data->scenario == TERRAN_BASE ) ? data->nScientists : CivsInScenario( data->scenario );
 	SceneInfo info( data->scenario, data->crash, nCivs );
 
-	CreateMap( &printer, random.Rand(), info, database );
+	MapDesc localDesc;
+	if ( !mapDesc )
+		mapDesc = &localDesc;
+	int mapSeed = random.Rand();
+	if ( mapDesc->Empty() )
+		CreateMap( mapDesc, mapSeed, info, database );
+	mapDesc->Save( printer );
 
 	BattleData battleData( itemDefArr );
 	battleData.SetDayTime( data->dayTime );
@@ -408,14 +411,14 @@ void TacticalIntroScene::SceneResult( int sceneID, int r )
 							random.Rand() );
 
 	// Civ team
-	GenerateCivTeam( battleData.CivPtr(), 
+	UnitGen::GenerateCivTeam( battleData.CivPtr(), 
 					 info.nCivs, 
 					 itemDefArr, 
 					 random.Rand() );
 
-	battleData.Save( &printer );
-	printer.CloseElement();
-	printer.CloseElement();
+	battleData.Save( printer );
+	printer->CloseElement();
+	printer->CloseElement();
 }
 
 
@@ -442,6 +445,82 @@ void TacticalIntroScene::FindNodes(	const char* set,
 }
 
 
+// The snippets parsed so far, and their items. Reset if the database changes.
+// CreateMap holds the bakedMutex, so the GeoScene can create a map on its own thread.
+struct BakedSnippet {
+	const gamedb::Item* item;
+	int start;
+	int count;
+};
+static const gamedb::Reader*		bakedDatabase = 0;
+static ::CDynArray< BakedSnippet >	bakedSnippets;
+static ::CDynArray< MapDesc::Item >	bakedItems;
+static grinliz::Mutex				bakedMutex;
+
+
+const MapDesc::Item* TacticalIntroScene::BakeSnippet( const gamedb::Reader* database, const gamedb::Item* item, int* nItems )
+{
+	if ( database != bakedDatabase ) {
+		bakedDatabase = database;
+		bakedSnippets.Clear();
+		bakedItems.Clear();
+	}
+	for( int i=0; i<bakedSnippets.Size(); ++i ) {
+		if ( bakedSnippets[i].item == item ) {
+			*nItems = bakedSnippets[i].count;
+			return bakedItems.Mem() + bakedSnippets[i].start;
+		}
+	}
+
+	// Not AccessData, which is main thread only.
+	char* xmlText = (char*) database->AllocData( item, "binary" );
+	XMLDocument snippet;
+	snippet.Parse( xmlText );
+	free( xmlText );
+	GLASSERT( !snippet.Error() );
+
+	int start = bakedItems.Size();
+	for( const XMLElement* ele = snippet.FirstChildElement( "Map" )->FirstChildElement( "Items" )->FirstChildElement( "Item" );
+		 ele;
+		 ele = ele->NextSiblingElement() )
+	{
+		int x=0, y=0, rot=0, index=-1, hp=MapDesc::DEFAULT_HP, flags=0;
+		ele->QueryIntAttribute( "x", &x );
+		ele->QueryIntAttribute( "y", &y );
+		ele->QueryIntAttribute( "rot", &rot );
+		ele->QueryIntAttribute( "hp", &hp );
+		ele->QueryIntAttribute( "flags", &flags );
+
+		if ( ele->QueryIntAttribute( "index", &index ) != XML_SUCCESS ) {
+			const MapItemDef* def = TacMap::StaticGetItemDef( ele->Attribute( "name" ) );
+			if ( def ) {
+				index = def - TacMap::StaticGetItemDef( 0 );
+			}
+			else {
+				GLOUTPUT(( "Could not load item '%s'\n", ele->Attribute( "name" ) ));
+			}
+		}
+		if ( index >= 0 ) {
+			MapDesc::Item* baked = bakedItems.Push();
+			baked->def = (U8)index;
+			baked->x = (U8)x;
+			baked->y = (U8)y;
+			baked->rot = (U8)rot;
+			baked->hp = (U16)hp;
+			baked->flags = (U16)flags;
+		}
+	}
+
+	BakedSnippet* bs = bakedSnippets.Push();
+	bs->item = item;
+	bs->start = start;
+	bs->count = bakedItems.Size() - start;
+
+	*nItems = bs->count;
+	return bakedItems.Mem() + start;
+}
+
+
 void TacticalIntroScene::AppendMapSnippet(	int dx, int dy, int tileRotation,
 											const char* set,
 											int size,
@@ -449,7 +528,7 @@ void TacticalIntroScene::AppendMapSnippet(	int dx, int dy, int tileRotation,
 											const char* type,
 											const gamedb::Reader* database,
 											const gamedb::Item* parent,
-											XMLElement* mapElement,
+											MapDesc* desc,
 											int _seed )
 {
 	const gamedb::Item* itemMatch[ MAX_ITEM_MATCH ];
@@ -463,26 +542,10 @@ void TacticalIntroScene::AppendMapSnippet(	int dx, int dy, int tileRotation,
 	int seed = random.Rand( nItemMatch );
 	const gamedb::Item* item = itemMatch[ seed ];
 
-	const char* xmlText = (const char*) database->AccessData( item, "binary" );
-
-	// Snippet is the XML to append. We need to be
-	// a little careful sticking them together due
-	// to the memory model.
-	XMLDocument snippet;
-	snippet.Parse( xmlText );
-	GLASSERT( !snippet.Error() );
-
-	XMLDocument* mapDocument = mapElement->GetDocument();
+	int nItems = 0;
+	const MapDesc::Item* snippetItems = BakeSnippet( database, item, &nItems );
 
-	XMLElement* itemsElement = mapElement->FirstChildElement( "Items" );
-	if ( !itemsElement ) {
-		itemsElement = mapDocument->NewElement( "Items" );
-		mapElement->InsertEndChild( itemsElement );
-	}
-
-	// Append the <Items>, account for (x,y) changes.
-	// Append the <Images>, account for (x,y) changes.
-	// Append one sub tree to the other. Adjust x, y as we go.
+	// Append the items and the image, account for (x,y) changes.
 	Matrix2I m;
 	Map::MapImageToWorld( dx, dy, size, size, tileRotation, &m );
 
@@ -492,73 +555,43 @@ void TacticalIntroScene::AppendMapSnippet(	int dx, int dy, int tileRotation,
 		crashRect.min.Set( random.Rand( half ), random.Rand( half ) );
 		crashRect.max.x = crashRect.min.x + half;
 		crashRect.max.y = crashRect.min.y + half;
-	}
-	Vector2I cr0 = m * crashRect.min;
-	Vector2I cr1 = m * crashRect.max;
-	crashRect0.FromPair( cr0.x, cr0.y, cr1.x, cr1.y );
 
-	for( XMLElement* eleIt = snippet.FirstChildElement( "Map" )->FirstChildElement( "Items" )->FirstChildElement( "Item" );
-		 eleIt;
-		 eleIt = eleIt->NextSiblingElement() )
-	{
-		GLASSERT( eleIt->FirstChild() == 0 );	// this is a shallow clone.
-		XMLElement* ele = eleIt->ShallowClone( mapDocument )->ToElement();
-
-		Vector2I v = { 0, 0 };
-		int rot = 0;
-		ele->QueryIntAttribute( "x", &v.x );
-		ele->QueryIntAttribute( "y", &v.y );
-		ele->QueryIntAttribute( "rot", &rot );
+		Vector2I cr0 = m * crashRect.min;
+		Vector2I cr1 = m * crashRect.max;
+		crashRect0.FromPair( cr0.x, cr0.y, cr1.x, cr1.y );
+	}
 
+	MapDesc::Item* items = desc->items.PushArr( nItems );
+	for( int i=0; i<nItems; ++i ) {
+		Vector2I v = { snippetItems[i].x, snippetItems[i].y };
 		Vector2I v0 = m * v;
 
-		ele->SetAttribute( "x", v0.x );
-		ele->SetAttribute( "y", v0.y );
-		ele->SetAttribute( "rot", (rot + tileRotation)%4 );
+		items[i] = snippetItems[i];
+		items[i].x = (U8)v0.x;
+		items[i].y = (U8)v0.y;
+		items[i].rot = (U8)((snippetItems[i].rot + tileRotation)%4);
 
-		if ( crashRect.Contains( v.x, v.y ) && random.Bit() ) {
-			const MapItemDef* mapItemDef = TacMap::StaticGetItemDef( ele->Attribute( "name" ) );
-			if ( mapItemDef && mapItemDef->CanDamage() ) {
-				ele->SetAttribute( "hp", 0 );
+		if ( crash && crashRect.Contains( v.x, v.y ) && random.Bit() ) {
+			if ( TacMap::StaticGetItemDef( items[i].def )->CanDamage() ) {
+				items[i].hp = 0;
 			}
 		}
-
-		itemsElement->InsertEndChild( ele );
 	}
 
 	// And add the image data
-	XMLElement* imagesElement = mapElement->FirstChildElement( "Images" );
-	if ( !imagesElement ) {
-		imagesElement = mapDocument->NewElement( "Images" );
-		mapElement->InsertEndChild( imagesElement );
-	}
-
-	char buffer[64];
-	SNPrintf( buffer, 64, "%4s_%02d_%4s_%02d", set, size, type, seed );
-
-	XMLElement* image = mapDocument->NewElement( "Image" );
-	image->SetAttribute( "name", buffer );
-	image->SetAttribute( "x", dx );
-	image->SetAttribute( "y", dy );
-	image->SetAttribute( "size", size );
-	image->SetAttribute( "tileRotation", tileRotation );
-	imagesElement->LinkEndChild( image );
+	MapDesc::Image* image = desc->images.Push();
+	SNPrintf( image->name, EL_FILE_STRING_LEN, "%4s_%02d_%4s_%02d", set, size, type, seed );
+	image->x = dx;
+	image->y = dy;
+	image->size = size;
+	image->tileRotation = tileRotation;
 
 	if ( crash ) {
-		XMLElement* pgElement = mapElement->FirstChildElement( "PyroGroup" );
-		if ( !pgElement ) {
-			pgElement = mapDocument->NewElement( "PyroGroup" );
-			mapElement->LinkEndChild( pgElement );
-		}
 		for( int j=crashRect0.min.y; j<=crashRect0.max.y; ++j ) {
 			for( int i=crashRect0.min.x; i<=crashRect0.max.x; ++i ) {
-				if ( random.Bit() ) {					
-					XMLElement* fire = mapDocument->NewElement( "Pyro" );
-					fire->SetAttribute( "x", i );
-					fire->SetAttribute( "y", j );
-					fire->SetAttribute( "fire", 1 );
-					fire->SetAttribute( "duration", 0 );
-					pgElement->LinkEndChild( fire );
+				if ( random.Bit() ) {
+					Vector2I fire = { i, j };
+					desc->fires.Push( fire );
 				}
 			}
 		}
@@ -566,23 +599,22 @@ void TacticalIntroScene::AppendMapSnippet(	int dx, int dy, int tileRotation,
 }
 
 
-void TacticalIntroScene::CreateMap(	XMLPrinter* printer, 
+void TacticalIntroScene::CreateMap(	MapDesc* desc, 
 									int seed,
 									const SceneInfo& info,
 									const gamedb::Reader* database )
 {
+	grinliz::MutexLock lock( &bakedMutex );
+
 	// Max world size is 64x64 units, in 16x16 unit blocks. That gives 4x4 blocks max.
 	BitArray< 4, 4, 1 > blocks;
 
-	XMLDocument doc;
-	XMLElement* mapElement = doc.NewElement( "Map" );
-	doc.InsertEndChild( mapElement );
-
 	const gamedb::Item* dataItem = database->Root()->Child( "data" );
 
 	Vector2I size = info.Size();
-	mapElement->SetAttribute( "sizeX", size.x*16 );
-	mapElement->SetAttribute( "sizeY", size.y*16 );
+	desc->Clear();
+	desc->sizeX = size.x*16;
+	desc->sizeY = size.y*16;
 	
 	Random random( seed );
 
@@ -610,7 +642,7 @@ void TacticalIntroScene::CreateMap(	XMLPrinter* printer,
 			blocks.Set( pos.x, pos.y );
 			int tileRotation = random.Rand(4);
 
-			AppendMapSnippet( pos.x*16, pos.y*16, tileRotation, info.Base(), 16, false, "LAND", database, dataItem, mapElement, random.Rand() );	
+			AppendMapSnippet( pos.x*16, pos.y*16, tileRotation, info.Base(), 16, false, "LAND", database, dataItem, desc, random.Rand() );	
 		}
 
 		// UFO
@@ -635,7 +667,7 @@ void TacticalIntroScene::CreateMap(	XMLPrinter* printer,
 					blocks.Set( i, j );
 
 			int tileRotation = random.Rand(4);
-			AppendMapSnippet( pos.min.x*16, pos.min.y*16, tileRotation, info.Base(), 16*ufoSize, info.crash, info.UFO(), database, dataItem, mapElement, random.Rand() );
+			AppendMapSnippet( pos.min.x*16, pos.min.y*16, tileRotation, info.Base(), 16*ufoSize, info.crash, info.UFO(), database, dataItem, desc, random.Rand() );
 		}
 
 		for( int j=0; j<size.y; ++j ) {
@@ -643,7 +675,7 @@ void TacticalIntroScene::CreateMap(	XMLPrinter* printer,
 				if ( !blocks.IsSet( i, j ) ) {
 					Vector2I pos = { i, j };
 					int tileRotation = random.Rand(4);
-					AppendMapSnippet( pos.x*16, pos.y*16, tileRotation, info.Base(), 16, false, "TILE", database, dataItem, mapElement, random.Rand() );	
+					AppendMapSnippet( pos.x*16, pos.y*16, tileRotation, info.Base(), 16, false, "TILE", database, dataItem, desc, random.Rand() );	
 				}
 			}
 		}
@@ -665,42 +697,40 @@ void TacticalIntroScene::CreateMap(	XMLPrinter* printer,
 		{
 			int tileRotation = random.Rand(4);
 			lander = open[random.Rand(4)];
-			AppendMapSnippet( lander.x*16, lander.y*16, tileRotation, "CITY", 16, false, "LAND", database, dataItem, mapElement, random.Rand() );	
+			AppendMapSnippet( lander.x*16, lander.y*16, tileRotation, "CITY", 16, false, "LAND", database, dataItem, desc, random.Rand() );	
 		}
 
 		// Open
 		for( int i=0; i<4; ++i ) {
 			if ( lander != open[i] ) {
 				int tileRotation = random.Rand(4);
-				AppendMapSnippet( open[i].x*16, open[i].y*16, tileRotation, "CITY", 16, false, "OPEN", database, dataItem, mapElement, random.Rand() );	
+				AppendMapSnippet( open[i].x*16, open[i].y*16, tileRotation, "CITY", 16, false, "OPEN", database, dataItem, desc, random.Rand() );	
 			}
 		}
 		// Roads
 		for( int i=0; i<4; ++i ) {
-			AppendMapSnippet( hroad[i].x*16, hroad[i].y*16, 1, "CITY", 16, false, "ROAD", database, dataItem, mapElement, random.Rand() );	
+			AppendMapSnippet( hroad[i].x*16, hroad[i].y*16, 1, "CITY", 16, false, "ROAD", database, dataItem, desc, random.Rand() );	
 		}
 		for( int i=0; i<4; ++i ) {
-			AppendMapSnippet( vroad[i].x*16, vroad[i].y*16, 0, "CITY", 16, false, "ROAD", database, dataItem, mapElement, random.Rand() );	
+			AppendMapSnippet( vroad[i].x*16, vroad[i].y*16, 0, "CITY", 16, false, "ROAD", database, dataItem, desc, random.Rand() );	
 		}
 		for( int i=0; i<4; ++i ) {
-			AppendMapSnippet( inter[i].x*16, inter[i].y*16, 1, "CITY", 16, false, "INTR", database, dataItem, mapElement, random.Rand() );	
+			AppendMapSnippet( inter[i].x*16, inter[i].y*16, 1, "CITY", 16, false, "INTR", database, dataItem, desc, random.Rand() );	
 		}
 		
 	}
 	else if ( info.scenario == BATTLESHIP ) {
-		AppendMapSnippet( 0, 0, 0, "BATT", 48, false, "TILE", database, dataItem, mapElement, random.Rand() );	
+		AppendMapSnippet( 0, 0, 0, "BATT", 48, false, "TILE", database, dataItem, desc, random.Rand() );	
 	}
 	else if ( info.scenario == ALIEN_BASE ) {
-		AppendMapSnippet( 0, 0, 0, "ALIN", 48, false, "TILE", database, dataItem, mapElement, random.Rand() );	
+		AppendMapSnippet( 0, 0, 0, "ALIN", 48, false, "TILE", database, dataItem, desc, random.Rand() );	
 	}
 	else if ( info.scenario == TERRAN_BASE ) {
-		AppendMapSnippet( 0, 0, 0, "BASE", 48, false, "TILE", database, dataItem, mapElement, random.Rand() );	
+		AppendMapSnippet( 0, 0, 0, "BASE", 48, false, "TILE", database, dataItem, desc, random.Rand() );	
 	}
 	else {
 		GLASSERT( 0 );
 	}
-
-	mapElement->Accept( printer );
 }
 
 
@@ -789,7 +819,7 @@ void TacticalIntroScene::GenerateAlienTeamUpper(	int scenario,
 		GLASSERT( 0 );
 	}
 
-	GenerateAlienTeam( units, count, rank, itemDefArr, random.Rand() );
+	UnitGen::GenerateAlienTeam( units, count, rank, itemDefArr, random.Rand() );
 	if ( crash ) {
 		for( int i=0; i<MAX_ALIENS; ++i ) {
 			if ( units[i].IsAlive() ) {
@@ -798,7 +828,7 @@ void TacticalIntroScene::GenerateAlienTeamUpper(	int scenario,
 				dd.energy = max*0.33f;
 				dd.kinetic = max*0.33f;
 				dd.incend = max*0.33f;
-				units[i].DoDamage( dd, 0, false );
+				units[i].DoDamage( dd, 0 );
 				GLASSERT( units[i].IsAlive() );
 			}
 		}
@@ -806,158 +836,6 @@ void TacticalIntroScene::GenerateAlienTeamUpper(	int scenario,
 }
 
 
-int TacticalIntroScene::RandomRank( grinliz::Random* random, float rank, int nRanks )
-{
-	int r = Clamp( (int)(rank+random->Uniform()*0.99f ), 0, nRanks-1 );
-	return r;
-}
-
-
-void TacticalIntroScene::GenerateAlienTeam( Unit* unit,				// target units to write
-											const int alienCount[],	// aliens per type
-											float averageRank,
-											const ItemDefArr& itemDefArr,
-											int seed )
-{
-	static const int WEAPON_RANKS = 5;
-	const char* weapon[Unit::NUM_ALIEN_TYPES][WEAPON_RANKS] = {
-		{	"RAY-1",	"RAY-1",	"RAY-2",	"RAY-2",	"RAY-3" },		// green
-		{	"RAY-1",	"RAY-2",	"RAY-2",	"RAY-3",	"PLS-3"	},		// prime
-		{	"PLS-1",	"PLS-1",	"PLS-2",	"PLS-2",	"PLS-3" },		// hornet
-		{	"STRM-1",	"STRM-1",	"STRM-2",	"STRM-2",	"STRM-3" },		// jackal
-		{	"PLS-1",	"PLS-1",	"PLS-2",	"PLS-2",	"PLS-3" },		// viper
-		{	"RAY-1",	"RAY-2",	"RAY-2",	"RAY-3",	"RAY-3"	},		// squid
-		{   "Spit-1",	"Spit-2",	"Spit-2",	"Spit-2",	"Spit-3" },		// spitter - intrinsic weapon
-		{	"", "", "", "", "" },											// crawler - can't use weapons
-	};
-
-	int nAliens = 0;
-
-	for( int i=0; i<Unit::NUM_ALIEN_TYPES; ++i ) {
-		nAliens += alienCount[i];
-	}
-	GLASSERT( nAliens <= MAX_ALIENS );
-	// local random - the same inputs always create same outputs.
-	grinliz::Random aRand( (nAliens*((int)averageRank)) ^ seed );
-	aRand.Rand();
-
-	int index=0;
-	for( int i=0; i<Unit::NUM_ALIEN_TYPES; ++i ) {
-		for( int k=0; k<alienCount[i]; ++k ) {
-			
-			// Create the unit.
-			int rank = RandomRank( &aRand, averageRank, NUM_ALIEN_RANKS );
- 			unit[index].Create( ALIEN_TEAM, i, rank, aRand.Rand() );
-
-			// About 1/3 should be guards that aren't green or prime.
-			if (    i == Unit::ALIEN_HORNET
-				 || i == Unit::ALIEN_VIPER ) 
-			{
-				if ( (index % 3) == 0 ) {
-					unit[index].SetAI( AI::AI_GUARD );
-				}
-			}
-
-			rank = RandomRank( &aRand, averageRank, WEAPON_RANKS );
-
-			// Add the weapon.
-			if ( *weapon[i][rank] ) {
-				Item item( itemDefArr, weapon[i][rank] );
-				unit[index].GetInventory()->AddItem( item, 0 );
-
-				// Add ammo.
-				const WeaponItemDef* weaponDef = item.GetItemDef()->IsWeapon();
-				GLASSERT( weaponDef );
-
-				for( int n=0; weaponDef->HasWeapon(n); ++n ) {
-					Item ammo( weaponDef->GetClipItemDef( n ) );
-					unit[index].GetInventory()->AddItem( ammo, 0 );
-				}
-			}
-			++index;
-		}
-	}
-}
-
-
-void TacticalIntroScene::GenerateTerranTeam(	Unit* unit,				// target units to write
-												int count,	
-												float baseRank,
-												const ItemDefArr& itemDefArr,
-												int seed )
-{
-	static const int POSITION = 4;
-	static const char* weapon[POSITION][NUM_TERRAN_RANKS] = {
-		{	"ASLT-1",	"ASLT-1",	"ASLT-2",	"ASLT-2",	"ASLT-3" },		// assault
-		{	"ASLT-1",	"ASLT-1",	"ASLT-2",	"PLS-2",	"PLS-3" },		// assault
-		{	"LR-1",		"LR-1",		"LR-2",		"LR-2",		"LR-3" },		// sniper
-		{	"MCAN-1",	"MCAN-1",	"MCAN-2",	"STRM-2",	"MCAN-3" },		// heavy
-	};
-	static const char* armorType[NUM_TERRAN_RANKS] = {
-		"ARM-1", "ARM-1", "ARM-2", "ARM-2", "ARM-3"
-	};
-	static const char* extraItems[NUM_TERRAN_RANKS] = {
-		"", "", "SG:I", "SG:K", "SG:E"
-	};
-
-	// local random - the same inputs always create same outputs.
-	grinliz::Random aRand( count ^ seed );
-	aRand.Rand();
-
-	for( int k=0; k<count; ++k ) 
-	{
-		int position = k % POSITION;
-
-		// Create the unit.
-		int rank = RandomRank( &aRand, baseRank, NUM_TERRAN_RANKS );
-		memset( &unit[k], 0, sizeof(Unit) );
- 		unit[k].Create( TERRAN_TEAM, 0, rank, aRand.Rand() );
-
-		rank = RandomRank( &aRand, baseRank, NUM_TERRAN_RANKS );
-
-		// Add the weapon.
-		Item item( itemDefArr, weapon[position][rank] );
-		unit[k].GetInventory()->AddItem( item, 0 );
-
-		// Add ammo.
-		const WeaponItemDef* weaponDef = item.GetItemDef()->IsWeapon();
-		GLASSERT( weaponDef );
-
-		for( int n=0; weaponDef->HasWeapon(n); ++n ) {
-			Item ammo( weaponDef->GetClipItemDef( n ) );
-			unit[k].GetInventory()->AddItem( ammo, 0 );
-		}
-
-		// Add extras
-		{
-			rank = RandomRank( &aRand, baseRank, NUM_TERRAN_RANKS );
-			Item armor( itemDefArr, armorType[rank] );
-			unit[k].GetInventory()->AddItem( armor, 0 );
-		}
-		rank = RandomRank( &aRand, baseRank, NUM_TERRAN_RANKS );
-		for( int i=0; i<=rank; ++i ) {
-			Item extra( itemDefArr, extraItems[i] );
-			unit[k].GetInventory()->AddItem( extra, 0 );
-		}
-	}
-}
-
-
-void TacticalIntroScene::GenerateCivTeam( Unit* unit,				// target units to write
-										  int count,
-										  const ItemDefArr& itemDefArr,
-										  int seed )
-{
-	grinliz::Random aRand( seed );
-	aRand.Rand();
-	aRand.Rand();
-
-	for( int i=0; i<count; ++i ) {
-		unit[i].Create( CIV_TEAM, 0, 0, aRand.Rand() );
-	}
-}
-
-
 Vector2I TacticalIntroScene::SceneInfo::Size() const
 {
 	Vector2I v = { 0, 0 };
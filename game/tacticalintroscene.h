@@ -24,6 +24,7 @@
 #include "../gamui/gamui.h"
 #include "../engine/uirendering.h"
 #include "battlescenedata.h"
+#include "tacmap.h"
 
 class UIImage;
 class UIButtonBox;
@@ -134,14 +135,7 @@ public:
 	};
 
 
-	static int RandomRank( grinliz::Random* random, float rank, int nRanks );
-
-	static void GenerateTerranTeam( Unit* units,				// target units to write
-									int count,
-									float averageLevel,
-									const ItemDefArr&,			// if null, will have no items
-									int seed=0 );
-
+	// Picks the aliens for the scenario and creates them with UnitGen.
 	static void GenerateAlienTeamUpper( int scenario,	
 										bool crash,
 										float rank,
@@ -149,23 +143,16 @@ public:
 										const ItemDefArr&,
 										int seed=0 );
 
-	static void GenerateAlienTeam(	Unit* units,				// target units to write
-									const int alienCount[],		// aliens per type
-									float averageLevel,
-									const ItemDefArr&,
-									int seed=0 );
-
-	static void GenerateCivTeam(	Unit* units,				// target units to write
-									int count,
-									const ItemDefArr&,
-									int seed=0 );
-
-	static void CreateMap(	tinyxml2::XMLPrinter*, 
+	// Can be called from any thread; maps are created one at a time.
+	static void CreateMap(	MapDesc* desc, 
 							int seed,
 							const SceneInfo& info,
 							const gamedb::Reader* database );
 
-	static void WriteXML( FILE* fp, const BattleSceneData* data, const ItemDefArr&, const gamedb::Reader* database  );
+	// Writes a new battle. If 'mapDesc' is not null, the map is returned
+	// as well, so it can be loaded with TacMap::LoadDesc(). If 'mapDesc'
+	// already holds a map (generated ahead of time) that map is used.
+	static void WriteXML( tinyxml2::XMLPrinter* printer, const BattleSceneData* data, const ItemDefArr&, const gamedb::Reader* database, MapDesc* mapDesc=0 );
 
 	
 private:
@@ -184,9 +171,14 @@ private:
 									const char* type,
 									const gamedb::Reader* database,
 									const gamedb::Item* parent,
-									tinyxml2::XMLElement* mapElement,
+									MapDesc* desc,
 									int seed );
 
+	// The items of a map snippet, in the coordinates of the snippet. The
+	// XML of the snippet is parsed the first time it is used. Called with
+	// the bakedMutex locked, by CreateMap.
+	static const MapDesc::Item* BakeSnippet( const gamedb::Reader* database, const gamedb::Item* item, int* nItems );
+
 	grinliz::Random random;
 
 	BackgroundUI		backgroundUI;
@@ -0,0 +1,152 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "tacticalreplay.h"
+#include "tacmap.h"
+#include "unit.h"
+#include "../tinyxml2/tinyxml2.h"
+
+#include <string.h>
+
+using namespace grinliz;
+using namespace tinyxml2;
+
+
+TacticalReplay::TacticalReplay( const ItemDefArr& _itemDefArr )
+	: itemDefArr( _itemDefArr ),
+	  tree( -0.1f, 3.0f ),
+	  battleData( _itemDefArr )
+{
+	tacMap = new TacMap( &tree, itemDefArr );
+	tacMap->SetUnits( battleData.UnitsPtr(), unitRenderers );
+	sim.Init( battleData.UnitsPtr(), tacMap, &itemDefArr, this );
+}
+
+
+TacticalReplay::~TacticalReplay()
+{
+	delete tacMap;
+}
+
+
+bool TacticalReplay::Load( FILE* fp )
+{
+	if ( !log.Load( fp ) )
+		return false;
+
+	XMLDocument doc;
+	doc.Parse( log.State() );
+	const XMLElement* element = doc.Error() ? 0 : doc.FirstChildElement( "BattleScene" );
+	if ( !element )
+		return false;
+
+	// The same load as the BattleScene. The units were placed before the recording started.
+	sim.Load( element );
+	tacMap->Load( element->FirstChildElement( "Map" ) );
+	battleData.Load( element );
+	tacMap->SetDayTime( battleData.GetDayTime() );
+
+	for( int i=0; i<NUM_TEAMS; ++i ) {
+		sim.SetTeamAI( i, log.TeamAI( i ) );
+	}
+	sim.StartBattle();
+	sim.GetRandom()->SetSeed( log.Seed() );
+	return true;
+}
+
+
+void TacticalReplay::Run( FILE* fp )
+{
+	bool more = true;
+	while ( more ) {
+		log.BeginFrame();
+		if ( sim.NoAction() ) {
+			more = ReadRecords( fp );
+		}
+		if ( !sim.NoAction() ) {
+			sim.Step( SIM_STEP );
+		}
+		log.EndFrame();
+	}
+	log.Report( fp );
+}
+
+
+bool TacticalReplay::ReadRecords( FILE* fp )
+{
+	Unit* units = battleData.UnitsPtr();
+	ActionLog::Record r;
+
+	while ( sim.NoAction() ) {
+		if ( !log.Next( &r ) )
+			return false;
+
+		bool inRange =    r.unit < MAX_UNITS
+					   && ( r.type != ActionLog::REC_PSI || r.target < MAX_UNITS )
+					   && ( r.type != ActionLog::REC_TURN || r.team < NUM_TEAMS );
+		if ( !inRange ) {
+			log.SetError( "unit or team out of range" );
+			return false;
+		}
+		Unit* unit = &units[r.unit];
+
+		switch( r.type ) {
+			case ActionLog::REC_TURN:
+				{
+					sim.NextTurn();
+					if ( r.team != sim.CurrentTeamTurn() ) {
+						fprintf( fp ? fp : stderr, "ActionLog: turn %d expected team %d, got %d\n", sim.TurnCount(), r.team, sim.CurrentTeamTurn() );
+					}
+					log.CheckHash( r.hash, sim.StateHash(), fp );
+				}
+				return true;
+
+			case ActionLog::REC_MOVE:
+				if ( r.pathLen <= MAX_TU ) {
+					Action* action = sim.PushAction( ACTION_MOVE, unit );
+					action->type.move.path.pathLen = r.pathLen;
+					memcpy( action->type.move.path.pathData, r.pathData, r.pathLen*2 );
+				}
+				break;
+
+			case ActionLog::REC_ROTATE:
+				{
+					Action* action = sim.PushAction( ACTION_ROTATE, unit );
+					action->type.rotate.rotation = r.rotation;
+				}
+				break;
+
+			case ActionLog::REC_SHOOT:
+				sim.PushShootAction( unit, r.pos, r.width, r.height, r.mode, r.error, false );
+				break;
+
+			case ActionLog::REC_PSI:
+				{
+					Action* action = sim.PushAction( ACTION_PSI_ATTACK, unit );
+					action->type.psi.targetID = r.target;
+				}
+				break;
+
+			case ActionLog::REC_INVENTORY:
+				sim.ProcessInventoryAI( unit );
+				break;
+
+			default:
+				GLASSERT( 0 );
+				break;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,77 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef UFO_TACTICAL_REPLAY_INCLUDED
+#define UFO_TACTICAL_REPLAY_INCLUDED
+
+#include <stdio.h>
+
+#include "../engine/loosequadtree.h"
+#include "tacticalsim.h"
+#include "actionlog.h"
+#include "battledata.h"
+#include "unitrenderer.h"
+
+class TacMap;
+
+
+/*	Plays an ActionLog through a TacticalSim, without a scene: nothing is
+	drawn or played, and the recorded commands stand in for the player and
+	the AI. The frame times in the Report() are the cost of the rules of the
+	battle alone.
+
+	The map and the unit models are loaded, in a SpaceTree of their own,
+	because the shots are hit tested against them. Only one Map can exist at
+	a time, so a replay is run when there is no BattleScene.
+*/
+class TacticalReplay : public ITacticalSimListener
+{
+public:
+	TacticalReplay( const ItemDefArr& itemDefArr );
+	~TacticalReplay();
+
+	// Loads the log and the battle saved in it. Returns false if it can't.
+	bool Load( FILE* fp );
+	// Plays the log to the end. The hash mismatches and the report are
+	// written to 'fp', or stderr if 'fp' is null.
+	void Run( FILE* fp );
+
+	// ITacticalSimListener: nothing to show.
+	virtual void UnitDown( Unit* unit )		{}
+	virtual void UnitUpgraded( Unit* unit )	{}
+	virtual U32 ShotFired(	const Unit* unit, const WeaponItemDef* weaponDef, int mode,
+							const grinliz::Vector3F& p0, const grinliz::Vector3F& p1,
+							bool impact, bool hitModel )	{ return 0; }
+	virtual void ShotLanded( bool direct, bool explosion )	{}
+	virtual void PsiAttacked( const Unit* unit, const Unit* target, bool success )	{}
+
+private:
+	enum { SIM_STEP = 20 };		// the same step as the BattleScene
+
+	// Reads the records up to the next action or turn change.
+	// Returns false at the end of the log.
+	bool ReadRecords( FILE* fp );
+
+	const ItemDefArr&	itemDefArr;
+	SpaceTree			tree;
+	BattleData			battleData;
+	UnitRenderer		unitRenderers[MAX_UNITS];	// freed before the tree
+	TacMap*				tacMap;
+	TacticalSim			sim;
+	ActionLog			log;
+};
+
+
+#endif // UFO_TACTICAL_REPLAY_INCLUDED
@@ -0,0 +1,1313 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "tacticalsim.h"
+#include "unit.h"
+#include "item.h"
+#include "unitgen.h"
+
+#include "../engine/ufoutil.h"
+#include "../grinliz/glperformance.h"
+#include "../grinliz/glutil.h"
+#include "../tinyxml2/tinyxml2.h"
+
+using namespace grinliz;
+using namespace tinyxml2;
+
+
+TacticalSim::TacticalSim() : units( 0 ), tacMap( 0 ), itemDefArr( 0 ), listener( 0 )
+{
+	currentTeamTurn = ALIEN_TEAM;
+	turnCount = 0;
+	random.SetSeedFromTime();
+	for( int i=0; i<NUM_TEAMS; ++i )
+		teamAI[i] = false;
+	for( int i=0; i<MAX_UNITS; ++i )
+		doorOpener[i].Set( -1, -1 );
+}
+
+
+void TacticalSim::Init( Unit* units, ITacticalMap* tacMap, const ItemDefArr* itemDefArr, ITacticalSimListener* listener )
+{
+	GLASSERT( units && tacMap && itemDefArr && listener );
+	this->units = units;
+	this->tacMap = tacMap;
+	this->itemDefArr = itemDefArr;
+	this->listener = listener;
+	visibility.Init( units, tacMap );
+}
+
+
+void TacticalSim::StartBattle()
+{
+	ResetDoors();
+	CalcTeamTargets();
+	targetEvents.Clear();
+	UpdateFogOfWar();
+}
+
+
+void TacticalSim::Save( XMLPrinter* printer )
+{
+	printer->PushAttribute( "currentTeamTurn", currentTeamTurn );
+	printer->PushAttribute( "turnCount", turnCount );
+}
+
+
+void TacticalSim::Load( const XMLElement* element )
+{
+	element->QueryIntAttribute( "currentTeamTurn", &currentTeamTurn );
+	turnCount = 0;
+	element->QueryIntAttribute( "turnCount", &turnCount );
+}
+
+
+void TacticalSim::NextTurn()
+{
+	currentTeamTurn++;
+	if ( currentTeamTurn == NUM_TEAMS )
+		currentTeamTurn = 0;
+	turnCount++;
+
+	switch ( currentTeamTurn ) {
+		case TERRAN_TEAM:
+			GLOUTPUT(( "New Turn: Terran\n" ));
+			for( int i=TERRAN_UNITS_START; i<TERRAN_UNITS_END; ++i )
+				units[i].NewTurn();
+			break;
+
+		case ALIEN_TEAM:
+			GLOUTPUT(( "New Turn: Alien\n" ));
+			for( int i=ALIEN_UNITS_START; i<ALIEN_UNITS_END; ++i ) {
+				if ( units[i].IsAlive() && units[i].AlienType() == Unit::ALIEN_CRAWLER ) {
+					if ( random.Uniform() < CRAWLER_GROWTH ) {
+						UpgradeCrawlerToSpitter( &units[i] );
+					}
+				}
+				units[i].NewTurn();
+			}
+			break;
+
+		case CIV_TEAM:
+			GLOUTPUT(( "New Turn: Civ\n" ));
+			for( int i=CIV_UNITS_START; i<CIV_UNITS_END; ++i )
+				units[i].NewTurn();
+			break;
+
+		default:
+			GLRELASSERT( 0 );
+			break;
+	}
+
+	// Allow the map to change (fire and smoke)
+	Rectangle2I changed;
+	tacMap->BeginChange();
+	tacMap->DoSubTurn( FIRE_DAMAGE_PER_SUBTURN );
+	tacMap->EndChange( &changed );
+	visibility.InvalidateAll( changed );
+
+	// Units downed in the turn change (by fire, for example) no
+	// longer hold their doors open:
+	ProcessDoors();
+	CalcTeamTargets();
+	targetEvents.Clear();
+	UpdateFogOfWar();
+}
+
+
+void TacticalSim::UpgradeCrawlerToSpitter( Unit* unit )
+{
+	bool okay = (unit->Team() == ALIEN_TEAM) && (unit->AlienType() == Unit::ALIEN_CRAWLER );
+	GLASSERT( okay );
+	if ( !okay )
+		return;
+
+	int rank = unit->GetStats().Rank();
+	Vector3F pos = unit->Pos();
+	float rot = unit->Rotation();
+
+	unit->Free();
+	int alienCount[Unit::NUM_ALIEN_TYPES] = { 0 };
+	alienCount[Unit::ALIEN_SPITTER] = 1;
+	UnitGen::GenerateAlienTeam( unit, alienCount, (float)rank, *itemDefArr, random.Rand() );
+	unit->SetPos( pos, rot );
+
+	listener->UnitUpgraded( unit );
+}
+
+
+void TacticalSim::GenerateCrawler( const Unit* unit, const Unit* shooter )
+{
+	if (    unit->Team() == CIV_TEAM
+		 && shooter
+		 && shooter->Team() == ALIEN_TEAM
+		 && shooter->AlienType() == Unit::ALIEN_SPITTER )
+	{
+		for( int i=ALIEN_UNITS_START; i<ALIEN_UNITS_END; ++i ) {
+			if ( !units[i].InUse() ) {
+				int rank = shooter->GetStats().Rank();
+				Vector3F pos = unit->Pos();
+				float rot = unit->Rotation();
+
+				int alienCount[Unit::NUM_ALIEN_TYPES] = { 0 };
+				alienCount[Unit::ALIEN_CRAWLER] = 1;
+				UnitGen::GenerateAlienTeam( &units[i], alienCount, (float)rank, *itemDefArr, random.Rand() );
+				units[i].SetPos( pos, rot );
+
+				return;
+			}
+		}
+	}
+}
+
+
+Unit* TacticalSim::GetUnitFromTile( int x, int z )
+{
+	for( int i=0; i<MAX_UNITS; ++i ) {
+		int ux = (int)units[i].Pos().x;
+		if ( ux == x ) {
+			int uz = (int)units[i].Pos().z;
+			if ( uz == z ) {
+				return &units[i];
+			}
+		}
+	}
+	return 0;
+}
+
+
+bool TacticalSim::DamageUnit( Unit* unit, const DamageDesc& damage, Unit* shooter )
+{
+	GLASSERT( unit->IsAlive() );
+	unit->DoDamage( damage, tacMap );
+	if ( !unit->IsAlive() ) {
+		visibility.InvalidateUnit( unit - units );
+		if ( shooter ) {
+			shooter->CreditKill();
+		}
+		listener->UnitDown( unit );
+		return true;
+	}
+	return false;
+}
+
+
+bool TacticalSim::HitUnit( Unit* unit, const DamageDesc& damage, Unit* shooter )
+{
+	if ( !unit->IsAlive() )
+		return false;
+
+	bool down = DamageUnit( unit, damage, shooter );
+	if ( down ) {
+		GenerateCrawler( unit, shooter );
+	}
+	GLOUTPUT(( "Hit Unit 0x%x hp=%d/%d\n", (unsigned)unit, (int)unit->HP(), (int)unit->GetStats().TotalHP() ));
+	return down;
+}
+
+
+void TacticalSim::Explode(	Vector2I* explosion, int nExplosion, int maxExplosion,
+							const DamageDesc& damageDesc, int weaponFlags, Unit* shooter )
+{
+	bool flareExplosion = (weaponFlags & WEAPON_FLARE) != 0;
+	bool smokeExplosion = (weaponFlags & WEAPON_SMOKE) != 0;
+
+	int totalExplosion = nExplosion;
+
+	const int MAX_RAD = 2;
+	const int MAX_RAD_2 = MAX_RAD*MAX_RAD;
+	Rectangle2I mapBounds = tacMap->Bounds();
+
+	while ( nExplosion ) {
+		// generates smoke:
+		int x0 = explosion[nExplosion-1].x;
+		int y0 = explosion[nExplosion-1].y;
+
+		for( int rad=0; rad<=MAX_RAD; ++rad ) {
+			DamageDesc dd = damageDesc;
+			dd.Scale( (float)(1+MAX_RAD-rad) / (float)(1+MAX_RAD) );
+
+			for( int y=y0-rad; y<=y0+rad; ++y ) {
+				for( int x=x0-rad; x<=x0+rad; ++x ) {
+					if ( x==(x0-rad) || x==(x0+rad) || y==(y0-rad) || y==(y0+rad) ) {
+
+						Vector2I x0y0 = { x, y };
+						if ( !mapBounds.Contains( x0y0 ) )	// keep explosions in-bounds
+							continue;
+
+						// Tried to do this with the pather, but the issue with
+						// walls being on the inside and outside of squares got
+						// ugly. But the other option - ray casting - also nasty.
+						// Finally settled on a line walk with CanSee()
+						int radius2 = (x-x0)*(x-x0) + (y-y0)*(y-y0);
+						if ( radius2 > MAX_RAD_2 )
+							continue;
+
+						// can the tile to be damaged be reached by the explosion?
+						// visibility is checked up to the tile before this one, else
+						// it is possible to miss because "you can't see yourself"
+						bool canSee = true;
+						if ( rad > 0 ) {
+							LineWalk walk( x0, y0, x, y );
+							// Actually 'less than' so that damage goes through walls a little.
+							while( walk.CurrentStep() < walk.NumSteps() ) {
+								Vector2I p = walk.P();
+								Vector2I q = walk.Q();
+
+								if ( !tacMap->CanSee( p, q ) ) {
+									canSee = false;
+									break;
+								}
+								walk.Step();
+							}
+							if ( !canSee )
+								continue;
+						}
+
+						Unit* unit = GetUnitFromTile( x, y );
+						if ( unit && unit->IsAlive() ) {
+							DamageUnit( unit, dd, shooter );
+						}
+						bool hitAnything = false;
+						Vector2I exp = { -1, -1 };
+						tacMap->DoDamage( x, y, dd, &exp );
+
+						if (    totalExplosion < maxExplosion
+							 && exp.x >= 0 && nExplosion < maxExplosion )
+						{
+							explosion[nExplosion++] = exp;
+							++totalExplosion;
+						}
+
+						// Where to add smoke?
+						// - if we hit anything
+						// - chance of smoke anyway
+						if ( flareExplosion ) {
+							int turns = 12 + random.Rand( 6 );
+							tacMap->AddFlare( x, y, turns );
+						}
+						else if ( smokeExplosion ) {
+							int turns = 12 + random.Rand( 6 );
+							tacMap->AddSmoke( x, y, turns );
+						}
+						else if ( hitAnything || random.Bit() ) {
+							int turns = 4 + random.Rand( 4 );
+							tacMap->AddSmoke( x, y, turns );
+						}
+					}
+				}
+			}
+		}
+		nExplosion--;
+		flareExplosion = false;
+		smokeExplosion = false;
+	}
+}
+
+
+void TacticalSim::CalcStateHash( BattleHash* hash )
+{
+	U32 h[MAX_UNITS+2];
+	for( int i=0; i<MAX_UNITS; ++i ) {
+		h[i] = units[i].StateHash();
+	}
+	h[MAX_UNITS+0] = currentTeamTurn;
+	h[MAX_UNITS+1] = turnCount;
+	UpdateFogOfWar();
+
+	hash->units = Random::Hash( h, sizeof( h ) );
+	hash->map = tacMap->StateHash();
+	hash->fog = tacMap->FogHash();
+	hash->visibility = visibility.StateHash();
+	hash->total = Random::Hash( hash, 4*sizeof( U32 ) );
+}
+
+
+bool TacticalSim::PsiAttack( Unit* unit, const Unit* targetUnit )
+{
+	GLASSERT( unit->TU() > TU_PSI - 0.1f );
+	unit->UseTU( TU_PSI );
+
+	int psiAttack = unit->GetStats().PsiPower();
+	int psiDefense = targetUnit->PsiDefense();
+	bool success = random.Rand( psiAttack ) > (U32)psiDefense;
+	GLOUTPUT(( "Psi: id=%d attack=%d defense=%d %s\n", targetUnit-units, psiAttack, psiDefense, success ? "success" : "fail" ));
+	return success;
+}
+
+
+Action* TacticalSim::PushAction( int actionID, Unit* unit )
+{
+	Action* action = actionStack.Push();
+	action->Init( actionID, unit );
+	return action;
+}
+
+
+void TacticalSim::PushRotateAction( Unit* src, const Vector3F& dst3F, bool quantize )
+{
+	Vector2I dst = { (int)dst3F.x, (int)dst3F.z };
+
+	float rot = src->AngleBetween( dst, quantize );
+	if ( src->Rotation() != rot ) {
+		Action* action = PushAction( ACTION_ROTATE, src );
+		action->type.rotate.rotation = rot;
+	}
+}
+
+
+bool TacticalSim::PushShootAction(	Unit* unit, 
+									const grinliz::Vector3F& target, 
+									float targetWidth, float targetHeight,
+									int mode,
+									float useError,
+									bool clearMoveIfShoot )
+{
+	GLRELASSERT( unit );
+
+	if ( !unit->IsAlive() )
+		return false;
+	
+	Item* weapon = unit->GetWeapon();
+	if ( !weapon )
+		return false;
+
+	const WeaponItemDef* wid = weapon->IsWeapon();
+
+	Vector3F normal, right, up;
+	Vector3F p = unit->Pos();
+
+	normal = target - p;
+	float length = normal.Length();
+	float range = length;
+	normal.Normalize();
+
+	up.Set( 0.0f, 1.0f, 0.0f );
+	CrossProduct( normal, up, &right );
+	CrossProduct( normal, right, &up );
+
+	BulletTarget bulletTarget( length );
+	if ( targetWidth )
+		bulletTarget.width = targetWidth;
+	if ( targetHeight )
+		bulletTarget.height = targetHeight;
+
+	if ( unit->CanFire( mode ) )
+	{
+		int nShots = wid->RoundsNeeded( mode );
+		unit->UseTU( unit->FireTimeUnits( mode ) );
+
+		// Could be removed, if optimization needed. Computes the metrics.
+		float chanceToHit, chanceAnyHit, tu, dptu;
+		unit->FireStatistics( mode, bulletTarget, &chanceToHit, &chanceAnyHit, &tu, &dptu );
+
+		for( int i=0; i<nShots; ++i ) {
+			Vector3F t = target;
+			if ( useError ) {
+				BulletSpread bulletSpread;
+				bulletSpread.Generate( random.Rand(), 
+									   unit->CalcAccuracy( mode ), length,
+									   normal, target, &t );
+			}
+
+			if ( clearMoveIfShoot && !actionStack.Empty() && actionStack.Top()->actionID == ACTION_MOVE ) {
+				actionStack.Clear();
+			}
+
+			Action* action = PushAction( ACTION_SHOOT, unit );
+			action->type.shoot.target = t;
+			action->type.shoot.mode = mode;
+			action->type.shoot.chanceToHit = chanceToHit;
+			action->type.shoot.range = range;
+			GLASSERT( InRange( chanceToHit, 0.0f, 1.0f ) );
+			unit->GetInventory()->UseClipRound( wid->GetClipItemDef( mode ) );
+		}
+		PushRotateAction( unit, target, false );
+		return true;
+	}
+	return false;
+}
+
+
+void TacticalSim::ProcessInventoryAI( Unit* theUnit )
+{
+	AI_LOG(( "[ai] Unit %d INVENTORY: ", theUnit - units ));
+	// Drop all the weapons and clips. Pick up new weapons and clips.
+	Vector2I pos = theUnit->MapPos();
+	Storage* storage = tacMap->LockStorage( pos.x, pos.y );
+	GLRELASSERT( storage );
+
+	Inventory* inventory = theUnit->GetInventory();
+	Item item;
+
+	if ( storage ) {
+		// Exception version=490 device=win32 at 	Sat, November 27, 2010 6:25 pm
+		// The IsResupply() is used by the AI query, an the same thing needs to 
+		// be used here, else we can infinte loop.
+		const WeaponItemDef* wid = storage->IsResupply( theUnit->GetWeaponDef() );
+		if ( wid ) {
+
+			// Clear out everything actually being carried so we don't run out of space.
+			for( int i=0; i<Inventory::NUM_SLOTS; ++i ) {
+				item = inventory->GetItem( i );
+				if ( item.IsWeapon() || item.IsClip() ) {
+					storage->AddItem( item );
+					inventory->RemoveItem( i );
+				}
+			}
+
+			storage->RemoveItem( wid, &item );
+#ifdef DEBUG
+			int slot = 
+#endif
+			inventory->AddItem( item, 0 );
+			GLRELASSERT( slot == Inventory::WEAPON_SLOT );
+			AI_LOG(( "'%s' ", item.Name() ));
+
+			// clips.
+			for( int k=0; k<2; ++k ) {
+				while ( storage->GetCount( wid->GetClipItemDef( k ) ) ) {
+					Item item;
+					storage->RemoveItem( wid->GetClipItemDef( k ), &item );
+					if ( inventory->AddItem( item, 0 ) < 0 ) {
+						storage->AddItem( item );
+						break;
+					}
+					else {
+						AI_LOG(( "'%s' ", item.Name() ));
+					}
+				}
+			}
+			AI_LOG(( "\n" ));
+		}
+	}
+	tacMap->ReleaseStorage( storage );
+}
+
+
+int TacticalSim::Step( U32 deltaTime )
+{
+	int result = ProcessAction( deltaTime );
+
+	if ( result & STEP_COMPLETE ) {
+		ProcessDoors();			// only the units that changed tiles
+		CalcTeamTargets();
+
+		StopForNewTeamTarget();
+		DoReactionFire();
+		targetEvents.Clear();	// All done! They don't get to carry on beyond the moment.
+	}
+	UpdateFogOfWar();		// fast if nothing changed
+	return result;
+}
+
+
+void TacticalSim::UpdateFogOfWar()
+{
+	if ( visibility.FogCheckAndClear() ) {
+		tacMap->SetFogOfWar( &visibility );
+	}
+}
+
+
+int TacticalSim::ProcessAction( U32 deltaTime )
+{
+	int result = 0;
+
+	if ( !actionStack.Empty() )
+	{
+		Action* action = actionStack.Top();
+
+		Unit* unit = 0;
+
+		if ( action->unit ) {
+			if ( !action->unit->IsAlive() ) {
+				actionStack.Pop();
+				return true;
+			}
+			unit = action->unit;
+		}
+
+		switch ( action->actionID ) {
+			case ACTION_MOVE: 
+				{
+					// Move the unit. Be careful to never move more than one step (Travel() does not).
+					// Used to do intermedia rotation, but it was annoying. Once vision was switched
+					// to 360 it did nothing. So rotation is free now.
+					//
+					float SPEED = 4.5f;
+					float x, z, r;
+
+					MoveAction* move = &action->type.move;
+						
+					move->path.GetPos( action->type.move.pathStep, move->pathFraction, &x, &z, &r );
+					// Face in the direction of walking.
+					unit->SetYRotation( r );
+
+					// Move fast when can't be seen:
+					if ( move->pathStep < move->path.pathLen-1 ) {
+						Vector2<S16> v0 = move->path.GetPathAt( move->pathStep );
+						Vector2<S16> v1 = move->path.GetPathAt( move->pathStep+1 );
+						if (    !visibility.TeamCanSee( TERRAN_TEAM, v0.x, v0.y )
+							 && !visibility.TeamCanSee( TERRAN_TEAM, v1.x, v1.y ) )
+						{
+							SPEED *= 10.0f;
+						}
+					}
+
+					float travel = Travel( deltaTime, SPEED );
+
+					while(    (move->pathStep < move->path.pathLen-1 )
+						   && travel > 0.0f
+						   && (!(result & STEP_COMPLETE))) 
+					{
+						move->path.Travel( &travel, &move->pathStep, &move->pathFraction );
+						if ( move->pathFraction == 0.0f ) {
+							// crossed a path boundary.
+							GLRELASSERT( unit->TU() >= 0.99 );	// one move is one TU. Should never be less than one, but
+																// occasionally see magic floating point number bugs.
+							
+							Vector2<S16> v0 = move->path.GetPathAt( move->pathStep-1 );
+							Vector2<S16> v1 = move->path.GetPathAt( move->pathStep );
+							int d = abs( v0.x-v1.x ) + abs( v0.y-v1.y );
+
+							if ( d == 1 )
+								unit->UseTU( 1.0f );
+							else if ( d == 2 )
+								unit->UseTU( 1.41f );
+							else { GLRELASSERT( 0 ); }
+
+							visibility.InvalidateUnit( unit-units );
+							result |= STEP_COMPLETE;
+						}
+						move->path.GetPos( move->pathStep, move->pathFraction, &x, &z, &r );
+						Vector3F v = { x+0.5f, 0.0f, z+0.5f };
+						unit->SetPos( v, unit->Rotation() );
+					}
+					if ( move->pathStep == move->path.pathLen-1 ) {
+						actionStack.Pop();
+						visibility.InvalidateUnit( unit-units );
+						result |= STEP_COMPLETE | UNIT_ACTION_COMPLETE;
+					}
+				}
+				break;
+
+			case ACTION_PSI_ATTACK:
+				{
+					ProcessPsiAttack( action );
+					result |= UNIT_ACTION_COMPLETE;
+					// actionStack.Pop(); called by the ProcessPsiAttack
+				}
+				break;
+
+			case ACTION_ROTATE:
+				{
+					const float ROTSPEED = 400.0f;
+					float travel = Travel( deltaTime, ROTSPEED );
+
+					float delta, bias;
+					MinDeltaDegrees( unit->Rotation(), 
+									 action->type.rotate.rotation, 
+									 &delta, &bias );
+
+					if ( delta <= travel ) {
+						unit->SetYRotation( action->type.rotate.rotation );
+						actionStack.Pop();
+						result |= UNIT_ACTION_COMPLETE;
+					}
+					else {
+						unit->SetYRotation( unit->Rotation() + bias*travel );
+					}
+				}
+				break;
+
+			case ACTION_SHOOT:
+				{
+					int r = ProcessActionShoot( action, unit );
+					result |= r;
+				}
+				break;
+
+			case ACTION_HIT:
+				{
+					int r = ProcessActionHit( action );
+					result |= r;
+				}
+				break;
+
+			case ACTION_DELAY:
+				{
+					if ( deltaTime >= action->type.delay.delay ) {
+						actionStack.Pop();
+						result |= OTHER_ACTION_COMPLETE;
+					}
+					else {
+						action->type.delay.delay -= deltaTime;
+					}
+				}
+				break;
+
+			default:
+				GLRELASSERT( 0 );
+				break;
+		}
+	}
+	return result;
+}
+
+
+int TacticalSim::ProcessActionShoot( Action* action, Unit* unit )
+{
+	DamageDesc damageDesc;
+	bool impact = false;
+	bool hitModel = false;
+	ShotHit shotHit = { 0, 0, 0 };
+	Vector3F intersection;
+	U32 delayTime = 0;
+	const WeaponItemDef* weaponDef = 0;
+	Ray ray;
+	int mode = action->type.shoot.mode;
+	Vector3F p0;
+
+	int result = 0;
+
+	if ( unit && unit->IsAlive() && tacMap->CalcTrigger( unit, &p0 ) ) {
+		Vector3F p1;
+		Vector3F beam0 = { 0, 0, 0 }, beam1 = { 0, 0, 0 };
+
+		const Item* weaponItem = unit->GetWeapon();
+		GLRELASSERT( weaponItem );
+		weaponDef = weaponItem->GetItemDef()->IsWeapon();
+		GLRELASSERT( weaponDef );
+
+		p1 = action->type.shoot.target;
+
+		ray.origin = p0;
+		ray.direction = p1-p0;
+
+		// What can we hit?
+		// model
+		//		unit, alive (does damage)
+		//		unit, dead (does nothing)
+		//		model, world (does damage)
+		//		gun, does nothing
+		// ground / bounds
+
+		// Don't hit the shooter:
+		bool hit = tacMap->IntersectShot( ray, unit, &intersection, &shotHit );
+
+		if ( hit && intersection.y < 0.0f ) {
+			// hit ground before the unit (intesection is with the part under ground)
+			// The world bounds will pick this up later.
+			hit = false;
+		}
+		if ( weaponDef->weapon[mode]->flags & WEAPON_DISTANCE ) {
+			if ( hit ) {
+				float len = (intersection-ray.origin).Length();
+				if ( len > action->type.shoot.range ) {
+					hit = false;
+				}
+			}
+			if ( !hit ) {
+				impact = true;
+				Vector3F normal = ray.direction;
+				normal.Normalize();
+				intersection = ray.origin + normal*action->type.shoot.range;
+				if ( intersection.y < 0 ) intersection.y = 0;
+				beam0 = ray.origin;
+				beam1 = intersection;
+			}
+		}
+
+		weaponDef->DamageBase( mode, &damageDesc );
+
+		if ( hit ) {
+			impact = true;
+			GLASSERT( intersection.x >= 0 && intersection.x <= (float)MAP_SIZE );
+			GLASSERT( intersection.z >= 0 && intersection.z <= (float)MAP_SIZE );
+			GLASSERT( intersection.y >= 0 && intersection.y <= 10.0f );
+			beam0 = p0;
+			beam1 = intersection;
+			hitModel = true;
+		}
+		else {
+			shotHit.unit = 0;
+			shotHit.weapon = 0;
+			shotHit.item = 0;
+
+			if ( !impact ) {		
+				Vector3F in, out;
+				int inResult, outResult;
+				Rectangle2I mapBounds = tacMap->Bounds();
+				Rectangle3F worldBounds;
+				worldBounds.Set( 0, 0, 0, 
+								(float)(mapBounds.max.x+1), 
+								8.0f,
+								(float)(mapBounds.max.y+1) );
+
+				int result = IntersectRayAllAABB( ray.origin, ray.direction, worldBounds, 
+												  &inResult, &in, &outResult, &out );
+
+				GLASSERT( result == grinliz::INTERSECT );
+				if ( result == grinliz::INTERSECT ) {
+					beam0 = p0;
+					beam1 = out;
+					intersection = out;
+					GLASSERT( intersection.x >= 0 && intersection.x <= (float)MAP_SIZE );
+					GLASSERT( intersection.z >= 0 && intersection.z <= (float)MAP_SIZE );
+					GLASSERT( intersection.y >= 0 && intersection.y <= 10.0f );
+
+					if ( out.y < 0.01 ) {
+						// hit the ground
+						impact = true;
+
+					}
+				}
+			}
+		}
+
+		// Shooting announces the units location; the view draws the shot.
+		delayTime = listener->ShotFired( unit, weaponDef, mode, beam0, beam1, impact, hitModel );
+	}
+
+	// Messy. Did we hit a target? Problems with code below:
+	// - accepts any target as a hit...not necessary what we were aiming for.
+	// - Ignore explosive data! It is too hard to get right.
+
+	if ( weaponDef && !weaponDef->IsExplosive( mode ) ) {
+		Unit* hitUnit = shotHit.unit;
+		if ( hitUnit && hitUnit->Team() == unit->Team() )
+			hitUnit = 0;	// don't count friendly fire
+		Unit* hitWeapon = shotHit.weapon;
+		if ( hitWeapon && hitWeapon->Team() == unit->Team() )
+			hitWeapon = 0;
+		WeaponItemDef::AddAccData( action->type.shoot.chanceToHit, hitUnit || hitWeapon );
+	}
+
+	actionStack.Pop();
+	result |= UNIT_ACTION_COMPLETE;
+	action = 0;	// invalidated by pop!!
+
+	if ( impact ) {
+		GLRELASSERT( weaponDef );
+		GLASSERT( intersection.x >= 0 && intersection.x <= (float)MAP_SIZE );
+		GLASSERT( intersection.z >= 0 && intersection.z <= (float)MAP_SIZE );
+		GLASSERT( intersection.y >= 0 && intersection.y <= 10.0f );
+
+		Action *h = PushAction( ACTION_HIT, unit );
+		h->type.hit.damageDesc = damageDesc;
+		h->type.hit.weapon = weaponDef->weapon[mode];
+		h->type.hit.p = intersection;
+		
+		h->type.hit.n = ray.direction;
+		h->type.hit.n.Normalize();
+
+		h->type.hit.hit = shotHit;
+	}
+
+	if ( delayTime ) {
+		Action* a = PushAction( ACTION_DELAY, 0 );
+		a->type.delay.delay = delayTime;
+	}
+	return result;
+}
+
+
+void TacticalSim::ProcessPsiAttack( Action* action )
+{
+	Unit* unit = action->unit;
+	const Unit* targetUnit = &units[action->type.psi.targetID];
+	bool success = PsiAttack( unit, targetUnit );
+
+	// Pop this - the PSI_ATTACK
+	actionStack.Pop();
+	listener->PsiAttacked( unit, targetUnit, success );
+}
+
+
+int TacticalSim::ProcessActionHit( Action* action )
+{
+	// Everything the hit does to the map is patched once, at the end.
+	tacMap->BeginChange();
+	int result = 0;
+	static const int MAX_EXPLOSION = 8;
+	Vector2I explosion[MAX_EXPLOSION];
+
+	int nExplosion = 0;
+	bool direct = !(action->type.hit.weapon->flags & WEAPON_EXPLOSIVE);
+
+	if ( direct ) {
+		// Apply direct hit damage
+		const ShotHit& hit = action->type.hit.hit;
+
+		if ( hit.unit ) {
+			HitUnit( hit.unit, action->type.hit.damageDesc, action->unit );
+		}
+		else if ( hit.weapon ) {
+			Inventory* inv = hit.weapon->GetInventory();
+			inv->RemoveItem( Inventory::WEAPON_SLOT );
+			GLOUTPUT(( "Shot the weapon out of Unit 0x%x hand.\n", (unsigned)hit.weapon ));
+		}
+		else if ( hit.item ) {
+			// Hit world object.
+			Vector2I exp = { -1, -1 };
+			tacMap->DamageItem( hit.item, action->type.hit.damageDesc, &exp );
+			if ( exp.x >= 0 )
+				explosion[nExplosion++] = exp;
+		}
+	}
+	else {
+		// There is a small offset to move the explosion back towards the shooter.
+		// If it hits a wall (common) this will move it to the previous square.
+		// Also means a model hit may be a "near miss"...but explosions are messy.
+		explosion[0].Set(	(int)(action->type.hit.p.x - 0.2f*action->type.hit.n.x), 
+							(int)(action->type.hit.p.z - 0.2f*action->type.hit.n.z) );
+
+		nExplosion = 1;
+	}
+
+	listener->ShotLanded( direct, nExplosion > 0 );
+
+	if ( nExplosion ) {
+		Explode(	explosion, nExplosion, MAX_EXPLOSION, 
+					action->type.hit.damageDesc, action->type.hit.weapon->flags, action->unit );
+	}
+	Rectangle2I changed;
+	tacMap->EndChange( &changed );
+	visibility.InvalidateAll( changed );
+	actionStack.Pop();
+	result |= UNIT_ACTION_COMPLETE;
+	return true;
+}
+
+
+void TacticalSim::ProcessDoors()
+{
+	tacMap->BeginChange();
+	for( int i=0; i<MAX_UNITS; ++i ) {
+		Vector2I pos = { -1, -1 };
+		if ( units[i].IsAlive() )
+			pos = units[i].MapPos();
+		if ( pos != doorOpener[i] ) {
+			tacMap->MoveOpener( doorOpener[i], pos );
+			doorOpener[i] = pos;
+		}
+	}
+	Rectangle2I changed;
+	tacMap->EndChange( &changed );
+	visibility.InvalidateAll( changed );
+}
+
+
+void TacticalSim::ResetDoors()
+{
+	Vector2I loc[MAX_UNITS];
+	int nLoc = 0;
+
+	for( int i=0; i<MAX_UNITS; ++i ) {
+		doorOpener[i].Set( -1, -1 );
+		if ( units[i].IsAlive() ) {
+			doorOpener[i] = units[i].MapPos();
+			loc[nLoc++] = doorOpener[i];
+		}
+	}
+	tacMap->BeginChange();
+	tacMap->ProcessDoors( loc, nLoc );
+	Rectangle2I changed;
+	tacMap->EndChange( &changed );
+	visibility.InvalidateAll( changed );
+}
+
+
+void TacticalSim::CalcTeamTargets()
+{
+	GRINLIZ_PERFTRACK
+	// generate events.
+	// - if team gets/loses target
+	// - if unit gets/loses target
+
+	grinliz::BitArray<MAX_UNITS, MAX_UNITS, 1> newUnitVis;
+	visibility.CalcVisMap( &newUnitVis );
+
+	const static Vector2I range[3] = {
+		{ TERRAN_UNITS_START, TERRAN_UNITS_END },
+		{ CIV_UNITS_START, CIV_UNITS_END },
+		{ ALIEN_UNITS_START, ALIEN_UNITS_END }
+	};
+
+	for( int src=0; src<MAX_UNITS; ++src ) {
+		if ( !units[src].IsAlive() )
+			continue;
+
+		for( int dst=0; dst<MAX_UNITS; ++dst ) {
+			if (    !units[src].IsAlive()
+				 || units[src].Team() == units[dst].Team() )	// Don't generate messages about team mates.
+			{
+				 continue;
+			}
+
+			// check unit change - did we see something new?
+			if ( !unitVis.IsSet( src, dst ) && newUnitVis.IsSet( src, dst ) )
+			{
+				int srcTeam = units[src].Team();
+
+				TargetEvent e = { 0, src, dst };
+				targetEvents.Push( e );
+
+				// Check team change.
+				Rectangle2I teamRange;
+				teamRange.Set( range[srcTeam].x, dst, range[srcTeam].y-1, dst );	// note the -1 inclusive/exclusive thing
+
+				// No one on this team, prior to this check, could see the unit.
+				if ( unitVis.IsRectEmpty( teamRange ) )
+				{	
+					TargetEvent e = { 1, srcTeam, dst };
+					targetEvents.Push( e );
+				}
+			}
+		}
+	}
+	unitVis = newUnitVis;
+}
+
+
+void TacticalSim::StopForNewTeamTarget()
+{
+	if ( currentTeamTurn == CIV_TEAM )
+		return;
+
+	if ( actionStack.Size() == 1 ) {
+		const Action& action = *actionStack.Top();
+		if (   action.actionID == ACTION_MOVE
+			&& action.unit
+			&& action.unit->Team() == currentTeamTurn
+			&& action.type.move.pathFraction == 0 )
+		{
+			// THEN check for interuption.
+			// Clear out the current team events, look for "new team"
+			// Player: only pauses on "new team"
+			// AI: pauses on "new team" OR "new target"
+			// No one pauses for Civs.
+			int i=0;
+			bool newTeam = false;
+			while( i < targetEvents.Size() ) {
+				TargetEvent t = targetEvents[i];
+				if (	( teamAI[currentTeamTurn] || t.team == 1 )	// AI always pause. Players pause on new team.
+					 && t.viewerID == currentTeamTurn
+					 && units[t.targetID].Team() != CIV_TEAM )
+				{
+					// New sighting!
+					GLOUTPUT(( "Sighting: Team %d sighted target %d on team %d.\n", t.viewerID, t.targetID, units[t.targetID].Team() ));
+					newTeam = true;
+					targetEvents.SwapRemove( i );
+				}
+				else {
+					++i;
+				}
+			}
+			if ( newTeam ) {
+				actionStack.Clear();
+			}
+		}
+	}
+}
+
+
+void TacticalSim::DoReactionFire()
+{
+	if ( currentTeamTurn == CIV_TEAM )
+		return;
+
+	int antiTeam = ALIEN_TEAM;
+	if ( currentTeamTurn == ALIEN_TEAM )
+		antiTeam = TERRAN_TEAM;
+
+	bool react = false;
+	if ( actionStack.Empty() ) {
+		react = true;
+	}
+	else { 
+		const Action& action = *actionStack.Top();
+		if (    action.actionID == ACTION_MOVE
+			&& action.unit
+			&& action.unit->Team() == currentTeamTurn
+			&& action.type.move.pathFraction == 0 )
+		{
+			react = true;		
+		}
+	}
+	if ( react ) {
+		int i=0;
+		while( i < targetEvents.Size() ) {
+			TargetEvent t = targetEvents[i];
+
+			// Reaction fire occurs on the *antiTeam*. It's a little
+			// strange to get the ol' head wrapped around.
+			if (    t.team == 0				// individual
+				 && units[t.viewerID].Team() == antiTeam
+				 && units[t.targetID].Team() == currentTeamTurn ) 
+			{
+				// Reaction fire
+				Unit* targetUnit = &units[t.targetID];
+				Unit* srcUnit = &units[t.viewerID];
+
+				Vector3F target = { 0, 0, 0 };
+				float targetWidth, targetHeight;
+
+				if (    targetUnit->IsAlive()
+					 && srcUnit->GetWeapon()
+					 && tacMap->CalcTarget( targetUnit, &target, &targetWidth, &targetHeight ) ) 
+				{
+					if ( SafeLineOfSight( srcUnit, 
+										  targetUnit,
+										  srcUnit->CanFire( 1 ) ? 1 : 0,
+										  srcUnit->Team() == TERRAN_TEAM ? true : false ) )
+					{
+						// Do we really react? Are we that lucky? Well, are you, punk?
+						float r = random.Uniform();
+						float reaction = srcUnit->GetStats().Reaction();
+
+						// Reaction is impacted by rotation.
+						// Multiple ways to do the math. Go with the normal of the src facing to
+						// the normal of the target.
+
+						Vector2I targetMapPos = targetUnit->MapPos();
+						Vector2I srcMapPos = srcUnit->MapPos();
+
+						Vector2F normalToTarget = { (float)(targetMapPos.x - srcMapPos.x), (float)(targetMapPos.y - srcMapPos.y) };
+						normalToTarget.Normalize();
+
+						Vector2F facing = { 0, 0 };
+						facing.x = sinf( ToRadian( srcUnit->Rotation() ) );
+						facing.y = cosf( ToRadian( srcUnit->Rotation() ) );
+
+						float mod = DotProduct( facing, normalToTarget ) * 0.5f + 0.5f;  
+						reaction *= mod;				// linear with angle.
+						float error = 2.0f - mod;		// doubles with rotation
+						
+						GLOUTPUT(( "reaction fire %s. (if %.2f < %.2f)\n", r <= reaction ? "Yes" : "No", r, reaction ));
+
+						if ( r <= reaction ) {
+							int shot = PushShootAction( srcUnit, target, targetWidth, targetHeight, 1, error, true );	// auto
+							if ( !shot )
+								PushShootAction( srcUnit, target, targetWidth, targetHeight, 0, error, true );	// snap
+						}
+					}
+				}
+				targetEvents.SwapRemove( i );
+			}
+			else {
+				++i;
+			}
+		}
+	}
+}
+
+
+bool TacticalSim::SafeLineOfSight(	const Unit* source, 
+									const Unit* target, 
+									int mode,
+									bool multicast )
+{
+	int sourceTeam = source->Team();
+	int targetTeam = target->Team();
+
+	Vector3F sourcePos, targetPos;
+
+	float fireRotation = source->AngleBetween( target->MapPos(), false );
+	if (    !tacMap->CalcTrigger( source, &sourcePos, &fireRotation )
+		 || !tacMap->CalcTarget( target, &targetPos ) )
+	{
+		return false;
+	}
+
+	float length = ( targetPos - sourcePos ).Length();
+	
+	Vector3F normal = ( targetPos - sourcePos );
+	normal.Normalize();
+
+	static const Vector3F up = { 0, 1, 0 };
+	Vector3F tangent;
+	CrossProduct( normal, up, &tangent );
+	
+	const WeaponItemDef* wid = source->GetWeaponDef();
+	Accuracy accuracy = source->CalcAccuracy( mode );
+
+	// Don't blow ourselves up.
+	if ( wid->IsExplosive( mode ) && length <= EXPLOSIVE_RANGE ) {
+		return false;
+	}
+
+	const int COUNT = multicast ? 5 : 1;
+
+	// Send out rays over the possible shooting space, see what happens. Basically want to know:
+	// 1. Does the center ray hit.
+	// 2. Do other possible solutions do bad things.
+
+	for( int i=0; i<COUNT; ++i ) {
+		float delta = 0;
+		if ( COUNT > 1 ) {
+			delta = Interpolate(  0.f,             -accuracy.RadiusAtOne()*length,
+								(float)(COUNT-1), accuracy.RadiusAtOne()*length,
+								float(i) );
+		}
+		Vector3F t = sourcePos + normal*length + tangent*delta;
+
+		Ray ray;
+		ray.origin = sourcePos;
+		ray.direction = t - sourcePos;
+		Vector3F intersection;
+		ShotHit hit;
+
+		bool m = tacMap->IntersectShot( ray, source, &intersection, &hit );
+		float distanceToImpact = m ? (intersection - sourcePos).Length() : (float)MAP_SIZE;
+
+		// Did we hit our own team?
+		const Unit* u = m ? hit.unit : 0;
+		if ( !u && m ) {
+			u = hit.weapon;
+		}
+		if ( u && u->Team() == sourceTeam ) {
+			GLOUTPUT(( "Ray fail %d: hit own team\n", source - units ));
+			return false;
+		}
+		// Is an explosive weapon too close?
+		if ( wid->IsExplosive(mode) && m && distanceToImpact <= EXPLOSIVE_RANGE ) {
+			GLOUTPUT(( "Ray fail %d: blow up in face.\n", source - units ));
+			return false;
+		}
+
+		// Do we actually hit the target? Only check for the center ray cast.
+		if ( i == COUNT/2 ) {
+			if ( u && u->Team() == targetTeam ) {
+				// all good.
+				GLOUTPUT(( "Ray main pass %d.\n", source - units ));
+			}
+			else {
+				GLOUTPUT(( "Ray fail %d: no line of site to target.\n", source - units ));
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+
+float MotionPath::DeltaToRotation( int dx, int dy )
+{
+	float rot = 0.0f;
+	GLRELASSERT( dx || dy );
+	GLRELASSERT( dx >= -1 && dx <= 1 );
+	GLRELASSERT( dy >= -1 && dy <= 1 );
+
+	if ( dx == 1 ) 
+		if ( dy == 1 )
+			rot = 45.0f;
+		else if ( dy == 0 )
+			rot = 90.0f;
+		else
+			rot = 135.0f;
+	else if ( dx == 0 )
+		if ( dy == 1 )
+			rot = 0.0f;
+		else
+			rot = 180.0f;
+	else
+		if ( dy == 1 )
+			rot = 315.0f;
+		else if ( dy == 0 )
+			rot = 270.0f;
+		else
+			rot = 225.0f;
+	return rot;
+}
+
+
+void MotionPath::Init( const MP_VECTOR< Vector2<S16> >& pathCache ) 
+{
+	GLRELASSERT( pathCache.size() <= (unsigned)MAX_TU );
+	GLRELASSERT( pathCache.size() > 1 );	// at least start and end
+
+	pathLen = (int)pathCache.size();
+	for( unsigned i=0; i<pathCache.size(); ++i ) {
+		GLRELASSERT( pathCache[i].x < 256 );
+		GLRELASSERT( pathCache[i].y < 256 );
+		pathData[i*2+0] = (U8) pathCache[i].x;
+		pathData[i*2+1] = (U8) pathCache[i].y;
+	}
+}
+
+		
+void MotionPath::CalcDelta( int i0, int i1, grinliz::Vector2I* vec, float* rot )
+{
+	Vector2<S16> path0 = GetPathAt( i0 );
+	Vector2<S16> path1 = GetPathAt( i1 );
+
+	int dx = path1.x - path0.x;
+	int dy = path1.y - path0.y;
+	if ( vec ) {
+		vec->x = dx;
+		vec->y = dy;
+	}
+	if ( rot ) {
+		*rot = DeltaToRotation( dx, dy );
+	}
+}
+
+
+void MotionPath::Travel(	float* travel,
+							int* pos,
+							float* fraction )
+{
+	// fraction is a bit funny. It is the lerp value between 2 path locations,
+	// so it isn't a constant distance.
+	Vector2I vec;
+	CalcDelta( *pos, *pos+1, &vec, 0 );
+
+	float distBetween = 1.0f;
+	if ( vec.x && vec.y ) {
+		distBetween = 1.41f;
+	}
+	float distRemain = (1.0f-*fraction) * distBetween;
+
+	if ( *travel >= distRemain ) {
+		*travel -= distRemain;
+		(*pos)++;
+		*fraction = 0.0f;
+	}
+	else {
+		*fraction += *travel / distBetween;
+		*travel = 0.0f;
+	}
+}
+
+
+void MotionPath::GetPos( int step, float fraction, float* x, float* z, float* rot )
+{
+	GLRELASSERT( step < pathLen );
+	GLRELASSERT( fraction >= 0.0f && fraction < 1.0f );
+	if ( step == pathLen-1 ) {
+		step = pathLen-2;
+		fraction = 1.0f;
+	}
+	Vector2<S16> path0 = GetPathAt( step );
+	Vector2<S16> path1 = GetPathAt( step+1 );
+
+	int dx = path1.x - path0.x;
+	int dy = path1.y - path0.y;
+	*x = (float)path0.x + fraction*(float)( dx );
+	*z = (float)path0.y + fraction*(float)( dy );
+	*rot = DeltaToRotation( dx, dy );
+}
@@ -0,0 +1,351 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef UFO_TACTICAL_SIM_INCLUDED
+#define UFO_TACTICAL_SIM_INCLUDED
+
+#include "../grinliz/gldebug.h"
+#include "../grinliz/gltypes.h"
+#include "../grinliz/glrandom.h"
+#include "../grinliz/glvector.h"
+#include "../grinliz/glrectangle.h"
+#include "../grinliz/glgeometry.h"
+#include "../grinliz/glbitarray.h"
+#include "../engine/ufoutil.h"
+#include "../micropather/micropather.h"
+
+#include "gamelimits.h"
+#include "item.h"
+#include "battlevisibility.h"
+
+class Unit;
+class Storage;
+
+namespace tinyxml2 {
+	class XMLPrinter;
+	class XMLElement;
+};
+
+
+// Needs to be a POD because it gets 'union'ed in a bunch of events.
+// size is important for the same reason.
+struct MotionPath
+{
+	int						pathLen;
+	U8						pathData[MAX_TU*2];
+
+	grinliz::Vector2<S16>	GetPathAt( int i ) 
+	{
+		GLRELASSERT( i < pathLen );
+		grinliz::Vector2<S16> v = { pathData[i*2+0], pathData[i*2+1] };
+		return v;
+	}
+	void Init( const MP_VECTOR< grinliz::Vector2<S16> >& pathCache );
+	void CalcDelta( int i0, int i1, grinliz::Vector2I* vec, float* rot );
+	void Travel( float* travelDistance, int* pathPos, float* fraction );
+	void GetPos( int step, float fraction, float* x, float* z, float* rot );
+private:
+	float DeltaToRotation( int dx, int dy );
+};
+
+
+// What a shot ran in to. All null if it hit nothing (the ground, or the edge of the world.)
+struct ShotHit
+{
+	Unit*			unit;		// unit (alive or not) hit
+	Unit*			weapon;		// unit whose weapon was hit
+	const void*		item;		// map object hit; passed back to ITacticalMap::DamageItem
+};
+
+
+/*	The map, as the TacticalSim sees it: the terrain, the doors, the storage
+	on the ground, and the shapes of the units for shooting. TacMap implements
+	it on top of the engine Map and the unit models; a check can implement it
+	without any of that.
+*/
+class ITacticalMap
+{
+public:
+	virtual grinliz::Rectangle2I Bounds() const = 0;
+	virtual bool CanSee( const grinliz::Vector2I& p, const grinliz::Vector2I& q ) = 0;
+	virtual bool Obscured( int x, int y ) const = 0;
+	virtual int  Flared( int x, int y ) const = 0;
+	virtual int  Luminance( int x, int y ) = 0;		// of the light: 255 (dark) to 765 (white)
+
+	// Changes to the map are made between BeginChange() and EndChange(), which
+	// returns the bounds of the tiles whose visibility may have changed.
+	virtual void BeginChange() = 0;
+	virtual void EndChange( grinliz::Rectangle2I* bounds ) = 0;
+	virtual void DoSubTurn( float fireDamagePerSubTurn ) = 0;
+	virtual void DoDamage( int x, int y, const DamageDesc& damage, grinliz::Vector2I* explosion ) = 0;
+	virtual void DamageItem( const void* item, const DamageDesc& damage, grinliz::Vector2I* explosion ) = 0;
+	virtual void AddSmoke( int x, int y, int subturns ) = 0;
+	virtual void AddFlare( int x, int y, int subturns ) = 0;
+
+	// Units open the doors they stand on or next to.
+	virtual bool ProcessDoors( const grinliz::Vector2I* openers, int nOpeners ) = 0;
+	virtual void MoveOpener( const grinliz::Vector2I& from, const grinliz::Vector2I& to ) = 0;
+
+	virtual Storage* LockStorage( int x, int y ) = 0;		// always returns something
+	virtual void ReleaseStorage( Storage* storage ) = 0;
+
+	virtual U32 StateHash() = 0;
+	virtual U32 FogHash() const = 0;
+	// Sets the fog of war to what the terran team can see, and adds it to what
+	// has been seen. Called by the sim when the visibility changes.
+	virtual void SetFogOfWar( Visibility* visibility ) = 0;
+
+	// Where a unit shoots from (facing 'rotation', if set), and where it is
+	// shot at. Return false if the unit has no shape (it isn't in use.)
+	virtual bool CalcTrigger( const Unit* unit, grinliz::Vector3F* trigger, const float* rotation=0 ) = 0;
+	virtual bool CalcTarget( const Unit* unit, grinliz::Vector3F* target, float* width=0, float* height=0 ) = 0;
+	// The first thing the ray hits, not counting 'shooter' and its weapon.
+	// Returns false if it hits nothing.
+	virtual bool IntersectShot( const grinliz::Ray& ray, const Unit* shooter, grinliz::Vector3F* at, ShotHit* hit ) = 0;
+};
+
+
+// Told about the things in the sim the view needs to react to.
+class ITacticalSimListener
+{
+public:
+	virtual void UnitDown( Unit* unit ) = 0;			// unit killed or knocked out
+	virtual void UnitUpgraded( Unit* unit ) = 0;		// unit was replaced in place (crawler to spitter)
+
+	// 'unit' fired; the shot goes from 'p0' to 'p1', and 'impact' if it hit something
+	// there ('hitModel' if that is a unit or a thing on the map, not the ground.) Returns
+	// how long, in msec, the shot takes to play out. The sim waits that long before the hit.
+	virtual U32 ShotFired(	const Unit* unit, const WeaponItemDef* weaponDef, int mode,
+							const grinliz::Vector3F& p0, const grinliz::Vector3F& p1,
+							bool impact, bool hitModel ) = 0;
+	// A shot landed: 'direct' for a shot that isn't explosive, and 'explosion'
+	// if anything blew up.
+	virtual void ShotLanded( bool direct, bool explosion ) = 0;
+	virtual void PsiAttacked( const Unit* unit, const Unit* target, bool success ) = 0;
+};
+
+
+enum {
+	ACTION_NONE,
+	ACTION_MOVE,
+	ACTION_ROTATE,
+	ACTION_SHOOT,
+	ACTION_DELAY,
+	ACTION_HIT,
+	ACTION_PSI_ATTACK
+};
+
+struct MoveAction	{
+	int			pathStep;
+	float		pathFraction;
+	MotionPath	path;
+};
+
+struct RotateAction {
+	float rotation;
+};
+
+struct ShootAction {
+	int					mode;
+	float				chanceToHit;
+	float				range;
+	grinliz::Vector3F	target;
+};
+
+struct PsiAction {
+	int targetID;
+};
+
+struct DelayAction {
+	U32 delay;
+};
+
+struct HitAction {
+	DamageDesc						damageDesc;		// damage done.
+	const WeaponItemDef::Weapon*	weapon;			// by what
+	
+	grinliz::Vector3F	p;				// point of impact
+	grinliz::Vector3F	n;				// normal from shooter to target
+	ShotHit				hit;			// what was impacted - may be nothing
+};
+
+struct Action
+{
+	int actionID;
+	Unit* unit;			// unit performing the action (sometimes null)
+
+	union {
+		MoveAction			move;
+		RotateAction		rotate;
+		ShootAction			shoot;
+		PsiAction			psi;
+		DelayAction			delay;
+		HitAction			hit;
+	} type;
+
+	void Clear()							{ actionID = ACTION_NONE; memset( &type, 0, sizeof( type ) ); }
+	void Init( int id, Unit* unit )			{ Clear(); actionID = id; this->unit = unit; }
+	bool NoAction()							{ return actionID == ACTION_NONE; }
+};
+
+
+/*	The rules of the tactical battle: turns, the actions of the units (moving,
+	shooting, psi), damage, explosions, doors, reaction fire, the
+	visibility of the units and the fog of war. The BattleScene is the view and controller: it
+	owns the models, the UI, the camera and the AI, pushes the actions, and
+	draws what the sim tells it about.
+
+	The sim does not know about the Engine, shaders, sound or gamui. The
+	map is an ITacticalMap.
+*/
+class TacticalSim
+{
+public:
+	TacticalSim();
+	~TacticalSim()	{}
+
+	void Init( Unit* units, ITacticalMap* tacMap, const ItemDefArr* itemDefArr, ITacticalSimListener* listener );
+
+	int CurrentTeamTurn() const			{ return currentTeamTurn; }
+	int TurnCount() const				{ return turnCount; }
+	// Sets the team whose turn is about to end. Call NextTurn() to start the game.
+	void SetTeamTurn( int team )		{ GLASSERT( team >= 0 && team < NUM_TEAMS ); currentTeamTurn = team; }
+	// The AI teams stop a move when they see a new target; players only for a new team.
+	void SetTeamAI( int team, bool ai )	{ GLASSERT( team >= 0 && team < NUM_TEAMS ); teamAI[team] = ai; }
+
+	grinliz::Random*	GetRandom()		{ return &random; }
+	Visibility*			GetVisibility()	{ return &visibility; }
+	ITacticalMap*		GetMap()		{ return tacMap; }
+	Unit*				Units()			{ return units; }
+
+	// Call once the units and the map are loaded: tells the map where the
+	// units are, and takes what they can see as already seen.
+	void StartBattle();
+
+	// Moves to the next team: new turn for the units of that team,
+	// crawler growth, and the map sub-turn (fire and smoke.)
+	void NextTurn();
+
+	Unit* GetUnitFromTile( int x, int z );
+
+	// A direct hit on a unit by 'shooter' (which may be null).
+	// Returns true if the unit went down.
+	bool HitUnit( Unit* unit, const DamageDesc& damage, Unit* shooter );
+
+	// Damage from explosions centered at 'explosion'. Map objects that explode
+	// are added to the explosion list, up to 'maxExplosion'. Call between
+	// ITacticalMap::BeginChange() and EndChange().
+	void Explode(	grinliz::Vector2I* explosion, int nExplosion, int maxExplosion,
+					const DamageDesc& damage, int weaponFlags, Unit* shooter );
+
+	// Uses the TU of the attacker and rolls the attack. Returns true on success.
+	bool PsiAttack( Unit* attacker, const Unit* target );
+
+	// The actions: the one on top of the stack is done first.
+	bool NoAction()						{ return actionStack.Empty(); }
+	Action* CurrentAction()				{ return actionStack.Empty() ? 0 : actionStack.Top(); }
+	Action* PushAction( int actionID, Unit* unit );
+	void ClearActions()					{ actionStack.Clear(); }
+
+	void PushRotateAction( Unit* src, const grinliz::Vector3F& dst, bool quantize );
+	// Try to shoot. Return true if success.
+	bool PushShootAction(	Unit* src, 
+							const grinliz::Vector3F& target, 
+							float targetWidth, 
+							float targetHeight,
+							int mode,
+							float useError,				// if 0, perfect shot. <1 improve, 1 normal error, >1 more error
+							bool clearMoveIfShoot );	// clears move commands if needed
+	// The unit drops its weapons and clips, and picks up the best ones on its tile.
+	void ProcessInventoryAI( Unit* unit );
+
+	// Does 'deltaTime' of the current action. When a unit steps to a new tile,
+	// the doors and targets are updated, and the units that see it may stop
+	// it or shoot at it. Returns the flags of what happened.
+	enum { 
+		STEP_COMPLETE			= 0x01,		// the step of a unit on a path completed. The unit is centered on the map grid
+		UNIT_ACTION_COMPLETE	= 0x02,		// shooting, rotating, some other unit action finished (resulted in Pop() )
+		OTHER_ACTION_COMPLETE	= 0x04,		// a non unit action (delay) finised (resulted in a Pop() )
+	};		
+	int Step( U32 deltaTime );
+
+	// Ray casts from 'source' to 'target': true if a shot hits the target and
+	// doesn't hit a team mate (or blow up in the face of the shooter.) 'multicast'
+	// checks the spread of the weapon as well as the center.
+	bool SafeLineOfSight( const Unit* source, const Unit* target, int mode, bool multicast );
+
+	// Hash of everything the battle saves: the units, the map, the fog of war,
+	// and the visibility of the units. Kept in parts so a difference between
+	// two builds can be tracked down. Used to check replays.
+	struct BattleHash {
+		U32 units;
+		U32 map;
+		U32 fog;
+		U32 visibility;
+		U32 total;
+	};
+	void CalcStateHash( BattleHash* hash );
+	U32 StateHash()						{ BattleHash h; CalcStateHash( &h ); return h.total; }
+
+	void Save( tinyxml2::XMLPrinter* printer );			// writes attributes only
+	void Load( const tinyxml2::XMLElement* element );
+
+private:
+	bool DamageUnit( Unit* unit, const DamageDesc& damage, Unit* shooter );
+	void GenerateCrawler( const Unit* unitKilled, const Unit* shooter );
+	void UpgradeCrawlerToSpitter( Unit* unit );
+
+	int ProcessAction( U32 deltaTime );
+	int ProcessActionShoot( Action* action, Unit* unit );
+	int ProcessActionHit( Action* action );	
+	void ProcessPsiAttack( Action* action );
+	float Travel( U32 timeMSec, float speed ) { return speed * (float)timeMSec / 1000.0f; }
+
+	// The fog is set at every step and turn change, so what has been seen
+	// is the same however often the battle is drawn.
+	void UpdateFogOfWar();
+	void ProcessDoors();		// tells the map about the units that changed tiles
+	void ResetDoors();			// tells the map about all the units
+
+	// Updates what units can and can not see, and generates targetEvents.
+	void CalcTeamTargets();
+	void StopForNewTeamTarget();
+	void DoReactionFire();
+
+	Unit*					units;
+	ITacticalMap*			tacMap;
+	const ItemDefArr*		itemDefArr;
+	ITacticalSimListener*	listener;
+
+	grinliz::Random	random;			// "the" random number generator for the battle
+	int				currentTeamTurn;
+	int				turnCount;
+	bool			teamAI[NUM_TEAMS];
+	Visibility		visibility;
+	CStack< Action > actionStack;
+	grinliz::Vector2I	doorOpener[MAX_UNITS];	// where the map has each unit as a door opener, (-1,-1) for none
+
+	struct TargetEvent
+	{
+		U8 team;		// 1: team, 0: unit
+		U8 viewerID;	// unit id of viewer, or teamID if team event
+		U8 targetID;	// unit id of target
+	};
+	grinliz::BitArray<MAX_UNITS, MAX_UNITS, 1>	unitVis;	// map of "previous" unit vis. Difference between this and current creates targetEvents.
+	CDynArray< TargetEvent >					targetEvents;
+};
+
+
+#endif // UFO_TACTICAL_SIM_INCLUDED
@@ -0,0 +1,362 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*	Steps a battle with the TacticalSim alone, on a map of its own: no Engine,
+	no models, no scene, no gamui, no GL. Checks that the units move and shoot
+	through the sim actions, that spitters turn civs into crawlers, that
+	crawlers grow into spitters, and that the same seed plays out the same battle.
+	A stand alone program, not part of the game build. From this directory:
+		g++ -DDEBUG -DGRINLIZ_NO_STL -I.. -o tacticalsimtest
+			tacticalsimtest.cpp tacticalsim.cpp unitgen.cpp unit.cpp item.cpp
+			inventory.cpp stats.cpp battlevisibility.cpp ../engine/ufoutil.cpp
+			../shared/glmap.cpp ../grinliz/*.cpp (but gldynamic.cpp, glbitarraytest.cpp) ../tinyxml2/tinyxml2.cpp
+	Returns 0 if all the checks pass.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+
+#include "tacticalsim.h"
+#include "unitgen.h"
+#include "unit.h"
+#include "item.h"
+
+using namespace grinliz;
+
+static int nCheck = 0;
+static int nFail = 0;
+
+#define CHECK( x )	{ ++nCheck; if ( !(x) ) { ++nFail; printf( "FAIL %s:%d %s\n", __FILE__, __LINE__, #x ); } }
+
+
+/*	An open field in daylight: everything can see everything. Smoke and flares
+	are counted down by the sub-turns; the units are boxes.
+*/
+class TestMap : public ITacticalMap
+{
+public:
+	enum { SIZE = 16 };
+
+	TestMap( const ItemDefArr& _itemDefArr ) : units( 0 ), itemDefArr( _itemDefArr ) {
+		memset( smoke, 0, sizeof( smoke ) );
+		memset( flare, 0, sizeof( flare ) );
+		memset( storage, 0, sizeof( storage ) );
+		memset( seen, 0, sizeof( seen ) );
+		changed.SetInvalid();
+	}
+	virtual ~TestMap() {
+		for( int j=0; j<SIZE; ++j )
+			for( int i=0; i<SIZE; ++i )
+				delete storage[j][i];
+	}
+	void SetUnits( const Unit* units )	{ this->units = units; }
+
+	virtual Rectangle2I Bounds() const	{ Rectangle2I b; b.Set( 0, 0, SIZE-1, SIZE-1 ); return b; }
+	virtual bool CanSee( const Vector2I& p, const Vector2I& q )	{ return true; }
+	virtual bool Obscured( int x, int y ) const	{ return smoke[y][x] > 0; }
+	virtual int  Flared( int x, int y ) const	{ return flare[y][x] > 0; }
+	virtual int  Luminance( int x, int y )		{ return 765; }
+
+	virtual void BeginChange()					{ changed.SetInvalid(); }
+	virtual void EndChange( Rectangle2I* bounds )	{ *bounds = changed; changed.SetInvalid(); }
+	virtual void DoSubTurn( float fireDamagePerSubTurn ) {
+		for( int j=0; j<SIZE; ++j ) {
+			for( int i=0; i<SIZE; ++i ) {
+				if ( smoke[j][i] ) { --smoke[j][i]; Change( i, j ); }
+				if ( flare[j][i] ) { --flare[j][i]; Change( i, j ); }
+			}
+		}
+	}
+	// Nothing on the map to damage.
+	virtual void DoDamage( int x, int y, const DamageDesc& damage, Vector2I* explosion )			{}
+	virtual void DamageItem( const void* item, const DamageDesc& damage, Vector2I* explosion )	{}
+	virtual void AddSmoke( int x, int y, int subturns )	{ smoke[y][x] = Max( smoke[y][x], subturns ); Change( x, y ); }
+	virtual void AddFlare( int x, int y, int subturns )	{ flare[y][x] = Max( flare[y][x], subturns ); Change( x, y ); }
+
+	virtual bool ProcessDoors( const Vector2I* openers, int nOpeners )	{ return false; }
+	virtual void MoveOpener( const Vector2I& from, const Vector2I& to )	{}
+
+	virtual Storage* LockStorage( int x, int y ) {
+		if ( !storage[y][x] )
+			storage[y][x] = new Storage( x, y, itemDefArr );
+		return storage[y][x];
+	}
+	virtual void ReleaseStorage( Storage* s )	{}
+
+	virtual U32 StateHash() {
+		U32 h = 2166136261U;
+		for( int j=0; j<SIZE; ++j ) {
+			for( int i=0; i<SIZE; ++i ) {
+				h = ( h ^ (U32)( smoke[j][i] + flare[j][i]*256 + ( storage[j][i] ? 65536 : 0 ) ) ) * 16777619U;
+			}
+		}
+		return h;
+	}
+	virtual U32 FogHash() const	{ return Random::Hash( seen, sizeof( seen ) ); }
+	virtual void SetFogOfWar( Visibility* visibility ) {
+		for( int j=0; j<SIZE; ++j )
+			for( int i=0; i<SIZE; ++i )
+				seen[j][i] |= visibility->TeamCanSee( TERRAN_TEAM, i, j ) ? 1 : 0;
+	}
+
+	virtual bool CalcTrigger( const Unit* unit, Vector3F* trigger, const float* rotation ) {
+		if ( !unit->InUse() )
+			return false;
+		*trigger = unit->Pos();
+		trigger->y = 1.0f;
+		return true;
+	}
+	virtual bool CalcTarget( const Unit* unit, Vector3F* target, float* width, float* height ) {
+		if ( !unit->InUse() )
+			return false;
+		*target = unit->Pos();
+		target->y = 0.8f;
+		if ( width ) *width = 0.6f;
+		if ( height ) *height = 1.5f;
+		return true;
+	}
+	virtual bool IntersectShot( const Ray& ray, const Unit* shooter, Vector3F* at, ShotHit* hit ) {
+		float best = FLT_MAX;
+		for( int i=0; i<MAX_UNITS; ++i ) {
+			const Unit* u = &units[i];
+			if ( u == shooter || !u->InUse() )
+				continue;
+			// Standing, or lying down.
+			Rectangle3F box;
+			Vector3F p = u->Pos();
+			box.Set( p.x-0.3f, 0, p.z-0.3f, p.x+0.3f, u->IsAlive() ? 1.5f : 0.2f, p.z+0.3f );
+
+			Vector3F v;
+			float t;
+			if (    IntersectRayAABB( ray.origin, ray.direction, box, &v, &t ) == grinliz::INTERSECT
+				 && t < best )
+			{
+				best = t;
+				*at = v;
+				hit->unit = const_cast< Unit* >( u );
+				hit->weapon = 0;
+				hit->item = 0;
+			}
+		}
+		return best < FLT_MAX;
+	}
+
+private:
+	void Change( int x, int y ) {
+		Rectangle2I r;
+		r.Set( x, y, x, y );
+		if ( changed.IsValid() )
+			changed.DoUnion( r );
+		else
+			changed = r;
+	}
+
+	const Unit*			units;
+	const ItemDefArr&	itemDefArr;
+	int					smoke[SIZE][SIZE];
+	int					flare[SIZE][SIZE];
+	Storage*			storage[SIZE][SIZE];
+	U8					seen[SIZE][SIZE];
+	Rectangle2I			changed;
+};
+
+
+class Listener : public ITacticalSimListener
+{
+public:
+	Listener() : down( 0 ), upgraded( 0 ), shots( 0 ), landed( 0 )	{}
+	virtual void UnitDown( Unit* unit )		{ ++down; }
+	virtual void UnitUpgraded( Unit* unit )	{ ++upgraded; }
+	virtual U32 ShotFired(	const Unit* unit, const WeaponItemDef* weaponDef, int mode,
+							const Vector3F& p0, const Vector3F& p1,
+							bool impact, bool hitModel )	{ ++shots; return 0; }
+	virtual void ShotLanded( bool direct, bool explosion )	{ ++landed; }
+	virtual void PsiAttacked( const Unit* unit, const Unit* target, bool success )	{}
+
+	int down;
+	int upgraded;
+	int shots;
+	int landed;
+};
+
+
+// The spitter weapons, the only items the aliens in this battle carry.
+// Hidden like the real ones, so a downed spitter leaves no crate. A spit
+// takes down a civ.
+static void CreateItemDefs( ItemDefArr* arr )
+{
+	static const WeaponItemDef::Weapon spit = { "Snap", "Spit-Clip", 0, 1000.0f, 1.0f, 4.0f, "spitter" };
+	static const char* name[] = { "Spit-1", "Spit-2", "Spit-3" };
+	static const int DECO_NONE = 32;
+
+	ClipItemDef* clip = new ClipItemDef();
+	clip->InitBase( "Spit-Clip", "Spit clip", DECO_NONE, 1, true, 0 );
+	clip->alien = true;
+	clip->defaultRounds = 100;
+	clip->dd.Set( 0.5f, 0, 0.5f );
+	arr->Add( clip );
+
+	for( int i=0; i<3; ++i ) {
+		WeaponItemDef* weapon = new WeaponItemDef();
+		weapon->InitBase( name[i], name[i], DECO_NONE, 1, true, 0 );
+		for( int j=0; j<WeaponItemDef::MAX_MODE; ++j ) {
+			weapon->weapon[j] = j ? 0 : &spit;
+			weapon->clipItemDef[j] = j ? 0 : clip;
+		}
+		arr->Add( weapon );
+	}
+}
+
+
+static int CountAliens( Unit* units, int type )
+{
+	int count = 0;
+	for( int i=ALIEN_UNITS_START; i<ALIEN_UNITS_END; ++i ) {
+		if ( units[i].IsAlive() && units[i].AlienType() == type )
+			++count;
+	}
+	return count;
+}
+
+
+// Steps the sim until the actions are done. Returns false if they don't finish.
+static bool RunActions( TacticalSim* sim, U32 step )
+{
+	for( int i=0; i<10000 && !sim->NoAction(); ++i ) {
+		sim->Step( step );
+	}
+	return sim->NoAction();
+}
+
+
+static void RunBattle( const ItemDefArr& itemDefArr, U32 seed, U32 step, int nTurns, U32* hash )
+{
+	static const int NUM_CIVS = 6;
+
+	TestMap testMap( itemDefArr );
+
+	Unit* units = new Unit[MAX_UNITS];
+	memset( units, 0, sizeof(Unit)*MAX_UNITS );
+	testMap.SetUnits( units );
+
+	int alienCount[Unit::NUM_ALIEN_TYPES] = { 0 };
+	alienCount[Unit::ALIEN_SPITTER] = 1;
+	alienCount[Unit::ALIEN_CRAWLER] = 2;
+	UnitGen::GenerateAlienTeam( units+ALIEN_UNITS_START, alienCount, 1.0f, itemDefArr, seed );
+	UnitGen::GenerateCivTeam( units+CIV_UNITS_START, NUM_CIVS, itemDefArr, seed );
+
+	for( int i=0; i<3; ++i )
+		units[ALIEN_UNITS_START+i].SetMapPos( 2+i, 2 );
+	for( int i=0; i<NUM_CIVS; ++i )
+		units[CIV_UNITS_START+i].SetMapPos( 2+i*2, 12 );
+
+	Listener listener;
+	TacticalSim sim;
+	sim.Init( units, &testMap, &itemDefArr, &listener );
+	sim.GetRandom()->SetSeed( seed );
+	sim.SetTeamTurn( CIV_TEAM );
+	sim.StartBattle();
+
+	Unit* spitter = units + ALIEN_UNITS_START;
+	Unit* crawler = units + ALIEN_UNITS_START + 1;
+	CHECK( spitter->AlienType() == Unit::ALIEN_SPITTER );
+	CHECK( CountAliens( units, Unit::ALIEN_CRAWLER ) == 2 );
+
+	int civsDown = 0;
+	bool moved = false;
+	for( int turn=0; turn<nTurns; ++turn ) {
+		sim.NextTurn();
+
+		if ( sim.CurrentTeamTurn() == ALIEN_TEAM && !moved ) {
+			// A crawler walks 2 tiles, a TU each, out of the line of fire.
+			static const U8 path[] = { 3, 2,  3, 1,  3, 0 };
+			float tu = crawler->TU();
+			Action* action = sim.PushAction( ACTION_MOVE, crawler );
+			action->type.move.path.pathLen = 3;
+			memcpy( action->type.move.path.pathData, path, sizeof( path ) );
+			CHECK( RunActions( &sim, step ) );
+			CHECK( crawler->MapPos().x == 3 && crawler->MapPos().y == 0 );
+			CHECK( crawler->TU() == tu - 2.0f );
+			moved = true;
+		}
+		if ( sim.CurrentTeamTurn() == ALIEN_TEAM && civsDown < NUM_CIVS ) {
+			// Each civ shot down by the spitter gets up as a crawler.
+			int crawlers = CountAliens( units, Unit::ALIEN_CRAWLER ) + CountAliens( units, Unit::ALIEN_SPITTER );
+			Unit* civ = units + CIV_UNITS_START + civsDown;
+			int shots = listener.shots;
+
+			Vector3F target;
+			float width, height;
+			CHECK( testMap.CalcTarget( civ, &target, &width, &height ) );
+			CHECK( sim.PushShootAction( spitter, target, width, height, 0, 0, false ) );
+			CHECK( RunActions( &sim, step ) );
+			CHECK( listener.shots == shots+1 );
+			CHECK( !civ->IsAlive() );
+			CHECK( CountAliens( units, Unit::ALIEN_CRAWLER ) + CountAliens( units, Unit::ALIEN_SPITTER ) == crawlers+1 );
+			++civsDown;
+		}
+		if ( sim.CurrentTeamTurn() == TERRAN_TEAM && ( turn % 6 ) == 0 ) {
+			// Smoke from an explosion away from the units; cleared by the map sub-turns.
+			Vector2I explosion[4] = { { 8, 7 } };
+			DamageDesc blast;
+			blast.Set( 0, 0, 10.0f );
+			testMap.BeginChange();
+			sim.Explode( explosion, 1, 4, blast, WEAPON_SMOKE, 0 );
+			Rectangle2I changed;
+			testMap.EndChange( &changed );
+			sim.GetVisibility()->InvalidateAll( changed );
+			CHECK( testMap.Obscured( 8, 7 ) );
+		}
+		hash[turn] = sim.StateHash();
+	}
+	CHECK( sim.TurnCount() == nTurns );
+	CHECK( listener.down == civsDown );
+	CHECK( listener.landed == civsDown );
+
+	// Crawlers grow into spitters over enough turns.
+	int spitters = CountAliens( units, Unit::ALIEN_SPITTER );
+	CHECK( spitters + CountAliens( units, Unit::ALIEN_CRAWLER ) == 3+civsDown );
+	CHECK( listener.upgraded > 0 );
+	CHECK( listener.upgraded == spitters-1 );
+
+	for( int i=0; i<MAX_UNITS; ++i )
+		units[i].Free();
+	delete [] units;
+}
+
+
+int main( int argc, const char* argv[] )
+{
+	ItemDefArr itemDefArr;
+	CreateItemDefs( &itemDefArr );
+
+	static const int TURNS = 60;
+	U32 hashA[TURNS], hashB[TURNS], hashC[TURNS], hashD[TURNS];
+	RunBattle( itemDefArr, 1, 20, TURNS, hashA );
+	RunBattle( itemDefArr, 1, 20, TURNS, hashB );
+	RunBattle( itemDefArr, 2, 20, TURNS, hashC );
+	RunBattle( itemDefArr, 1, 7, TURNS, hashD );
+
+	// The same seed plays the same battle, whatever the step of the sim (a
+	// replay doesn't step like the game did.) The state changes as it goes.
+	CHECK( memcmp( hashA, hashB, sizeof(hashA) ) == 0 );
+	CHECK( memcmp( hashA, hashD, sizeof(hashA) ) == 0 );
+	CHECK( memcmp( hashA, hashC, sizeof(hashA) ) != 0 );
+	CHECK( hashA[0] != hashA[TURNS-1] );
+
+	printf( "TacticalSim: %d checks, %d failed.\n", nCheck, nFail );
+	return nFail ? 1 : 0;
+}
@@ -14,15 +14,11 @@
 */
 
 #include "unit.h"
-#include "game.h"
-#include "../engine/engine.h"
-#include "material.h"
+#include "item.h"
+#include "tacticalsim.h"
+#include "../engine/serialize.h"
 #include "../tinyxml2/tinyxml2.h"
 #include "../grinliz/glstringutil.h"
-#include "ai.h"
-#include "ufosound.h"
-#include "tacmap.h"
-#include "../engine/loosequadtree.h"
 
 using namespace grinliz;
 using namespace tinyxml2;
@@ -273,9 +269,9 @@ void Unit::Init(	int team,
 	visibilityCurrent = false;
 	
 	if ( team == TERRAN_TEAM )
-		ai = AI::AI_TRAVEL;
+		ai = AI_TRAVEL;
 	else
-		ai = AI::AI_NORMAL;
+		ai = AI_NORMAL;
 
 	if ( p_status == STATUS_ALIVE ) {
 		tu = 1.0f;
@@ -413,7 +409,7 @@ void Unit::CalcMapPos( grinliz::Vector2I* vec, float* _rot ) const
 }
 
 
-void Unit::Kill( TacMap* map, bool playSound )
+void Unit::Kill( ITacticalMap* map )
 {
 	GLASSERT( status == STATUS_ALIVE );
 	
@@ -421,15 +417,9 @@ void Unit::Kill( TacMap* map, bool playSound )
 	hp = 0;
 
 	if ( team == TERRAN_TEAM ) {
-		if ( playSound )
-			SoundManager::Instance()->QueueSound( "terrandown0" );
 		if ( random.Rand( 100 ) < stats.Constitution() )
 			status = STATUS_UNCONSCIOUS;
 	}
-	else if ( team == ALIEN_TEAM ) {
-		if ( playSound )
-			SoundManager::Instance()->QueueSound( "aliendown0" );
-	}
 	visibilityCurrent = false;
 
 	if ( map && !inventory.Empty() ) {
@@ -460,7 +450,7 @@ void Unit::Leave()
 }
 
 
-void Unit::DoDamage( const DamageDesc& damage, TacMap* map, bool playSound )
+void Unit::DoDamage( const DamageDesc& damage, ITacticalMap* map )
 {
 	GLASSERT( status != STATUS_NOT_INIT );
 	if ( status == STATUS_ALIVE ) {
@@ -478,7 +468,7 @@ void Unit::DoDamage( const DamageDesc& damage, TacMap* map, bool playSound )
 
 		hp = Max( 0, hp-(int)LRintf( damageDone ) );
 		if ( hp == 0 ) {
-			Kill( map, playSound );
+			Kill( map );
 			visibilityCurrent = false;
 		}
 	}
@@ -492,6 +482,53 @@ void Unit::NewTurn()
 	}
 }
 
+U32 Unit::StateHash() const
+{
+	struct {
+		int		status, team, type, hp, kills, ai;
+		int		nMissions, allMissionKills, allMissionOvals, gunner;
+		int		str, dex, psy, rank;
+		U32		body;
+		float	tu, rot, x, z;
+		int		rounds[Inventory::NUM_SLOTS];
+	} s;
+	memset( &s, 0, sizeof( s ) );	// no uninitialized padding in the hash
+
+	s.status = status;
+	if ( status == STATUS_NOT_INIT ) {
+		return Random::Hash( &s, sizeof( s ) );
+	}
+
+	s.team = team;
+	s.type = type;
+	s.hp = hp;
+	s.kills = kills;
+	s.ai = ai;
+	s.nMissions = nMissions;
+	s.allMissionKills = allMissionKills;
+	s.allMissionOvals = allMissionOvals;
+	s.gunner = gunner;
+	s.str = stats.STR();
+	s.dex = stats.DEX();
+	s.psy = stats.PSY();
+	s.rank = stats.Rank();
+	s.body = body;
+	s.tu = tu;
+	s.rot = rot;
+	s.x = pos.x;
+	s.z = pos.z;
+
+	// The item defs are hashed by name, not pointer, so the hash is the same between runs.
+	U32 h = Random::HASH_SEED;
+	for( int i=0; i<Inventory::NUM_SLOTS; ++i ) {
+		const ItemDef* itemDef = inventory.GetItemDef( i );
+		if ( itemDef ) {
+			h = Random::Hash( itemDef->name, strlen( itemDef->name ), h );
+			s.rounds[i] = inventory.GetItem( i ).Rounds();
+		}
+	}
+	return Random::Hash( &s, sizeof( s ), h );
+}
 
 
 void Unit::Save( XMLPrinter* printer ) const
@@ -512,7 +549,7 @@ void Unit::Save( XMLPrinter* printer ) const
 		XMLUtil::Attribute( fp, "allMissionOvals", allMissionOvals );
 		XMLUtil::Attribute( fp, "gunner", gunner );
 		XMLUtil::Attribute( fp, "tu", tu );
-		if ( ai == AI::AI_GUARD )
+		if ( ai == AI_GUARD )
 			XMLUtil::Attribute( fp, "ai", "guard" );
 
 		XMLUtil::Attribute( fp, "modelX", pos.x );
@@ -535,7 +572,7 @@ void Unit::Save( XMLPrinter* printer ) const
 		XML_PUSH_ATTRIB( printer, allMissionOvals );
 		XML_PUSH_ATTRIB( printer, gunner );
 		XML_PUSH_ATTRIB( printer, tu );
-		if ( ai == AI::AI_GUARD ) {
+		if ( ai == AI_GUARD ) {
 			printer->PushAttribute( "ai", "guard" );
 		}
 		printer->PushAttribute( "modelX", pos.x );
@@ -550,18 +587,6 @@ void Unit::Save( XMLPrinter* printer ) const
 }
 
 
-void Unit::InitLoc( TacMap* tacmap )
-{
-	if ( pos.x == 0.0f ) {
-		GLASSERT( pos.z == 0.0f );
-
-		Vector2I pi;
-		tacmap->PopLocation( team, ai == AI::AI_GUARD, &pi, &rot );
-		pos.Set( (float)pi.x+0.5f, 0.0f, (float)pi.y+0.5f );
-	}
-}
-
-
 void Unit::Load( const XMLElement* ele, const ItemDefArr& itemDefArr )
 {
 	Free();
@@ -578,7 +603,7 @@ void Unit::Load( const XMLElement* ele, const ItemDefArr& itemDefArr )
 	body = random.Rand() & 0x7fffffff;
 	type = 0;
 	int a_status = 0;
-	ai = AI::AI_NORMAL;
+	ai = AI_NORMAL;
 	kills = 0;
 	nMissions = 0;
 	allMissionKills = 0;
@@ -621,7 +646,7 @@ void Unit::Load( const XMLElement* ele, const ItemDefArr& itemDefArr )
 		ele->QueryIntAttribute( "gunner", &gunner );
 
 		if ( StrEqual( ele->Attribute( "ai" ), "guard" ) ) {
-			ai = AI::AI_GUARD;
+			ai = AI_GUARD;
 		}
 
 #if 0
@@ -802,151 +827,3 @@ Accuracy Unit::CalcAccuracy( int mode ) const
 	}
 	return Accuracy();
 }
-
-
-
-UnitRenderer::UnitRenderer() : tree( 0 ), model( 0 ), weapon( 0 )
-{
-}
-
-
-UnitRenderer::~UnitRenderer()
-{
-	GLASSERT( tree );
-	if ( model ) 
-		tree->FreeModel( model );
-	if ( weapon )
-		tree->FreeModel( weapon );
-}
-
-
-void UnitRenderer::SetSelectable( bool selectable )
-{
-	if ( model ) {
-		if ( selectable )
-			model->SetFlag( Model::MODEL_SELECTABLE );
-		else
-			model->ClearFlag( Model::MODEL_SELECTABLE );
-	}
-}
-
-
-void UnitRenderer::Update( SpaceTree* _tree, const Unit* unit )
-{
-	GLASSERT( _tree );
-	if ( !tree ) {
-		tree = _tree;
-	}
-	else {
-		GLASSERT( tree == _tree );
-	}
-
-	const ModelResource* resource = 0;
-	const ModelResource* weaponResource = 0;
-	ModelResourceManager* modman = ModelResourceManager::Instance();
-	Texture* texture = 0;
-	float texA = 0;
-	float texD = 0;
-	float texX = 0;
-	float texY = 0;
-	bool shadow = true;
-
-	if ( !unit->InUse() ) {
-		// Should be nothing.
-		if ( model ) {
-			tree->FreeModel( model );
-			model = 0;
-		}
-		if ( weapon ) {
-			tree->FreeModel( weapon );
-			weapon = 0;
-		}
-	}
-	else if ( unit->IsAlive() ) {
-		switch ( unit->Team() ) {
-			case TERRAN_TEAM:
-				resource = modman->GetModelResource( ( unit->Gender() == Unit::MALE ) ? "maleMarine" : "femaleMarine" );
-				break;
-
-			case CIV_TEAM:
-				resource = modman->GetModelResource( ( unit->Gender() == Unit::MALE ) ? "maleCiv" : "femaleCiv" );
-				break;
-
-			case ALIEN_TEAM:
-				resource = modman->GetModelResource( unit->AlienName() );
-				break;
-			
-			default:
-				GLASSERT( 0 );
-				break;
-		}
-		GLASSERT( resource );
-		if ( unit->GetWeapon() && unit->GetWeapon()->IsWeapon() ) {
-			weaponResource = unit->GetWeapon()->IsWeapon()->resource;
-			// For instinsic weapons (spitter alien) can be null. GLASSERT( weaponResource );
-		}
-	}
-	else {
-		resource = modman->GetModelResource( "unitplate" );
-		texture = TextureManager::Instance()->GetTexture( "particleQuad" );
-		shadow = false;
-
-		if ( unit->Team() != ALIEN_TEAM ) {
-			texA = 0.25f; texD = 0.25f; texX = 0.75f; texY = 0;
-		}
-		else {
-			texA = 0.25f; texD = 0.25f; texX = 0.75f; texY = 0.25f;
-		}
-	}
-
-
-	if ( model && model->GetResource() != resource ) {
-		tree->FreeModel( model );	model = 0;
-	}
-	if ( weapon && weapon->GetResource() != weaponResource ) {
-		tree->FreeModel( weapon );	weapon = 0;
-	}
-
-	if ( !model && resource ) {
-		GLASSERT( resource );
-		model = tree->AllocModel( resource );
-		if ( !shadow )
-			model->SetFlag( Model::MODEL_NO_SHADOW );
-		if ( texture )
-			model->SetTexture( texture );
-		if ( texA ) {
-			model->SetTexXForm( 0, texA, texD, texX, texY );
-		}
-
-		if ( unit->IsAlive() && unit->Team() == TERRAN_TEAM ) {
-			int armor		= unit->GetInventory()->GetArmorLevel();
-			int appearance	= unit->GetValue( Unit::APPEARANCE );
-			int gender		= unit->GetValue( Unit::GENDER );
-			model->SetSkin( gender, armor, appearance );
-		}
-		GLASSERT( model );
-	}
-	if ( !weapon && weaponResource ) {
-		weapon = tree->AllocModel( weaponResource );
-		weapon->SetFlag( Model::MODEL_NO_SHADOW );
-	}
-
-	// The model checks for redundancy.
-	if ( model ) {
-		model->SetPos( unit->Pos() );
-		model->SetRotation( unit->Rotation() );
-	}
-
-	if ( weapon && model ) {
-		Matrix4 r;
-		r.SetYRotation( model->GetRotation() );
-
-		Vector4F mPos, gPos, pos4;
-
-		mPos.Set( model->Pos(), 1 );
-		gPos.Set( model->GetResource()->header.trigger, 1.0 );
-		pos4 = mPos + r*gPos;
-		weapon->SetPos( pos4.x, pos4.y, pos4.z );
-		weapon->SetRotation( model->GetRotation() );
-	}
-}
@@ -33,8 +33,7 @@ class Model;
 class ModelResource;
 class Engine;
 class Game;
-class TacMap;
-class SpaceTree;
+class ITacticalMap;
 
 
 class Unit
@@ -49,6 +48,14 @@ public:
 		STATUS_MIA
 	};
 
+	// AI behavior of a unit (see AI::Think.)
+	enum {
+		AI_NORMAL = 0x00,
+		AI_WANDER = 0x01,
+		AI_GUARD  = 0x02,
+		AI_TRAVEL = 0x04,
+	};
+
 	enum {
 		ALIEN_GREEN,
 		ALIEN_PRIME,
@@ -82,8 +89,8 @@ public:
 	float TU() const			{ return tu; }
 
 	// Do damage to this unit. Will create a Storage on the map, if the map is provided.
-	void DoDamage( const DamageDesc& damage, TacMap* map, bool playSound );
-	void Kill( TacMap* map, bool playSound );		// normally called by DoDamage
+	void DoDamage( const DamageDesc& damage, ITacticalMap* map );
+	void Kill( ITacticalMap* map );		// normally called by DoDamage
 	void UseTU( float val )		{ tu = grinliz::Max( 0.0f, tu-val ); }
 	void Leave();
 	void Heal()					{ if ( status != STATUS_NOT_INIT ) { tu = stats.TotalTU(); hp = stats.TotalHP(); status = STATUS_ALIVE; }}
@@ -189,10 +196,11 @@ public:
 	const U32 Body() const			{ return body; }
 
 	void Save( tinyxml2::XMLPrinter* printer ) const;
+	// Hash of the battle state of the unit, to check that a replay matches.
+	U32 StateHash() const;
 
 	// Loads the model. Follow with InitModel() if models needed.
 	void Load( const tinyxml2::XMLElement* doc, const ItemDefArr& arr );
-	void InitLoc(  TacMap* tacmap );
 	void Create(	int team,
 					int alienType,
 					int rank,
@@ -266,24 +274,4 @@ private:
 };
 
 
-class UnitRenderer
-{
-public:
-	UnitRenderer();
-	~UnitRenderer();
-
-	void Update( SpaceTree* tree, const Unit* unit );
-
-	const Model* GetModel() const		{ return model; }
-	const Model* GetWeapon() const		{ return weapon; }
-
-	void SetSelectable( bool selectable );
-
-private:
-	SpaceTree*  tree;
-	Model*		model;
-	Model*		weapon;
-};
-
-
 #endif // UFOATTACK_UNIT_INCLUDED
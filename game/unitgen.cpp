@@ -0,0 +1,175 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "unitgen.h"
+#include "unit.h"
+#include "item.h"
+#include "gamelimits.h"
+
+#include <string.h>
+
+using namespace grinliz;
+
+
+int UnitGen::RandomRank( grinliz::Random* random, float rank, int nRanks )
+{
+	int r = Clamp( (int)(rank+random->Uniform()*0.99f ), 0, nRanks-1 );
+	return r;
+}
+
+
+void UnitGen::GenerateAlienTeam( Unit* unit,				// target units to write
+											const int alienCount[],	// aliens per type
+											float averageRank,
+											const ItemDefArr& itemDefArr,
+											int seed )
+{
+	static const int WEAPON_RANKS = 5;
+	const char* weapon[Unit::NUM_ALIEN_TYPES][WEAPON_RANKS] = {
+		{	"RAY-1",	"RAY-1",	"RAY-2",	"RAY-2",	"RAY-3" },		// green
+		{	"RAY-1",	"RAY-2",	"RAY-2",	"RAY-3",	"PLS-3"	},		// prime
+		{	"PLS-1",	"PLS-1",	"PLS-2",	"PLS-2",	"PLS-3" },		// hornet
+		{	"STRM-1",	"STRM-1",	"STRM-2",	"STRM-2",	"STRM-3" },		// jackal
+		{	"PLS-1",	"PLS-1",	"PLS-2",	"PLS-2",	"PLS-3" },		// viper
+		{	"RAY-1",	"RAY-2",	"RAY-2",	"RAY-3",	"RAY-3"	},		// squid
+		{   "Spit-1",	"Spit-2",	"Spit-2",	"Spit-2",	"Spit-3" },		// spitter - intrinsic weapon
+		{	"", "", "", "", "" },											// crawler - can't use weapons
+	};
+
+	int nAliens = 0;
+
+	for( int i=0; i<Unit::NUM_ALIEN_TYPES; ++i ) {
+		nAliens += alienCount[i];
+	}
+	GLASSERT( nAliens <= MAX_ALIENS );
+	// local random - the same inputs always create same outputs.
+	grinliz::Random aRand( (nAliens*((int)averageRank)) ^ seed );
+	aRand.Rand();
+
+	int index=0;
+	for( int i=0; i<Unit::NUM_ALIEN_TYPES; ++i ) {
+		for( int k=0; k<alienCount[i]; ++k ) {
+			
+			// Create the unit.
+			int rank = RandomRank( &aRand, averageRank, NUM_ALIEN_RANKS );
+ 			unit[index].Create( ALIEN_TEAM, i, rank, aRand.Rand() );
+
+			// About 1/3 should be guards that aren't green or prime.
+			if (    i == Unit::ALIEN_HORNET
+				 || i == Unit::ALIEN_VIPER ) 
+			{
+				if ( (index % 3) == 0 ) {
+					unit[index].SetAI( Unit::AI_GUARD );
+				}
+			}
+
+			rank = RandomRank( &aRand, averageRank, WEAPON_RANKS );
+
+			// Add the weapon.
+			if ( *weapon[i][rank] ) {
+				Item item( itemDefArr, weapon[i][rank] );
+				unit[index].GetInventory()->AddItem( item, 0 );
+
+				// Add ammo.
+				const WeaponItemDef* weaponDef = item.GetItemDef()->IsWeapon();
+				GLASSERT( weaponDef );
+
+				for( int n=0; weaponDef->HasWeapon(n); ++n ) {
+					Item ammo( weaponDef->GetClipItemDef( n ) );
+					unit[index].GetInventory()->AddItem( ammo, 0 );
+				}
+			}
+			++index;
+		}
+	}
+}
+
+
+void UnitGen::GenerateTerranTeam(	Unit* unit,				// target units to write
+												int count,	
+												float baseRank,
+												const ItemDefArr& itemDefArr,
+												int seed )
+{
+	static const int POSITION = 4;
+	static const char* weapon[POSITION][NUM_TERRAN_RANKS] = {
+		{	"ASLT-1",	"ASLT-1",	"ASLT-2",	"ASLT-2",	"ASLT-3" },		// assault
+		{	"ASLT-1",	"ASLT-1",	"ASLT-2",	"PLS-2",	"PLS-3" },		// assault
+		{	"LR-1",		"LR-1",		"LR-2",		"LR-2",		"LR-3" },		// sniper
+		{	"MCAN-1",	"MCAN-1",	"MCAN-2",	"STRM-2",	"MCAN-3" },		// heavy
+	};
+	static const char* armorType[NUM_TERRAN_RANKS] = {
+		"ARM-1", "ARM-1", "ARM-2", "ARM-2", "ARM-3"
+	};
+	static const char* extraItems[NUM_TERRAN_RANKS] = {
+		"", "", "SG:I", "SG:K", "SG:E"
+	};
+
+	// local random - the same inputs always create same outputs.
+	grinliz::Random aRand( count ^ seed );
+	aRand.Rand();
+
+	for( int k=0; k<count; ++k ) 
+	{
+		int position = k % POSITION;
+
+		// Create the unit.
+		int rank = RandomRank( &aRand, baseRank, NUM_TERRAN_RANKS );
+		memset( &unit[k], 0, sizeof(Unit) );
+ 		unit[k].Create( TERRAN_TEAM, 0, rank, aRand.Rand() );
+
+		rank = RandomRank( &aRand, baseRank, NUM_TERRAN_RANKS );
+
+		// Add the weapon.
+		Item item( itemDefArr, weapon[position][rank] );
+		unit[k].GetInventory()->AddItem( item, 0 );
+
+		// Add ammo.
+		const WeaponItemDef* weaponDef = item.GetItemDef()->IsWeapon();
+		GLASSERT( weaponDef );
+
+		for( int n=0; weaponDef->HasWeapon(n); ++n ) {
+			Item ammo( weaponDef->GetClipItemDef( n ) );
+			unit[k].GetInventory()->AddItem( ammo, 0 );
+		}
+
+		// Add extras
+		{
+			rank = RandomRank( &aRand, baseRank, NUM_TERRAN_RANKS );
+			Item armor( itemDefArr, armorType[rank] );
+			unit[k].GetInventory()->AddItem( armor, 0 );
+		}
+		rank = RandomRank( &aRand, baseRank, NUM_TERRAN_RANKS );
+		for( int i=0; i<=rank; ++i ) {
+			Item extra( itemDefArr, extraItems[i] );
+			unit[k].GetInventory()->AddItem( extra, 0 );
+		}
+	}
+}
+
+
+void UnitGen::GenerateCivTeam( Unit* unit,				// target units to write
+										  int count,
+										  const ItemDefArr& itemDefArr,
+										  int seed )
+{
+	grinliz::Random aRand( seed );
+	aRand.Rand();
+	aRand.Rand();
+
+	for( int i=0; i<count; ++i ) {
+		unit[i].Create( CIV_TEAM, 0, 0, aRand.Rand() );
+	}
+}
@@ -0,0 +1,52 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef UFO_UNIT_GEN_INCLUDED
+#define UFO_UNIT_GEN_INCLUDED
+
+#include "../grinliz/glrandom.h"
+
+class Unit;
+class ItemDefArr;
+
+/*	Creates the units of a team: rank, stats, weapons, ammo and armor.
+	Used by the scenes that set up a battle or a base, and by the
+	TacticalSim when a crawler grows or a civ goes down to a spitter.
+	The same inputs (including the seed) always create the same units.
+*/
+class UnitGen
+{
+public:
+	static int RandomRank( grinliz::Random* random, float rank, int nRanks );
+
+	static void GenerateTerranTeam( Unit* units,				// target units to write
+									int count,
+									float averageLevel,
+									const ItemDefArr&,			// if null, will have no items
+									int seed=0 );
+
+	static void GenerateAlienTeam(	Unit* units,				// target units to write
+									const int alienCount[],		// aliens per type
+									float averageLevel,
+									const ItemDefArr&,
+									int seed=0 );
+
+	static void GenerateCivTeam(	Unit* units,				// target units to write
+									int count,
+									const ItemDefArr&,
+									int seed=0 );
+};
+
+#endif // UFO_UNIT_GEN_INCLUDED
@@ -0,0 +1,170 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "unitrenderer.h"
+#include "unit.h"
+#include "item.h"
+#include "../engine/model.h"
+#include "../engine/texture.h"
+#include "../engine/loosequadtree.h"
+
+using namespace grinliz;
+
+
+UnitRenderer::UnitRenderer() : tree( 0 ), model( 0 ), weapon( 0 )
+{
+}
+
+
+UnitRenderer::~UnitRenderer()
+{
+	GLASSERT( tree );
+	if ( model ) 
+		tree->FreeModel( model );
+	if ( weapon )
+		tree->FreeModel( weapon );
+}
+
+
+void UnitRenderer::SetSelectable( bool selectable )
+{
+	if ( model ) {
+		if ( selectable )
+			model->SetFlag( Model::MODEL_SELECTABLE );
+		else
+			model->ClearFlag( Model::MODEL_SELECTABLE );
+	}
+}
+
+
+void UnitRenderer::Update( SpaceTree* _tree, const Unit* unit, const Vector3F* pos )
+{
+	GLASSERT( _tree );
+	if ( !tree ) {
+		tree = _tree;
+	}
+	else {
+		GLASSERT( tree == _tree );
+	}
+
+	const ModelResource* resource = 0;
+	const ModelResource* weaponResource = 0;
+	ModelResourceManager* modman = ModelResourceManager::Instance();
+	Texture* texture = 0;
+	float texA = 0;
+	float texD = 0;
+	float texX = 0;
+	float texY = 0;
+	bool shadow = true;
+
+	if ( !unit->InUse() ) {
+		// Should be nothing.
+		if ( model ) {
+			tree->FreeModel( model );
+			model = 0;
+		}
+		if ( weapon ) {
+			tree->FreeModel( weapon );
+			weapon = 0;
+		}
+	}
+	else if ( unit->IsAlive() ) {
+		switch ( unit->Team() ) {
+			case TERRAN_TEAM:
+				resource = modman->GetModelResource( ( unit->Gender() == Unit::MALE ) ? "maleMarine" : "femaleMarine" );
+				break;
+
+			case CIV_TEAM:
+				resource = modman->GetModelResource( ( unit->Gender() == Unit::MALE ) ? "maleCiv" : "femaleCiv" );
+				break;
+
+			case ALIEN_TEAM:
+				resource = modman->GetModelResource( unit->AlienName() );
+				break;
+			
+			default:
+				GLASSERT( 0 );
+				break;
+		}
+		GLASSERT( resource );
+		if ( unit->GetWeapon() && unit->GetWeapon()->IsWeapon() ) {
+			weaponResource = unit->GetWeapon()->IsWeapon()->resource;
+			// For instinsic weapons (spitter alien) can be null. GLASSERT( weaponResource );
+		}
+	}
+	else {
+		resource = modman->GetModelResource( "unitplate" );
+		texture = TextureManager::Instance()->GetTexture( "particleQuad" );
+		shadow = false;
+
+		if ( unit->Team() != ALIEN_TEAM ) {
+			texA = 0.25f; texD = 0.25f; texX = 0.75f; texY = 0;
+		}
+		else {
+			texA = 0.25f; texD = 0.25f; texX = 0.75f; texY = 0.25f;
+		}
+	}
+
+
+	if ( model && model->GetResource() != resource ) {
+		tree->FreeModel( model );	model = 0;
+	}
+	if ( weapon && weapon->GetResource() != weaponResource ) {
+		tree->FreeModel( weapon );	weapon = 0;
+	}
+
+	if ( !model && resource ) {
+		GLASSERT( resource );
+		model = tree->AllocModel( resource );
+		if ( !shadow )
+			model->SetFlag( Model::MODEL_NO_SHADOW );
+		if ( texture )
+			model->SetTexture( texture );
+		if ( texA ) {
+			model->SetTexXForm( 0, texA, texD, texX, texY );
+		}
+
+		if ( unit->IsAlive() && unit->Team() == TERRAN_TEAM ) {
+			int armor		= unit->GetInventory()->GetArmorLevel();
+			int appearance	= unit->GetValue( Unit::APPEARANCE );
+			int gender		= unit->GetValue( Unit::GENDER );
+			model->SetSkin( gender, armor, appearance );
+		}
+		GLASSERT( model );
+	}
+	if ( !weapon && weaponResource ) {
+		weapon = tree->AllocModel( weaponResource );
+		weapon->SetFlag( Model::MODEL_NO_SHADOW );
+	}
+
+	// The model checks for redundancy.
+	if ( model ) {
+		model->SetPos( pos ? *pos : unit->Pos() );
+		model->SetRotation( unit->Rotation() );
+	}
+
+	if ( weapon && model ) {
+		Matrix4 r;
+		r.SetYRotation( model->GetRotation() );
+
+		Vector4F mPos, gPos, pos4;
+
+		mPos.Set( model->Pos(), 1 );
+		gPos.Set( model->GetResource()->header.trigger, 1.0 );
+		pos4 = mPos + r*gPos;
+		weapon->SetPos( pos4.x, pos4.y, pos4.z );
+		weapon->SetRotation( model->GetRotation() );
+	}
+}
@@ -0,0 +1,48 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef UFOATTACK_UNIT_RENDERER_INCLUDED
+#define UFOATTACK_UNIT_RENDERER_INCLUDED
+
+#include "../grinliz/glvector.h"
+
+class Unit;
+class Model;
+class SpaceTree;
+
+
+// The models of a unit and its weapon.
+class UnitRenderer
+{
+public:
+	UnitRenderer();
+	~UnitRenderer();
+
+	// 'pos', if set, is where to draw the unit instead of its current position.
+	void Update( SpaceTree* tree, const Unit* unit, const grinliz::Vector3F* pos=0 );
+
+	const Model* GetModel() const		{ return model; }
+	const Model* GetWeapon() const		{ return weapon; }
+
+	void SetSelectable( bool selectable );
+
+private:
+	SpaceTree*  tree;
+	Model*		model;
+	Model*		weapon;
+};
+
+
+#endif // UFOATTACK_UNIT_RENDERER_INCLUDED
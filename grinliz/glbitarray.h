@@ -25,9 +25,10 @@ distribution.
 #ifndef GRINLIZ_BITARRAY_INCLUDED
 #define GRINLIZ_BITARRAY_INCLUDED
 
-
+#include <string.h>
 #include "gltypes.h"
 #include "glrectangle.h"
+#include "glutil.h"
 
 namespace grinliz {
 
@@ -48,6 +49,7 @@ class BitArray
 	};
 
 	BitArray()					{ memset( array, 0, TOTAL_MEM ); }	
+	BitArray( const BitArray< WIDTH, HEIGHT, DEPTH >& rhs )	{ memcpy( array, rhs.array, TOTAL_MEM ); }
 
 	bool operator==( const BitArray< WIDTH, HEIGHT, DEPTH >& rhs ) const {
 		return memcmp( array, rhs.array, TOTAL_MEM ) == 0;
@@ -88,91 +90,194 @@ class BitArray
 		array[ z*PLANE32 + y*WIDTH32 + (x>>5) ] &= (~( 0x1 << ( x & 31 ) ) ); 
 	}
 	/// Clear a rectangle of bits
-	void ClearRect( const Rectangle2I& rect, int z=0 )	{
-													// FIXME: use a mask to make this more efficient.
-													for( int j=rect.min.y; j<=rect.max.y; ++j )
-														for( int i=rect.min.x; i<=rect.max.x; ++i )
-															Clear( i, j, z );
-													}
+	void ClearRect( const Rectangle2I& rect, int z=0 )
+	{
+		GLASSERT( InRange( rect, z ) );
+		for( int j=rect.min.y; j<=rect.max.y; ++j ) {
+			U32* row = Row( j, z );
+			for( int w=rect.min.x>>5; w<=rect.max.x>>5; ++w )
+				row[w] &= ~WordMask( w, rect.min.x, rect.max.x );
+		}
+	}
 	void ClearPlane( int z )						
 	{
 		GLASSERT( z >= 0 && z < DEPTH );
 		memset( &array[ z*PLANE32 ], 0, PLANE32*4 );
 	}
 
-	/// Clear a rectangle of bits in z=0.
+	/// Set a rectangle of bits.
 	void SetRect( const Rectangle2I& rect, int z=0 )	
 	{
-		for( int j=rect.min.y; j<=rect.max.y; ++j )
-			for( int i=rect.min.x; i<=rect.max.x; ++i )	
-				Set( i, j, z );
+		GLASSERT( InRange( rect, z ) );
+		for( int j=rect.min.y; j<=rect.max.y; ++j ) {
+			U32* row = Row( j, z );
+			for( int w=rect.min.x>>5; w<=rect.max.x>>5; ++w )
+				row[w] |= WordMask( w, rect.min.x, rect.max.x );
+		}
 	}
 
 
-	/// Check if a rectangle is empty in z=0.
+	/// Check if a rectangle is empty.
 	bool IsRectEmpty( const Rectangle2I& rect, int z=0 ) const 
 	{
-		for( int j=rect.min.y; j<=rect.max.y; ++j )
-			for( int i=rect.min.x; i<=rect.max.x; ++i )
-				if ( IsSet( i, j, z ) )
+		GLASSERT( InRange( rect, z ) );
+		for( int j=rect.min.y; j<=rect.max.y; ++j ) {
+			const U32* row = Row( j, z );
+			for( int w=rect.min.x>>5; w<=rect.max.x>>5; ++w )
+				if ( row[w] & WordMask( w, rect.min.x, rect.max.x ) )
 					return false;
+		}
 		return true;
 	}
 
-	/// Check if a rectangle is empty in z=0.
+	/// Check if a rectangle is empty.
 	bool IsRectEmpty( const Rectangle3I& rect ) const 
 	{
+		Rectangle2I r2;
+		r2.Set( rect.min.x, rect.min.y, rect.max.x, rect.max.y );
 		for( int k=rect.min.z; k<=rect.max.z; ++k )
-			for( int j=rect.min.y; j<=rect.max.y; ++j )
-				for( int i=rect.min.x; i<=rect.max.x; ++i )
-					if ( IsSet( i, j, k ) )
-						return false;
+			if ( !IsRectEmpty( r2, k ) )
+				return false;
 		return true;
 	}
-	/// Check if a rectangle is completely set in z=0.
+	/// Check if a rectangle is completely set.
 	bool IsRectSet( const Rectangle2I& rect, int z=0 ) const 
 	{
-		// FIXME: use a mask to make this more efficient.
-		for( int j=rect.min.y; j<=rect.max.y; ++j )
-			for( int i=rect.min.x; i<=rect.max.x; ++i )
-				if ( !IsSet( i, j, z ) )
+		GLASSERT( InRange( rect, z ) );
+		for( int j=rect.min.y; j<=rect.max.y; ++j ) {
+			const U32* row = Row( j, z );
+			for( int w=rect.min.x>>5; w<=rect.max.x>>5; ++w ) {
+				U32 mask = WordMask( w, rect.min.x, rect.max.x );
+				if ( ( row[w] & mask ) != mask )
 					return false;
+			}
+		}
 		return true;
 	}
 
-	/// Check if a rectangle is completely set in z=0.
+	/// Check if a rectangle is completely set.
 	bool IsRectSet( const Rectangle3I& rect ) const 
 	{
+		Rectangle2I r2;
+		r2.Set( rect.min.x, rect.min.y, rect.max.x, rect.max.y );
 		for( int k=rect.min.z; k<=rect.max.z; ++k )
-			for( int j=rect.min.y; j<=rect.max.y; ++j )
-				for( int i=rect.min.x; i<=rect.max.x; ++i )
-					if ( !IsSet( i, j, k ) )
-						return false;
+			if ( !IsRectSet( r2, k ) )
+				return false;
+		return true;
+	}
+
+	/// Number of bits set in a rectangle.
+	int NumSet( const Rectangle2I& rect, int z=0 ) const 
+	{
+		GLASSERT( InRange( rect, z ) );
+		int count = 0;
+		for( int j=rect.min.y; j<=rect.max.y; ++j ) {
+			const U32* row = Row( j, z );
+			for( int w=rect.min.x>>5; w<=rect.max.x>>5; ++w )
+				count += PopCount( row[w] & WordMask( w, rect.min.x, rect.max.x ) );
+		}
+		return count;
 	}
 
 	int NumSet( const Rectangle3I& rect ) const 
 	{
+		Rectangle2I r2;
+		r2.Set( rect.min.x, rect.min.y, rect.max.x, rect.max.y );
 		int count = 0;
 		for( int k=rect.min.z; k<=rect.max.z; ++k )
-			for( int j=rect.min.y; j<=rect.max.y; ++j )
-				for( int i=rect.min.x; i<=rect.max.x; ++i )
-					if ( IsSet( i, j, k ) )
-						++count;
+			count += NumSet( r2, k );
+		return count;
+	}
+
+	/// Number of bits set in the whole array.
+	int NumSet() const
+	{
+		int count = 0;
+		for( int i=0; i<TOTAL_MEM32; ++i )
+			count += PopCount( array[i] );
 		return count;
 	}
 
+	/// True if no bits are set.
+	bool IsEmpty() const
+	{
+		for( int i=0; i<TOTAL_MEM32; ++i )
+			if ( array[i] )
+				return false;
+		return true;
+	}
+
+	/// this |= rhs
 	void DoUnion( const BitArray< WIDTH, HEIGHT, DEPTH >& rhs ) {
 		for( int i=0; i<TOTAL_MEM32; ++i ) {
 			array[i] |= rhs.array[i];
 		}
 	}
+	/// this &= rhs
+	void DoIntersection( const BitArray< WIDTH, HEIGHT, DEPTH >& rhs ) {
+		for( int i=0; i<TOTAL_MEM32; ++i ) {
+			array[i] &= rhs.array[i];
+		}
+	}
+	/// this &= ~rhs
+	void DoSubtract( const BitArray< WIDTH, HEIGHT, DEPTH >& rhs ) {
+		for( int i=0; i<TOTAL_MEM32; ++i ) {
+			array[i] &= ~rhs.array[i];
+		}
+	}
+	/// this ^= rhs. Leaves the bits that differ.
+	void DoXor( const BitArray< WIDTH, HEIGHT, DEPTH >& rhs ) {
+		for( int i=0; i<TOTAL_MEM32; ++i ) {
+			array[i] ^= rhs.array[i];
+		}
+	}
+
+	/**	Walks the set bits of one plane in row order, a word at a time:
+		for( BitArray<W,H,D>::Iterator it( bits ); !it.Done(); it.Next() ) { it.X(), it.Y() }
+		The array can't change while it is walked.
+	*/
+	class Iterator
+	{
+	public:
+		Iterator( const BitArray< WIDTH, HEIGHT, DEPTH >& bits, int z=0 ) : words( bits.Plane( z ) ), index( -1 ), word( 0 ), bit( 0 )	{ Next(); }
+
+		bool Done() const	{ return index >= PLANE32; }
+		int X() const		{ GLASSERT( !Done() ); return ( index % WIDTH32 )*32 + bit; }
+		int Y() const		{ GLASSERT( !Done() ); return index / WIDTH32; }
+
+		void Next() {
+			while ( !word ) {
+				if ( ++index >= PLANE32 )
+					return;
+				word = words[index];
+			}
+			bit = CountTrailingZeros( word );
+			word &= word - 1;
+		}
+
+	private:
+		const U32* words;
+		int index;
+		U32 word;		// bits of words[index] not yet returned
+		int bit;
+	};
 
 	/// Clear all the bits.
 	void ClearAll()				{ memset( array, 0, TOTAL_MEM ); }
 	/// Set all the bits.
-	void SetAll()				{ memset( array, 0xff, TOTAL_MEM ); }
+	void SetAll()
+	{
+		memset( array, 0xff, TOTAL_MEM );
+		// Keep the bits past WIDTH clear, so they aren't counted or walked.
+		if ( WIDTH & 31 ) {
+			for( int i=WIDTH32-1; i<TOTAL_MEM32; i+=WIDTH32 )
+				array[i] = 0xffffffff >> ( 32 - ( WIDTH & 31 ) );
+		}
+	}
 
 	U32 Access32( int x, int y, int z ) { return array[ z*PLANE32 + y*WIDTH32 + (x>>5) ]; }
+	/// The PLANE32 words of plane 'z'.
+	const U32* Plane( int z ) const		{ return array + z*PLANE32; }
 
 	// 0xffffffff
 	enum { STRING_SIZE = TOTAL_MEM32*8 + 1 };
@@ -210,6 +315,25 @@ class BitArray
 	}
 
 private:
+	U32* Row( int y, int z )				{ return array + z*PLANE32 + y*WIDTH32; }
+	const U32* Row( int y, int z ) const	{ return array + z*PLANE32 + y*WIDTH32; }
+
+	// The bits of word 'w' of a row that are in [x0,x1].
+	static U32 WordMask( int w, int x0, int x1 ) {
+		int lo = x0 - w*32;
+		int hi = x1 - w*32;
+		U32 mask = 0xffffffff;
+		if ( lo > 0 )	mask &= 0xffffffff << lo;
+		if ( hi < 31 )	mask &= 0xffffffff >> ( 31-hi );
+		return mask;
+	}
+
+	static bool InRange( const Rectangle2I& rect, int z ) {
+		return    rect.min.x >= 0 && rect.max.x < WIDTH
+			   && rect.min.y >= 0 && rect.max.y < HEIGHT
+			   && z >= 0 && z < DEPTH;
+	}
+
 	U32 array[ TOTAL_MEM32 ];
 };
 
@@ -0,0 +1,216 @@
+/*
+Copyright (c) 2000-2010 Lee Thomason (www.grinninglizard.com)
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+/*	Checks the word-at-a-time operations of BitArray against a bit-at-a-time
+	reference. A stand alone program, not part of the game build:
+		g++ -DDEBUG -I.. glbitarraytest.cpp gldebug.cpp glrandom.cpp -o glbitarraytest
+	Returns 0 if all the checks pass.
+*/
+
+#include <stdio.h>
+#include "glbitarray.h"
+#include "glrandom.h"
+
+using namespace grinliz;
+
+static int nCheck = 0;
+static int nFail = 0;
+
+#define CHECK( x )	{ ++nCheck; if ( !(x) ) { ++nFail; printf( "FAIL %s:%d %s\n", __FILE__, __LINE__, #x ); } }
+
+
+template< int W, int H, int D >
+static int RefCount( const BitArray< W, H, D >& bits, const Rectangle2I& r, int z )
+{
+	int count = 0;
+	for( int j=r.min.y; j<=r.max.y; ++j )
+		for( int i=r.min.x; i<=r.max.x; ++i )
+			if ( bits.IsSet( i, j, z ) )
+				++count;
+	return count;
+}
+
+
+template< int W, int H, int D >
+static void RandomBits( BitArray< W, H, D >* bits, Random* random )
+{
+	bits->ClearAll();
+	for( int k=0; k<D; ++k )
+		for( int j=0; j<H; ++j )
+			for( int i=0; i<W; ++i )
+				if ( random->Rand( 3 ) == 0 )
+					bits->Set( i, j, k );
+}
+
+
+template< int W, int H, int D >
+static void CheckRects( Random* random )
+{
+	BitArray< W, H, D > bits, ref;
+
+	for( int trial=0; trial<200; ++trial ) {
+		// Rectangles that start and end at, and next to, the word edges.
+		static const int edge[] = { 0, 1, 30, 31, 32, 33, 63, 64, 65 };
+		Rectangle2I r;
+		int x0 = ( trial & 1 ) ? edge[ random->Rand( 9 ) ] : random->Rand( W );
+		int x1 = ( trial & 2 ) ? edge[ random->Rand( 9 ) ] : random->Rand( W );
+		x0 = Min( x0, W-1 );	x1 = Min( x1, W-1 );
+		int y0 = random->Rand( H );
+		int y1 = random->Rand( H );
+		r.Set( Min( x0, x1 ), Min( y0, y1 ), Max( x0, x1 ), Max( y0, y1 ) );
+		int z = random->Rand( D );
+
+		RandomBits( &bits, random );
+		CHECK( bits.NumSet( r, z ) == RefCount( bits, r, z ) );
+		CHECK( bits.IsRectEmpty( r, z ) == ( RefCount( bits, r, z ) == 0 ) );
+		CHECK( bits.IsRectSet( r, z ) == ( RefCount( bits, r, z ) == r.Area() ) );
+
+		// SetRect changes only the rectangle.
+		ref = bits;
+		bits.SetRect( r, z );
+		CHECK( bits.IsRectSet( r, z ) );
+		CHECK( bits.NumSet( r, z ) == r.Area() );
+		CHECK( bits.NumSet() == ref.NumSet() + r.Area() - RefCount( ref, r, z ) );
+
+		// ClearRect likewise.
+		bits.ClearRect( r, z );
+		CHECK( bits.IsRectEmpty( r, z ) );
+		CHECK( bits.NumSet() == ref.NumSet() - RefCount( ref, r, z ) );
+	}
+}
+
+
+template< int W, int H, int D >
+static void CheckOps( Random* random )
+{
+	BitArray< W, H, D > a, b;
+	for( int trial=0; trial<20; ++trial ) {
+		RandomBits( &a, random );
+		RandomBits( &b, random );
+
+		int nA = 0, nB = 0, nAnd = 0, nOr = 0, nXor = 0, nSub = 0;
+		for( int k=0; k<D; ++k ) {
+			for( int j=0; j<H; ++j ) {
+				for( int i=0; i<W; ++i ) {
+					bool sa = a.IsSet( i, j, k ) != 0;
+					bool sb = b.IsSet( i, j, k ) != 0;
+					nA += sa;
+					nB += sb;
+					nAnd += sa && sb;
+					nOr += sa || sb;
+					nXor += sa != sb;
+					nSub += sa && !sb;
+				}
+			}
+		}
+		CHECK( a.NumSet() == nA );
+		CHECK( b.NumSet() == nB );
+
+		// The copy constructor copies.
+		BitArray< W, H, D > c( a );
+		CHECK( c == a );
+
+		c.DoUnion( b );			CHECK( c.NumSet() == nOr );
+		c = a;	c.DoIntersection( b );	CHECK( c.NumSet() == nAnd );
+		c = a;	c.DoSubtract( b );		CHECK( c.NumSet() == nSub );
+		c = a;	c.DoXor( b );			CHECK( c.NumSet() == nXor );
+		c.DoXor( c );			CHECK( c.IsEmpty() );
+	}
+}
+
+
+template< int W, int H, int D >
+static void CheckIterator( Random* random )
+{
+	BitArray< W, H, D > bits;
+	for( int trial=0; trial<20; ++trial ) {
+		RandomBits( &bits, random );
+		for( int z=0; z<D; ++z ) {
+			// Every set bit, in row order, once.
+			int n = 0;
+			int prev = -1;
+			bool inOrder = true;
+			bool allSet = true;
+			for( typename BitArray< W, H, D >::Iterator it( bits, z ); !it.Done(); it.Next() ) {
+				int index = it.Y()*W + it.X();
+				inOrder = inOrder && index > prev;
+				allSet = allSet && it.X() < W && it.Y() < H && bits.IsSet( it.X(), it.Y(), z );
+				prev = index;
+				++n;
+			}
+			Rectangle2I all;
+			all.Set( 0, 0, W-1, H-1 );
+			CHECK( inOrder );
+			CHECK( allSet );
+			CHECK( n == bits.NumSet( all, z ) );
+		}
+	}
+	bits.ClearAll();
+	typename BitArray< W, H, D >::Iterator empty( bits );
+	CHECK( empty.Done() );
+}
+
+
+template< int W, int H, int D >
+static void CheckSetAll()
+{
+	BitArray< W, H, D > bits;
+	bits.SetAll();
+	// The padding bits past WIDTH stay clear: they aren't counted or walked.
+	CHECK( bits.NumSet() == W*H*D );
+
+	int n = 0;
+	for( typename BitArray< W, H, D >::Iterator it( bits, D-1 ); !it.Done(); it.Next() ) {
+		CHECK( it.X() < W );
+		++n;
+	}
+	CHECK( n == W*H );
+
+	Rectangle3I all;
+	all.Set( 0, 0, 0, W-1, H-1, D-1 );
+	CHECK( bits.IsRectSet( all ) );
+	CHECK( bits.NumSet( all ) == W*H*D );
+}
+
+
+int main( int argc, const char* argv[] )
+{
+	Random random( 1 );
+
+	CheckRects< 70, 5, 2 >( &random );
+	CheckRects< 64, 4, 1 >( &random );
+	CheckRects< 7, 3, 1 >( &random );
+
+	CheckOps< 70, 5, 2 >( &random );
+	CheckOps< 32, 3, 1 >( &random );
+
+	CheckIterator< 70, 5, 2 >( &random );
+	CheckIterator< 96, 2, 1 >( &random );
+
+	CheckSetAll< 70, 5, 2 >();
+	CheckSetAll< 64, 4, 1 >();
+	CheckSetAll< 33, 1, 1 >();
+
+	printf( "BitArray: %d checks, %d failed.\n", nCheck, nFail );
+	return nFail ? 1 : 0;
+}
@@ -186,10 +186,10 @@ void Random::NormalVector( float* v, int dim )
 // public domain.
 //
 
-/*static*/ U32 Random::Hash( const void* data, U32 len )
+/*static*/ U32 Random::Hash( const void* data, U32 len, U32 seed )
 {
 	const unsigned char *p = (const unsigned char *)(data);
-	unsigned int h = 2166136261U;
+	unsigned int h = seed;
 
 	for( U32 i=0; i<len; ++i, ++p ) {
 		h ^= *p;
@@ -125,8 +125,9 @@ class Random
 	void NormalVector2D( float* v );
 	void NormalVector3D( float* v );
 
-	/// Fast hash
-	static U32 Hash( const void* data, U32 len );
+	static const U32 HASH_SEED = 2166136261U;
+	/// Fast hash. Pass the result of a previous Hash() as the 'seed' to continue it.
+	static U32 Hash( const void* data, U32 len, U32 seed = HASH_SEED );
 
 private:
 	U32 x, y, z, c, lowCount;
@@ -0,0 +1,205 @@
+/*
+Copyright (c) 2000-2010 Lee Thomason (www.grinninglizard.com)
+Grinning Lizard Utilities.
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+#include "glthread.h"
+
+#if defined( _WIN32 )
+#	define WIN32_LEAN_AND_MEAN
+#	include <windows.h>
+#else
+#	include <pthread.h>
+#endif
+
+using namespace grinliz;
+
+
+#if defined( _WIN32 )
+
+Mutex::Mutex()
+{
+	CRITICAL_SECTION* cs = new CRITICAL_SECTION;
+	InitializeCriticalSection( cs );
+	handle = cs;
+}
+
+
+Mutex::~Mutex()
+{
+	CRITICAL_SECTION* cs = (CRITICAL_SECTION*)handle;
+	DeleteCriticalSection( cs );
+	delete cs;
+}
+
+
+void Mutex::Lock()		{ EnterCriticalSection( (CRITICAL_SECTION*)handle ); }
+void Mutex::Unlock()	{ LeaveCriticalSection( (CRITICAL_SECTION*)handle ); }
+
+
+Signal::Signal()
+{
+	// Auto-reset: a wait takes the signal.
+	handle = CreateEvent( 0, FALSE, FALSE, 0 );
+	GLASSERT( handle );
+}
+
+
+Signal::~Signal()		{ CloseHandle( (HANDLE)handle ); }
+void Signal::Set()		{ SetEvent( (HANDLE)handle ); }
+void Signal::Wait()		{ WaitForSingleObject( (HANDLE)handle, INFINITE ); }
+
+
+namespace grinliz {
+struct ThreadEntry {
+	static DWORD WINAPI Func( LPVOID param )	{ Thread::Run( (Thread*)param ); return 0; }
+};
+};
+
+
+bool Thread::Start( Function _func, void* _data )
+{
+	GLASSERT( !handle );
+	func = _func;
+	data = _data;
+	handle = CreateThread( 0, 0, ThreadEntry::Func, this, 0, 0 );
+	return handle != 0;
+}
+
+
+void Thread::Join()
+{
+	if ( handle ) {
+		WaitForSingleObject( (HANDLE)handle, INFINITE );
+		CloseHandle( (HANDLE)handle );
+		handle = 0;
+	}
+}
+
+#else
+
+Mutex::Mutex()
+{
+	pthread_mutex_t* mutex = new pthread_mutex_t;
+	pthread_mutex_init( mutex, 0 );
+	handle = mutex;
+}
+
+
+Mutex::~Mutex()
+{
+	pthread_mutex_t* mutex = (pthread_mutex_t*)handle;
+	pthread_mutex_destroy( mutex );
+	delete mutex;
+}
+
+
+void Mutex::Lock()		{ pthread_mutex_lock( (pthread_mutex_t*)handle ); }
+void Mutex::Unlock()	{ pthread_mutex_unlock( (pthread_mutex_t*)handle ); }
+
+
+struct SignalData {
+	pthread_mutex_t mutex;
+	pthread_cond_t	cond;
+	bool			set;
+};
+
+
+Signal::Signal()
+{
+	SignalData* s = new SignalData;
+	pthread_mutex_init( &s->mutex, 0 );
+	pthread_cond_init( &s->cond, 0 );
+	s->set = false;
+	handle = s;
+}
+
+
+Signal::~Signal()
+{
+	SignalData* s = (SignalData*)handle;
+	pthread_cond_destroy( &s->cond );
+	pthread_mutex_destroy( &s->mutex );
+	delete s;
+}
+
+
+void Signal::Set()
+{
+	SignalData* s = (SignalData*)handle;
+	pthread_mutex_lock( &s->mutex );
+	s->set = true;
+	pthread_cond_signal( &s->cond );
+	pthread_mutex_unlock( &s->mutex );
+}
+
+
+void Signal::Wait()
+{
+	SignalData* s = (SignalData*)handle;
+	pthread_mutex_lock( &s->mutex );
+	while ( !s->set ) {
+		pthread_cond_wait( &s->cond, &s->mutex );
+	}
+	s->set = false;
+	pthread_mutex_unlock( &s->mutex );
+}
+
+
+namespace grinliz {
+struct ThreadEntry {
+	static void* Func( void* param )	{ Thread::Run( (Thread*)param ); return 0; }
+};
+};
+
+
+bool Thread::Start( Function _func, void* _data )
+{
+	GLASSERT( !handle );
+	func = _func;
+	data = _data;
+	pthread_t* thread = new pthread_t;
+	if ( pthread_create( thread, 0, ThreadEntry::Func, this ) != 0 ) {
+		delete thread;
+		return false;
+	}
+	handle = thread;
+	return true;
+}
+
+
+void Thread::Join()
+{
+	if ( handle ) {
+		pthread_t* thread = (pthread_t*)handle;
+		pthread_join( *thread, 0 );
+		delete thread;
+		handle = 0;
+	}
+}
+
+#endif
+
+
+Thread::Thread() : func( 0 ), data( 0 ), handle( 0 )
+{
+}
@@ -0,0 +1,118 @@
+/*
+Copyright (c) 2000-2010 Lee Thomason (www.grinninglizard.com)
+Grinning Lizard Utilities.
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+#ifndef GRINLIZ_THREAD_INCLUDED
+#define GRINLIZ_THREAD_INCLUDED
+
+#include "gldebug.h"
+
+namespace grinliz
+{
+
+/*	Minimal threading: a mutex, a signal, and a thread to join. Win32 threads
+	on Windows, pthreads everywhere else (Android, iPhone, Mac, Linux.) The
+	platform objects are allocated in the constructors so the system headers
+	stay out of this one.
+*/
+class Mutex
+{
+public:
+	Mutex();
+	~Mutex();
+
+	void Lock();
+	void Unlock();
+
+private:
+	Mutex( const Mutex& );			// not supported
+	void operator=( const Mutex& );	// not supported
+
+	void* handle;
+};
+
+
+// Locks the mutex for the scope of the MutexLock.
+class MutexLock
+{
+public:
+	MutexLock( Mutex* _mutex ) : mutex( _mutex )	{ mutex->Lock(); }
+	~MutexLock()									{ mutex->Unlock(); }
+
+private:
+	MutexLock( const MutexLock& );		// not supported
+	void operator=( const MutexLock& );	// not supported
+
+	Mutex* mutex;
+};
+
+
+/*	A flag one thread waits on and another sets. It stays set until a Wait()
+	takes it, so a Set() before the Wait() isn't lost. Wakes one waiter.
+*/
+class Signal
+{
+public:
+	Signal();
+	~Signal();
+
+	void Set();
+	void Wait();
+
+private:
+	Signal( const Signal& );			// not supported
+	void operator=( const Signal& );	// not supported
+
+	void* handle;
+};
+
+
+class Thread
+{
+public:
+	typedef void (*Function)( void* data );
+
+	Thread();
+	~Thread()						{ GLASSERT( !handle ); }
+
+	// Runs func(data) on a new thread. Returns false if it couldn't be created.
+	bool Start( Function func, void* data );
+	// Waits for the thread function to return.
+	void Join();
+	bool Started() const			{ return handle != 0; }
+
+private:
+	Thread( const Thread& );			// not supported
+	void operator=( const Thread& );	// not supported
+
+	static void Run( Thread* thread )	{ thread->func( thread->data ); }
+	friend struct ThreadEntry;
+
+	Function func;
+	void* data;
+	void* handle;
+};
+
+};	// namespace grinliz
+
+#endif
@@ -37,6 +37,10 @@ distribution.
 #include "gldebug.h"
 #include "gltypes.h"
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 namespace grinliz {
 
 /// Minimum
@@ -99,6 +103,38 @@ inline bool IsPowerOf2( U32 x )
 	return x == CeilPowerOf2( x );
 }
 
+/// Index of the lowest set bit. 'v' can not be 0.
+inline int CountTrailingZeros( U32 v )
+{
+	GLASSERT( v );
+	#if defined (__GNUC__)
+		return __builtin_ctz( v );
+	#elif defined (_MSC_VER)
+		unsigned long index;
+		_BitScanForward( &index, v );
+		return (int)index;
+	#else
+		int n = 0;
+		while ( (v & 1) == 0 ) {
+			v >>= 1;
+			++n;
+		}
+		return n;
+	#endif
+}
+
+/// Number of set bits.
+inline int PopCount( U32 v )
+{
+	#if defined (__GNUC__)
+		return __builtin_popcount( v );
+	#else
+		v = v - ( ( v >> 1 ) & 0x55555555 );
+		v = ( v & 0x33333333 ) + ( ( v >> 2 ) & 0x33333333 );
+		return (int)( ( ( ( v + ( v >> 4 ) ) & 0x0F0F0F0F ) * 0x01010101 ) >> 24 );
+	#endif
+}
+
 /// Linear interpolation.
 template <class A, class B> inline B Interpolate( A x0, B q0, A x1, B q1, A x )
 {
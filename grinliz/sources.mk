@@ -8,6 +8,7 @@ sources :=  glcontainer.cpp \
 			glprime.cpp \
 			glrandom.cpp \
 			glstringutil.cpp \
+			glthread.cpp \
 			glutil.cpp \
 			glvector.cpp \
 			
@@ -427,6 +427,21 @@ PathNode* PathNodePool::GetPathNode( unsigned frame, void* _state, float _costFr
 }
 
 
+PathNode* PathNodePool::FetchPathNode( void* state )
+{
+	unsigned key = Hash( state );
+
+	PathNode* root = hashTable[key];
+	while( root ) {
+		if ( root->state == state ) {
+			break;
+		}
+		root = ( state < root->state ) ? root->child[0] : root->child[1];
+	}
+	return root;
+}
+
+
 void PathNode::Init(	unsigned _frame,
 						void* _state,
 						float _costFromStart, 
@@ -464,6 +479,17 @@ void MicroPather::Reset()
 }
 
 
+void MicroPather::StateCostChange( void* state )
+{
+	PathNode* node = pathNodePool.FetchPathNode( state );
+	if ( node ) {
+		// The cache entries are abandoned, not freed. Reset() reclaims them.
+		node->numAdjacent = -1;
+		node->cacheIndex = -1;
+	}
+}
+
+
 void MicroPather::GoalReached( PathNode* node, void* start, void* end, MP_VECTOR< void* > *_path )
 {
 	MP_VECTOR< void* >& path = *_path;
@@ -295,6 +295,9 @@ namespace micropather
 									float _estToGoal, 
 									PathNode* _parent );
 
+		// Get the PathNode associated with this state, if there is one. Does not allocate.
+		PathNode* FetchPathNode( void* state );
+
 		// Store stuff in cache
 		bool PushCache( const NodeCost* nodes, int nNodes, int* start );
 
@@ -410,6 +413,12 @@ namespace micropather
 		*/
 		void Reset();
 
+		/** Should be called when the cost from a state to its neighbors changes, and called
+			for each neighbor as well. Cheaper than a Reset() when few states change: only
+			the cached neighbors of 'state' are thrown away.
+		*/
+		void StateCostChange( void* state );
+
 		/**
 			Return the "checksum" of the last path returned by Solve(). Useful for debugging,
 			and a quick way to see if 2 paths are the same.
@@ -31,11 +31,38 @@
 #	include "../zlib/zlib.h"
 #endif
 
+#if defined( _WIN32 )
+#	define WIN32_LEAN_AND_MEAN
+#	include <windows.h>
+#	include <io.h>
+#else
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
+
 #ifdef _MSC_VER
 #pragma warning ( disable : 4996 )
 #endif
 using namespace gamedb;
 
+namespace gamedb
+{
+// An entry in the Reader's data cache. The data (null terminated) follows the struct.
+struct CacheEntry
+{
+	const Reader* reader;
+	int dataID;
+	int size;
+	int refCount;
+	CacheEntry* prev;
+	CacheEntry* next;
+
+	U8* Data()	{ return (U8*)(this+1); }
+};
+};
+
 struct CompStringID
 {
 	const char* key;
@@ -147,14 +174,21 @@ Reader::Reader()
 	memSize = 0;
 	fp = 0;
 	mod = 0;
+	mapMem = 0;
+	mapSize = 0;
 
 	// Add to linked list.
 	next = readerRoot;
 	readerRoot = this;
-	buffer = 0;
-	bufferSize = 0;
 	access = 0;
 	accessSize = 0;
+
+	cacheHead = 0;
+	cacheTail = 0;
+	cacheBytes = 0;
+	cacheHits = 0;
+	cacheMisses = 0;
+	cacheSize = DEFAULT_CACHE_SIZE;
 }
 
 
@@ -176,10 +210,20 @@ Reader::~Reader()
 		readerRoot = r->next;
 	}
 
-	if ( mem )
+	if ( cacheHits || cacheMisses ) {
+		GLOUTPUT(( "Reader %d data cache: hits=%d misses=%d bytes=%d\n", databaseID, cacheHits, cacheMisses, cacheBytes ));
+	}
+	while ( cacheHead ) {
+		CacheEntry* e = cacheHead;
+		GLASSERT( e->refCount == 0 );	// a DataHandle outlived the Reader
+		CacheUnlink( e );
+		free( e );
+	}
+
+	if ( mapMem )
+		UnmapFile( mapMem, mapSize );
+	else if ( mem )
 		free( mem );
-	if ( buffer )
-		free( buffer );
 	if ( access )
 		free( access );
 	if ( fp ) {
@@ -188,28 +232,94 @@ Reader::~Reader()
 }
 
 
+/*static*/ void* Reader::MapFile( const char* filename, int* size )
+{
+	void* result = 0;
+	*size = 0;
+#if defined( _WIN32 )
+	HANDLE file = CreateFileA( filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0 );
+	if ( file != INVALID_HANDLE_VALUE ) {
+		DWORD fileSize = GetFileSize( file, 0 );
+		HANDLE mapping = ( fileSize && fileSize != INVALID_FILE_SIZE ) ? CreateFileMapping( file, 0, PAGE_READONLY, 0, 0, 0 ) : 0;
+		if ( mapping ) {
+			result = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+			*size = (int)fileSize;
+			CloseHandle( mapping );		// the view keeps the mapping
+		}
+		CloseHandle( file );
+	}
+#else
+	int fd = open( filename, O_RDONLY );
+	if ( fd >= 0 ) {
+		struct stat st;
+		if ( fstat( fd, &st ) == 0 && st.st_size > 0 ) {
+			void* m = mmap( 0, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+			if ( m != MAP_FAILED ) {
+				result = m;
+				*size = (int)st.st_size;
+			}
+		}
+		close( fd );	// the map keeps the file
+	}
+#endif
+	if ( !result )
+		*size = 0;
+	return result;
+}
+
+
+/*static*/ void Reader::UnmapFile( void* m, int size )
+{
+#if defined( _WIN32 )
+	UnmapViewOfFile( m );
+#else
+	munmap( m, size );
+#endif
+}
+
+
 bool Reader::Init( int id, const char* filename, int _offset )
 {
 	databaseID = id;
-	fp = fopen( filename, "rb" );
-	if ( !fp )
-		return false;
-
 	offset = _offset;
-	fseek( fp, 0, SEEK_END );
-	int dbSize = (int)ftell( fp ) - (int)offset;
-	fseek( fp, offset, SEEK_SET );
 
-	// Read in the data structers. Leave the "data" compressed and in the file.
+	// Map the file if we can. The structures are used in place (so the
+	// offset has to keep them aligned) and the data read from the map.
 	HeaderStruct header;
-	int size = fread( &header, sizeof(header), 1, fp );
-	if ( size != 1 ) {
-		GLOUTPUT(( "CORRUPT DATABASE\n" ));
-		fclose( fp );
-		return false;
+	int dbSize = 0;
+	if ( offset % 4 == 0 ) {
+		mapMem = MapFile( filename, &mapSize );
+	}
+	if ( mapMem ) {
+		dbSize = mapSize - offset;
+		if ( dbSize < (int)sizeof(header) ) {
+			GLOUTPUT(( "CORRUPT DATABASE\n" ));
+			UnmapFile( mapMem, mapSize );
+			mapMem = 0;
+			return false;
+		}
+		memcpy( &header, (const char*)mapMem + offset, sizeof(header) );
+	}
+	else {
+		fp = fopen( filename, "rb" );
+		if ( !fp )
+			return false;
+
+		fseek( fp, 0, SEEK_END );
+		dbSize = (int)ftell( fp ) - (int)offset;
+		fseek( fp, offset, SEEK_SET );
+
+		// Read in the data structers. Leave the "data" compressed and in the file.
+		int size = fread( &header, sizeof(header), 1, fp );
+		if ( size != 1 ) {
+			GLOUTPUT(( "CORRUPT DATABASE\n" ));
+			fclose( fp );
+			fp = 0;
+			return false;
+		}
+		fseek( fp, offset, SEEK_SET );
 	}
 
-	fseek( fp, offset, SEEK_SET );
 	memSize = header.offsetToData;
 
 	// FIXME: Should add a checksum...
@@ -218,16 +328,28 @@ bool Reader::Init( int id, const char* filename, int _offset )
 		 || memSize > dbSize ) 
 	{
 		GLOUTPUT(( "CORRUPT DATABASE\n" ));
-		fclose( fp );
+		if ( mapMem ) {
+			UnmapFile( mapMem, mapSize );
+			mapMem = 0;
+		}
+		if ( fp ) {
+			fclose( fp );
+			fp = 0;
+		}
 		return false;
 	}
 
-	mem = malloc( memSize );
+	if ( mapMem ) {
+		GLOUTPUT(( "Mapping '%s' from offset=%d\n", filename, offset ));
+		mem = (char*)mapMem + offset;
+	}
+	else {
+		GLOUTPUT(( "Reading '%s' from offset=%d\n", filename, offset ));
+		mem = malloc( memSize );
+		fread( mem, memSize, 1, fp );
+	}
 	endMem = (const char*)mem + memSize;
 
-	GLOUTPUT(( "Reading '%s' from offset=%d\n", filename, offset ));
-	fread( mem, memSize, 1, fp );
-
 	root = (const Item*)( (U8*)mem + header.offsetToItems );
 
 #if 0		// Dump string pool
@@ -320,7 +442,7 @@ int Reader::GetStringID( const char* str ) const
 }
 
 
-int Reader::GetDataSize( int dataID ) const
+const DataDescStruct& Reader::DataDesc( int dataID ) const
 {
 	const HeaderStruct* header = (const HeaderStruct*)mem;
 	GLASSERT( header->offsetToDataDesc % 4 == 0 );
@@ -328,51 +450,93 @@ int Reader::GetDataSize( int dataID ) const
 	const DataDescStruct* dataDesc = (const DataDescStruct*)((const U8*)mem + header->offsetToDataDesc);
 	GLASSERT( dataID >= 0 && dataID < (int)header->nData );
 
-	return dataDesc[dataID].size;
+	return dataDesc[dataID];
+}
+
+
+int Reader::GetDataSize( int dataID ) const
+{
+	return DataDesc( dataID ).size;
 }
 
 
 void Reader::GetData( int dataID, void* target, int memSize ) const
 {
-	const HeaderStruct* header = (const HeaderStruct*)mem;
-	GLASSERT( header->offsetToDataDesc % 4 == 0 );
+	const DataDescStruct& dataDesc = DataDesc( dataID );
 
-	const DataDescStruct* dataDescPtr = (const DataDescStruct*)((const U8*)mem + header->offsetToDataDesc);
-	GLASSERT( dataID >= 0 && dataID < (int)header->nData );
-	const DataDescStruct& dataDesc = dataDescPtr[dataID];
-	
-	fseek( fp, offset+dataDesc.offset, SEEK_SET );
+	if ( mapMem ) {
+		// Straight from the map: no read, and no buffer for the compressed data.
+		const U8* src = (const U8*)mapMem + offset + dataDesc.offset;
+		GLASSERT( offset + dataDesc.offset + dataDesc.compressedSize <= (U32)mapSize );
+		GLASSERT( dataDesc.size == (U32)memSize );
+
+		if ( dataDesc.compressedSize == dataDesc.size ) {
+			memcpy( target, src, memSize );
+		}
+		else {
+			uLongf size = dataDesc.size;
+#ifdef DEBUG
+			int result =
+#endif
+			uncompress( (Bytef*)target, &size, (const Bytef*)src, dataDesc.compressedSize );
+			GLASSERT( result == Z_OK );
+			GLASSERT( size == dataDesc.size );
+		}
+		return;
+	}
 
 	if ( dataDesc.compressedSize == dataDesc.size ) {
 		// no compression.
 		GLASSERT( dataDesc.size == (U32)memSize );
-		fread( target, memSize, 1, fp );
+		ReadAt( target, memSize, offset+dataDesc.offset );
 	}
 	else {
-		if ( bufferSize < (int)dataDesc.compressedSize ) {
-			bufferSize = (int)dataDesc.compressedSize*5/4;
-			if ( bufferSize < 1000 )
-				bufferSize = 1000;
-			if ( buffer )
-				buffer = realloc( buffer, bufferSize );
-			else 
-				buffer = malloc( bufferSize );
-		}
-		fread( buffer, dataDesc.compressedSize, 1, fp );
-
+		// The compressed data goes in a buffer of this call (on the
+		// stack if it is small) so concurrent calls don't share it.
+		U8 stackBuffer[STACK_BUFFER];
+		U8* buffer = stackBuffer;
+		if ( dataDesc.compressedSize > STACK_BUFFER )
+			buffer = (U8*)malloc( dataDesc.compressedSize );
+		ReadAt( buffer, dataDesc.compressedSize, offset+dataDesc.offset );
+
+		uLongf size = dataDesc.size;
 #ifdef DEBUG
 		int result =
 #endif
 		uncompress(	(Bytef*)target, 
-					(uLongf*)&dataDesc.size, 
+					&size, 
 					(const Bytef*)buffer,
 					dataDesc.compressedSize );
 		GLASSERT( result == Z_OK );
-		GLASSERT( dataDesc.size == (U32)memSize );
+		GLASSERT( size == (U32)memSize );
+
+		if ( buffer != stackBuffer )
+			free( buffer );
 	}
 }
 
 
+void Reader::ReadAt( void* target, int size, U32 pos ) const
+{
+	// A positional read: the shared FILE* position is never used
+	// after Init, so reads on different threads don't interfere.
+#if defined( _WIN32 )
+	HANDLE h = (HANDLE)_get_osfhandle( _fileno( fp ) );
+	OVERLAPPED overlapped;
+	memset( &overlapped, 0, sizeof( overlapped ) );
+	overlapped.Offset = pos;
+	DWORD nRead = 0;
+	BOOL okay = ReadFile( h, target, size, &nRead, &overlapped );
+	GLASSERT( okay && nRead == (DWORD)size );
+	(void)okay;
+#else
+	ssize_t nRead = pread( fileno( fp ), target, size, pos );
+	GLASSERT( nRead == size );
+	(void)nRead;
+#endif
+}
+
+
 const void* Reader::AccessData( const Item* item, const char* name, int* p_size ) const
 {
 	int size = 0;
@@ -399,6 +563,187 @@ const void* Reader::AccessData( const Item* item, const char* name, int* p_size
 }
 
 
+void* Reader::AllocData( const Item* item, const char* name, int* p_size ) const
+{
+	if ( p_size ) *p_size = 0;
+
+	if ( item->AttributeType( name ) != ATTRIBUTE_DATA ) {
+		return 0;
+	}
+	int size = item->GetDataSize( name );
+	void* data = malloc( size+1 );
+	item->GetData( name, data, size );
+	*((char*)data + size) = 0;		// null terminate for text assets.
+
+	if ( p_size )
+		*p_size = size;
+	return data;
+}
+
+
+const void* Reader::AccessBinary( const Item* item, const char* name, int* p_size ) const
+{
+	if ( p_size ) *p_size = 0;
+
+	int i = item->AttributeIndex( name );
+	if ( i < 0 || item->AttributeType( i ) != ATTRIBUTE_DATA ) {
+		return 0;
+	}
+	const Reader* context = GetContext( item );
+	const DataDescStruct& dataDesc = context->DataDesc( item->GetDataID( i ) );
+	if ( context->mapMem && dataDesc.compressedSize == dataDesc.size ) {
+		if ( p_size )
+			*p_size = dataDesc.size;
+		return (const U8*)context->mapMem + context->offset + dataDesc.offset;
+	}
+	return AccessData( item, name, p_size );
+}
+
+
+DataHandle Reader::CacheData( const Item* item, const char* name ) const
+{
+	DataHandle handle;
+	int i = item->AttributeIndex( name );
+	if ( i < 0 || item->AttributeType( i ) != ATTRIBUTE_DATA ) {
+		return handle;
+	}
+
+	// The data is cached by the Reader that holds it.
+	const Reader* context = GetContext( item );
+	int dataID = item->GetDataID( i );
+	const DataDescStruct& dataDesc = context->DataDesc( dataID );
+
+	if ( context->mapMem && dataDesc.compressedSize == dataDesc.size ) {
+		// Nothing to inflate: use the map.
+		handle.data = (const U8*)context->mapMem + context->offset + dataDesc.offset;
+		handle.size = dataDesc.size;
+		return handle;
+	}
+
+	CacheEntry* e = context->cacheHead;
+	while ( e && e->dataID != dataID ) {
+		e = e->next;
+	}
+	if ( e ) {
+		++context->cacheHits;
+		context->CacheUnlink( e );
+	}
+	else {
+		++context->cacheMisses;
+		e = (CacheEntry*) malloc( sizeof( CacheEntry ) + dataDesc.size + 1 );
+		e->reader = context;
+		e->dataID = dataID;
+		e->size = dataDesc.size;
+		e->refCount = 0;
+		context->GetData( dataID, e->Data(), e->size );
+		e->Data()[e->size] = 0;		// null terminate for text assets.
+		context->cacheBytes += e->size;
+	}
+	context->CacheLinkFront( e );
+
+	++e->refCount;
+	handle.entry = e;
+	handle.data = e->Data();
+	handle.size = e->size;
+
+	context->CacheTrim();
+	return handle;
+}
+
+
+void Reader::SetCacheSize( int bytes )
+{
+	cacheSize = bytes;
+	CacheTrim();
+}
+
+
+void Reader::CacheStats( int* hits, int* misses, int* bytes ) const
+{
+	*hits = cacheHits;
+	*misses = cacheMisses;
+	*bytes = cacheBytes;
+}
+
+
+void Reader::CacheTrim() const
+{
+	// Drop the least recently used data that isn't held by a handle.
+	CacheEntry* e = cacheTail;
+	while ( e && cacheBytes > cacheSize ) {
+		CacheEntry* prev = e->prev;
+		if ( e->refCount == 0 ) {
+			CacheUnlink( e );
+			cacheBytes -= e->size;
+			free( e );
+		}
+		e = prev;
+	}
+}
+
+
+void Reader::CacheUnlink( CacheEntry* e ) const
+{
+	if ( e->prev )
+		e->prev->next = e->next;
+	else
+		cacheHead = e->next;
+	if ( e->next )
+		e->next->prev = e->prev;
+	else
+		cacheTail = e->prev;
+	e->prev = e->next = 0;
+}
+
+
+void Reader::CacheLinkFront( CacheEntry* e ) const
+{
+	e->prev = 0;
+	e->next = cacheHead;
+	if ( cacheHead )
+		cacheHead->prev = e;
+	cacheHead = e;
+	if ( !cacheTail )
+		cacheTail = e;
+}
+
+
+DataHandle::DataHandle( const DataHandle& rhs ) : data( rhs.data ), size( rhs.size ), entry( rhs.entry )
+{
+	if ( entry )
+		++entry->refCount;
+}
+
+
+void DataHandle::operator=( const DataHandle& rhs )
+{
+	if ( this != &rhs ) {
+		Release();
+		data = rhs.data;
+		size = rhs.size;
+		entry = rhs.entry;
+		if ( entry )
+			++entry->refCount;
+	}
+}
+
+
+void DataHandle::Release()
+{
+	if ( entry ) {
+		GLASSERT( entry->refCount > 0 );
+		--entry->refCount;
+		if ( entry->refCount == 0 ) {
+			// May have been held over the cache size.
+			entry->reader->CacheTrim();
+		}
+	}
+	entry = 0;
+	data = 0;
+	size = 0;
+}
+
+
 const char* Item::Name() const
 {
 	const Reader* context = Reader::GetContext( this );
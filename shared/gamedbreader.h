@@ -32,6 +32,7 @@
 namespace gamedb
 {
 class Reader;
+struct CacheEntry;
 
 
 /** Node of the gamedb.
@@ -114,6 +115,31 @@ private:
 };
 
 
+/** A reference to inflated ATTRIBUTE_DATA, from Reader::CacheData. The data stays in
+	the Reader's cache, and Data() stays valid, while any handle to it exists. Handles
+	can be copied, and must be released before the Reader is deleted.
+*/
+class DataHandle
+{
+public:
+	DataHandle() : data( 0 ), size( 0 ), entry( 0 )	{}
+	DataHandle( const DataHandle& rhs );
+	~DataHandle()									{ Release(); }
+	void operator=( const DataHandle& rhs );
+
+	bool Valid() const			{ return data != 0; }
+	const void* Data() const	{ return data; }	///< null terminated, unless it is mapped (see AccessBinary)
+	int Size() const			{ return size; }
+	void Release();
+
+private:
+	friend class Reader;
+	const void* data;
+	int size;
+	CacheEntry* entry;		// null if the data is in the file map
+};
+
+
 /**
 	Utility class to read a gamedb. 
 
@@ -123,8 +149,11 @@ private:
 	# Navigate and query Items
 	# At the end of program execution, or when all resources are loaded, delete Reader
 
-	Threading note: currently all Readers should be on the same thread. That could
-	be fixed by adding a semaphore to GetContext()
+	Threading note: the Readers have to be created and deleted on one thread, but once
+	they are initialized GetData (and so Item::GetData), AllocData and AccessBinary
+	(for mapped data) can be called from any thread: they use no state of the Reader.
+	AccessData has one buffer for all callers and is for the main thread only. CacheData
+	is for one thread at a time: callers on more than one thread lock around it.
 */
 class Reader
 {
@@ -133,7 +162,9 @@ public:
 	Reader();
 	~Reader();
 
-	/** Initialize the object. This will hold a read-binary FILE* for the lifetime of Reader.
+	/** Initialize the object. The file is memory mapped if the platform supports it, and
+		the Items are read straight from the map. Otherwise this will hold a read-binary FILE*
+		for the lifetime of Reader.
 		@return true if filename could be opened and read.
 				false if error.
 	*/
@@ -161,6 +192,28 @@ public:
 	*/
 	const void* AccessData( const Item* item, const char* name, int* size=0 ) const;
 
+	/** Like AccessData, but the data is in memory allocated for the caller, which must
+		free() it. Not invalidated by other access, and safe to call from any thread.
+	*/
+	void* AllocData( const Item* item, const char* name, int* size=0 ) const;
+
+	/** Like AccessData, but the data is not null terminated. If the database is memory
+		mapped and the data is not compressed, this is a pointer into the map, with no copy,
+		and is valid for the lifetime of the Reader. Otherwise it is the AccessData cache.
+	*/
+	const void* AccessBinary( const Item* item, const char* name, int* size=0 ) const;
+
+	bool MemoryMapped() const					{ return mapMem != 0; }
+
+	/** Inflated data from a cache of the most recently used data, so data that is loaded
+		again (the light maps of each mission, for example) isn't inflated again. The cache
+		is bounded by SetCacheSize(), but data with a handle to it is never dropped. Not
+		locked: the caller holds its own lock from CacheData until the handle is released.
+	*/
+	DataHandle CacheData( const Item* item, const char* name ) const;
+	void SetCacheSize( int bytes );
+	void CacheStats( int* hits, int* misses, int* bytes ) const;
+
 	const void* BaseMem() const					{ return mem; }
 	int OffsetFromStart() const					{ return offset; }	///< Offset from the start of the file (passed in)
 
@@ -175,19 +228,39 @@ private:
 	Reader* next;
 	const Reader* mod;	// when chaining, 'this' is the base, 'mod' overrides
 
+	static void* MapFile( const char* filename, int* size );
+	static void UnmapFile( void* mem, int size );
+	const DataDescStruct& DataDesc( int dataID ) const;
+	void ReadAt( void* target, int size, U32 pos ) const;
+
+	enum { STACK_BUFFER = 4096, DEFAULT_CACHE_SIZE = 4*1024*1024 };
+
+	friend class DataHandle;
+	void CacheTrim() const;
+	void CacheUnlink( CacheEntry* entry ) const;
+	void CacheLinkFront( CacheEntry* entry ) const;
+
 	FILE* fp;
 	int databaseID;
 
+	void* mapMem;	// the whole file, if mapped. 'mem' points into it.
+	int mapSize;
+
 	void* mem;
 	const void* endMem;
 	int memSize;
 	int offset;	// offset to read from file start
 
-	mutable void* buffer;
-	mutable int bufferSize;
 	mutable void* access;
 	mutable int accessSize;
 
+	mutable CacheEntry* cacheHead;	// most recently used first
+	mutable CacheEntry* cacheTail;
+	mutable int cacheBytes;
+	mutable int cacheHits;
+	mutable int cacheMisses;
+	int cacheSize;
+
 	const Item* root;
 };
 
@@ -1407,25 +1407,27 @@ public:
 		with only required whitespace and newlines.
 	*/
 	XMLPrinter( FILE* file=0, bool compact = false );
-	~XMLPrinter()	{}
+	virtual ~XMLPrinter()	{}
 
 	/** If streaming, write the BOM and declaration. */
 	void PushHeader( bool writeBOM, bool writeDeclaration );
 	/** If streaming, start writing an element.
 	    The element must be closed with CloseElement()
+		The element, attribute and text methods are virtual, so
+		a subclass can write the stream in another format.
 	*/
-	void OpenElement( const char* name );
+	virtual void OpenElement( const char* name );
 	/// If streaming, add an attribute to an open element.
-	void PushAttribute( const char* name, const char* value );
-	void PushAttribute( const char* name, int value );
-	void PushAttribute( const char* name, unsigned value );
-	void PushAttribute( const char* name, bool value );
-	void PushAttribute( const char* name, double value );
+	virtual void PushAttribute( const char* name, const char* value );
+	virtual void PushAttribute( const char* name, int value );
+	virtual void PushAttribute( const char* name, unsigned value );
+	virtual void PushAttribute( const char* name, bool value );
+	virtual void PushAttribute( const char* name, double value );
 	/// If streaming, close the Element.
-	void CloseElement();
+	virtual void CloseElement();
 
 	/// Add a text node.
-	void PushText( const char* text, bool cdata=false );
+	virtual void PushText( const char* text, bool cdata=false );
 	/// Add a text node from an integer.
 	void PushText( int value );
 	/// Add a text node from an unsigned.
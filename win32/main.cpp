@@ -603,6 +603,10 @@ int main( int argc, char **argv )
 						GameHotKey( game, GAME_HK_TOGGLE_DEBUG_TEXT );
 						break;
 
+					case SDLK_f:
+						GameHotKey( game, GAME_HK_TOGGLE_FAST );
+						break;
+
 					case SDLK_DELETE:
 						if ( mapMakerMode )
 							((Game*)game)->DeleteAtSelection(); 